@@ -18,6 +18,8 @@
 
 #define UART_BASEADDR XPAR_PS7_UART_0_BASEADDR
 
+static QueueHandle_t speccy_file_io_queue;
+static volatile uint32_t speccy_file_io_f12_pending = 0;
 
 uint32_t speccy_main_thread(void)
 {
@@ -36,22 +38,85 @@ uint32_t speccy_main_thread(void)
 
     zx_vdma_start_address_set(EMULATOR_MEMORY_AREA_START + EMULATOR_VDMA_AREA_OFFSET, 1);
 
+    // The boot loader has placed the ROM images, look up their entry points once
+    zx_rom_init();
+
     reg_ZX_Spectrum_cpu_control_Struct speccy2021_cpu_control_reg;
     speccy2021_cpu_control_reg.bits.cpu_halt_req = 0;
     speccy2021_cpu_control_reg.bits.cpu_restore_pc_n = 1;
     zx_spectrum_control_reg_write(&speccy2021_cpu_control_reg);
 
     zynq_sd_card_init();
+
+    // Keyboard events are handed over to the file I/O thread so a slow SD card
+    // access never holds up processing of USB reports
+    speccy_file_io_queue = xQueueCreate(FILE_IO_QUEUE_DEPTH, sizeof(uint8_t));
+    xTaskCreate(speccy_file_io_thread, "file_io_thread", THREAD_STACKSIZE, NULL, FILE_IO_THREAD_PRIO, NULL);
+    zx_tape_init();
+    zx_rewind_init();
+    zx_betadisk_init();
+
+    // From now on this thread only handles USB host events
+    vTaskPrioritySet(NULL, USB_THREAD_PRIO);
     tusb_init();
     while (true)
     {
-        tuh_task();
-        zx_tape_routine();
+        if (tuh_task_wait(OSAL_TIMEOUT_WAIT_FOREVER))
+        {
+            zynq_task_stats_begin(ZYNQ_TASK_STATS_USB);
+            tuh_task();
+            zynq_task_stats_end(ZYNQ_TASK_STATS_USB);
+        }
     }
 
     return -1;
 }
 
+void speccy_file_io_thread(void* param)
+{
+    uint8_t keycode;
+
+    while (true)
+    {
+        // While the shell is reading a folder the keyboard is polled between chunks of files,
+        // waiting a tick for it lets the lower priority rewind task run meanwhile
+        if (xQueueReceive(speccy_file_io_queue, &keycode, zx_shell_loading_get() ? 1 : portMAX_DELAY) != pdTRUE)
+        {
+            if (zx_shell_loading_get())
+            {
+                zx_tape_lock();
+                zynq_task_stats_begin(ZYNQ_TASK_STATS_FILE_IO);
+                zx_shell_loading_step();
+                zynq_task_stats_end(ZYNQ_TASK_STATS_FILE_IO);
+                zx_tape_unlock();
+            }
+            continue;
+        }
+
+        // The shell shares the file system and the tape state with the tape task
+        zx_tape_lock();
+        zynq_task_stats_begin(ZYNQ_TASK_STATS_FILE_IO);
+        if (zx_shell_active_get() == false && zx_snapshot_slot_key(keycode) == true)
+        {
+            // Quick save slots are only available while the shell is hidden
+            zx_snapshot_hid_keycode_handle(keycode);
+        }
+        else if (zx_shell_hid_keycode_handle(keycode) == true)
+        {
+            zx_tape_hid_keycode_handle(keycode);
+        }
+        zynq_task_stats_end(ZYNQ_TASK_STATS_FILE_IO);
+        zx_tape_unlock();
+
+        if (HID_KEY_F12 == keycode)
+        {
+            taskENTER_CRITICAL();
+            speccy_file_io_f12_pending--;
+            taskEXIT_CRITICAL();
+        }
+    }
+}
+
 
 //! @brief A top level function to handle events from USB keyboard
 //! @param keycode is a HID keycode
@@ -61,9 +126,34 @@ uint32_t speccy_main_thread(void)
 bool hid_keycode_cb(uint8_t keycode)
 {
     bool res = false;
-    if (zx_shell_hid_keycode_handle(keycode) == true)
+
+    // A queued F12 is about to open the shell so the keys typed after it
+    // belong to the shell as well. Quick save slots go through the same queue
+    // as they share the CPU handshake with the shell and the tape, any other
+    // key goes to the ZX machine even while a slot is being saved or loaded
+    if (HID_KEY_F12 == keycode || zx_shell_active_get() == true || speccy_file_io_f12_pending > 0 || zx_snapshot_slot_key(keycode))
+    {
+        bool f12 = (HID_KEY_F12 == keycode);
+
+        if (f12)
+        {
+            taskENTER_CRITICAL();
+            speccy_file_io_f12_pending++;
+            taskEXIT_CRITICAL();
+        }
+
+        zynq_task_stats_signal(ZYNQ_TASK_STATS_FILE_IO);
+        if (xQueueSend(speccy_file_io_queue, &keycode, 0) != pdTRUE && f12)
+        {
+            taskENTER_CRITICAL();
+            speccy_file_io_f12_pending--;
+            taskEXIT_CRITICAL();
+        }
+        res = true;
+    }
+    else if (zx_rewind_hid_keycode_handle(keycode))
     {
-        zx_tape_hid_keycode_handle(keycode);
+        // Only a request is posted, the rewind task does the restoring
         res = true;
     }
     return res;
@@ -20,6 +20,7 @@
 
 #include <FreeRTOS.h>
 #include <task.h>
+#include <queue.h>
 #include <stdio.h>
 #include <ctype.h>
 #include <stdlib.h>
@@ -46,8 +47,14 @@
 #include "zynq_file_io/zynq_file_io.h"
 #include "zx_spectrum_file_io/zx_shell.h"
 #include "zx_spectrum_file_io/zx_tape.h"
+#include "zx_spectrum_file_io/zx_rewind.h"
+#include "zx_spectrum_file_io/zx_betadisk.h"
+#include "zynq_misc/task_stats/zynq_task_stats.h"
 
 #define DEFAULT_THREAD_PRIO 2
+#define USB_THREAD_PRIO (DEFAULT_THREAD_PRIO + 2)
+#define FILE_IO_THREAD_PRIO (DEFAULT_THREAD_PRIO)
+#define FILE_IO_QUEUE_DEPTH (16)
 #define ZYNQ_MARK_UNCACHEABLE 0x14de2U
 #define DEMO_TIMEOUT_DEFAULT_US (5000000U)
 
@@ -57,5 +64,9 @@ static const uint32_t THREAD_STACKSIZE = 4096;
 //! @return error code as uint
 uint32_t speccy_main_thread(void);
 
+//! @brief The thread which runs the shell and everything it does with files
+//! @param *param is not used
+void speccy_file_io_thread(void* param);
+
 
 #endif /* SPECCY_2021_H */
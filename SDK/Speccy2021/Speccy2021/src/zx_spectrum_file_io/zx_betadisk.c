@@ -0,0 +1,1174 @@
+/*
+ Emulator of Betadisk interface
+ ==============================
+
+ The PL pages TR-DOS ROM in and out the same way Betadisk does and stops
+ the CPU on every access to the WD1793 ports. Such an access raises an
+ interrupt, this task answers it as the controller would and lets the CPU
+ go on. Sector data do not go through the port by port handshake: the whole
+ sector is pushed into a FIFO which the CPU reads from port 7F with DRQ
+ following the FIFO level, the sectors written by the CPU are collected in
+ another FIFO the same way. There is no rotational delay so a sector is
+ transferred as fast as TR-DOS is able to move the bytes.
+
+ A mounted TRD image is read into DDR as a whole. The tracks written by
+ the emulated machine are marked dirty and go back to the SD card once the
+ drive has not been written for a while or when the image is taken out.
+
+ An SCL archive is not a disk image but its files are stored one after
+ another just like TR-DOS lays them out on a disk. So only the catalogue
+ track is made up at mount time, any other sector maps to a fixed offset
+ in the archive and is read when TR-DOS asks for it for the first time.
+ The CPU does not wait for that: the controller reports busy and the
+ sector is fetched with the CPU running. The sectors written by the
+ emulated machine stay in DDR on top of the archive and are lost once
+ the disk is taken out.
+
+ Designed in Magictale Electronics.
+
+ Copyright (c) 2021 Dmitry Pakhomenko.
+ dmitryp@magictale.com
+ http://magictale.com
+
+ This code is in the public domain.
+*/
+
+#include "zx_betadisk.h"
+
+#define ZX_BETADISK_IRQ_ID 64
+#define ZX_BETADISK_IRQ_PRIORITY 0xA0
+#define ZX_BETADISK_IRQ_LEVEL_HIGH 0x1
+#define ZX_BETADISK_TASK_STACK_SIZE 1024
+#define ZX_BETADISK_TASK_PRIO (tskIDLE_PRIORITY + 3)
+#define ZX_BETADISK_TASK_POLL_MS 100
+#define ZX_BETADISK_FLUSH_IDLE_MS 500
+
+#define ZX_BETADISK_SECTOR_SIZE 256
+#define ZX_BETADISK_SECTORS_PER_TRACK 16
+#define ZX_BETADISK_TRACK_SIZE (ZX_BETADISK_SECTOR_SIZE * ZX_BETADISK_SECTORS_PER_TRACK)
+#define ZX_BETADISK_TRACKS_MAX (EMULATOR_BETADISK_DRIVE_SIZE / ZX_BETADISK_TRACK_SIZE)
+#define ZX_BETADISK_SECTORS_MAX (EMULATOR_BETADISK_DRIVE_SIZE / ZX_BETADISK_SECTOR_SIZE)
+#define ZX_BETADISK_PRESENT_WORDS ((ZX_BETADISK_SECTORS_MAX + 31) / 32)
+#define ZX_BETADISK_CYLINDERS_MAX 80
+#define ZX_BETADISK_DIRTY_WORDS ((ZX_BETADISK_TRACKS_MAX + 31) / 32)
+// Bytes the controller takes from the CPU during one revolution of a formatted track
+#define ZX_BETADISK_RAW_TRACK_SIZE 6250
+#define ZX_BETADISK_ROTATION_MS 200
+#define ZX_BETADISK_INDEX_PULSE_MS 4
+
+#define ZX_BETADISK_PORT_COMMAND 0x1F
+#define ZX_BETADISK_PORT_TRACK 0x3F
+#define ZX_BETADISK_PORT_SECTOR 0x5F
+#define ZX_BETADISK_PORT_DATA 0x7F
+#define ZX_BETADISK_PORT_SYSTEM 0xFF
+
+#define ZX_BETADISK_SYSTEM_DRIVE_MASK 0x03
+#define ZX_BETADISK_SYSTEM_RESET_N 0x04
+#define ZX_BETADISK_SYSTEM_SIDE_N 0x10
+
+#define ZX_BETADISK_STATUS_BUSY 0x01
+#define ZX_BETADISK_STATUS_INDEX 0x02
+#define ZX_BETADISK_STATUS_DRQ 0x02
+#define ZX_BETADISK_STATUS_TRACK0 0x04
+#define ZX_BETADISK_STATUS_SEEK_ERROR 0x10
+#define ZX_BETADISK_STATUS_RNF 0x10
+#define ZX_BETADISK_STATUS_HEAD_LOADED 0x20
+#define ZX_BETADISK_STATUS_WRITE_PROTECT 0x40
+#define ZX_BETADISK_STATUS_NOT_READY 0x80
+
+#define ZX_BETADISK_CMD_TYPE_MASK 0xF0
+#define ZX_BETADISK_CMD_TYPE_II_III 0x80
+#define ZX_BETADISK_CMD_RESTORE 0x00
+#define ZX_BETADISK_CMD_SEEK 0x10
+#define ZX_BETADISK_CMD_STEP 0x20
+#define ZX_BETADISK_CMD_STEP_IN 0x40
+#define ZX_BETADISK_CMD_STEP_OUT 0x60
+#define ZX_BETADISK_CMD_READ_SECTOR 0x80
+#define ZX_BETADISK_CMD_WRITE_SECTOR 0xA0
+#define ZX_BETADISK_CMD_READ_ADDRESS 0xC0
+#define ZX_BETADISK_CMD_FORCE_INTERRUPT 0xD0
+#define ZX_BETADISK_CMD_READ_TRACK 0xE0
+#define ZX_BETADISK_CMD_WRITE_TRACK 0xF0
+#define ZX_BETADISK_CMD_STEP_MASK 0xE0
+#define ZX_BETADISK_FLAG_UPDATE 0x10
+#define ZX_BETADISK_FLAG_MULTIPLE 0x10
+#define ZX_BETADISK_FLAG_HEAD_LOAD 0x08
+#define ZX_BETADISK_FLAG_VERIFY 0x04
+#define ZX_BETADISK_FLAG_INTERRUPT_NOW 0x08
+
+#define ZX_BETADISK_MARK_ID 0xFE
+#define ZX_BETADISK_MARK_DATA 0xFB
+#define ZX_BETADISK_ID_SIZE 4
+#define ZX_BETADISK_ID_SECTOR 2
+#define ZX_BETADISK_ID_SIZE_256 1
+
+#define ZX_BETADISK_CATALOGUE_ENTRY_SIZE 16
+#define ZX_BETADISK_CATALOGUE_FILES_MAX 128
+#define ZX_BETADISK_FILE_HEADER_SIZE 14
+#define ZX_BETADISK_FILE_SECTORS 13
+#define ZX_BETADISK_INFO_OFFSET 0x800
+#define ZX_BETADISK_INFO_FIRST_FREE_SECTOR 0xE1
+#define ZX_BETADISK_INFO_FIRST_FREE_TRACK 0xE2
+#define ZX_BETADISK_INFO_DISK_TYPE 0xE3
+#define ZX_BETADISK_INFO_FILES 0xE4
+#define ZX_BETADISK_INFO_FREE_SECTORS 0xE5
+#define ZX_BETADISK_INFO_TRDOS_ID 0xE7
+#define ZX_BETADISK_INFO_PASSWORD 0xEA
+#define ZX_BETADISK_INFO_PASSWORD_SIZE 9
+#define ZX_BETADISK_INFO_DELETED_FILES 0xF4
+#define ZX_BETADISK_INFO_LABEL 0xF5
+#define ZX_BETADISK_INFO_LABEL_SIZE 8
+#define ZX_BETADISK_TRDOS_ID 0x10
+#define ZX_BETADISK_TYPE_80_DS 0x16
+#define ZX_BETADISK_TYPE_80_SS 0x18
+#define ZX_BETADISK_TYPE_40_SS 0x19
+#define ZX_BETADISK_SCL_SIGNATURE "SINCLAIR"
+#define ZX_BETADISK_SCL_SIGNATURE_SIZE 8
+
+//! @brief Command which is being transferred through the FIFOs
+typedef enum
+{
+    ZX_BETADISK_IDLE = 0,
+    ZX_BETADISK_READ_SECTOR,
+    ZX_BETADISK_READ_ADDRESS,
+    ZX_BETADISK_WRITE_SECTOR,
+    ZX_BETADISK_WRITE_TRACK
+} zx_betadisk_transfer_Enum;
+
+//! @brief Position in the byte stream of the track being formatted
+typedef enum
+{
+    ZX_BETADISK_FORMAT_GAP = 0,
+    ZX_BETADISK_FORMAT_ID,
+    ZX_BETADISK_FORMAT_ID_GAP,
+    ZX_BETADISK_FORMAT_DATA
+} zx_betadisk_format_Enum;
+
+//! @brief Disk drive with the image kept in DDR, an SCL archive has
+//!   only the sectors marked present there
+typedef struct
+{
+    FIL file;
+    bool inserted;
+    bool file_open;
+    bool write_protected;
+    bool scl;
+    uint8_t sides;
+    uint8_t cylinder;
+    uint32_t scl_data_offset;
+    uint32_t scl_sectors;
+    uint32_t present[ZX_BETADISK_PRESENT_WORDS];
+    uint32_t dirty[ZX_BETADISK_DIRTY_WORDS];
+    TickType_t last_write;
+} zx_betadisk_drive_Struct;
+
+static zx_betadisk_drive_Struct zx_betadisk_drives[EMULATOR_BETADISK_DRIVES_COUNT];
+static uint8_t zx_betadisk_status = 0;
+static uint8_t zx_betadisk_track = 0;
+static uint8_t zx_betadisk_sector = 1;
+static uint8_t zx_betadisk_data = 0;
+static uint8_t zx_betadisk_system = 0;
+static bool zx_betadisk_type_i = true;
+static bool zx_betadisk_head_loaded = false;
+static bool zx_betadisk_step_in = true;
+static bool zx_betadisk_multiple = false;
+static zx_betadisk_transfer_Enum zx_betadisk_transfer = ZX_BETADISK_IDLE;
+static zx_betadisk_format_Enum zx_betadisk_format = ZX_BETADISK_FORMAT_GAP;
+static uint8_t zx_betadisk_format_id[ZX_BETADISK_ID_SIZE];
+static uint32_t zx_betadisk_format_pos;
+static uint8_t* zx_betadisk_format_sector;
+static uint32_t zx_betadisk_raw_count;
+static uint8_t* zx_betadisk_fill = NULL;
+static volatile bool zx_betadisk_dirty = false;
+static uint8_t zx_betadisk_scl_headers[ZX_BETADISK_CATALOGUE_FILES_MAX * ZX_BETADISK_FILE_HEADER_SIZE];
+static reg_ZX_Spectrum_trdos_fifo_ctrl_Struct zx_betadisk_ctrl_reg;
+static TaskHandle_t zx_betadisk_task_handle = NULL;
+static SemaphoreHandle_t zx_betadisk_mutex = NULL;
+
+extern XScuGic xInterruptController;
+
+//! @brief Get the image of a drive in DDR
+//! @param drive is the drive number
+//! @return a pointer to the first byte of the image
+static uint8_t* zx_betadisk_image_get(uint8_t drive);
+
+//! @brief Get the drive selected by the system register
+//! @return a pointer to the drive
+static zx_betadisk_drive_Struct* zx_betadisk_drive_get(void);
+
+//! @brief Find a sector under the head of the selected drive
+//! @param sector is the sector number as it is in the sector ID
+//! @return a pointer to the sector data or NULL if there is no such sector
+static uint8_t* zx_betadisk_sector_find(uint8_t sector);
+
+//! @brief Mark the track holding a sector as changed
+//! @param *data is a pointer to the sector data
+static void zx_betadisk_sector_written(const uint8_t* data);
+
+//! @brief Check whether a sector is in DDR, that is always true for a TRD image
+//! @param *data is a pointer to the sector data
+//! @return true if the sector can be transferred false if it has to be read first
+static bool zx_betadisk_sector_present(const uint8_t* data);
+
+//! @brief Read a sector of an SCL archive into DDR, called with zx_tape_lock taken
+//! @param *data is a pointer to the sector data
+static void zx_betadisk_sector_load(uint8_t* data);
+
+//! @brief Start the transfer of a sector to the CPU, a sector which is not
+//!   in DDR yet is left for the task to be read with the CPU running
+//! @param *data is a pointer to the sector data
+static void zx_betadisk_sector_send(uint8_t* data);
+
+//! @brief Enable the interrupt again once a request has been served
+static void zx_betadisk_ctrl_arm(void);
+
+//! @brief Write to the FIFO control register, the interrupt is kept disabled
+//! @param release set to true to let the waiting CPU go on
+//! @param response is the byte the CPU reads if it waits for a port read
+//! @param fifo_rst set to true to empty both FIFOs
+static void zx_betadisk_ctrl_write(bool release, uint8_t response, bool fifo_rst);
+
+//! @brief Compose the status register as the CPU reads it
+//! @return the status register
+static uint8_t zx_betadisk_status_get(void);
+
+//! @brief Put the data of a sector into the FIFO read by the CPU
+//! @param *data is a pointer to the sector data
+//! @param size is the number of bytes
+static void zx_betadisk_fifo_push(const uint8_t* data, uint32_t size);
+
+//! @brief Take the bytes written by the CPU out of the FIFO
+//! @param *data is a pointer to the destination or NULL to drop the bytes
+//! @param size is the number of bytes
+static void zx_betadisk_fifo_pop(uint8_t* data, uint32_t size);
+
+//! @brief Finish the command being executed and raise INTRQ
+//! @param status is the error bits of the status register
+static void zx_betadisk_complete(uint8_t status);
+
+//! @brief Execute a command written into the command register
+//! @param command is the command
+static void zx_betadisk_command(uint8_t command);
+
+//! @brief Execute Restore, Seek and Step commands
+//! @param command is the command
+static void zx_betadisk_command_type_i(uint8_t command);
+
+//! @brief Parse the byte stream of the track being formatted
+//! @param *data is a pointer to the bytes written by the CPU
+//! @param size is the number of bytes
+static void zx_betadisk_format_parse(const uint8_t* data, uint32_t size);
+
+//! @brief Go on with the sector transfer once the CPU has emptied or filled a FIFO
+//! @param *p_fifo is a pointer to the FIFO status
+static void zx_betadisk_transfer_next(const reg_ZX_Spectrum_trdos_fifo_status_Struct* p_fifo);
+
+//! @brief Emulate a read from a controller port
+//! @param port is the lower byte of the port address
+//! @return the byte the CPU gets
+static uint8_t zx_betadisk_port_read(uint8_t port);
+
+//! @brief Emulate a write into a controller port
+//! @param port is the lower byte of the port address
+//! @param data is the byte written by the CPU
+static void zx_betadisk_port_write(uint8_t port, uint8_t data);
+
+//! @brief Make up the catalogue track of an SCL archive and map the rest of the disk onto it
+//! @param *p_drive is a pointer to the drive with the archive open
+//! @param *image is a pointer to the image of the drive
+//! @return true if the archive is valid false otherwise
+static bool zx_betadisk_scl_mount(zx_betadisk_drive_Struct* p_drive, uint8_t* image);
+
+//! @brief Write back the changed tracks of a drive
+//! @param *p_drive is a pointer to the drive
+//! @param drive is the drive number
+//! @param force set to true to write back even if the drive is still being written
+//! @return true if the drive has tracks which are not written back yet
+static bool zx_betadisk_drive_flush(zx_betadisk_drive_Struct* p_drive, uint8_t drive, bool force);
+
+//! @brief Interrupt handler, the request is served by the task
+//! @param *data is not used
+static void zx_betadisk_irq_handler(void* data);
+
+//! @brief Task serving the CPU accesses to the controller
+//! @param *param is not used
+static void zx_betadisk_task(void* param);
+
+
+void zx_betadisk_init()
+{
+    zx_betadisk_mutex = xSemaphoreCreateMutex();
+
+    zx_betadisk_ctrl_reg.u32 = 0;
+    zx_betadisk_ctrl_write(false, 0, true);
+
+    xTaskCreate(zx_betadisk_task, "betadisk_task", ZX_BETADISK_TASK_STACK_SIZE, NULL, ZX_BETADISK_TASK_PRIO, &zx_betadisk_task_handle);
+
+    XScuGic_SetPriorityTriggerType(&xInterruptController, ZX_BETADISK_IRQ_ID, ZX_BETADISK_IRQ_PRIORITY, ZX_BETADISK_IRQ_LEVEL_HIGH);
+    if (XScuGic_Connect(&xInterruptController, ZX_BETADISK_IRQ_ID, (Xil_ExceptionHandler)zx_betadisk_irq_handler, NULL) == XST_SUCCESS)
+    {
+        XScuGic_Enable(&xInterruptController, ZX_BETADISK_IRQ_ID);
+    }
+
+    // The CPU is only stopped once TR-DOS is paged in so the interrupt may be enabled right away
+    zx_betadisk_ctrl_arm();
+}
+
+bool zx_betadisk_mount(uint8_t drive, const char* name)
+{
+    zx_betadisk_drive_Struct* p_drive = &zx_betadisk_drives[drive];
+    uint8_t* image = zx_betadisk_image_get(drive);
+    bool result = false;
+    UINT res;
+
+    zx_betadisk_unmount(drive);
+
+    const char* ext = name + strlen(name);
+    while (ext > name && *ext != '.')
+    {
+        ext--;
+    }
+
+    xSemaphoreTake(zx_betadisk_mutex, portMAX_DELAY);
+
+    memset(image, 0, EMULATOR_BETADISK_DRIVE_SIZE);
+    memset(p_drive->dirty, 0, sizeof(p_drive->dirty));
+    memset(p_drive->present, 0, sizeof(p_drive->present));
+    p_drive->sides = 2;
+    p_drive->write_protected = false;
+    p_drive->scl = strcasecmp(ext, ".scl") == 0;
+
+    if (p_drive->scl)
+    {
+        // The archive stays open for the sectors to be read on demand
+        if (f_open(&p_drive->file, name, FA_READ) == FR_OK)
+        {
+            result = zx_betadisk_scl_mount(p_drive, image);
+            p_drive->file_open = result;
+            if (!result)
+            {
+                f_close(&p_drive->file);
+            }
+        }
+    }
+    else
+    {
+        if (f_open(&p_drive->file, name, FA_READ | FA_WRITE) != FR_OK)
+        {
+            p_drive->write_protected = true;
+            if (f_open(&p_drive->file, name, FA_READ) != FR_OK)
+            {
+                xSemaphoreGive(zx_betadisk_mutex);
+                return false;
+            }
+        }
+
+        uint32_t size = f_size(&p_drive->file);
+        if (size > EMULATOR_BETADISK_DRIVE_SIZE)
+        {
+            size = EMULATOR_BETADISK_DRIVE_SIZE;
+        }
+
+        result = (f_read(&p_drive->file, image, size, &res) == FR_OK && res == size);
+        p_drive->file_open = result;
+        if (!result)
+        {
+            f_close(&p_drive->file);
+        }
+
+        uint8_t type = image[ZX_BETADISK_INFO_OFFSET + ZX_BETADISK_INFO_DISK_TYPE];
+        if (type == ZX_BETADISK_TYPE_80_SS || type == ZX_BETADISK_TYPE_40_SS)
+        {
+            p_drive->sides = 1;
+        }
+    }
+
+    p_drive->inserted = result;
+    xSemaphoreGive(zx_betadisk_mutex);
+
+    if (result)
+    {
+        xil_printf("Disk %s inserted into drive %c%s\r\n", name, 'A' + drive, p_drive->write_protected ? ", write protected" : "");
+    }
+    return result;
+}
+
+void zx_betadisk_unmount(uint8_t drive)
+{
+    zx_betadisk_drive_Struct* p_drive = &zx_betadisk_drives[drive];
+
+    xSemaphoreTake(zx_betadisk_mutex, portMAX_DELAY);
+    // A sector which is still to be read is gone with the disk
+    if (zx_betadisk_fill != NULL)
+    {
+        zx_betadisk_complete(ZX_BETADISK_STATUS_NOT_READY);
+        zx_betadisk_ctrl_arm();
+    }
+    zx_betadisk_drive_flush(p_drive, drive, true);
+    if (p_drive->file_open)
+    {
+        f_close(&p_drive->file);
+        p_drive->file_open = false;
+    }
+    p_drive->inserted = false;
+    xSemaphoreGive(zx_betadisk_mutex);
+}
+
+void zx_betadisk_flush(bool force)
+{
+    bool dirty = false;
+
+    xSemaphoreTake(zx_betadisk_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < EMULATOR_BETADISK_DRIVES_COUNT; i++)
+    {
+        dirty |= zx_betadisk_drive_flush(&zx_betadisk_drives[i], i, force);
+    }
+    zx_betadisk_dirty = dirty;
+    xSemaphoreGive(zx_betadisk_mutex);
+}
+
+static bool zx_betadisk_drive_flush(zx_betadisk_drive_Struct* p_drive, uint8_t drive, bool force)
+{
+    const uint8_t* image = zx_betadisk_image_get(drive);
+    bool written = false;
+    UINT res;
+
+    if (!p_drive->file_open || p_drive->scl)
+    {
+        return false;
+    }
+
+    // A track is usually written sector by sector so wait until the drive calms down
+    if (!force && (xTaskGetTickCount() - p_drive->last_write) < pdMS_TO_TICKS(ZX_BETADISK_FLUSH_IDLE_MS))
+    {
+        for (uint32_t i = 0; i < ZX_BETADISK_DIRTY_WORDS; i++)
+        {
+            if (p_drive->dirty[i] != 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    for (uint32_t track = 0; track < ZX_BETADISK_TRACKS_MAX; track++)
+    {
+        if ((p_drive->dirty[track / 32] & (1U << (track % 32))) == 0)
+        {
+            continue;
+        }
+
+        if (f_lseek(&p_drive->file, track * ZX_BETADISK_TRACK_SIZE) != FR_OK ||
+            f_write(&p_drive->file, image + track * ZX_BETADISK_TRACK_SIZE, ZX_BETADISK_TRACK_SIZE, &res) != FR_OK ||
+            res != ZX_BETADISK_TRACK_SIZE)
+        {
+            xil_printf("Failed to write back track %lu of drive %c\r\n", (unsigned long)track, 'A' + drive);
+        }
+        p_drive->dirty[track / 32] &= ~(1U << (track % 32));
+        written = true;
+    }
+
+    if (written)
+    {
+        f_sync(&p_drive->file);
+    }
+    return false;
+}
+
+static uint8_t* zx_betadisk_image_get(uint8_t drive)
+{
+    return (uint8_t*)(EMULATOR_BETADISK_AREA_START + drive * EMULATOR_BETADISK_DRIVE_SIZE);
+}
+
+static zx_betadisk_drive_Struct* zx_betadisk_drive_get()
+{
+    return &zx_betadisk_drives[zx_betadisk_system & ZX_BETADISK_SYSTEM_DRIVE_MASK];
+}
+
+static uint8_t* zx_betadisk_sector_find(uint8_t sector)
+{
+    zx_betadisk_drive_Struct* p_drive = zx_betadisk_drive_get();
+    uint8_t side = (zx_betadisk_system & ZX_BETADISK_SYSTEM_SIDE_N) ? 0 : 1;
+
+    // Sector IDs of a TRD image always carry the cylinder number
+    if (!p_drive->inserted || side >= p_drive->sides || zx_betadisk_track != p_drive->cylinder ||
+        sector == 0 || sector > ZX_BETADISK_SECTORS_PER_TRACK)
+    {
+        return NULL;
+    }
+
+    uint32_t track = p_drive->cylinder * p_drive->sides + side;
+    if (track >= ZX_BETADISK_TRACKS_MAX)
+    {
+        return NULL;
+    }
+
+    return zx_betadisk_image_get(zx_betadisk_system & ZX_BETADISK_SYSTEM_DRIVE_MASK) +
+        track * ZX_BETADISK_TRACK_SIZE + (sector - 1) * ZX_BETADISK_SECTOR_SIZE;
+}
+
+static void zx_betadisk_sector_written(const uint8_t* data)
+{
+    uint8_t drive = zx_betadisk_system & ZX_BETADISK_SYSTEM_DRIVE_MASK;
+    zx_betadisk_drive_Struct* p_drive = &zx_betadisk_drives[drive];
+    uint32_t sector = (data - zx_betadisk_image_get(drive)) / ZX_BETADISK_SECTOR_SIZE;
+    uint32_t track = sector / ZX_BETADISK_SECTORS_PER_TRACK;
+
+    // A sector written over an SCL archive is never read from it again
+    p_drive->present[sector / 32] |= 1U << (sector % 32);
+    if (p_drive->scl)
+    {
+        return;
+    }
+
+    p_drive->dirty[track / 32] |= 1U << (track % 32);
+    p_drive->last_write = xTaskGetTickCount();
+    zx_betadisk_dirty = true;
+}
+
+static bool zx_betadisk_sector_present(const uint8_t* data)
+{
+    uint8_t drive = ((uint32_t)data - EMULATOR_BETADISK_AREA_START) / EMULATOR_BETADISK_DRIVE_SIZE;
+    zx_betadisk_drive_Struct* p_drive = &zx_betadisk_drives[drive];
+    uint32_t sector = (data - zx_betadisk_image_get(drive)) / ZX_BETADISK_SECTOR_SIZE;
+
+    return !p_drive->scl || (p_drive->present[sector / 32] & (1U << (sector % 32))) != 0;
+}
+
+static void zx_betadisk_sector_load(uint8_t* data)
+{
+    uint8_t drive = ((uint32_t)data - EMULATOR_BETADISK_AREA_START) / EMULATOR_BETADISK_DRIVE_SIZE;
+    zx_betadisk_drive_Struct* p_drive = &zx_betadisk_drives[drive];
+    uint32_t sector = (data - zx_betadisk_image_get(drive)) / ZX_BETADISK_SECTOR_SIZE;
+    UINT res;
+
+    // File data start right after the catalogue track, the free space past them stays zeroed
+    uint32_t idx = sector - ZX_BETADISK_SECTORS_PER_TRACK;
+    if (p_drive->file_open && idx < p_drive->scl_sectors)
+    {
+        if (f_lseek(&p_drive->file, p_drive->scl_data_offset + idx * ZX_BETADISK_SECTOR_SIZE) != FR_OK ||
+            f_read(&p_drive->file, data, ZX_BETADISK_SECTOR_SIZE, &res) != FR_OK)
+        {
+            xil_printf("Failed to read sector %lu of drive %c\r\n", (unsigned long)sector, 'A' + drive);
+        }
+    }
+    p_drive->present[sector / 32] |= 1U << (sector % 32);
+}
+
+static void zx_betadisk_sector_send(uint8_t* data)
+{
+    if (zx_betadisk_sector_present(data))
+    {
+        zx_betadisk_fifo_push(data, ZX_BETADISK_SECTOR_SIZE);
+        zx_betadisk_ctrl_reg.bits.stream_rd = 1;
+    }
+    else
+    {
+        // Busy without DRQ until the task has read the sector
+        zx_betadisk_fill = data;
+        zx_betadisk_ctrl_reg.bits.stream_rd = 0;
+    }
+}
+
+static void zx_betadisk_ctrl_write(bool release, uint8_t response, bool fifo_rst)
+{
+    reg_ZX_Spectrum_trdos_fifo_ctrl_Struct value = zx_betadisk_ctrl_reg;
+    value.bits.response = response;
+    value.bits.req_release = release ? 1 : 0;
+    value.bits.fifo_rst = fifo_rst ? 1 : 0;
+    zx_trdos_fifo_ctrl_reg_write(&value);
+}
+
+static void zx_betadisk_ctrl_arm()
+{
+    reg_ZX_Spectrum_trdos_fifo_ctrl_Struct value = zx_betadisk_ctrl_reg;
+    value.bits.irq_en = 1;
+    zx_trdos_fifo_ctrl_reg_write(&value);
+}
+
+static uint8_t zx_betadisk_status_get()
+{
+    zx_betadisk_drive_Struct* p_drive = zx_betadisk_drive_get();
+    uint8_t status = zx_betadisk_status;
+
+    if (zx_betadisk_transfer != ZX_BETADISK_IDLE)
+    {
+        reg_ZX_Spectrum_trdos_fifo_status_Struct fifo;
+        zx_trdos_fifo_status_reg_read(&fifo);
+
+        status |= ZX_BETADISK_STATUS_BUSY;
+        if (fifo.bits.drq)
+        {
+            status |= ZX_BETADISK_STATUS_DRQ;
+        }
+    }
+
+    if (!p_drive->inserted)
+    {
+        status |= ZX_BETADISK_STATUS_NOT_READY;
+    }
+
+    // Type II and III commands report write protection only when it has failed a write
+    if (zx_betadisk_type_i)
+    {
+        if (p_drive->inserted && p_drive->write_protected)
+        {
+            status |= ZX_BETADISK_STATUS_WRITE_PROTECT;
+        }
+        if (p_drive->cylinder == 0)
+        {
+            status |= ZX_BETADISK_STATUS_TRACK0;
+        }
+        if (zx_betadisk_head_loaded)
+        {
+            status |= ZX_BETADISK_STATUS_HEAD_LOADED;
+        }
+
+        // TR-DOS tells an empty drive by the absence of index pulses
+        XTime now;
+        XTime_GetTime(&now);
+        if (p_drive->inserted && (now / (COUNTS_PER_SECOND / 1000)) % ZX_BETADISK_ROTATION_MS < ZX_BETADISK_INDEX_PULSE_MS)
+        {
+            status |= ZX_BETADISK_STATUS_INDEX;
+        }
+    }
+
+    return status;
+}
+
+static void zx_betadisk_fifo_push(const uint8_t* data, uint32_t size)
+{
+    reg_ZX_Spectrum_trdos_ports_Struct value;
+
+    value.u32 = 0;
+    value.bits.fifo_push = 1;
+    for (uint32_t i = 0; i < size; i++)
+    {
+        value.bits.fifo_data = data[i];
+        zx_trdos_ports_reg_write(&value);
+    }
+}
+
+static void zx_betadisk_fifo_pop(uint8_t* data, uint32_t size)
+{
+    reg_ZX_Spectrum_trdos_ports_Struct value;
+    reg_ZX_Spectrum_trdos_request_Struct request;
+
+    value.u32 = 0;
+    value.bits.fifo_pop = 1;
+    for (uint32_t i = 0; i < size; i++)
+    {
+        // The popped byte is latched long before the read reaches the register
+        zx_trdos_ports_reg_write(&value);
+        zx_trdos_request_reg_read(&request);
+        if (data != NULL)
+        {
+            data[i] = request.bits.fifo_data;
+        }
+    }
+}
+
+static void zx_betadisk_complete(uint8_t status)
+{
+    zx_betadisk_transfer = ZX_BETADISK_IDLE;
+    zx_betadisk_fill = NULL;
+    zx_betadisk_status = status;
+    zx_betadisk_ctrl_reg.bits.stream_rd = 0;
+    zx_betadisk_ctrl_reg.bits.stream_wr = 0;
+    zx_betadisk_ctrl_reg.bits.intrq = 1;
+}
+
+static void zx_betadisk_command(uint8_t command)
+{
+    zx_betadisk_drive_Struct* p_drive = zx_betadisk_drive_get();
+    uint8_t* data;
+
+    if ((command & ZX_BETADISK_CMD_TYPE_MASK) == ZX_BETADISK_CMD_FORCE_INTERRUPT)
+    {
+        zx_betadisk_transfer = ZX_BETADISK_IDLE;
+        zx_betadisk_fill = NULL;
+        zx_betadisk_type_i = true;
+        zx_betadisk_status = 0;
+        zx_betadisk_ctrl_reg.bits.stream_rd = 0;
+        zx_betadisk_ctrl_reg.bits.stream_wr = 0;
+        zx_betadisk_ctrl_reg.bits.intrq = (command & ZX_BETADISK_FLAG_INTERRUPT_NOW) ? 1 : 0;
+        zx_betadisk_ctrl_write(false, 0, true);
+        return;
+    }
+
+    // The controller ignores everything but Force Interrupt while busy
+    if (zx_betadisk_transfer != ZX_BETADISK_IDLE)
+    {
+        return;
+    }
+
+    zx_betadisk_ctrl_reg.bits.intrq = 0;
+    zx_betadisk_status = 0;
+    zx_betadisk_type_i = (command & ZX_BETADISK_CMD_TYPE_II_III) == 0;
+
+    if (zx_betadisk_type_i)
+    {
+        zx_betadisk_command_type_i(command);
+        return;
+    }
+
+    if (!p_drive->inserted)
+    {
+        zx_betadisk_complete(ZX_BETADISK_STATUS_NOT_READY);
+        return;
+    }
+
+    zx_betadisk_head_loaded = true;
+    zx_betadisk_multiple = (command & ZX_BETADISK_FLAG_MULTIPLE) != 0;
+
+    switch (command & ZX_BETADISK_CMD_TYPE_MASK)
+    {
+        case ZX_BETADISK_CMD_READ_SECTOR:
+        case ZX_BETADISK_CMD_READ_SECTOR | ZX_BETADISK_FLAG_MULTIPLE:
+            data = zx_betadisk_sector_find(zx_betadisk_sector);
+            if (data == NULL)
+            {
+                zx_betadisk_complete(ZX_BETADISK_STATUS_RNF);
+                break;
+            }
+            zx_betadisk_transfer = ZX_BETADISK_READ_SECTOR;
+            zx_betadisk_sector_send(data);
+            break;
+
+        case ZX_BETADISK_CMD_WRITE_SECTOR:
+        case ZX_BETADISK_CMD_WRITE_SECTOR | ZX_BETADISK_FLAG_MULTIPLE:
+            if (p_drive->write_protected)
+            {
+                zx_betadisk_complete(ZX_BETADISK_STATUS_WRITE_PROTECT);
+                break;
+            }
+            if (zx_betadisk_sector_find(zx_betadisk_sector) == NULL)
+            {
+                zx_betadisk_complete(ZX_BETADISK_STATUS_RNF);
+                break;
+            }
+            zx_betadisk_transfer = ZX_BETADISK_WRITE_SECTOR;
+            zx_betadisk_ctrl_reg.bits.stream_wr = 1;
+            break;
+
+        case ZX_BETADISK_CMD_READ_ADDRESS:
+        {
+            // The ID of the first sector, the CRC is not checked by TR-DOS
+            uint8_t id[] = { p_drive->cylinder, (zx_betadisk_system & ZX_BETADISK_SYSTEM_SIDE_N) ? 0 : 1, 1, ZX_BETADISK_ID_SIZE_256, 0, 0 };
+            zx_betadisk_sector = p_drive->cylinder;
+            zx_betadisk_fifo_push(id, sizeof(id));
+            zx_betadisk_transfer = ZX_BETADISK_READ_ADDRESS;
+            zx_betadisk_ctrl_reg.bits.stream_rd = 1;
+            break;
+        }
+
+        case ZX_BETADISK_CMD_WRITE_TRACK:
+            if (p_drive->write_protected)
+            {
+                zx_betadisk_complete(ZX_BETADISK_STATUS_WRITE_PROTECT);
+                break;
+            }
+            zx_betadisk_format = ZX_BETADISK_FORMAT_GAP;
+            zx_betadisk_raw_count = 0;
+            zx_betadisk_transfer = ZX_BETADISK_WRITE_TRACK;
+            zx_betadisk_ctrl_reg.bits.stream_wr = 1;
+            break;
+
+        default:
+            // Read Track is not used by TR-DOS
+            zx_betadisk_complete(0);
+            break;
+    }
+}
+
+static void zx_betadisk_command_type_i(uint8_t command)
+{
+    zx_betadisk_drive_Struct* p_drive = zx_betadisk_drive_get();
+    int16_t cylinder = p_drive->cylinder;
+
+    switch (command & ZX_BETADISK_CMD_STEP_MASK)
+    {
+        case ZX_BETADISK_CMD_RESTORE:
+            if ((command & ZX_BETADISK_CMD_TYPE_MASK) == ZX_BETADISK_CMD_SEEK)
+            {
+                cylinder += (int16_t)zx_betadisk_data - zx_betadisk_track;
+                zx_betadisk_step_in = zx_betadisk_data > zx_betadisk_track;
+                zx_betadisk_track = zx_betadisk_data;
+            }
+            else
+            {
+                cylinder = 0;
+                zx_betadisk_track = 0;
+            }
+            break;
+
+        case ZX_BETADISK_CMD_STEP_IN:
+        case ZX_BETADISK_CMD_STEP_OUT:
+            zx_betadisk_step_in = (command & ZX_BETADISK_CMD_STEP_MASK) == ZX_BETADISK_CMD_STEP_IN;
+            // fall through
+        default:
+            cylinder += zx_betadisk_step_in ? 1 : -1;
+            if (command & ZX_BETADISK_FLAG_UPDATE)
+            {
+                zx_betadisk_track += zx_betadisk_step_in ? 1 : -1;
+            }
+            break;
+    }
+
+    if (cylinder < 0)
+    {
+        cylinder = 0;
+    }
+    else if (cylinder >= ZX_BETADISK_CYLINDERS_MAX)
+    {
+        cylinder = ZX_BETADISK_CYLINDERS_MAX - 1;
+    }
+    p_drive->cylinder = cylinder;
+
+    zx_betadisk_head_loaded = (command & ZX_BETADISK_FLAG_HEAD_LOAD) != 0;
+    if ((command & ZX_BETADISK_FLAG_VERIFY) && (!p_drive->inserted || zx_betadisk_track != p_drive->cylinder))
+    {
+        zx_betadisk_complete(ZX_BETADISK_STATUS_SEEK_ERROR);
+    }
+    else
+    {
+        zx_betadisk_complete(0);
+    }
+}
+
+static void zx_betadisk_format_parse(const uint8_t* data, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++)
+    {
+        switch (zx_betadisk_format)
+        {
+            case ZX_BETADISK_FORMAT_GAP:
+                if (data[i] == ZX_BETADISK_MARK_ID)
+                {
+                    zx_betadisk_format = ZX_BETADISK_FORMAT_ID;
+                    zx_betadisk_format_pos = 0;
+                }
+                break;
+
+            case ZX_BETADISK_FORMAT_ID:
+                zx_betadisk_format_id[zx_betadisk_format_pos++] = data[i];
+                if (zx_betadisk_format_pos == ZX_BETADISK_ID_SIZE)
+                {
+                    zx_betadisk_format = ZX_BETADISK_FORMAT_ID_GAP;
+                }
+                break;
+
+            case ZX_BETADISK_FORMAT_ID_GAP:
+                if (data[i] == ZX_BETADISK_MARK_DATA)
+                {
+                    zx_betadisk_format = ZX_BETADISK_FORMAT_DATA;
+                    zx_betadisk_format_pos = 0;
+                    zx_betadisk_format_sector = zx_betadisk_sector_find(zx_betadisk_format_id[ZX_BETADISK_ID_SECTOR]);
+                }
+                else if (data[i] == ZX_BETADISK_MARK_ID)
+                {
+                    zx_betadisk_format = ZX_BETADISK_FORMAT_ID;
+                    zx_betadisk_format_pos = 0;
+                }
+                break;
+
+            case ZX_BETADISK_FORMAT_DATA:
+                if (zx_betadisk_format_sector != NULL)
+                {
+                    zx_betadisk_format_sector[zx_betadisk_format_pos] = data[i];
+                }
+                if (++zx_betadisk_format_pos == ZX_BETADISK_SECTOR_SIZE)
+                {
+                    if (zx_betadisk_format_sector != NULL)
+                    {
+                        zx_betadisk_sector_written(zx_betadisk_format_sector);
+                    }
+                    zx_betadisk_format = ZX_BETADISK_FORMAT_GAP;
+                }
+                break;
+        }
+    }
+}
+
+static void zx_betadisk_transfer_next(const reg_ZX_Spectrum_trdos_fifo_status_Struct* p_fifo)
+{
+    uint8_t buf[ZX_BETADISK_SECTOR_SIZE];
+    uint8_t* data;
+
+    switch (zx_betadisk_transfer)
+    {
+        case ZX_BETADISK_READ_SECTOR:
+            if (!p_fifo->bits.rfifo_empty || zx_betadisk_fill != NULL)
+            {
+                break;
+            }
+            if (!zx_betadisk_multiple)
+            {
+                zx_betadisk_complete(0);
+                break;
+            }
+            // Multiple sectors go on until there is no next one on the track
+            data = zx_betadisk_sector_find(++zx_betadisk_sector);
+            if (data == NULL)
+            {
+                zx_betadisk_complete(ZX_BETADISK_STATUS_RNF);
+                break;
+            }
+            zx_betadisk_sector_send(data);
+            break;
+
+        case ZX_BETADISK_READ_ADDRESS:
+            if (p_fifo->bits.rfifo_empty)
+            {
+                zx_betadisk_complete(0);
+            }
+            break;
+
+        case ZX_BETADISK_WRITE_SECTOR:
+            if (p_fifo->bits.wfifo_level < ZX_BETADISK_SECTOR_SIZE)
+            {
+                break;
+            }
+            // DRQ stays low while the sector is taken out of the FIFO
+            zx_betadisk_ctrl_reg.bits.stream_wr = 0;
+            zx_betadisk_ctrl_write(false, 0, false);
+
+            // The track or the drive may have been changed by the CPU while the
+            // sector was being written, the data is dropped then
+            data = zx_betadisk_sector_find(zx_betadisk_sector);
+            zx_betadisk_fifo_pop(data, ZX_BETADISK_SECTOR_SIZE);
+            if (data == NULL)
+            {
+                zx_betadisk_complete(ZX_BETADISK_STATUS_RNF);
+                break;
+            }
+            zx_betadisk_sector_written(data);
+
+            if (!zx_betadisk_multiple)
+            {
+                zx_betadisk_complete(0);
+            }
+            else if (zx_betadisk_sector_find(++zx_betadisk_sector) == NULL)
+            {
+                zx_betadisk_complete(ZX_BETADISK_STATUS_RNF);
+            }
+            else
+            {
+                zx_betadisk_ctrl_reg.bits.stream_wr = 1;
+            }
+            break;
+
+        case ZX_BETADISK_WRITE_TRACK:
+            if (p_fifo->bits.wfifo_level < ZX_BETADISK_SECTOR_SIZE)
+            {
+                break;
+            }
+            zx_betadisk_ctrl_reg.bits.stream_wr = 0;
+            zx_betadisk_ctrl_write(false, 0, false);
+
+            zx_betadisk_fifo_pop(buf, ZX_BETADISK_SECTOR_SIZE);
+            zx_betadisk_format_parse(buf, ZX_BETADISK_SECTOR_SIZE);
+
+            // The track is over once the index hole comes round again
+            zx_betadisk_raw_count += ZX_BETADISK_SECTOR_SIZE;
+            if (zx_betadisk_raw_count >= ZX_BETADISK_RAW_TRACK_SIZE)
+            {
+                zx_betadisk_complete(0);
+            }
+            else
+            {
+                zx_betadisk_ctrl_reg.bits.stream_wr = 1;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+static uint8_t zx_betadisk_port_read(uint8_t port)
+{
+    switch (port)
+    {
+        case ZX_BETADISK_PORT_COMMAND:
+            // Reading the status acknowledges the interrupt
+            zx_betadisk_ctrl_reg.bits.intrq = 0;
+            return zx_betadisk_status_get();
+        case ZX_BETADISK_PORT_TRACK:
+            return zx_betadisk_track;
+        case ZX_BETADISK_PORT_SECTOR:
+            return zx_betadisk_sector;
+        case ZX_BETADISK_PORT_DATA:
+            return zx_betadisk_data;
+        default:
+            return 0xFF;
+    }
+}
+
+static void zx_betadisk_port_write(uint8_t port, uint8_t data)
+{
+    switch (port)
+    {
+        case ZX_BETADISK_PORT_COMMAND:
+            zx_betadisk_command(data);
+            break;
+        case ZX_BETADISK_PORT_TRACK:
+            zx_betadisk_track = data;
+            break;
+        case ZX_BETADISK_PORT_SECTOR:
+            zx_betadisk_sector = data;
+            break;
+        case ZX_BETADISK_PORT_DATA:
+            zx_betadisk_data = data;
+            break;
+        case ZX_BETADISK_PORT_SYSTEM:
+            zx_betadisk_system = data;
+            if ((data & ZX_BETADISK_SYSTEM_RESET_N) == 0)
+            {
+                zx_betadisk_transfer = ZX_BETADISK_IDLE;
+                zx_betadisk_fill = NULL;
+                zx_betadisk_type_i = true;
+                zx_betadisk_status = 0;
+                zx_betadisk_ctrl_reg.bits.stream_rd = 0;
+                zx_betadisk_ctrl_reg.bits.stream_wr = 0;
+                zx_betadisk_ctrl_reg.bits.intrq = 0;
+                zx_betadisk_ctrl_write(false, 0, true);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static bool zx_betadisk_scl_mount(zx_betadisk_drive_Struct* p_drive, uint8_t* image)
+{
+    uint8_t header[ZX_BETADISK_SCL_SIGNATURE_SIZE + 1];
+    uint8_t* info = image + ZX_BETADISK_INFO_OFFSET;
+    uint32_t sector = ZX_BETADISK_SECTORS_PER_TRACK;
+    UINT res;
+
+    if (f_read(&p_drive->file, header, sizeof(header), &res) != FR_OK || res != sizeof(header) ||
+        memcmp(header, ZX_BETADISK_SCL_SIGNATURE, ZX_BETADISK_SCL_SIGNATURE_SIZE) != 0 ||
+        header[ZX_BETADISK_SCL_SIGNATURE_SIZE] > ZX_BETADISK_CATALOGUE_FILES_MAX)
+    {
+        return false;
+    }
+
+    uint8_t files = header[ZX_BETADISK_SCL_SIGNATURE_SIZE];
+    if (f_read(&p_drive->file, zx_betadisk_scl_headers, files * ZX_BETADISK_FILE_HEADER_SIZE, &res) != FR_OK ||
+        res != files * ZX_BETADISK_FILE_HEADER_SIZE)
+    {
+        return false;
+    }
+
+    // The files go on the disk in the same order as their data follow the headers
+    for (uint8_t i = 0; i < files; i++)
+    {
+        const uint8_t* file_header = zx_betadisk_scl_headers + i * ZX_BETADISK_FILE_HEADER_SIZE;
+        uint8_t* entry = image + i * ZX_BETADISK_CATALOGUE_ENTRY_SIZE;
+
+        memcpy(entry, file_header, ZX_BETADISK_FILE_HEADER_SIZE);
+        entry[ZX_BETADISK_FILE_HEADER_SIZE] = sector % ZX_BETADISK_SECTORS_PER_TRACK;
+        entry[ZX_BETADISK_FILE_HEADER_SIZE + 1] = sector / ZX_BETADISK_SECTORS_PER_TRACK;
+        sector += file_header[ZX_BETADISK_FILE_SECTORS];
+    }
+
+    if (sector > ZX_BETADISK_SECTORS_MAX ||
+        f_size(&p_drive->file) < f_tell(&p_drive->file) + (sector - ZX_BETADISK_SECTORS_PER_TRACK) * ZX_BETADISK_SECTOR_SIZE)
+    {
+        return false;
+    }
+    p_drive->scl_data_offset = f_tell(&p_drive->file);
+    p_drive->scl_sectors = sector - ZX_BETADISK_SECTORS_PER_TRACK;
+
+    uint16_t free_sectors = ZX_BETADISK_SECTORS_MAX - sector;
+    info[ZX_BETADISK_INFO_FIRST_FREE_SECTOR] = sector % ZX_BETADISK_SECTORS_PER_TRACK;
+    info[ZX_BETADISK_INFO_FIRST_FREE_TRACK] = sector / ZX_BETADISK_SECTORS_PER_TRACK;
+    info[ZX_BETADISK_INFO_DISK_TYPE] = ZX_BETADISK_TYPE_80_DS;
+    info[ZX_BETADISK_INFO_FILES] = files;
+    info[ZX_BETADISK_INFO_FREE_SECTORS] = free_sectors & 0xFF;
+    info[ZX_BETADISK_INFO_FREE_SECTORS + 1] = free_sectors >> 8;
+    info[ZX_BETADISK_INFO_TRDOS_ID] = ZX_BETADISK_TRDOS_ID;
+    memset(info + ZX_BETADISK_INFO_PASSWORD, ' ', ZX_BETADISK_INFO_PASSWORD_SIZE);
+    info[ZX_BETADISK_INFO_DELETED_FILES] = 0;
+    memset(info + ZX_BETADISK_INFO_LABEL, ' ', ZX_BETADISK_INFO_LABEL_SIZE);
+
+    // The catalogue track is complete, nothing of it comes from the archive
+    p_drive->present[0] |= (1U << ZX_BETADISK_SECTORS_PER_TRACK) - 1;
+
+    return true;
+}
+
+static void zx_betadisk_irq_handler(void* data)
+{
+    BaseType_t woken = pdFALSE;
+
+    // The request stays asserted until served as the interrupt is level sensitive
+    zx_trdos_fifo_ctrl_reg_write(&zx_betadisk_ctrl_reg);
+    zynq_task_stats_signal(ZYNQ_TASK_STATS_BETADISK);
+    vTaskNotifyGiveFromISR(zx_betadisk_task_handle, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static void zx_betadisk_task(void* param)
+{
+    reg_ZX_Spectrum_trdos_request_Struct request;
+    reg_ZX_Spectrum_trdos_fifo_status_Struct fifo;
+
+    while (true)
+    {
+        // Wakes up on a port access or once the CPU is done with a FIFO,
+        // the timeout keeps the write back going while the disk is idle
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ZX_BETADISK_TASK_POLL_MS));
+
+        xSemaphoreTake(zx_betadisk_mutex, portMAX_DELAY);
+        zynq_task_stats_begin(ZYNQ_TASK_STATS_BETADISK);
+
+        zx_trdos_request_reg_read(&request);
+        if (request.bits.req_pending)
+        {
+            uint8_t response = 0xFF;
+            if (request.bits.req_wr)
+            {
+                zx_betadisk_port_write(request.bits.req_port, request.bits.req_data);
+            }
+            else
+            {
+                response = zx_betadisk_port_read(request.bits.req_port);
+            }
+            zx_betadisk_ctrl_write(true, response, false);
+        }
+
+        zx_trdos_fifo_status_reg_read(&fifo);
+        zx_betadisk_transfer_next(&fifo);
+        zx_betadisk_ctrl_arm();
+
+        zynq_task_stats_end(ZYNQ_TASK_STATS_BETADISK);
+        xSemaphoreGive(zx_betadisk_mutex);
+
+        // A sector of an SCL archive is read with the CPU polling the busy
+        // controller so the CPU is never stopped while the file system is taken
+        if (zx_betadisk_fill != NULL)
+        {
+            zx_tape_lock();
+            xSemaphoreTake(zx_betadisk_mutex, portMAX_DELAY);
+            if (zx_betadisk_fill != NULL)
+            {
+                zx_betadisk_sector_load(zx_betadisk_fill);
+                zx_betadisk_sector_send(zx_betadisk_fill);
+                zx_betadisk_fill = NULL;
+                zx_betadisk_ctrl_arm();
+            }
+            xSemaphoreGive(zx_betadisk_mutex);
+            zx_tape_unlock();
+        }
+
+        // The CPU never waits for the SD card, only the write back takes the file system
+        if (zx_betadisk_dirty)
+        {
+            zx_tape_lock();
+            zx_betadisk_flush(false);
+            zx_tape_unlock();
+        }
+    }
+}
@@ -0,0 +1,46 @@
+//! @file zx_betadisk.h
+//! @brief Emulator of Betadisk interface with WD1793 floppy disk controller
+
+#ifndef ZX_BETADISK_H
+#define ZX_BETADISK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+#include "xscugic.h"
+#include "xtime_l.h"
+#include "xil_printf.h"
+#include "../zx_spectrum_io/zx_config.h"
+#include "../zx_spectrum_video/zx_spectrum_display_ctrl.h"
+#include "../zynq_misc/task_stats/zynq_task_stats.h"
+#include "../zynq_file_io/xilffs_v4_4/ff.h"
+#include "zx_tape.h"
+
+#define ZX_BETADISK_DRIVE_A (0)
+
+//! @brief Create the task which emulates the disk controller
+void zx_betadisk_init(void);
+
+//! @brief Insert a *.trd or *.scl disk image into a drive, called with zx_tape_lock taken.
+//!   A TRD image is read into DDR and the tracks written by the emulated machine go back
+//!   to the SD card once the drive has been idle for a while. An SCL archive is read
+//!   sector by sector on demand and the sectors written over it are kept in DDR only
+//! @param drive is the drive number
+//! @param *name is a pointer to the file name
+//! @return true if the image has been inserted false otherwise
+bool zx_betadisk_mount(uint8_t drive, const char* name);
+
+//! @brief Write back the changed tracks and take the disk image out of a drive,
+//!   called with zx_tape_lock taken
+//! @param drive is the drive number
+void zx_betadisk_unmount(uint8_t drive);
+
+//! @brief Write back the changed tracks which have not been touched for a while,
+//!   called with zx_tape_lock taken
+//! @param force set to true to write back all changed tracks at once
+void zx_betadisk_flush(bool force);
+
+#endif
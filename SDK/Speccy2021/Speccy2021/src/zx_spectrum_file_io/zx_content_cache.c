@@ -0,0 +1,232 @@
+/*
+ Content cache
+ =============
+
+ The board has far more DDR than the emulator needs, so files which have
+ been loaded once are kept there: decoded RAM images for snapshots and raw
+ files for tapes. Loading the same file again skips SD card altogether.
+
+ An entry is found by the path together with the size and the FAT time
+ stamp, so a file rewritten on a PC is read again. Room is taken first-fit
+ from the arena and the least recently used entries are evicted until the
+ content fits. Entries never move so a pointer handed out stays valid until
+ the entry is evicted, which is not done to pinned ones.
+
+ Designed in Magictale Electronics.
+
+ Copyright (c) 2021 Dmitry Pakhomenko.
+ dmitryp@magictale.com
+ http://magictale.com
+
+ This code is in the public domain.
+*/
+
+#include "zx_content_cache.h"
+
+#define ZX_CONTENT_CACHE_ALIGN 32
+// A single file may not push out more than a quarter of the arena
+#define ZX_CONTENT_CACHE_MAX_LENGTH (EMULATOR_CACHE_AREA_SIZE / 4)
+
+typedef struct
+{
+    zx_content_cache_key_Struct key;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t used;
+    bool valid;
+    bool pinned;
+} zx_content_cache_entry_Struct;
+
+static zx_content_cache_entry_Struct zx_content_cache_entries[ZX_CONTENT_CACHE_ENTRIES];
+static uint32_t zx_content_cache_clock = 0;
+static uint32_t zx_content_cache_hits = 0;
+static uint32_t zx_content_cache_misses = 0;
+
+//! @brief Find the entry holding the content at the given address
+//! @param *data is a pointer to the content
+//! @return a pointer to the entry or NULL if there is none
+static zx_content_cache_entry_Struct* zx_content_cache_entry_get(const uint8_t* data);
+
+//! @brief Find a free range in the arena
+//! @param length is the aligned length of the range
+//! @param *offset is a pointer to the offset of the range
+//! @return true if the range has been found or false otherwise
+static bool zx_content_cache_range_find(uint32_t length, uint32_t* offset);
+
+//! @brief Evict the least recently used entry which is not pinned
+//! @return true if an entry has been evicted or false if there is nothing to evict
+static bool zx_content_cache_evict(void);
+
+
+bool zx_content_cache_key_make(zx_content_cache_key_Struct* p_key, const char* path, uint8_t kind)
+{
+    FILINFO fi;
+
+    if (strlen(path) >= ZX_CONTENT_CACHE_PATH_SIZE || f_stat(path, &fi) != FR_OK)
+    {
+        return false;
+    }
+
+    memset(p_key, 0, sizeof(zx_content_cache_key_Struct));
+    strcpy(p_key->path, path);
+    p_key->size = fi.fsize;
+    p_key->date = fi.fdate;
+    p_key->time = fi.ftime;
+    p_key->kind = kind;
+    return true;
+}
+
+const uint8_t* zx_content_cache_find(const zx_content_cache_key_Struct* p_key, uint32_t* length)
+{
+    for (uint8_t i = 0; i < ZX_CONTENT_CACHE_ENTRIES; i++)
+    {
+        zx_content_cache_entry_Struct* p_entry = &zx_content_cache_entries[i];
+
+        if (p_entry->valid && p_entry->key.size == p_key->size && p_entry->key.date == p_key->date &&
+            p_entry->key.time == p_key->time && p_entry->key.kind == p_key->kind && strcmp(p_entry->key.path, p_key->path) == 0)
+        {
+            p_entry->used = ++zx_content_cache_clock;
+            zx_content_cache_hits++;
+            if (length != NULL) *length = p_entry->length;
+            return (const uint8_t*)(EMULATOR_CACHE_AREA_START + p_entry->offset);
+        }
+    }
+
+    zx_content_cache_misses++;
+    return NULL;
+}
+
+uint8_t* zx_content_cache_store(const zx_content_cache_key_Struct* p_key, uint32_t length)
+{
+    uint32_t aligned = (length + ZX_CONTENT_CACHE_ALIGN - 1) & ~(ZX_CONTENT_CACHE_ALIGN - 1);
+    zx_content_cache_entry_Struct* p_entry = NULL;
+    uint32_t offset;
+
+    if (length == 0 || length > ZX_CONTENT_CACHE_MAX_LENGTH)
+    {
+        return NULL;
+    }
+
+    while (true)
+    {
+        if (p_entry == NULL)
+        {
+            for (uint8_t i = 0; i < ZX_CONTENT_CACHE_ENTRIES && p_entry == NULL; i++)
+            {
+                if (!zx_content_cache_entries[i].valid) p_entry = &zx_content_cache_entries[i];
+            }
+        }
+
+        if (p_entry != NULL && zx_content_cache_range_find(aligned, &offset))
+        {
+            break;
+        }
+
+        if (!zx_content_cache_evict())
+        {
+            return NULL;
+        }
+    }
+
+    p_entry->key = *p_key;
+    p_entry->offset = offset;
+    p_entry->length = length;
+    p_entry->used = ++zx_content_cache_clock;
+    p_entry->valid = true;
+    p_entry->pinned = false;
+    return (uint8_t*)(EMULATOR_CACHE_AREA_START + offset);
+}
+
+void zx_content_cache_drop(const uint8_t* data)
+{
+    zx_content_cache_entry_Struct* p_entry = zx_content_cache_entry_get(data);
+    if (p_entry != NULL)
+    {
+        p_entry->valid = false;
+    }
+}
+
+void zx_content_cache_pin(const uint8_t* data, bool pinned)
+{
+    zx_content_cache_entry_Struct* p_entry = zx_content_cache_entry_get(data);
+    if (p_entry != NULL)
+    {
+        p_entry->pinned = pinned;
+    }
+}
+
+void zx_content_cache_stats_get(uint32_t* hits, uint32_t* misses)
+{
+    *hits = zx_content_cache_hits;
+    *misses = zx_content_cache_misses;
+}
+
+static zx_content_cache_entry_Struct* zx_content_cache_entry_get(const uint8_t* data)
+{
+    for (uint8_t i = 0; i < ZX_CONTENT_CACHE_ENTRIES; i++)
+    {
+        zx_content_cache_entry_Struct* p_entry = &zx_content_cache_entries[i];
+        if (p_entry->valid && data == (const uint8_t*)(EMULATOR_CACHE_AREA_START + p_entry->offset))
+        {
+            return p_entry;
+        }
+    }
+    return NULL;
+}
+
+static bool zx_content_cache_range_find(uint32_t length, uint32_t* offset)
+{
+    bool found = false;
+
+    // A free range starts either at the beginning of the arena or right after an entry
+    for (int8_t i = -1; i < ZX_CONTENT_CACHE_ENTRIES; i++)
+    {
+        uint32_t start = 0;
+        if (i >= 0)
+        {
+            if (!zx_content_cache_entries[i].valid) continue;
+            start = zx_content_cache_entries[i].offset +
+                ((zx_content_cache_entries[i].length + ZX_CONTENT_CACHE_ALIGN - 1) & ~(ZX_CONTENT_CACHE_ALIGN - 1));
+        }
+
+        if (start + length > EMULATOR_CACHE_AREA_SIZE || (found && start >= *offset))
+        {
+            continue;
+        }
+
+        bool overlaps = false;
+        for (uint8_t j = 0; j < ZX_CONTENT_CACHE_ENTRIES && !overlaps; j++)
+        {
+            zx_content_cache_entry_Struct* p_entry = &zx_content_cache_entries[j];
+            overlaps = p_entry->valid && p_entry->offset < start + length && start < p_entry->offset + p_entry->length;
+        }
+
+        if (!overlaps)
+        {
+            *offset = start;
+            found = true;
+        }
+    }
+    return found;
+}
+
+static bool zx_content_cache_evict()
+{
+    zx_content_cache_entry_Struct* p_oldest = NULL;
+
+    for (uint8_t i = 0; i < ZX_CONTENT_CACHE_ENTRIES; i++)
+    {
+        zx_content_cache_entry_Struct* p_entry = &zx_content_cache_entries[i];
+        if (p_entry->valid && !p_entry->pinned && (p_oldest == NULL || p_entry->used < p_oldest->used))
+        {
+            p_oldest = p_entry;
+        }
+    }
+
+    if (p_oldest == NULL)
+    {
+        return false;
+    }
+    p_oldest->valid = false;
+    return true;
+}
@@ -0,0 +1,65 @@
+//! @file zx_content_cache.h
+//! @brief Cache of recently loaded snapshots and tapes kept in spare DDR
+
+#ifndef ZX_CONTENT_CACHE_H
+#define ZX_CONTENT_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "../zynq_file_io/xilffs_v4_4/ff.h"
+#include "../zx_spectrum_io/zx_config.h"
+
+#define ZX_CONTENT_CACHE_PATH_SIZE (0x80)
+#define ZX_CONTENT_CACHE_ENTRIES (32)
+
+typedef enum
+{
+    ZX_CONTENT_CACHE_SNAPSHOT = 0,
+    ZX_CONTENT_CACHE_TAPE = 1,
+} zx_content_cache_kind_Enum;
+
+//! @brief A file is only found again while it has the same size and modification time
+typedef struct
+{
+    char path[ZX_CONTENT_CACHE_PATH_SIZE];
+    uint32_t size;
+    uint16_t date;
+    uint16_t time;
+    uint8_t kind;
+} zx_content_cache_key_Struct;
+
+//! @brief Build the key of a file, all functions of this module are called with zx_tape_lock taken
+//! @param *p_key is a pointer to the key to be filled in
+//! @param *path is a pointer to the file name
+//! @param kind is zx_content_cache_kind_Enum as a snapshot and a tape keep different content
+//! @return true if the file exists or false otherwise
+bool zx_content_cache_key_make(zx_content_cache_key_Struct* p_key, const char* path, uint8_t kind);
+
+//! @brief Look up the content of a file and count a hit or a miss
+//! @param *p_key is a pointer to the key of the file
+//! @param *length is a pointer to the length of the content, may be NULL
+//! @return a pointer to the content or NULL if it is not in the cache
+const uint8_t* zx_content_cache_find(const zx_content_cache_key_Struct* p_key, uint32_t* length);
+
+//! @brief Allocate room for the content of a file evicting the least recently used entries
+//! @param *p_key is a pointer to the key of the file
+//! @param length is the length of the content
+//! @return a pointer to the room to be filled in by the caller or NULL if the content does not fit
+uint8_t* zx_content_cache_store(const zx_content_cache_key_Struct* p_key, uint32_t length);
+
+//! @brief Forget an entry, e.g. when it could not be filled in
+//! @param *data is a pointer returned by zx_content_cache_find or zx_content_cache_store
+void zx_content_cache_drop(const uint8_t* data);
+
+//! @brief Protect an entry from eviction while its content is being read
+//! @param *data is a pointer returned by zx_content_cache_find or zx_content_cache_store
+//! @param pinned set to true to protect the entry or false to release it
+void zx_content_cache_pin(const uint8_t* data, bool pinned);
+
+//! @brief Get the number of lookups served by the cache and the ones that went to SD card
+//! @param *hits is a pointer to the number of hits
+//! @param *misses is a pointer to the number of misses
+void zx_content_cache_stats_get(uint32_t* hits, uint32_t* misses);
+
+#endif
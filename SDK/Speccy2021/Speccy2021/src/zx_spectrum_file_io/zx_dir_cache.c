@@ -0,0 +1,391 @@
+/*
+ Directory cache
+ ===============
+
+ Walking a large folder with f_readdir means thousands of single sector
+ reads, and the listing has to be sorted again on top of that. The cache
+ keeps the sorted listings of recently visited folders in spare DDR, and
+ the large ones also in the cache folder on SD card so they survive a
+ power cycle.
+
+ FAT does not update the time stamp of a folder when its content changes,
+ so a cached listing is validated by the folder content itself: the raw
+ sectors of the folder are read cluster by cluster along its FAT chain,
+ several sectors at once, and hashed together with the start cluster and
+ the number of sectors. Any file added, removed, renamed, resized or
+ touched changes a directory entry and therefore the hash. This is far
+ cheaper than f_readdir, which reads one sector at a time and assembles
+ every long file name.
+
+ Only FAT16 and FAT32 chains are followed. On FAT12 and exFAT, or while
+ FatFs holds a changed sector which is not on the card yet, the stamp is
+ not taken and the folder is always read.
+
+ Designed in Magictale Electronics.
+
+ Copyright (c) 2021 Dmitry Pakhomenko.
+ dmitryp@magictale.com
+ http://magictale.com
+
+ This code is in the public domain.
+*/
+
+#include "zx_dir_cache.h"
+
+// Shared with the cache of compiled tapes
+#define ZX_DIR_CACHE_DIR "zxcache"
+#define ZX_DIR_CACHE_MAGIC 0x4C44585A
+#define ZX_DIR_CACHE_HASH_BASIS 0x811C9DC5
+#define ZX_DIR_CACHE_HASH_PRIME 0x01000193
+#define ZX_DIR_CACHE_SLOT_SIZE (EMULATOR_DIR_CACHE_AREA_SIZE / ZX_DIR_CACHE_SLOTS)
+// Small folders are read quickly anyway and are not worth a file on SD card
+#define ZX_DIR_CACHE_PERSIST_ENTRIES (256)
+#define ZX_DIR_CACHE_BURST_SECTORS (16)
+// A chain longer than the largest folder FAT allows means a broken FAT
+#define ZX_DIR_CACHE_CLUSTERS_MAX (0x10000U)
+#define ZX_DIR_CACHE_NO_SECTOR (0xFFFFFFFFU)
+#define ZX_DIR_CACHE_DIR_ENTRY_SIZE (32)
+
+typedef struct
+{
+    char path[ZX_DIR_CACHE_PATH_SIZE];
+    zx_dir_cache_stamp_Struct stamp;
+    uint32_t length;
+    uint32_t used;
+    uint8_t order;
+    bool valid;
+} zx_dir_cache_slot_Struct;
+
+typedef struct
+{
+    uint32_t magic;
+    char path[ZX_DIR_CACHE_PATH_SIZE];
+    zx_dir_cache_stamp_Struct stamp;
+    uint32_t length;
+    uint32_t order;
+} zx_dir_cache_header_Struct;
+
+static zx_dir_cache_slot_Struct zx_dir_cache_slots[ZX_DIR_CACHE_SLOTS];
+static uint32_t zx_dir_cache_clock = 0;
+static uint8_t zx_dir_cache_buffer[ZX_DIR_CACHE_BURST_SECTORS * FF_MAX_SS] __attribute__ ((aligned(32)));
+static uint8_t zx_dir_cache_fat_buffer[FF_MAX_SS] __attribute__ ((aligned(32)));
+static uint32_t zx_dir_cache_fat_sector = ZX_DIR_CACHE_NO_SECTOR;
+
+//! @brief Hash a run of sectors into the stamp
+//! @param *fs is a pointer to the file system
+//! @param sector is the first sector of the run
+//! @param count is the number of sectors in the run
+//! @param *p_stamp is a pointer to the stamp
+//! @return true if the sectors have been read or false otherwise
+static bool zx_dir_cache_hash_sectors(FATFS* fs, uint32_t sector, uint32_t count, zx_dir_cache_stamp_Struct* p_stamp);
+
+//! @brief Follow the FAT chain by one cluster
+//! @param *fs is a pointer to the file system
+//! @param *p_clst is a pointer to the cluster number to be replaced with the next one
+//! @return true if the FAT has been read or false otherwise
+static bool zx_dir_cache_fat_next(FATFS* fs, uint32_t* p_clst);
+
+//! @brief Take the stamp of an opened folder
+//! @param *p_dir is a pointer to the opened folder
+//! @param *p_stamp is a pointer to the stamp to be filled in
+//! @return true if the stamp has been taken or false if the folder can not be validated
+static bool zx_dir_cache_stamp_take(DIR* p_dir, zx_dir_cache_stamp_Struct* p_stamp);
+
+//! @brief Pick the slot for a listing: the one of the same folder, a free one or the least recently used
+//! @param *path is a pointer to the folder name
+//! @return a pointer to the slot
+static zx_dir_cache_slot_Struct* zx_dir_cache_slot_pick(const char* path);
+
+//! @brief Get the DDR room of a slot
+//! @param *p_slot is a pointer to the slot
+//! @return a pointer to the room
+static uint8_t* zx_dir_cache_slot_data(const zx_dir_cache_slot_Struct* p_slot);
+
+//! @brief Build the name of the cache file of a folder
+//! @param *name is a pointer to the buffer for the name
+//! @param size is the size of the buffer
+//! @param *path is a pointer to the folder name
+static void zx_dir_cache_file_name(char* name, size_t size, const char* path);
+
+//! @brief Read the listing of a folder from its cache file into a slot and zx_dir_list
+//! @param *path is a pointer to the folder name
+//! @param *p_stamp is a pointer to the stamp of the folder
+//! @param *p_order is a pointer to the order the listing is sorted in
+//! @return true if zx_dir_list has been filled in or false otherwise
+static bool zx_dir_cache_file_load(const char* path, const zx_dir_cache_stamp_Struct* p_stamp, uint8_t* p_order);
+
+//! @brief Write the listing kept in a slot into the cache file of the folder
+//! @param *p_slot is a pointer to the slot
+static void zx_dir_cache_file_save(const zx_dir_cache_slot_Struct* p_slot);
+
+
+static bool zx_dir_cache_hash_sectors(FATFS* fs, uint32_t sector, uint32_t count, zx_dir_cache_stamp_Struct* p_stamp)
+{
+    while (count > 0)
+    {
+        uint32_t burst = count < ZX_DIR_CACHE_BURST_SECTORS ? count : ZX_DIR_CACHE_BURST_SECTORS;
+
+        if (disk_read(fs->pdrv, zx_dir_cache_buffer, sector, burst) != RES_OK)
+        {
+            return false;
+        }
+
+        const uint32_t* p_word = (const uint32_t*)zx_dir_cache_buffer;
+        for (uint32_t i = 0; i < burst * FF_MAX_SS / sizeof(uint32_t); i++)
+        {
+            p_stamp->hash ^= p_word[i];
+            p_stamp->hash *= ZX_DIR_CACHE_HASH_PRIME;
+        }
+
+        p_stamp->sectors += burst;
+        sector += burst;
+        count -= burst;
+    }
+    return true;
+}
+
+static bool zx_dir_cache_fat_next(FATFS* fs, uint32_t* p_clst)
+{
+    uint32_t entry_size = fs->fs_type == FS_FAT32 ? 4 : 2;
+    uint32_t sector = fs->fatbase + *p_clst / (FF_MAX_SS / entry_size);
+    uint32_t offset = (*p_clst % (FF_MAX_SS / entry_size)) * entry_size;
+
+    if (sector != zx_dir_cache_fat_sector)
+    {
+        if (disk_read(fs->pdrv, zx_dir_cache_fat_buffer, sector, 1) != RES_OK)
+        {
+            zx_dir_cache_fat_sector = ZX_DIR_CACHE_NO_SECTOR;
+            return false;
+        }
+        zx_dir_cache_fat_sector = sector;
+    }
+
+    const uint8_t* p_entry = &zx_dir_cache_fat_buffer[offset];
+    if (entry_size == 4)
+    {
+        *p_clst = (p_entry[0] | (p_entry[1] << 8) | (p_entry[2] << 16) | ((uint32_t)p_entry[3] << 24)) & 0x0FFFFFFF;
+    }
+    else
+    {
+        *p_clst = p_entry[0] | (p_entry[1] << 8);
+    }
+    return true;
+}
+
+static bool zx_dir_cache_stamp_take(DIR* p_dir, zx_dir_cache_stamp_Struct* p_stamp)
+{
+    FATFS* fs = p_dir->obj.fs;
+    uint32_t clst = p_dir->obj.sclust;
+
+    p_stamp->start = clst;
+    p_stamp->sectors = 0;
+    p_stamp->hash = ZX_DIR_CACHE_HASH_BASIS;
+
+    // A directory entry changed in the FatFs window may not be on the card yet
+    if (fs->wflag & 1)
+    {
+        return false;
+    }
+
+    if (clst == 0 && fs->fs_type == FS_FAT32)
+    {
+        clst = fs->dirbase;
+    }
+
+    if (clst == 0 && (fs->fs_type == FS_FAT12 || fs->fs_type == FS_FAT16))
+    {
+        // The root folder of FAT12/16 is a fixed region
+        return zx_dir_cache_hash_sectors(fs, fs->dirbase, fs->n_rootdir * ZX_DIR_CACHE_DIR_ENTRY_SIZE / FF_MAX_SS, p_stamp);
+    }
+
+    if (fs->fs_type != FS_FAT16 && fs->fs_type != FS_FAT32)
+    {
+        return false;
+    }
+
+    // The FAT may have been changed since the previous stamp
+    zx_dir_cache_fat_sector = ZX_DIR_CACHE_NO_SECTOR;
+
+    for (uint32_t clusters = 0; clst >= 2 && clst < fs->n_fatent; clusters++)
+    {
+        if (clusters >= ZX_DIR_CACHE_CLUSTERS_MAX ||
+            !zx_dir_cache_hash_sectors(fs, fs->database + (clst - 2) * fs->csize, fs->csize, p_stamp) ||
+            !zx_dir_cache_fat_next(fs, &clst))
+        {
+            p_stamp->sectors = 0;
+            return false;
+        }
+    }
+
+    return p_stamp->sectors != 0;
+}
+
+static uint8_t* zx_dir_cache_slot_data(const zx_dir_cache_slot_Struct* p_slot)
+{
+    return (uint8_t*)(EMULATOR_DIR_CACHE_AREA_START + (p_slot - zx_dir_cache_slots) * ZX_DIR_CACHE_SLOT_SIZE);
+}
+
+static zx_dir_cache_slot_Struct* zx_dir_cache_slot_pick(const char* path)
+{
+    zx_dir_cache_slot_Struct* p_victim = &zx_dir_cache_slots[0];
+
+    for (uint8_t i = 0; i < ZX_DIR_CACHE_SLOTS; i++)
+    {
+        zx_dir_cache_slot_Struct* p_slot = &zx_dir_cache_slots[i];
+
+        if (p_slot->valid && strcmp(p_slot->path, path) == 0)
+        {
+            return p_slot;
+        }
+
+        if (p_victim->valid && (!p_slot->valid || p_slot->used < p_victim->used))
+        {
+            p_victim = p_slot;
+        }
+    }
+    return p_victim;
+}
+
+static void zx_dir_cache_file_name(char* name, size_t size, const char* path)
+{
+    uint32_t hash = ZX_DIR_CACHE_HASH_BASIS;
+
+    while (*path)
+    {
+        hash ^= (uint8_t)*path++;
+        hash *= ZX_DIR_CACHE_HASH_PRIME;
+    }
+
+    sniprintf(name, size, "%s/%08lx.zdl", ZX_DIR_CACHE_DIR, (unsigned long)hash);
+}
+
+static bool zx_dir_cache_file_load(const char* path, const zx_dir_cache_stamp_Struct* p_stamp, uint8_t* p_order)
+{
+    char name[ZX_DIR_CACHE_PATH_SIZE];
+    zx_dir_cache_header_Struct header;
+    FIL file;
+    UINT res;
+    bool result = false;
+
+    zx_dir_cache_file_name(name, sizeof(name), path);
+    if (f_open(&file, name, FA_READ) != FR_OK)
+    {
+        return false;
+    }
+
+    if (f_read(&file, &header, sizeof(header), &res) == FR_OK && res == sizeof(header) &&
+        header.magic == ZX_DIR_CACHE_MAGIC && strncmp(header.path, path, ZX_DIR_CACHE_PATH_SIZE) == 0 &&
+        memcmp(&header.stamp, p_stamp, sizeof(zx_dir_cache_stamp_Struct)) == 0 &&
+        header.length <= ZX_DIR_CACHE_SLOT_SIZE && header.order < ZX_DIR_LIST_ORDER_LAST_ENTRY)
+    {
+        zx_dir_cache_slot_Struct* p_slot = zx_dir_cache_slot_pick(path);
+        uint8_t* data = zx_dir_cache_slot_data(p_slot);
+        p_slot->valid = false;
+
+        if (f_read(&file, data, header.length, &res) == FR_OK && res == header.length &&
+            zx_dir_list_restore(data, header.length))
+        {
+            strcpy(p_slot->path, path);
+            p_slot->stamp = *p_stamp;
+            p_slot->length = header.length;
+            p_slot->order = header.order;
+            p_slot->used = ++zx_dir_cache_clock;
+            p_slot->valid = true;
+
+            *p_order = header.order;
+            result = true;
+        }
+    }
+
+    f_close(&file);
+    return result;
+}
+
+static void zx_dir_cache_file_save(const zx_dir_cache_slot_Struct* p_slot)
+{
+    char name[ZX_DIR_CACHE_PATH_SIZE];
+    zx_dir_cache_header_Struct header;
+    FIL file;
+    UINT res;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = ZX_DIR_CACHE_MAGIC;
+    strcpy(header.path, p_slot->path);
+    header.stamp = p_slot->stamp;
+    header.length = p_slot->length;
+    header.order = p_slot->order;
+
+    zx_dir_cache_file_name(name, sizeof(name), p_slot->path);
+    f_mkdir(ZX_DIR_CACHE_DIR);
+    if (f_open(&file, name, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+    {
+        return;
+    }
+
+    bool written = f_write(&file, &header, sizeof(header), &res) == FR_OK && res == sizeof(header) &&
+                   f_write(&file, zx_dir_cache_slot_data(p_slot), p_slot->length, &res) == FR_OK && res == p_slot->length;
+
+    if (f_close(&file) != FR_OK || !written)
+    {
+        f_unlink(name);
+    }
+}
+
+bool zx_dir_cache_find(DIR* p_dir, const char* path, zx_dir_cache_stamp_Struct* p_stamp, uint8_t* p_order)
+{
+    if (strlen(path) >= ZX_DIR_CACHE_PATH_SIZE || !zx_dir_cache_stamp_take(p_dir, p_stamp))
+    {
+        p_stamp->sectors = 0;
+        return false;
+    }
+
+    for (uint8_t i = 0; i < ZX_DIR_CACHE_SLOTS; i++)
+    {
+        zx_dir_cache_slot_Struct* p_slot = &zx_dir_cache_slots[i];
+
+        if (p_slot->valid && strcmp(p_slot->path, path) == 0)
+        {
+            if (memcmp(&p_slot->stamp, p_stamp, sizeof(zx_dir_cache_stamp_Struct)) == 0 &&
+                zx_dir_list_restore(zx_dir_cache_slot_data(p_slot), p_slot->length))
+            {
+                p_slot->used = ++zx_dir_cache_clock;
+                *p_order = p_slot->order;
+                return true;
+            }
+
+            // The folder has been changed
+            p_slot->valid = false;
+            break;
+        }
+    }
+
+    return zx_dir_cache_file_load(path, p_stamp, p_order);
+}
+
+void zx_dir_cache_store(const char* path, const zx_dir_cache_stamp_Struct* p_stamp, uint8_t order)
+{
+    if (p_stamp->sectors == 0 || strlen(path) >= ZX_DIR_CACHE_PATH_SIZE)
+    {
+        return;
+    }
+
+    zx_dir_cache_slot_Struct* p_slot = zx_dir_cache_slot_pick(path);
+    p_slot->valid = false;
+    p_slot->length = zx_dir_list_save(zx_dir_cache_slot_data(p_slot), ZX_DIR_CACHE_SLOT_SIZE);
+
+    if (p_slot->length == 0)
+    {
+        return;
+    }
+
+    strcpy(p_slot->path, path);
+    p_slot->stamp = *p_stamp;
+    p_slot->order = order;
+    p_slot->used = ++zx_dir_cache_clock;
+    p_slot->valid = true;
+
+    if (zx_dir_list_count() >= ZX_DIR_CACHE_PERSIST_ENTRIES)
+    {
+        zx_dir_cache_file_save(p_slot);
+    }
+}
@@ -0,0 +1,42 @@
+//! @file zx_dir_cache.h
+//! @brief Cache of the listings of recently visited folders kept in DDR and on SD card
+
+#ifndef ZX_DIR_CACHE_H
+#define ZX_DIR_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include "../zx_spectrum_io/zx_config.h"
+#include "../zynq_file_io/xilffs_v4_4/ff.h"
+#include "../zynq_file_io/xilffs_v4_4/diskio.h"
+#include "zx_dir_list.h"
+
+#define ZX_DIR_CACHE_PATH_SIZE (0x80)
+#define ZX_DIR_CACHE_SLOTS (8)
+
+//! @brief A listing is only taken from the cache while the folder has exactly the same content on SD card
+typedef struct
+{
+    uint32_t start;
+    uint32_t sectors;
+    uint32_t hash;
+} zx_dir_cache_stamp_Struct;
+
+//! @brief Take the stamp of an opened folder and look its listing up,
+//!   all functions of this module are called with zx_tape_lock taken
+//! @param *p_dir is a pointer to the opened folder
+//! @param *path is a pointer to the folder name
+//! @param *p_stamp is a pointer to the stamp to be filled in and passed to zx_dir_cache_store later
+//! @param *p_order is a pointer to zx_dir_list_order_Enum the cached listing is sorted in
+//! @return true if zx_dir_list has been filled in from the cache or false otherwise
+bool zx_dir_cache_find(DIR* p_dir, const char* path, zx_dir_cache_stamp_Struct* p_stamp, uint8_t* p_order);
+
+//! @brief Keep the listing which is in zx_dir_list now, large ones also go to SD card
+//! @param *path is a pointer to the folder name
+//! @param *p_stamp is a pointer to the stamp taken by zx_dir_cache_find
+//! @param order is zx_dir_list_order_Enum the listing is sorted in
+void zx_dir_cache_store(const char* path, const zx_dir_cache_stamp_Struct* p_stamp, uint8_t order);
+
+#endif
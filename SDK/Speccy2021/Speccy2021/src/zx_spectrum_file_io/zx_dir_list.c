@@ -0,0 +1,680 @@
+/*
+ Directory listing
+ =================
+
+ The listing of the folder shown by the shell. Every file takes a small
+ fixed size entry in a table while its name is appended to a packed arena
+ right behind the table, so a folder of short names costs a few dozen bytes
+ per file instead of a record sized for the longest possible name. Both the
+ table and the arena live in spare DDR. Reordering the listing only moves
+ the entries, the names never move until the listing is cleared.
+
+ Before sorting every entry gets a 32-bit key: the first four case folded
+ characters of the name or the extension, the size or the time stamp.
+ The positions of the folders and of the files are then sorted by their
+ keys with an LSD radix sort, a byte per pass. Long runs of equal keys
+ are sorted the same way by the next four characters of the names, a few
+ levels deep, and only short runs which are not in order yet are merge
+ sorted by comparing the names.
+ The extension order sorts by the names first, so that the radix sort by
+ the extensions leaves files of the same extension in order of their
+ names. Finally every entry is moved once to its place. The keys go into the room of the view, which is
+ built again after sorting anyway, and the positions take 16 bits each.
+
+ For the type-ahead search every entry keeps a mask of the characters its
+ name is made of, so most names are rejected by a single AND before being
+ scanned for the pattern. The positions of the matching entries are kept
+ in a view between the table and the arena, and typing one more character
+ only scans the entries which are in the view already.
+
+ A listing can be saved as a flat image: the number of entries and the
+ size of the names followed by the table and the names as they are.
+
+ Designed in Magictale Electronics.
+
+ Copyright (c) 2021 Dmitry Pakhomenko.
+ dmitryp@magictale.com
+ http://magictale.com
+
+ This code is in the public domain.
+*/
+
+#include "zx_dir_list.h"
+
+#define ZX_DIR_LIST_TABLE_SIZE (ZX_DIR_LIST_ENTRIES * sizeof(zx_dir_list_entry_Struct))
+#define ZX_DIR_LIST_VIEW_START (EMULATOR_DIR_LIST_AREA_START + ZX_DIR_LIST_TABLE_SIZE)
+#define ZX_DIR_LIST_VIEW_SIZE (ZX_DIR_LIST_ENTRIES * sizeof(uint32_t))
+#define ZX_DIR_LIST_SORT_START (ZX_DIR_LIST_VIEW_START + ZX_DIR_LIST_VIEW_SIZE)
+#define ZX_DIR_LIST_SORT_SIZE (2 * ZX_DIR_LIST_ENTRIES * sizeof(uint16_t))
+#define ZX_DIR_LIST_ARENA_START (ZX_DIR_LIST_SORT_START + ZX_DIR_LIST_SORT_SIZE)
+#define ZX_DIR_LIST_ARENA_SIZE (EMULATOR_DIR_LIST_AREA_SIZE - ZX_DIR_LIST_TABLE_SIZE - ZX_DIR_LIST_VIEW_SIZE - ZX_DIR_LIST_SORT_SIZE)
+#define ZX_DIR_LIST_RADIX_BITS (8)
+#define ZX_DIR_LIST_RADIX_PASSES (32 / ZX_DIR_LIST_RADIX_BITS)
+#define ZX_DIR_LIST_NAME_DEPTH (8)
+#define ZX_DIR_LIST_MERGE_RUN (16)
+
+#if ZX_DIR_LIST_ENTRIES > 0x10000
+#error "The sort keeps the positions of the entries in 16 bits"
+#endif
+
+static zx_dir_list_entry_Struct* const zx_dir_list_table = (zx_dir_list_entry_Struct*)EMULATOR_DIR_LIST_AREA_START;
+static uint32_t* const zx_dir_list_view = (uint32_t*)ZX_DIR_LIST_VIEW_START;
+static uint16_t* const zx_dir_list_sort_pos = (uint16_t*)ZX_DIR_LIST_SORT_START;
+static uint16_t* const zx_dir_list_sort_tmp = (uint16_t*)ZX_DIR_LIST_SORT_START + ZX_DIR_LIST_ENTRIES;
+static uint32_t zx_dir_list_radix_counts[ZX_DIR_LIST_RADIX_PASSES][1 << ZX_DIR_LIST_RADIX_BITS];
+static char* const zx_dir_list_arena = (char*)ZX_DIR_LIST_ARENA_START;
+static uint32_t zx_dir_list_total = 0;
+static uint32_t zx_dir_list_arena_used = 0;
+static uint32_t zx_dir_list_view_total = 0;
+static char zx_dir_list_pattern[ZX_DIR_LIST_PATTERN_SIZE] = "";
+static uint32_t zx_dir_list_pattern_length = 0;
+static uint32_t zx_dir_list_pattern_chars = 0;
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t names_size;
+} zx_dir_list_image_Struct;
+
+//! @brief Fold a character to lower case
+//! @param c is the character
+//! @return the folded character
+static uint8_t zx_dir_list_fold(uint8_t c);
+
+//! @brief Get the bit of a character in the mask of the characters a name is made of
+//! @param c is the character
+//! @return the bit, digits share the bits in pairs and all other characters share one bit
+static uint32_t zx_dir_list_char_bit(uint8_t c);
+
+//! @brief Check whether the name of an entry contains the pattern
+//! @param *p_entry is a pointer to the entry
+//! @return true if the name contains the pattern or false otherwise
+static bool zx_dir_list_match(const zx_dir_list_entry_Struct* p_entry);
+
+//! @brief Collect the positions of the entries which match the pattern
+//! @param narrow set to true to scan the entries in the view only or false to scan all entries
+static void zx_dir_list_view_build(bool narrow);
+
+//! @brief Pack the first four case folded characters of a string so that the keys compare as the strings do
+//! @param *str is a pointer to the null terminated string
+//! @return the key
+static uint32_t zx_dir_list_str_key(const char* str);
+
+//! @brief Compare two entries in a given order
+//! @param *a is a pointer to the first entry
+//! @param *b is a pointer to the second entry
+//! @param order is zx_dir_list_order_Enum
+//! @return a negative value if a goes before b, a positive value if a goes after b or 0 otherwise
+static int zx_dir_list_compare(const zx_dir_list_entry_Struct* a, const zx_dir_list_entry_Struct* b, uint8_t order);
+
+//! @brief Sort positions by their keys, positions with equal keys keep their order
+//! @param *keys is a pointer to the keys of the entries
+//! @param *pos is a pointer to the positions to be sorted
+//! @param *tmp is a pointer to the room for as many positions
+//! @param count is the number of positions
+static void zx_dir_list_radix_sort(const uint32_t* keys, uint16_t* pos, uint16_t* tmp, uint32_t count);
+
+//! @brief Sort positions of entries by comparing the entries
+//! @param *p_table is a pointer to the entries
+//! @param *pos is a pointer to the positions to be sorted
+//! @param *tmp is a pointer to the room for as many positions
+//! @param count is the number of positions
+//! @param order is zx_dir_list_order_Enum
+static void zx_dir_list_merge_sort(const zx_dir_list_entry_Struct* p_table, uint16_t* pos, uint16_t* tmp, uint32_t count, uint8_t order);
+
+//! @brief Work out the keys of the entries
+//! @param *p_table is a pointer to the entries
+//! @param *keys is a pointer to the room for the keys
+//! @param count is the number of entries
+//! @param order is zx_dir_list_order_Enum
+static void zx_dir_list_keys_make(zx_dir_list_entry_Struct* p_table, uint32_t* keys, uint32_t count, uint8_t order);
+
+//! @brief Sort every run of positions with equal keys, by the next characters of the names while
+//!   the run is long or by comparing the entries once it is short and not in order already
+//! @param *p_table is a pointer to the entries
+//! @param *keys is a pointer to the keys of the entries
+//! @param *pos is a pointer to the positions sorted by their keys
+//! @param count is the number of positions
+//! @param order is zx_dir_list_order_Enum
+//! @param depth is the number of four character steps into the names already covered by the keys
+static void zx_dir_list_ties_sort(const zx_dir_list_entry_Struct* p_table, uint32_t* keys, uint16_t* pos, uint32_t count, uint8_t order, uint8_t depth);
+
+
+void zx_dir_list_clear()
+{
+    zx_dir_list_total = 0;
+    zx_dir_list_arena_used = 0;
+    zx_dir_list_view_total = 0;
+    zx_dir_list_pattern_length = 0;
+}
+
+bool zx_dir_list_add(const char* name, uint8_t attr, uint32_t size, uint16_t date, uint16_t time)
+{
+    uint32_t length = strlen(name);
+
+    if (zx_dir_list_total >= ZX_DIR_LIST_ENTRIES || zx_dir_list_arena_used + length + 1 > ZX_DIR_LIST_ARENA_SIZE)
+    {
+        return false;
+    }
+
+    zx_dir_list_entry_Struct* p_entry = &zx_dir_list_table[zx_dir_list_total++];
+    p_entry->name_offset = zx_dir_list_arena_used;
+    p_entry->name_length = length;
+    p_entry->size = size;
+    p_entry->date = date;
+    p_entry->time = time;
+    p_entry->attr = attr;
+    p_entry->sel = 0;
+    p_entry->key = 0;
+    p_entry->chars = 0;
+
+    for (uint32_t i = 0; i < length; i++)
+    {
+        p_entry->chars |= zx_dir_list_char_bit(name[i]);
+    }
+
+    memcpy(&zx_dir_list_arena[zx_dir_list_arena_used], name, length + 1);
+    zx_dir_list_arena_used += length + 1;
+
+    if (zx_dir_list_pattern_length != 0 && zx_dir_list_match(p_entry))
+    {
+        zx_dir_list_view[zx_dir_list_view_total++] = zx_dir_list_total - 1;
+    }
+    return true;
+}
+
+uint32_t zx_dir_list_count()
+{
+    return zx_dir_list_total;
+}
+
+zx_dir_list_entry_Struct* zx_dir_list_entry(uint32_t pos)
+{
+    if (pos >= zx_dir_list_total)
+    {
+        return NULL;
+    }
+
+    return &zx_dir_list_table[pos];
+}
+
+const char* zx_dir_list_name(const zx_dir_list_entry_Struct* p_entry)
+{
+    return &zx_dir_list_arena[p_entry->name_offset];
+}
+
+uint32_t zx_dir_list_save(uint8_t* dst, uint32_t size)
+{
+    zx_dir_list_image_Struct image = {zx_dir_list_total, zx_dir_list_arena_used};
+    uint32_t table_size = zx_dir_list_total * sizeof(zx_dir_list_entry_Struct);
+    uint32_t length = sizeof(image) + table_size + zx_dir_list_arena_used;
+
+    if (length > size)
+    {
+        return 0;
+    }
+
+    memcpy(dst, &image, sizeof(image));
+    memcpy(dst + sizeof(image), zx_dir_list_table, table_size);
+    memcpy(dst + sizeof(image) + table_size, zx_dir_list_arena, zx_dir_list_arena_used);
+    return length;
+}
+
+bool zx_dir_list_restore(const uint8_t* src, uint32_t length)
+{
+    zx_dir_list_image_Struct image;
+
+    if (length < sizeof(image))
+    {
+        return false;
+    }
+
+    memcpy(&image, src, sizeof(image));
+    uint32_t table_size = image.count * sizeof(zx_dir_list_entry_Struct);
+
+    if (image.count > ZX_DIR_LIST_ENTRIES || image.names_size > ZX_DIR_LIST_ARENA_SIZE ||
+        length != sizeof(image) + table_size + image.names_size)
+    {
+        return false;
+    }
+
+    memcpy(zx_dir_list_table, src + sizeof(image), table_size);
+    memcpy(zx_dir_list_arena, src + sizeof(image) + table_size, image.names_size);
+    zx_dir_list_total = image.count;
+    zx_dir_list_arena_used = image.names_size;
+    zx_dir_list_view_total = 0;
+    zx_dir_list_pattern_length = 0;
+
+    // Every name has to be within the arena and terminated
+    for (uint32_t i = 0; i < zx_dir_list_total; i++)
+    {
+        const zx_dir_list_entry_Struct* p_entry = &zx_dir_list_table[i];
+        if (p_entry->name_offset + p_entry->name_length >= zx_dir_list_arena_used ||
+            zx_dir_list_arena[p_entry->name_offset + p_entry->name_length] != 0)
+        {
+            zx_dir_list_clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+const char* zx_dir_list_name_ext(const char* name)
+{
+    const char* ext = name + strlen(name);
+    while (ext > name && *ext != '.')
+    {
+        ext--;
+    }
+
+    return ext;
+}
+
+static uint8_t zx_dir_list_fold(uint8_t c)
+{
+    if (c >= 'A' && c <= 'Z')
+    {
+        c += 'a' - 'A';
+    }
+    return c;
+}
+
+static uint32_t zx_dir_list_char_bit(uint8_t c)
+{
+    c = zx_dir_list_fold(c);
+
+    if (c >= 'a' && c <= 'z')
+    {
+        return 1U << (c - 'a');
+    }
+    else if (c >= '0' && c <= '9')
+    {
+        return 1U << (26 + (c - '0') / 2);
+    }
+    return 1U << 31;
+}
+
+static bool zx_dir_list_match(const zx_dir_list_entry_Struct* p_entry)
+{
+    if ((p_entry->chars & zx_dir_list_pattern_chars) != zx_dir_list_pattern_chars)
+    {
+        return false;
+    }
+
+    const char* name = zx_dir_list_name(p_entry);
+
+    for (uint32_t i = 0; i + zx_dir_list_pattern_length <= p_entry->name_length; i++)
+    {
+        uint32_t j = 0;
+        while (j < zx_dir_list_pattern_length && zx_dir_list_fold(name[i + j]) == (uint8_t)zx_dir_list_pattern[j])
+        {
+            j++;
+        }
+
+        if (j == zx_dir_list_pattern_length)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void zx_dir_list_view_build(bool narrow)
+{
+    uint32_t count = 0;
+
+    if (narrow)
+    {
+        // The view is compacted in place
+        for (uint32_t i = 0; i < zx_dir_list_view_total; i++)
+        {
+            if (zx_dir_list_match(&zx_dir_list_table[zx_dir_list_view[i]]))
+            {
+                zx_dir_list_view[count++] = zx_dir_list_view[i];
+            }
+        }
+    }
+    else
+    {
+        for (uint32_t i = 0; i < zx_dir_list_total; i++)
+        {
+            if (zx_dir_list_match(&zx_dir_list_table[i]))
+            {
+                zx_dir_list_view[count++] = i;
+            }
+        }
+    }
+
+    zx_dir_list_view_total = count;
+}
+
+void zx_dir_list_filter(const char* pattern)
+{
+    uint32_t length = strlen(pattern);
+    if (length >= ZX_DIR_LIST_PATTERN_SIZE)
+    {
+        length = ZX_DIR_LIST_PATTERN_SIZE - 1;
+    }
+
+    // A longer pattern which starts with the previous one can only drop entries
+    bool narrow = zx_dir_list_pattern_length != 0 && length >= zx_dir_list_pattern_length &&
+                  strncasecmp(pattern, zx_dir_list_pattern, zx_dir_list_pattern_length) == 0;
+
+    zx_dir_list_pattern_chars = 0;
+    for (uint32_t i = 0; i < length; i++)
+    {
+        zx_dir_list_pattern[i] = zx_dir_list_fold(pattern[i]);
+        zx_dir_list_pattern_chars |= zx_dir_list_char_bit(pattern[i]);
+    }
+    zx_dir_list_pattern[length] = 0;
+    zx_dir_list_pattern_length = length;
+
+    if (length != 0)
+    {
+        zx_dir_list_view_build(narrow);
+    }
+}
+
+uint32_t zx_dir_list_view_count()
+{
+    return zx_dir_list_pattern_length != 0 ? zx_dir_list_view_total : zx_dir_list_total;
+}
+
+zx_dir_list_entry_Struct* zx_dir_list_view_entry(uint32_t pos)
+{
+    if (zx_dir_list_pattern_length == 0)
+    {
+        return zx_dir_list_entry(pos);
+    }
+
+    if (pos >= zx_dir_list_view_total)
+    {
+        return NULL;
+    }
+
+    return &zx_dir_list_table[zx_dir_list_view[pos]];
+}
+
+static uint32_t zx_dir_list_str_key(const char* str)
+{
+    uint32_t key = 0;
+
+    for (uint8_t i = 0; i < sizeof(key); i++)
+    {
+        uint8_t c = *str;
+        if (c != 0)
+        {
+            str++;
+        }
+
+        key = (key << 8) | zx_dir_list_fold(c);
+    }
+
+    return key;
+}
+
+static int zx_dir_list_compare(const zx_dir_list_entry_Struct* a, const zx_dir_list_entry_Struct* b, uint8_t order)
+{
+    if ((a->attr ^ b->attr) & AM_DIR)
+    {
+        return (a->attr & AM_DIR) ? -1 : 1;
+    }
+
+    if (a->key != b->key)
+    {
+        return a->key < b->key ? -1 : 1;
+    }
+
+    const char* name_a = zx_dir_list_name(a);
+    const char* name_b = zx_dir_list_name(b);
+
+    if (order == ZX_DIR_LIST_ORDER_EXT)
+    {
+        int result = strcasecmp(zx_dir_list_name_ext(name_a), zx_dir_list_name_ext(name_b));
+        if (result != 0)
+        {
+            return result;
+        }
+    }
+
+    return strcasecmp(name_a, name_b);
+}
+
+static void zx_dir_list_radix_sort(const uint32_t* keys, uint16_t* pos, uint16_t* tmp, uint32_t count)
+{
+    const uint32_t mask = (1U << ZX_DIR_LIST_RADIX_BITS) - 1;
+    uint16_t* src = pos;
+    uint16_t* dst = tmp;
+
+    if (count < 2)
+    {
+        return;
+    }
+
+    // The counts of all passes are taken in a single scan
+    memset(zx_dir_list_radix_counts, 0, sizeof(zx_dir_list_radix_counts));
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t key = keys[pos[i]];
+        for (uint8_t pass = 0; pass < ZX_DIR_LIST_RADIX_PASSES; pass++)
+        {
+            zx_dir_list_radix_counts[pass][(key >> (pass * ZX_DIR_LIST_RADIX_BITS)) & mask]++;
+        }
+    }
+
+    for (uint8_t pass = 0; pass < ZX_DIR_LIST_RADIX_PASSES; pass++)
+    {
+        uint32_t* counts = zx_dir_list_radix_counts[pass];
+        uint8_t shift = pass * ZX_DIR_LIST_RADIX_BITS;
+
+        // A byte which is the same in every key does not change the order
+        if (counts[(keys[src[0]] >> shift) & mask] == count)
+        {
+            continue;
+        }
+
+        uint32_t start = 0;
+        for (uint32_t digit = 0; digit <= mask; digit++)
+        {
+            uint32_t n = counts[digit];
+            counts[digit] = start;
+            start += n;
+        }
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            dst[counts[(keys[src[i]] >> shift) & mask]++] = src[i];
+        }
+
+        uint16_t* swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != pos)
+    {
+        memcpy(pos, src, count * sizeof(pos[0]));
+    }
+}
+
+static void zx_dir_list_merge_sort(const zx_dir_list_entry_Struct* p_table, uint16_t* pos, uint16_t* tmp, uint32_t count, uint8_t order)
+{
+    uint16_t* src = pos;
+    uint16_t* dst = tmp;
+
+    for (uint32_t width = 1; width < count; width *= 2)
+    {
+        for (uint32_t lo = 0; lo < count; lo += 2 * width)
+        {
+            uint32_t mid = (lo + width < count) ? lo + width : count;
+            uint32_t hi = (lo + 2 * width < count) ? lo + 2 * width : count;
+            uint32_t i = lo;
+            uint32_t j = mid;
+            uint32_t k = lo;
+
+            while (i < mid && j < hi)
+            {
+                dst[k++] = (zx_dir_list_compare(&p_table[src[j]], &p_table[src[i]], order) < 0) ? src[j++] : src[i++];
+            }
+            while (i < mid)
+            {
+                dst[k++] = src[i++];
+            }
+            while (j < hi)
+            {
+                dst[k++] = src[j++];
+            }
+        }
+
+        uint16_t* swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != pos)
+    {
+        memcpy(pos, src, count * sizeof(pos[0]));
+    }
+}
+
+static void zx_dir_list_ties_sort(const zx_dir_list_entry_Struct* p_table, uint32_t* keys, uint16_t* pos, uint32_t count, uint8_t order, uint8_t depth)
+{
+    uint32_t start = 0;
+
+    while (start < count)
+    {
+        uint32_t end = start + 1;
+        while (end < count && keys[pos[end]] == keys[pos[start]])
+        {
+            end++;
+        }
+
+        // Long runs of equal keys are told apart by the next four characters of
+        // the names. Ties of the extension order compare two strings, so they are
+        // always merge sorted
+        if (order != ZX_DIR_LIST_ORDER_EXT && end - start > ZX_DIR_LIST_MERGE_RUN && depth < ZX_DIR_LIST_NAME_DEPTH)
+        {
+            for (uint32_t i = start; i < end; i++)
+            {
+                const zx_dir_list_entry_Struct* p_entry = &p_table[pos[i]];
+                uint32_t offset = depth * sizeof(uint32_t);
+                keys[pos[i]] = zx_dir_list_str_key(zx_dir_list_name(p_entry) + (offset < p_entry->name_length ? offset : p_entry->name_length));
+            }
+            zx_dir_list_radix_sort(keys, pos + start, zx_dir_list_sort_tmp, end - start);
+            zx_dir_list_ties_sort(p_table, keys, pos + start, end - start, order, depth + 1);
+        }
+        else
+        {
+            uint32_t i = start + 1;
+            while (i < end && zx_dir_list_compare(&p_table[pos[i - 1]], &p_table[pos[i]], order) <= 0)
+            {
+                i++;
+            }
+
+            if (i < end)
+            {
+                zx_dir_list_merge_sort(p_table, pos + start, zx_dir_list_sort_tmp, end - start, order);
+            }
+        }
+        start = end;
+    }
+}
+
+static void zx_dir_list_keys_make(zx_dir_list_entry_Struct* p_table, uint32_t* keys, uint32_t count, uint8_t order)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        zx_dir_list_entry_Struct* p_entry = &p_table[i];
+
+        switch (order)
+        {
+            case ZX_DIR_LIST_ORDER_EXT:
+                p_entry->key = zx_dir_list_str_key(zx_dir_list_name_ext(zx_dir_list_name(p_entry)));
+                break;
+
+            case ZX_DIR_LIST_ORDER_SIZE:
+                p_entry->key = p_entry->size;
+                break;
+
+            case ZX_DIR_LIST_ORDER_DATE:
+                p_entry->key = ~(((uint32_t)p_entry->date << 16) | p_entry->time);
+                break;
+
+            default:
+                p_entry->key = zx_dir_list_str_key(zx_dir_list_name(p_entry));
+                break;
+        }
+        keys[i] = p_entry->key;
+    }
+}
+
+void zx_dir_list_sort(uint32_t first, uint8_t order)
+{
+    if (first + 1 >= zx_dir_list_total)
+    {
+        return;
+    }
+
+    zx_dir_list_entry_Struct* p_table = &zx_dir_list_table[first];
+    uint32_t count = zx_dir_list_total - first;
+    uint32_t* keys = zx_dir_list_view;
+    uint16_t* pos = zx_dir_list_sort_pos;
+    uint32_t folders = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (p_table[i].attr & AM_DIR)
+        {
+            folders++;
+        }
+    }
+
+    // Folders go before files, both keep the order of the table until they are sorted
+    uint32_t next_folder = 0;
+    uint32_t next_file = folders;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        pos[(p_table[i].attr & AM_DIR) ? next_folder++ : next_file++] = i;
+    }
+
+    // The radix sort keeps the order of equal keys, so files with the same
+    // extension stay in order of their names if they have been sorted by them
+    for (uint8_t pass = (order == ZX_DIR_LIST_ORDER_EXT) ? 0 : 1; pass < 2; pass++)
+    {
+        uint8_t pass_order = (pass == 0) ? ZX_DIR_LIST_ORDER_NAME : order;
+        uint8_t depth = (pass_order == ZX_DIR_LIST_ORDER_NAME) ? 1 : 0;
+
+        zx_dir_list_keys_make(p_table, keys, count, pass_order);
+        zx_dir_list_radix_sort(keys, pos, zx_dir_list_sort_tmp, folders);
+        zx_dir_list_radix_sort(keys, pos + folders, zx_dir_list_sort_tmp, count - folders);
+        zx_dir_list_ties_sort(p_table, keys, pos, folders, pass_order, depth);
+        zx_dir_list_ties_sort(p_table, keys, pos + folders, count - folders, pass_order, depth);
+    }
+
+    // Every entry is moved once, following the cycles of the permutation
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (pos[i] == i)
+        {
+            continue;
+        }
+
+        zx_dir_list_entry_Struct entry = p_table[i];
+        uint32_t j = i;
+        while (pos[j] != i)
+        {
+            uint32_t k = pos[j];
+            p_table[j] = p_table[k];
+            pos[j] = j;
+            j = k;
+        }
+        p_table[j] = entry;
+        pos[j] = j;
+    }
+
+    // The keys have overwritten the view
+    if (zx_dir_list_pattern_length != 0)
+    {
+        zx_dir_list_view_build(false);
+    }
+}
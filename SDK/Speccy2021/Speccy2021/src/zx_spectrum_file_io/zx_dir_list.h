@@ -0,0 +1,103 @@
+//! @file zx_dir_list.h
+//! @brief Listing of a folder kept as a table of entries and a packed arena of names
+
+#ifndef ZX_DIR_LIST_H
+#define ZX_DIR_LIST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include "../zx_spectrum_io/zx_config.h"
+#include "../zynq_file_io/xilffs_v4_4/ff.h"
+
+#define ZX_DIR_LIST_ENTRIES (0x10000U)
+#define ZX_DIR_LIST_PATTERN_SIZE (32)
+
+typedef enum
+{
+    ZX_DIR_LIST_ORDER_NAME = 0,
+    ZX_DIR_LIST_ORDER_EXT = 1,
+    ZX_DIR_LIST_ORDER_SIZE = 2,
+    ZX_DIR_LIST_ORDER_DATE = 3,
+    ZX_DIR_LIST_ORDER_LAST_ENTRY
+} zx_dir_list_order_Enum;
+
+//! @brief An entry of the listing, the name itself lives in the arena
+typedef struct
+{
+    uint32_t key;
+    uint32_t chars;
+    uint32_t name_offset;
+    uint32_t size;
+    uint16_t date;
+    uint16_t time;
+    uint8_t attr;
+    uint8_t sel;
+    uint16_t name_length;
+} zx_dir_list_entry_Struct;
+
+//! @brief Forget all entries of the listing
+void zx_dir_list_clear(void);
+
+//! @brief Append an entry to the listing
+//! @param *name is a pointer to the null terminated file name
+//! @param attr is the FAT attribute byte
+//! @param size is the file size
+//! @param date is the FAT modification date
+//! @param time is the FAT modification time
+//! @return true if the entry has been added or false if either the table or the arena is full
+bool zx_dir_list_add(const char* name, uint8_t attr, uint32_t size, uint16_t date, uint16_t time);
+
+//! @brief Get the number of entries in the listing
+//! @return the number of entries
+uint32_t zx_dir_list_count(void);
+
+//! @brief Get an entry of the listing
+//! @param pos is the position of the entry
+//! @return a pointer to the entry or NULL if there is no such entry
+zx_dir_list_entry_Struct* zx_dir_list_entry(uint32_t pos);
+
+//! @brief Get the name of an entry
+//! @param *p_entry is a pointer to the entry
+//! @return a pointer to the null terminated name
+const char* zx_dir_list_name(const zx_dir_list_entry_Struct* p_entry);
+
+//! @brief Show only the entries whose names contain a pattern, ignoring case.
+//!   A pattern which extends the previous one only narrows the entries shown now,
+//!   entries added or sorted later are filtered as well
+//! @param *pattern is a pointer to the null terminated pattern, an empty one shows all entries
+void zx_dir_list_filter(const char* pattern);
+
+//! @brief Get the number of entries shown through the filter
+//! @return the number of entries
+uint32_t zx_dir_list_view_count(void);
+
+//! @brief Get an entry shown through the filter
+//! @param pos is the position of the entry among the ones shown
+//! @return a pointer to the entry or NULL if there is no such entry
+zx_dir_list_entry_Struct* zx_dir_list_view_entry(uint32_t pos);
+
+//! @brief Sort the listing, folders always go before files and equal keys are ordered by name
+//! @param first is the position of the first entry to be sorted, the ones before it stay in place
+//! @param order is zx_dir_list_order_Enum, the date order puts the newest files first
+void zx_dir_list_sort(uint32_t first, uint8_t order);
+
+//! @brief Copy the listing into a flat image which can be kept elsewhere
+//! @param *dst is a pointer to the room for the image
+//! @param size is the size of the room
+//! @return the length of the image or 0 if it does not fit
+uint32_t zx_dir_list_save(uint8_t* dst, uint32_t size);
+
+//! @brief Replace the listing with a flat image made by zx_dir_list_save
+//! @param *src is a pointer to the image
+//! @param length is the length of the image
+//! @return true if the listing has been replaced or false if the image is broken
+bool zx_dir_list_restore(const uint8_t* src, uint32_t length);
+
+//! @brief Find the extension of a file name
+//! @param *name is a pointer to the null terminated file name
+//! @return a pointer to the last dot of the name or to the name itself if there is no dot
+const char* zx_dir_list_name_ext(const char* name);
+
+#endif
@@ -0,0 +1,223 @@
+/*
+ Double-buffered file reader
+ ===========================
+
+ This API replaces byte-by-byte f_read calls with whole block reads into
+ one of two buffer halves. Parsers consume bytes straight from memory and
+ the file system is only touched when the position leaves both halves.
+ The least recently used half is refilled so short backward jumps (such as
+ TZX loop blocks) are normally served from the other half.
+ A stream may also be attached to a file held in memory, in which case the
+ halves are not used and bytes are taken straight from there.
+
+ Designed in Magictale Electronics.
+
+ Copyright (c) 2021 Dmitry Pakhomenko.
+ dmitryp@magictale.com
+ http://magictale.com
+
+ This code is in the public domain.
+*/
+
+#include "zx_file_stream.h"
+
+//! @brief Find the half holding the current position
+//! @param *p_stream is a pointer to zx_file_stream_Struct
+//! @return the index of the half or -1 if the position is not buffered
+static int zx_file_stream_find(zx_file_stream_Struct* p_stream);
+
+//! @brief Fill the least recently used half with the block holding the current position
+//! @param *p_stream is a pointer to zx_file_stream_Struct
+//! @return the index of the filled half or -1 at the end of file or on error
+static int zx_file_stream_fill(zx_file_stream_Struct* p_stream);
+
+
+void zx_file_stream_init(zx_file_stream_Struct* p_stream, FIL* file)
+{
+    p_stream->file = file;
+    p_stream->memory = NULL;
+    p_stream->memory_size = 0;
+    p_stream->pos = 0;
+    p_stream->last_used = 0;
+    p_stream->fs_calls = 0;
+    p_stream->bytes_read = 0;
+
+    for (uint8_t i = 0; i < ZX_FILE_STREAM_HALVES; i++)
+    {
+        p_stream->half_start[i] = 0;
+        p_stream->half_length[i] = 0;
+    }
+}
+
+void zx_file_stream_init_memory(zx_file_stream_Struct* p_stream, const uint8_t* data, uint32_t size)
+{
+    zx_file_stream_init(p_stream, NULL);
+    p_stream->memory = data;
+    p_stream->memory_size = size;
+}
+
+static int zx_file_stream_find(zx_file_stream_Struct* p_stream)
+{
+    for (uint8_t i = 0; i < ZX_FILE_STREAM_HALVES; i++)
+    {
+        if (p_stream->pos - p_stream->half_start[i] < p_stream->half_length[i])
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int zx_file_stream_fill(zx_file_stream_Struct* p_stream)
+{
+    uint8_t half = p_stream->last_used ^ 1;
+    uint32_t start = p_stream->pos & ~(ZX_FILE_STREAM_HALF_SIZE - 1);
+    UINT res = 0;
+
+    p_stream->half_length[half] = 0;
+
+    if (p_stream->file == NULL || start >= f_size(p_stream->file))
+    {
+        return -1;
+    }
+
+    if (p_stream->file->fptr != start)
+    {
+        p_stream->fs_calls++;
+        if (f_lseek(p_stream->file, start) != FR_OK)
+        {
+            return -1;
+        }
+    }
+
+    p_stream->fs_calls++;
+    if (f_read(p_stream->file, p_stream->buffer[half], ZX_FILE_STREAM_HALF_SIZE, &res) != FR_OK || res == 0)
+    {
+        return -1;
+    }
+
+    p_stream->bytes_read += res;
+    p_stream->half_start[half] = start;
+    p_stream->half_length[half] = res;
+
+    // The fill may not reach the current position if the file was truncated
+    if (p_stream->pos - start >= res)
+    {
+        return -1;
+    }
+    return half;
+}
+
+bool zx_file_stream_read_byte(zx_file_stream_Struct* p_stream, uint8_t* value)
+{
+    uint8_t half = p_stream->last_used;
+
+    if (p_stream->memory != NULL)
+    {
+        if (p_stream->pos >= p_stream->memory_size)
+        {
+            return false;
+        }
+        *value = p_stream->memory[p_stream->pos++];
+        return true;
+    }
+
+    if (p_stream->pos - p_stream->half_start[half] >= p_stream->half_length[half])
+    {
+        int found = zx_file_stream_find(p_stream);
+        if (found < 0)
+        {
+            found = zx_file_stream_fill(p_stream);
+            if (found < 0)
+            {
+                return false;
+            }
+        }
+        half = (uint8_t)found;
+        p_stream->last_used = half;
+    }
+
+    *value = p_stream->buffer[half][p_stream->pos - p_stream->half_start[half]];
+    p_stream->pos++;
+    return true;
+}
+
+uint32_t zx_file_stream_read(zx_file_stream_Struct* p_stream, uint8_t* dst, uint32_t cnt)
+{
+    uint32_t done = 0;
+
+    if (p_stream->memory != NULL)
+    {
+        if (p_stream->pos < p_stream->memory_size)
+        {
+            done = p_stream->memory_size - p_stream->pos;
+            if (done > cnt)
+            {
+                done = cnt;
+            }
+            memcpy(dst, p_stream->memory + p_stream->pos, done);
+            p_stream->pos += done;
+        }
+        return done;
+    }
+
+    while (done < cnt)
+    {
+        int half = zx_file_stream_find(p_stream);
+        if (half < 0)
+        {
+            half = zx_file_stream_fill(p_stream);
+            if (half < 0)
+            {
+                break;
+            }
+        }
+        p_stream->last_used = (uint8_t)half;
+
+        uint32_t offset = p_stream->pos - p_stream->half_start[half];
+        uint32_t chunk = p_stream->half_length[half] - offset;
+        if (chunk > cnt - done)
+        {
+            chunk = cnt - done;
+        }
+
+        memcpy(dst + done, &p_stream->buffer[half][offset], chunk);
+        done += chunk;
+        p_stream->pos += chunk;
+    }
+    return done;
+}
+
+void zx_file_stream_seek(zx_file_stream_Struct* p_stream, uint32_t pos)
+{
+    p_stream->pos = pos;
+}
+
+uint32_t zx_file_stream_tell(zx_file_stream_Struct* p_stream)
+{
+    return p_stream->pos;
+}
+
+bool zx_file_stream_eof(zx_file_stream_Struct* p_stream)
+{
+    return p_stream->pos >= zx_file_stream_size_get(p_stream);
+}
+
+uint32_t zx_file_stream_size_get(zx_file_stream_Struct* p_stream)
+{
+    if (p_stream->memory != NULL)
+    {
+        return p_stream->memory_size;
+    }
+    return (p_stream->file == NULL) ? 0 : f_size(p_stream->file);
+}
+
+uint32_t zx_file_stream_fs_calls_get(zx_file_stream_Struct* p_stream)
+{
+    return p_stream->fs_calls;
+}
+
+uint32_t zx_file_stream_bytes_read_get(zx_file_stream_Struct* p_stream)
+{
+    return p_stream->bytes_read;
+}
@@ -0,0 +1,88 @@
+//! @file zx_file_stream.h
+//! @brief Double-buffered sequential reader on top of FatFs
+
+#ifndef ZX_FILE_STREAM_H
+#define ZX_FILE_STREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "../zynq_file_io/xilffs_v4_4/ff.h"
+
+// Each half is a whole number of sectors so that FatFs transfers it
+// with a single multi-sector disk_read straight into the buffer
+#define ZX_FILE_STREAM_HALF_SIZE (0x800U)
+#define ZX_FILE_STREAM_HALVES (2)
+
+typedef struct
+{
+    FIL *file;
+    const uint8_t* memory;
+    uint32_t memory_size;
+    uint32_t pos;
+    uint8_t last_used;
+    uint32_t half_start[ZX_FILE_STREAM_HALVES];
+    uint32_t half_length[ZX_FILE_STREAM_HALVES];
+    uint32_t fs_calls;
+    uint32_t bytes_read;
+    uint8_t buffer[ZX_FILE_STREAM_HALVES][ZX_FILE_STREAM_HALF_SIZE] __attribute__ ((aligned (32)));
+} zx_file_stream_Struct;
+
+
+//! @brief Attach the stream to an opened file and drop any buffered data
+//! @param *p_stream is a pointer to zx_file_stream_Struct
+//! @param *file is a pointer to an opened FatFs file object
+void zx_file_stream_init(zx_file_stream_Struct* p_stream, FIL* file);
+
+//! @brief Attach the stream to a file which is already held in memory,
+//!   the file system is not touched at all then
+//! @param *p_stream is a pointer to zx_file_stream_Struct
+//! @param *data is a pointer to the content of the file
+//! @param size is the size of the file
+void zx_file_stream_init_memory(zx_file_stream_Struct* p_stream, const uint8_t* data, uint32_t size);
+
+//! @brief Read one byte at the current position and advance it
+//! @param *p_stream is a pointer to zx_file_stream_Struct
+//! @param *value is a pointer to the destination byte
+//! @return true if the byte has been read or false at the end of file or on error
+bool zx_file_stream_read_byte(zx_file_stream_Struct* p_stream, uint8_t* value);
+
+//! @brief Read a number of bytes at the current position and advance it
+//! @param *p_stream is a pointer to zx_file_stream_Struct
+//! @param *dst is a pointer to the destination buffer
+//! @param cnt is the number of bytes to be read
+//! @return the number of bytes actually read
+uint32_t zx_file_stream_read(zx_file_stream_Struct* p_stream, uint8_t* dst, uint32_t cnt);
+
+//! @brief Move the current position. Buffered data is kept so seeking
+//!   within either half does not touch the file system
+//! @param *p_stream is a pointer to zx_file_stream_Struct
+//! @param pos is the new absolute position in the file
+void zx_file_stream_seek(zx_file_stream_Struct* p_stream, uint32_t pos);
+
+//! @brief Get the current position
+//! @param *p_stream is a pointer to zx_file_stream_Struct
+//! @return the absolute position in the file
+uint32_t zx_file_stream_tell(zx_file_stream_Struct* p_stream);
+
+//! @brief Check whether the current position has reached the end of the file
+//! @param *p_stream is a pointer to zx_file_stream_Struct
+//! @return true if there is no more data to read or false otherwise
+bool zx_file_stream_eof(zx_file_stream_Struct* p_stream);
+
+//! @brief Get the size of the file behind the stream
+//! @param *p_stream is a pointer to zx_file_stream_Struct
+//! @return the size in bytes or 0 if there is no file attached
+uint32_t zx_file_stream_size_get(zx_file_stream_Struct* p_stream);
+
+//! @brief Get the number of FatFs calls (reads and seeks) issued by the stream
+//! @param *p_stream is a pointer to zx_file_stream_Struct
+//! @return the number of calls since the last zx_file_stream_init
+uint32_t zx_file_stream_fs_calls_get(zx_file_stream_Struct* p_stream);
+
+//! @brief Get the number of bytes fetched from the file system by the stream
+//! @param *p_stream is a pointer to zx_file_stream_Struct
+//! @return the number of bytes since the last zx_file_stream_init
+uint32_t zx_file_stream_bytes_read_get(zx_file_stream_Struct* p_stream);
+
+#endif
@@ -0,0 +1,418 @@
+/*
+ Streaming inflate
+ =================
+
+ A compact decompressor for deflate data such as Z-RLE tape blocks or
+ compressed snapshot pages. Data are pulled from a file stream and handed
+ out byte by byte, so the only memory needed is the 32K sliding window and
+ two code tables no matter how large the compressed data are. A decoding
+ state is kept between calls and every call resumes exactly where the
+ previous one stopped.
+
+ Designed in Magictale Electronics.
+
+ Copyright (c) 2021 Dmitry Pakhomenko.
+ dmitryp@magictale.com
+ http://magictale.com
+
+ This code is in the public domain.
+*/
+
+#include "zx_inflate.h"
+
+#define ZX_INFLATE_STATE_HEADER 0
+#define ZX_INFLATE_STATE_STORED 1
+#define ZX_INFLATE_STATE_CODES 2
+#define ZX_INFLATE_STATE_DONE 3
+
+#define ZX_INFLATE_END_OF_BLOCK 256
+#define ZX_INFLATE_CLEN_CODES 19
+
+static const uint16_t zx_inflate_length_base[] =
+{
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const uint8_t zx_inflate_length_extra[] =
+{
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const uint16_t zx_inflate_dist_base[] =
+{
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+
+static const uint8_t zx_inflate_dist_extra[] =
+{
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static const uint8_t zx_inflate_clen_order[ZX_INFLATE_CLEN_CODES] =
+{
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+//! @brief Get a number of bits from the compressed data, LSB first
+//! @param *p_inflate is a pointer to zx_inflate_Struct
+//! @param n is the number of bits, up to 16
+//! @return the value of the bits
+static uint32_t zx_inflate_bits(zx_inflate_Struct* p_inflate, uint8_t n);
+
+//! @brief Build a canonical Huffman table from the code lengths
+//! @param *table is a pointer to the table to be built
+//! @param *lengths is a pointer to the code length of every symbol
+//! @param num is the number of symbols
+static void zx_inflate_build(zx_inflate_table_Struct* table, const uint8_t* lengths, uint16_t num);
+
+//! @brief Decode one symbol
+//! @param *p_inflate is a pointer to zx_inflate_Struct
+//! @param *table is a pointer to the table to decode with
+//! @return the symbol or -1 on error
+static int zx_inflate_decode(zx_inflate_Struct* p_inflate, zx_inflate_table_Struct* table);
+
+//! @brief Read the code tables of a dynamic block
+//! @param *p_inflate is a pointer to zx_inflate_Struct
+//! @return true if the tables are valid or false otherwise
+static bool zx_inflate_dynamic(zx_inflate_Struct* p_inflate);
+
+//! @brief Read the header of the next block
+//! @param *p_inflate is a pointer to zx_inflate_Struct
+static void zx_inflate_block_header(zx_inflate_Struct* p_inflate);
+
+//! @brief Put a byte into the sliding window
+//! @param *p_inflate is a pointer to zx_inflate_Struct
+//! @param value is the byte value
+static void zx_inflate_put(zx_inflate_Struct* p_inflate, uint8_t value);
+
+
+void zx_inflate_init(zx_inflate_Struct* p_inflate, zx_file_stream_Struct* stream, uint32_t length, bool zlib)
+{
+    p_inflate->stream = stream;
+    p_inflate->remaining = length;
+    p_inflate->bit_buf = 0;
+    p_inflate->bit_cnt = 0;
+    p_inflate->state = ZX_INFLATE_STATE_HEADER;
+    p_inflate->final = false;
+    p_inflate->error = false;
+    p_inflate->stored_left = 0;
+    p_inflate->match_len = 0;
+    p_inflate->match_dist = 0;
+    p_inflate->window_pos = 0;
+
+    if (zlib)
+    {
+        uint32_t cmf = zx_inflate_bits(p_inflate, 8);
+        uint32_t flg = zx_inflate_bits(p_inflate, 8);
+
+        // Only deflate without a preset dictionary is used in practice
+        if ((cmf & 0x0F) != 8 || ((cmf << 8) | flg) % 31 != 0 || (flg & 0x20) != 0)
+        {
+            p_inflate->error = true;
+        }
+    }
+}
+
+static uint32_t zx_inflate_bits(zx_inflate_Struct* p_inflate, uint8_t n)
+{
+    while (p_inflate->bit_cnt < n)
+    {
+        uint8_t data = 0;
+
+        if (p_inflate->remaining == 0 || !zx_file_stream_read_byte(p_inflate->stream, &data))
+        {
+            p_inflate->error = true;
+        }
+        else
+        {
+            p_inflate->remaining--;
+        }
+
+        p_inflate->bit_buf |= (uint32_t)data << p_inflate->bit_cnt;
+        p_inflate->bit_cnt += 8;
+    }
+
+    uint32_t value = p_inflate->bit_buf & ((1UL << n) - 1);
+    p_inflate->bit_buf >>= n;
+    p_inflate->bit_cnt -= n;
+    return value;
+}
+
+static void zx_inflate_build(zx_inflate_table_Struct* table, const uint8_t* lengths, uint16_t num)
+{
+    uint16_t offsets[ZX_INFLATE_MAX_BITS + 1];
+    uint16_t i;
+
+    for (i = 0; i <= ZX_INFLATE_MAX_BITS; i++)
+    {
+        table->counts[i] = 0;
+    }
+
+    for (i = 0; i < num; i++)
+    {
+        table->counts[lengths[i]]++;
+    }
+    table->counts[0] = 0;
+
+    offsets[1] = 0;
+    for (i = 1; i < ZX_INFLATE_MAX_BITS; i++)
+    {
+        offsets[i + 1] = offsets[i] + table->counts[i];
+    }
+
+    for (i = 0; i < num; i++)
+    {
+        if (lengths[i] != 0)
+        {
+            table->symbols[offsets[lengths[i]]++] = i;
+        }
+    }
+}
+
+static int zx_inflate_decode(zx_inflate_Struct* p_inflate, zx_inflate_table_Struct* table)
+{
+    int code = 0;
+    int first = 0;
+    int index = 0;
+
+    for (uint8_t len = 1; len <= ZX_INFLATE_MAX_BITS; len++)
+    {
+        code |= zx_inflate_bits(p_inflate, 1);
+        int count = table->counts[len];
+
+        if (code - first < count)
+        {
+            return table->symbols[index + code - first];
+        }
+
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+static bool zx_inflate_dynamic(zx_inflate_Struct* p_inflate)
+{
+    uint8_t lengths[ZX_INFLATE_LIT_CODES + ZX_INFLATE_DIST_CODES];
+    uint16_t hlit = zx_inflate_bits(p_inflate, 5) + 257;
+    uint16_t hdist = zx_inflate_bits(p_inflate, 5) + 1;
+    uint16_t hclen = zx_inflate_bits(p_inflate, 4) + 4;
+    uint16_t i;
+
+    if (hlit > ZX_INFLATE_LIT_CODES || hdist > ZX_INFLATE_DIST_CODES)
+    {
+        return false;
+    }
+
+    for (i = 0; i < ZX_INFLATE_CLEN_CODES; i++)
+    {
+        lengths[zx_inflate_clen_order[i]] = (i < hclen) ? zx_inflate_bits(p_inflate, 3) : 0;
+    }
+    zx_inflate_build(&p_inflate->lit, lengths, ZX_INFLATE_CLEN_CODES);
+
+    for (i = 0; i < hlit + hdist && !p_inflate->error; )
+    {
+        int sym = zx_inflate_decode(p_inflate, &p_inflate->lit);
+        uint8_t value = 0;
+        uint16_t repeat;
+
+        if (sym < 0)
+        {
+            return false;
+        }
+        else if (sym < 16)
+        {
+            lengths[i++] = sym;
+            continue;
+        }
+        else if (sym == 16)
+        {
+            if (i == 0) return false;
+            value = lengths[i - 1];
+            repeat = 3 + zx_inflate_bits(p_inflate, 2);
+        }
+        else if (sym == 17)
+        {
+            repeat = 3 + zx_inflate_bits(p_inflate, 3);
+        }
+        else
+        {
+            repeat = 11 + zx_inflate_bits(p_inflate, 7);
+        }
+
+        if (i + repeat > hlit + hdist)
+        {
+            return false;
+        }
+
+        while (repeat--)
+        {
+            lengths[i++] = value;
+        }
+    }
+
+    zx_inflate_build(&p_inflate->lit, lengths, hlit);
+    zx_inflate_build(&p_inflate->dist, lengths + hlit, hdist);
+    return !p_inflate->error;
+}
+
+static void zx_inflate_block_header(zx_inflate_Struct* p_inflate)
+{
+    uint8_t lengths[ZX_INFLATE_LIT_CODES];
+    uint16_t i;
+
+    if (p_inflate->final)
+    {
+        p_inflate->state = ZX_INFLATE_STATE_DONE;
+        return;
+    }
+
+    p_inflate->final = zx_inflate_bits(p_inflate, 1);
+
+    switch (zx_inflate_bits(p_inflate, 2))
+    {
+        case 0:
+        {
+            // Stored blocks start at a byte boundary
+            zx_inflate_bits(p_inflate, p_inflate->bit_cnt & 7);
+            uint16_t len = zx_inflate_bits(p_inflate, 16);
+            uint16_t nlen = zx_inflate_bits(p_inflate, 16);
+
+            if (len != (uint16_t)~nlen)
+            {
+                p_inflate->error = true;
+            }
+            p_inflate->stored_left = len;
+            p_inflate->state = ZX_INFLATE_STATE_STORED;
+            break;
+        }
+
+        case 1:
+            for (i = 0; i < 144; i++) lengths[i] = 8;
+            for (; i < 256; i++) lengths[i] = 9;
+            for (; i < 280; i++) lengths[i] = 7;
+            for (; i < ZX_INFLATE_LIT_CODES; i++) lengths[i] = 8;
+            zx_inflate_build(&p_inflate->lit, lengths, ZX_INFLATE_LIT_CODES);
+
+            for (i = 0; i < ZX_INFLATE_DIST_CODES; i++) lengths[i] = 5;
+            zx_inflate_build(&p_inflate->dist, lengths, ZX_INFLATE_DIST_CODES);
+
+            p_inflate->state = ZX_INFLATE_STATE_CODES;
+            break;
+
+        case 2:
+            if (!zx_inflate_dynamic(p_inflate))
+            {
+                p_inflate->error = true;
+            }
+            p_inflate->state = ZX_INFLATE_STATE_CODES;
+            break;
+
+        default:
+            p_inflate->error = true;
+            break;
+    }
+}
+
+static void zx_inflate_put(zx_inflate_Struct* p_inflate, uint8_t value)
+{
+    p_inflate->window[p_inflate->window_pos] = value;
+    p_inflate->window_pos = (p_inflate->window_pos + 1) & (ZX_INFLATE_WINDOW_SIZE - 1);
+}
+
+bool zx_inflate_read_byte(zx_inflate_Struct* p_inflate, uint8_t* value)
+{
+    while (!p_inflate->error)
+    {
+        if (p_inflate->match_len > 0)
+        {
+            *value = p_inflate->window[(p_inflate->window_pos - p_inflate->match_dist) & (ZX_INFLATE_WINDOW_SIZE - 1)];
+            zx_inflate_put(p_inflate, *value);
+            p_inflate->match_len--;
+            return true;
+        }
+
+        switch (p_inflate->state)
+        {
+            case ZX_INFLATE_STATE_HEADER:
+                zx_inflate_block_header(p_inflate);
+                break;
+
+            case ZX_INFLATE_STATE_STORED:
+                if (p_inflate->stored_left == 0)
+                {
+                    p_inflate->state = ZX_INFLATE_STATE_HEADER;
+                    break;
+                }
+                *value = zx_inflate_bits(p_inflate, 8);
+                zx_inflate_put(p_inflate, *value);
+                p_inflate->stored_left--;
+                return !p_inflate->error;
+
+            case ZX_INFLATE_STATE_CODES:
+            {
+                int sym = zx_inflate_decode(p_inflate, &p_inflate->lit);
+
+                if (sym < 0)
+                {
+                    p_inflate->error = true;
+                }
+                else if (sym < ZX_INFLATE_END_OF_BLOCK)
+                {
+                    *value = sym;
+                    zx_inflate_put(p_inflate, *value);
+                    return !p_inflate->error;
+                }
+                else if (sym == ZX_INFLATE_END_OF_BLOCK)
+                {
+                    p_inflate->state = ZX_INFLATE_STATE_HEADER;
+                }
+                else
+                {
+                    sym -= ZX_INFLATE_END_OF_BLOCK + 1;
+                    if (sym >= (int)sizeof(zx_inflate_length_extra))
+                    {
+                        p_inflate->error = true;
+                        break;
+                    }
+                    p_inflate->match_len = zx_inflate_length_base[sym] + zx_inflate_bits(p_inflate, zx_inflate_length_extra[sym]);
+
+                    int dist = zx_inflate_decode(p_inflate, &p_inflate->dist);
+                    if (dist < 0 || dist >= (int)sizeof(zx_inflate_dist_extra))
+                    {
+                        p_inflate->error = true;
+                        break;
+                    }
+                    p_inflate->match_dist = zx_inflate_dist_base[dist] + zx_inflate_bits(p_inflate, zx_inflate_dist_extra[dist]);
+                }
+                break;
+            }
+
+            default:
+                return false;
+        }
+    }
+    return false;
+}
+
+uint32_t zx_inflate_read(zx_inflate_Struct* p_inflate, uint8_t* dst, uint32_t cnt)
+{
+    uint32_t done = 0;
+
+    while (done < cnt && zx_inflate_read_byte(p_inflate, &dst[done]))
+    {
+        done++;
+    }
+    return done;
+}
+
+bool zx_inflate_error(zx_inflate_Struct* p_inflate)
+{
+    return p_inflate->error;
+}
@@ -0,0 +1,66 @@
+//! @file zx_inflate.h
+//! @brief Streaming decompressor of deflate (RFC 1951) and zlib (RFC 1950) data
+
+#ifndef ZX_INFLATE_H
+#define ZX_INFLATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "zx_file_stream.h"
+
+#define ZX_INFLATE_WINDOW_SIZE (0x8000U)
+#define ZX_INFLATE_MAX_BITS (15)
+#define ZX_INFLATE_LIT_CODES (288)
+#define ZX_INFLATE_DIST_CODES (32)
+
+typedef struct
+{
+    uint16_t counts[ZX_INFLATE_MAX_BITS + 1];
+    uint16_t symbols[ZX_INFLATE_LIT_CODES];
+} zx_inflate_table_Struct;
+
+typedef struct
+{
+    zx_file_stream_Struct* stream;
+    uint32_t remaining;
+    uint32_t bit_buf;
+    uint8_t bit_cnt;
+    uint8_t state;
+    bool final;
+    bool error;
+    uint16_t stored_left;
+    uint16_t match_len;
+    uint16_t match_dist;
+    uint16_t window_pos;
+    zx_inflate_table_Struct lit;
+    zx_inflate_table_Struct dist;
+    uint8_t window[ZX_INFLATE_WINDOW_SIZE];
+} zx_inflate_Struct;
+
+
+//! @brief Start decompression of a compressed stream
+//! @param *p_inflate is a pointer to zx_inflate_Struct
+//! @param *stream is a pointer to the stream positioned at the compressed data
+//! @param length is the number of compressed bytes available in the stream
+//! @param zlib is set to true if the data starts with a zlib header or false for raw deflate
+void zx_inflate_init(zx_inflate_Struct* p_inflate, zx_file_stream_Struct* stream, uint32_t length, bool zlib);
+
+//! @brief Get the next decompressed byte
+//! @param *p_inflate is a pointer to zx_inflate_Struct
+//! @param *value is a pointer to the destination byte
+//! @return true if the byte has been produced or false at the end of data or on error
+bool zx_inflate_read_byte(zx_inflate_Struct* p_inflate, uint8_t* value);
+
+//! @brief Get a number of decompressed bytes
+//! @param *p_inflate is a pointer to zx_inflate_Struct
+//! @param *dst is a pointer to the destination buffer
+//! @param cnt is the number of bytes to be produced
+//! @return the number of bytes actually produced
+uint32_t zx_inflate_read(zx_inflate_Struct* p_inflate, uint8_t* dst, uint32_t cnt);
+
+//! @brief Check whether the data has been corrupted
+//! @param *p_inflate is a pointer to zx_inflate_Struct
+//! @return true if an error has been found or false otherwise
+bool zx_inflate_error(zx_inflate_Struct* p_inflate);
+
+#endif
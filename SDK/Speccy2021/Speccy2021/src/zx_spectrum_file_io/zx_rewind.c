@@ -0,0 +1,401 @@
+/*
+ Rewind buffer
+ =============
+
+ The machine state is captured every ZX_REWIND_PERIOD_FRAMES frames into
+ a ring buffer in DDR. A keyframe holds all RAM pages, the captures after it
+ hold only the pages which have been written since the keyframe. The PL
+ keeps a dirty flag per RAM page for that. A page is stored XORed with its
+ copy taken at the keyframe and then run-length encoded, so the bytes which
+ have not changed shrink to a few zero runs.
+
+ The CPU is halted only while the registers are captured and the dirty
+ pages are copied aside, the encoding is done with the CPU running by a task
+ of the lowest priority so it never holds up USB or tape servicing.
+
+ Designed in Magictale Electronics.
+
+ Copyright (c) 2021 Dmitry Pakhomenko.
+ dmitryp@magictale.com
+ http://magictale.com
+
+ This code is in the public domain.
+*/
+
+#include "zx_rewind.h"
+
+#define ZX_REWIND_PERIOD_FRAMES 50
+#define ZX_REWIND_FRAME_MS 20
+#define ZX_REWIND_KEYFRAME_PERIOD 8
+#define ZX_REWIND_ENTRIES 64
+#define ZX_REWIND_PAGES 8
+#define ZX_REWIND_ALL_PAGES 0xFF
+#define ZX_REWIND_RLE_ZERO_FLAG 0x80
+#define ZX_REWIND_RLE_MAX_RUN 0x80
+// A page which does not compress at all grows by one byte per literal run
+#define ZX_REWIND_PAGE_MAX_SIZE (EMULATOR_PAGE_SIZE + EMULATOR_PAGE_SIZE / ZX_REWIND_RLE_MAX_RUN)
+#define ZX_REWIND_ENTRY_MAX_SIZE (ZX_REWIND_PAGES * ZX_REWIND_PAGE_MAX_SIZE)
+#define ZX_REWIND_RAM_SIZE (ZX_REWIND_PAGES * EMULATOR_PAGE_SIZE)
+// The area starts with the copy of RAM taken at the keyframe and the pages copied aside
+#define ZX_REWIND_REFERENCE ((uint8_t*)EMULATOR_REWIND_AREA_START)
+#define ZX_REWIND_STAGING ((uint8_t*)(EMULATOR_REWIND_AREA_START + ZX_REWIND_RAM_SIZE))
+#define ZX_REWIND_DATA ((uint8_t*)(EMULATOR_REWIND_AREA_START + 2 * ZX_REWIND_RAM_SIZE))
+#define ZX_REWIND_DATA_SIZE (EMULATOR_REWIND_AREA_SIZE - 2 * ZX_REWIND_RAM_SIZE)
+#define ZX_REWIND_TASK_STACK_SIZE 1024
+#define ZX_REWIND_TASK_PRIO (tskIDLE_PRIORITY + 1)
+
+//! @brief A capture stored in the ring buffer
+typedef struct
+{
+    uint32_t offset;
+    uint32_t page_size[ZX_REWIND_PAGES];
+    uint8_t pages;
+    bool keyframe;
+    zx_snapshot_state_Struct state;
+} zx_rewind_entry_Struct;
+
+static zx_rewind_entry_Struct zx_rewind_entries[ZX_REWIND_ENTRIES];
+static uint32_t zx_rewind_oldest = 0;
+static volatile uint32_t zx_rewind_count = 0;
+static uint32_t zx_rewind_write_pos = 0;
+static uint32_t zx_rewind_since_keyframe = 0;
+static bool zx_rewind_keyframe_due = true;
+static uint8_t zx_rewind_touched = 0;
+static volatile uint32_t zx_rewind_step_requests = 0;
+static TaskHandle_t zx_rewind_task_handle;
+
+//! @brief The task which captures the machine state and steps back on request
+//! @param *param is not used
+static void zx_rewind_task(void* param);
+
+//! @brief Capture the machine state into the ring buffer
+static void zx_rewind_capture(void);
+
+//! @brief Restore the newest capture and drop it from the ring buffer
+static void zx_rewind_restore(void);
+
+//! @brief Get an entry counting from the oldest one
+//! @param idx is the entry number
+//! @return a pointer to the entry
+static zx_rewind_entry_Struct* zx_rewind_entry_get(uint32_t idx);
+
+//! @brief Make room in the ring buffer for a capture of the largest possible size
+static void zx_rewind_make_room(void);
+
+//! @brief Encode a page as XOR with a reference followed by run-length encoding
+//! @param *src is a pointer to the page
+//! @param *ref is a pointer to the reference page or NULL for a keyframe
+//! @param *dst is a pointer to the destination of at least ZX_REWIND_PAGE_MAX_SIZE bytes
+//! @return the number of bytes produced
+static uint32_t zx_rewind_encode(const uint8_t* src, const uint8_t* ref, uint8_t* dst);
+
+//! @brief Decode a page encoded by zx_rewind_encode
+//! @param *src is a pointer to the encoded data
+//! @param *dst is a pointer to the page which holds the reference for a delta
+//! @param delta is true if the data is XORed with the content of dst or false for a keyframe
+static void zx_rewind_decode(const uint8_t* src, uint8_t* dst, bool delta);
+
+
+void zx_rewind_init()
+{
+    xTaskCreate(zx_rewind_task, "rewind_task", ZX_REWIND_TASK_STACK_SIZE, NULL, ZX_REWIND_TASK_PRIO, &zx_rewind_task_handle);
+}
+
+void zx_rewind_pages_touched(uint8_t pages)
+{
+    taskENTER_CRITICAL();
+    zx_rewind_touched |= pages;
+    taskEXIT_CRITICAL();
+}
+
+void zx_rewind_step_back()
+{
+    taskENTER_CRITICAL();
+    zx_rewind_step_requests++;
+    taskEXIT_CRITICAL();
+
+    zynq_task_stats_signal(ZYNQ_TASK_STATS_REWIND);
+    xTaskNotifyGive(zx_rewind_task_handle);
+}
+
+uint32_t zx_rewind_depth_get()
+{
+    return zx_rewind_count;
+}
+
+bool zx_rewind_hid_keycode_handle(uint8_t keycode)
+{
+    bool res = false;
+    if (ZX_REWIND_KEY == keycode)
+    {
+        zx_rewind_step_back();
+        res = true;
+    }
+    return res;
+}
+
+static zx_rewind_entry_Struct* zx_rewind_entry_get(uint32_t idx)
+{
+    return &zx_rewind_entries[(zx_rewind_oldest + idx) % ZX_REWIND_ENTRIES];
+}
+
+static void zx_rewind_task(void* param)
+{
+    TickType_t next = xTaskGetTickCount() + pdMS_TO_TICKS(ZX_REWIND_PERIOD_FRAMES * ZX_REWIND_FRAME_MS);
+
+    while (true)
+    {
+        TickType_t now = xTaskGetTickCount();
+        ulTaskNotifyTake(pdTRUE, ((int32_t)(next - now) > 0) ? (next - now) : 0);
+
+        if (zx_rewind_step_requests > 0)
+        {
+            taskENTER_CRITICAL();
+            zx_rewind_step_requests--;
+            taskEXIT_CRITICAL();
+
+            zynq_task_stats_begin(ZYNQ_TASK_STATS_REWIND);
+            zx_rewind_restore();
+            zynq_task_stats_end(ZYNQ_TASK_STATS_REWIND);
+
+            // Give the user a full period before the restored state gets captured again
+            next = xTaskGetTickCount() + pdMS_TO_TICKS(ZX_REWIND_PERIOD_FRAMES * ZX_REWIND_FRAME_MS);
+            if (zx_rewind_step_requests > 0)
+            {
+                xTaskNotifyGive(zx_rewind_task_handle);
+            }
+        }
+        else if ((int32_t)(xTaskGetTickCount() - next) >= 0)
+        {
+            zynq_task_stats_begin(ZYNQ_TASK_STATS_REWIND);
+            zx_rewind_capture();
+            zynq_task_stats_end(ZYNQ_TASK_STATS_REWIND);
+
+            next += pdMS_TO_TICKS(ZX_REWIND_PERIOD_FRAMES * ZX_REWIND_FRAME_MS);
+        }
+    }
+}
+
+static void zx_rewind_make_room()
+{
+    if (zx_rewind_write_pos + ZX_REWIND_ENTRY_MAX_SIZE > ZX_REWIND_DATA_SIZE)
+    {
+        zx_rewind_write_pos = 0;
+    }
+
+    // Drop the oldest captures which are in the way and then the deltas
+    // which have lost their keyframe
+    while (zx_rewind_count > 0)
+    {
+        zx_rewind_entry_Struct* p_entry = zx_rewind_entry_get(0);
+        bool overlaps = p_entry->offset < zx_rewind_write_pos + ZX_REWIND_ENTRY_MAX_SIZE &&
+            zx_rewind_write_pos < p_entry->offset + ZX_REWIND_ENTRY_MAX_SIZE;
+
+        if (!overlaps && zx_rewind_count < ZX_REWIND_ENTRIES)
+        {
+            break;
+        }
+
+        do
+        {
+            zx_rewind_oldest = (zx_rewind_oldest + 1) % ZX_REWIND_ENTRIES;
+            zx_rewind_count--;
+        } while (zx_rewind_count > 0 && !zx_rewind_entry_get(0)->keyframe);
+    }
+
+    if (zx_rewind_count == 0)
+    {
+        zx_rewind_keyframe_due = true;
+    }
+}
+
+static void zx_rewind_capture()
+{
+    reg_ZX_Ram_dirty_Struct dirty;
+    uint8_t touched;
+    uint8_t page;
+
+    zx_tape_lock();
+    if (zx_cpu_stopped())
+    {
+        zx_tape_unlock();
+        return;
+    }
+
+    zx_rewind_make_room();
+    zx_rewind_entry_Struct* p_entry = zx_rewind_entry_get(zx_rewind_count);
+    p_entry->keyframe = zx_rewind_keyframe_due || zx_rewind_since_keyframe >= ZX_REWIND_KEYFRAME_PERIOD;
+
+    zx_snapshot_state_capture(&p_entry->state);
+
+    // Both masks are only cleared at a keyframe so they cover everything since then
+    taskENTER_CRITICAL();
+    touched = zx_rewind_touched;
+    if (p_entry->keyframe)
+    {
+        zx_rewind_touched = 0;
+    }
+    taskEXIT_CRITICAL();
+
+    zx_ram_dirty_reg_read(&dirty);
+    p_entry->pages = p_entry->keyframe ? ZX_REWIND_ALL_PAGES : (dirty.bits.pages | touched);
+    if (p_entry->keyframe)
+    {
+        dirty.u32 = 0;
+        dirty.bits.pages = ZX_REWIND_ALL_PAGES;
+        zx_ram_dirty_reg_write(&dirty);
+    }
+
+    for (page = 0; page < ZX_REWIND_PAGES; page++)
+    {
+        if ((p_entry->pages & (1 << page)) != 0)
+        {
+            zx_memory_page_read(page, ZX_REWIND_STAGING + page * EMULATOR_PAGE_SIZE);
+        }
+    }
+
+    zx_cpu_regs_restore(p_entry->state.header, p_entry->state.pc, p_entry->state.istate);
+    zx_tape_unlock();
+
+    // Only this task touches the buffer so the rest goes on with the CPU running
+    uint32_t pos = zx_rewind_write_pos;
+    p_entry->offset = pos;
+    for (page = 0; page < ZX_REWIND_PAGES; page++)
+    {
+        p_entry->page_size[page] = 0;
+        if ((p_entry->pages & (1 << page)) != 0)
+        {
+            const uint8_t* src = ZX_REWIND_STAGING + page * EMULATOR_PAGE_SIZE;
+            const uint8_t* ref = p_entry->keyframe ? NULL : ZX_REWIND_REFERENCE + page * EMULATOR_PAGE_SIZE;
+
+            p_entry->page_size[page] = zx_rewind_encode(src, ref, ZX_REWIND_DATA + pos);
+            pos += p_entry->page_size[page];
+        }
+    }
+
+    if (p_entry->keyframe)
+    {
+        memcpy(ZX_REWIND_REFERENCE, ZX_REWIND_STAGING, ZX_REWIND_RAM_SIZE);
+        zx_rewind_since_keyframe = 0;
+        zx_rewind_keyframe_due = false;
+    }
+    zx_rewind_since_keyframe++;
+
+    zx_rewind_write_pos = pos;
+    zx_rewind_count++;
+}
+
+static void zx_rewind_restore()
+{
+    uint32_t ram = EMULATOR_MEMORY_AREA_START | (EMULATOR_ROM_PAGES_COUNT << EMULATOR_PAGE_LEFT_SHIFT_BITS);
+    uint32_t key_idx;
+    uint8_t page;
+
+    if (zx_rewind_count == 0)
+    {
+        return;
+    }
+
+    zx_rewind_entry_Struct* p_entry = zx_rewind_entry_get(zx_rewind_count - 1);
+
+    // The oldest entry is always a keyframe so the search stops there at the latest
+    for (key_idx = zx_rewind_count - 1; key_idx > 0 && !zx_rewind_entry_get(key_idx)->keyframe; key_idx--);
+    zx_rewind_entry_Struct* p_key = zx_rewind_entry_get(key_idx);
+
+    zx_tape_lock();
+    zx_snapshot_state_prepare(&p_entry->state);
+
+    const uint8_t* src = ZX_REWIND_DATA + p_key->offset;
+    for (page = 0; page < ZX_REWIND_PAGES; page++)
+    {
+        zx_rewind_decode(src, (uint8_t*)(ram + page * EMULATOR_PAGE_SIZE), false);
+        src += p_key->page_size[page];
+    }
+
+    if (p_entry != p_key)
+    {
+        src = ZX_REWIND_DATA + p_entry->offset;
+        for (page = 0; page < ZX_REWIND_PAGES; page++)
+        {
+            if ((p_entry->pages & (1 << page)) != 0)
+            {
+                zx_rewind_decode(src, (uint8_t*)(ram + page * EMULATOR_PAGE_SIZE), true);
+                src += p_entry->page_size[page];
+            }
+        }
+    }
+    Xil_DCacheFlushRange(ram, ZX_REWIND_RAM_SIZE);
+
+    zx_cpu_modify_pc(p_entry->state.pc, p_entry->state.istate);
+    zx_tape_unlock();
+
+    // The restored capture is dropped so the next step goes further back,
+    // the reference no longer matches RAM so a keyframe has to follow
+    zx_rewind_write_pos = p_entry->offset;
+    zx_rewind_count--;
+    zx_rewind_keyframe_due = true;
+}
+
+static uint32_t zx_rewind_encode(const uint8_t* src, const uint8_t* ref, uint8_t* dst)
+{
+    uint32_t in = 0;
+    uint32_t out = 0;
+    uint32_t run;
+
+    while (in < EMULATOR_PAGE_SIZE)
+    {
+        for (run = 0; in + run < EMULATOR_PAGE_SIZE && run < ZX_REWIND_RLE_MAX_RUN; run++)
+        {
+            if ((src[in + run] ^ (ref != NULL ? ref[in + run] : 0)) != 0) break;
+        }
+
+        if (run > 0)
+        {
+            dst[out++] = ZX_REWIND_RLE_ZERO_FLAG | (run - 1);
+            in += run;
+            continue;
+        }
+
+        // Literals go on until two unchanged bytes in a row start a zero run
+        uint32_t ctrl = out++;
+        for (run = 0; in + run < EMULATOR_PAGE_SIZE && run < ZX_REWIND_RLE_MAX_RUN; run++)
+        {
+            uint8_t value = src[in + run] ^ (ref != NULL ? ref[in + run] : 0);
+            if (value == 0 && in + run + 1 < EMULATOR_PAGE_SIZE &&
+                (src[in + run + 1] ^ (ref != NULL ? ref[in + run + 1] : 0)) == 0)
+            {
+                break;
+            }
+            dst[out++] = value;
+        }
+        dst[ctrl] = run - 1;
+        in += run;
+    }
+    return out;
+}
+
+static void zx_rewind_decode(const uint8_t* src, uint8_t* dst, bool delta)
+{
+    uint32_t out = 0;
+
+    while (out < EMULATOR_PAGE_SIZE)
+    {
+        uint8_t ctrl = *src++;
+        uint32_t run = (ctrl & ~ZX_REWIND_RLE_ZERO_FLAG) + 1;
+
+        if ((ctrl & ZX_REWIND_RLE_ZERO_FLAG) != 0)
+        {
+            // XOR with zero leaves a delta untouched
+            if (!delta) memset(dst + out, 0, run);
+        }
+        else
+        {
+            for (uint32_t i = 0; i < run; i++)
+            {
+                dst[out + i] = delta ? (dst[out + i] ^ src[i]) : src[i];
+            }
+            src += run;
+        }
+        out += run;
+    }
+}
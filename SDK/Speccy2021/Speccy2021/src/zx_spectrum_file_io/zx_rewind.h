@@ -0,0 +1,40 @@
+//! @file zx_rewind.h
+//! @brief Rewind buffer of periodic machine snapshots kept in DDR
+
+#ifndef ZX_REWIND_H
+#define ZX_REWIND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include "zx_snapshot.h"
+#include "zx_tape.h"
+#include "../zx_spectrum_io/zx_config.h"
+#include "../zx_spectrum_video/zx_spectrum_display_ctrl.h"
+#include "../zynq_misc/task_stats/zynq_task_stats.h"
+#include "../zynq_usb/tinyusb/class/hid/hid.h"
+
+#define ZX_REWIND_KEY (HID_KEY_F9)
+
+//! @brief Create the task which captures the machine state in the background
+void zx_rewind_init(void);
+
+//! @brief Note RAM pages written behind the back of the CPU so that
+//!   the next capture does not take them as unchanged
+//! @param pages is a bit mask of RAM pages
+void zx_rewind_pages_touched(uint8_t pages);
+
+//! @brief Request to go one capture back in time, the state is restored by the rewind task
+void zx_rewind_step_back(void);
+
+//! @brief Get the number of captures which can be stepped back to
+//! @return the number of captures in the buffer
+uint32_t zx_rewind_depth_get(void);
+
+//! @brief Handle keyboard events
+//! @return true if the even has been consumed false otherwise
+bool zx_rewind_hid_keycode_handle(uint8_t keycode);
+
+#endif
@@ -26,31 +26,32 @@
 #define ZX_SHELL_FILES_PER_ROW (18)
 #define ZX_SHELL_FILES_PER_COLUMN (2)
 #define ZX_SHELL_PATH_SIZE (0x80)
-#define ZX_SHELL_FILES_PER_DIR (10000U)
-
-typedef struct
-{
-    uint32_t size;
-    uint8_t attr;
-    uint8_t sel;
-    uint16_t date;
-    uint16_t time;
-    char name[FF_MAX_LFN + 1];
-} zx_shell_file_record_Struct;
+#define ZX_SHELL_SNAPSHOT_SLOTS (1000U)
+#define ZX_SHELL_CACHE_STATS_COLUMN (21)
+#define ZX_SHELL_LOAD_CHUNK (32)
 
 static const uint8_t* zx_shell_char_table[ZX_FONT_LAST_ENTRY] = {zx_font1, zx_font2, zx_font3};
 static zx_font_Enum zx_shell_current_font = ZX_FONT1;
 static bool zx_shell_active = false;
-static zx_shell_file_record_Struct zx_shell_files[ZX_SHELL_FILES_PER_DIR];
 static int zx_shell_sel_files;
 static int zx_shell_sel_file_number = 0;
 static char zx_shell_path[ZX_SHELL_PATH_SIZE] = "";
-static zx_shell_file_record_Struct* zx_shell_p_curr_record;
 static int zx_shell_total_files = 0;
 static bool zx_shell_too_many_files;
 static uint32_t zx_shell_file_table_start;
 static char zx_shell_file_last_name[FF_MAX_LFN + 1] = "";
 static uint8_t selx = 0, sely = 0;
+static bool zx_shell_tape_view = false;
+static int zx_shell_tape_sel = 0;
+static int zx_shell_tape_table_start = 0;
+static bool zx_shell_stats_view = false;
+static uint8_t zx_shell_sort_order = ZX_DIR_LIST_ORDER_NAME;
+static DIR zx_shell_dir;
+static zx_dir_cache_stamp_Struct zx_shell_dir_stamp;
+static bool zx_shell_loading = false;
+static bool zx_shell_sel_moved = false;
+static char zx_shell_filter[ZX_DIR_LIST_PATTERN_SIZE] = "";
+static const char* zx_shell_sort_names[ZX_DIR_LIST_ORDER_LAST_ENTRY] = {"name", "extension", "size", "date"};
 
 //! @brief Clear screen and fill it with a given color attribute
 //! @param attr is the color attribure to fill with
@@ -95,61 +96,65 @@ static void zx_shell_write_str(uint8_t x, uint8_t y, const char *str, size_t siz
 //! @param size is the number of characters to be drawn
 static void zx_shell_write_str_attr(uint8_t x, uint8_t y, const char *str, uint8_t attr, uint8_t size);
 
-//! @brief Low level function which manipulates file entries in two lists. Used for sorting
-//! @param *p_fr is the destination
-//! @param *p_file_table is the source
-//! @param pos is the number of elements by which *p_file_table gets incremented 
-static bool zx_shell_read(zx_shell_file_record_Struct* p_fr, zx_shell_file_record_Struct* p_file_table, uint32_t pos);
+//! @brief Sort the listing in the next order keeping the same file selected
+static void zx_shell_sort_next(void);
 
-//! @brief Low level function which manipulates file entries in two lists. Used for sorting
-//! @param *p_fr is the source
-//! @param *p_file_table is the destination
-//! @param pos is the number of elements by which *p_file_table gets incremented 
-static bool zx_shell_write(zx_shell_file_record_Struct* p_fr, zx_shell_file_record_Struct* p_file_table, uint32_t pos);
-
-//! @brief Read the current folder and fill the shell panel with list of files
+//! @brief Start reading the current folder, the first page of files is read at once
 static void zx_shell_read_dir(void);
 
-//! @brief A top level function which initialises the shell, reads the current folder and
-//!   highlights currently selected file
-static void zx_shell_browser(void);
+//! @brief Get the position of the first file to be sorted
+//! @return 1 if the parent folder is on top or 0 otherwise
+static uint32_t zx_shell_first_file(void);
 
+//! @brief Read more files of the current folder, sort and cache the listing once it has been read to the end
+//! @param count is the number of files to be read
+//! @return true if the folder has been read to the end or false if there is more to read
+static bool zx_shell_read_dir_step(uint32_t count);
 
-static bool zx_shell_read(zx_shell_file_record_Struct* p_fr, zx_shell_file_record_Struct* p_file_table, uint32_t pos)
-{
-    if (p_file_table == 0)
-    {
-        return false;
-    }
+//! @brief Sort the listing keeping the same file selected
+static void zx_shell_sort_keep_sel(void);
 
-    if (pos >= ZX_SHELL_FILES_PER_DIR)
-    {
-        return false;
-    }
+//! @brief Select the file remembered by name unless the selection has been moved by the user
+static void zx_shell_sel_last_name(void);
 
-    p_file_table += pos;
+//! @brief Select a file by the offset of its name
+//! @param name_offset is the offset of the name in the arena
+//! @return true if the file is shown and has been selected or false otherwise
+static bool zx_shell_sel_find(uint32_t name_offset);
 
-    memcpy(p_fr, p_file_table, sizeof(zx_shell_files[0]));
-    return true;
-}
+//! @brief Get the character a key adds to the type-ahead search
+//! @param keycode is a HID keycode
+//! @return the character or 0 if the key does not add one
+static char zx_shell_filter_char(uint8_t keycode);
 
-static bool zx_shell_write(zx_shell_file_record_Struct* p_fr, zx_shell_file_record_Struct* p_file_table, uint32_t pos)
-{
-    if (p_file_table == 0)
-    {
-        return false;
-    }
+//! @brief Extend, shorten or clear the type-ahead search and show the matching files
+//! @param keycode is a HID keycode: a character, backspace or escape
+static void zx_shell_filter_update(uint8_t keycode);
 
-    if (pos >= ZX_SHELL_FILES_PER_DIR)
-    {
-        return false;
-    }
+//! @brief A top level function which initialises the shell, reads the current folder and
+//!   highlights currently selected file
+static void zx_shell_browser(void);
 
-    p_file_table += pos;
+//! @brief Draw the block list of the selected tape in place of the file panel
+static void zx_shell_show_tape(void);
+
+//! @brief Handle keyboard events while the block list of the tape is shown
+//! @param keycode is a HID keycode
+//! @return true if the event has been consumed or false otherwise
+static bool zx_shell_tape_keycode_handle(uint8_t keycode);
+
+//! @brief Draw CPU load and latency statistics of the tasks in place of the file panel
+static void zx_shell_show_stats(void);
+
+//! @brief Handle keyboard events while the task statistics are shown
+//! @param keycode is a HID keycode
+//! @return true if the event has been consumed or false otherwise
+static bool zx_shell_stats_keycode_handle(uint8_t keycode);
+
+//! @brief Save the machine state into the current directory under the first free name
+//! @param *ext is a pointer to the file extension which selects the format
+static void zx_shell_snapshot_save(const char* ext);
 
-    memcpy(p_file_table, p_fr, sizeof(zx_shell_files[0]));
-    return true;
-}
 
 static void zx_shell_cycle_mark()
 {
@@ -160,127 +165,154 @@ static void zx_shell_cycle_mark()
     mark = (mark + 1) & 3;
 }
 
-uint8_t zx_shell_comp_name(int a, int b)
-{
-    zx_shell_file_record_Struct ra, rb;
-    zx_shell_read(&ra, zx_shell_files, a);
-    zx_shell_read(&rb, zx_shell_files, b);
-
-    strlwr(ra.name);
-    strlwr(rb.name);
-
-    if ((ra.attr & AM_DIR) && !(rb.attr & AM_DIR)) return true;
-    else if (!(ra.attr & AM_DIR) && (rb.attr & AM_DIR)) return false;
-    else return strcmp(ra.name, rb.name) <= 0;
-}
-
-void zx_shell_swap_name(int a, int b)
-{
-    zx_shell_file_record_Struct ra, rb;
-    zx_shell_read(&ra, zx_shell_files, a);
-    zx_shell_read(&rb, zx_shell_files, b);
-
-    zx_shell_write(&ra, zx_shell_files, b);
-    zx_shell_write(&rb, zx_shell_files, a);
-}
-
-void zx_shell_qsort(int l, int h)
-{
-    int i = l;
-    int j = h;
-    int k = (l + h) / 2;
-
-    while (true)
-    {
-        while (i < k && zx_shell_comp_name(i, k)) i++;
-        while (j > k && zx_shell_comp_name(k, j)) j--;
-
-        if (i == j) break;
-        zx_shell_swap_name(i, j);
-
-        if (i == k) k = j;
-        else if (j == k) k = i;
-    }
-
-    if (l < k - 1) zx_shell_qsort(l, k - 1);
-    if (k + 1 < h) zx_shell_qsort(k + 1, h);
-}
-
 static void zx_shell_read_dir()
 {
     zx_shell_total_files = 0;
     zx_shell_too_many_files = false;
     zx_shell_file_table_start = 0;
-    zx_shell_p_curr_record = &zx_shell_files[0];
     zx_shell_sel_files = 0;
     zx_shell_sel_file_number = 0;
+    zx_shell_sel_moved = false;
+    zx_shell_loading = false;
+    zx_shell_filter[0] = 0;
 
-    zx_shell_file_record_Struct fr;
-
-    if (strlen(zx_shell_path) != 0)
-    {
-        fr.attr = AM_DIR;
-        fr.sel = 0;
-        fr.size = 0;
-        strcpy(fr.name, "..");
-        zx_shell_write(&fr, zx_shell_p_curr_record, zx_shell_total_files++);
-    }
-
-    DIR dir;
+    uint8_t order;
     FRESULT r;
 
     int path_size = strlen(zx_shell_path);
     if (path_size > 0) zx_shell_path[path_size - 1] = 0;
 
-    r = f_opendir(&dir, zx_shell_path);
+    r = f_opendir(&zx_shell_dir, zx_shell_path);
     if (path_size > 0)
     {
         zx_shell_path[path_size - 1] = '/';
     }
 
-    while (r == FR_OK)
+    if (r == FR_OK && zx_dir_cache_find(&zx_shell_dir, zx_shell_path, &zx_shell_dir_stamp, &order))
+    {
+        zx_shell_total_files = zx_dir_list_view_count();
+        if (order != zx_shell_sort_order) zx_dir_list_sort(zx_shell_first_file(), zx_shell_sort_order);
+    }
+    else
+    {
+        zx_dir_list_clear();
+
+        // The parent folder stays on top
+        if (zx_shell_first_file() != 0)
+        {
+            zx_dir_list_add("..", AM_DIR, 0, 0, 0);
+            zx_shell_total_files++;
+        }
+
+        // The first page is shown at once, the rest is read between keyboard events
+        zx_shell_loading = r == FR_OK;
+        if (zx_shell_loading && !zx_shell_read_dir_step(ZX_SHELL_FILES_PER_ROW * 2))
+        {
+            zx_dir_list_sort(zx_shell_first_file(), zx_shell_sort_order);
+        }
+    }
+
+    zx_shell_sel_last_name();
+}
+
+static uint32_t zx_shell_first_file()
+{
+    return strlen(zx_shell_path) != 0 ? 1 : 0;
+}
+
+static bool zx_shell_read_dir_step(uint32_t count)
+{
+    FRESULT r = FR_OK;
+
+    while (true)
     {
+        if (count == 0)
+        {
+            return false;
+        }
+
         FILINFO fi;
-        r = f_readdir(&dir, &fi);
+        r = f_readdir(&zx_shell_dir, &fi);
 
         if (r != FR_OK || fi.fname[0] == 0) break;
         if (fi.fattrib & ( AM_HID | AM_SYS )) continue;
 
-        if (zx_shell_total_files >= ZX_SHELL_FILES_PER_DIR)
+        if (!zx_dir_list_add(fi.fname, fi.fattrib, fi.fsize, fi.fdate, fi.ftime))
         {
             zx_shell_too_many_files = true;
-
-            if (strlen(zx_shell_path) != 0) zx_shell_total_files = 1;
-            else zx_shell_total_files = 0;
-
+            zx_shell_filter[0] = 0;
+            zx_dir_list_filter(zx_shell_filter);
+            zx_shell_total_files = zx_shell_first_file();
             break;
         }
 
-        fr.sel = 0;
-        fr.attr = fi.fattrib;
-        fr.size = fi.fsize;
-        fr.date = fi.fdate;
-        fr.time = fi.ftime;
-        strcpy(fr.name , fi.fname);
+        // A file which does not match the search is not shown
+        zx_shell_total_files = zx_dir_list_view_count();
+        count--;
+    }
+
+    zx_shell_loading = false;
 
-        zx_shell_write(&fr, zx_shell_p_curr_record, zx_shell_total_files);
-        zx_shell_total_files++;
-        if ((zx_shell_total_files & 0x3f) == 0) zx_shell_cycle_mark();
+    // Only a folder which has been read to the end is worth keeping
+    if (r == FR_OK && !zx_shell_too_many_files)
+    {
+        zx_shell_sort_keep_sel();
+        zx_dir_cache_store(zx_shell_path, &zx_shell_dir_stamp, zx_shell_sort_order);
+        zx_shell_sel_last_name();
     }
+    return true;
+}
 
-    if (zx_shell_total_files > 0 && zx_shell_total_files < 0x100) zx_shell_qsort(0, zx_shell_total_files - 1);
+static void zx_shell_sort_keep_sel()
+{
+    const zx_dir_list_entry_Struct* p_entry = zx_dir_list_view_entry(zx_shell_sel_files);
+    uint32_t selected = p_entry != NULL ? p_entry->name_offset : 0;
+
+    zx_dir_list_sort(zx_shell_first_file(), zx_shell_sort_order);
 
-    if (strlen(zx_shell_file_last_name) != 0)
+    if (p_entry != NULL)
     {
-        zx_shell_file_record_Struct fr;
-        for (int i = 0; i < zx_shell_total_files; i++)
+        zx_shell_sel_find(selected);
+    }
+}
+
+static bool zx_shell_sel_find(uint32_t name_offset)
+{
+    // Names do not move, so a file is found again by its name offset
+    for (int i = 0; i < zx_shell_total_files; i++)
+    {
+        if (zx_dir_list_view_entry(i)->name_offset == name_offset)
         {
-            zx_shell_read(&fr, zx_shell_files, i);
-            if (strcmp(fr.name, zx_shell_file_last_name) == 0)
-            {
-                zx_shell_sel_files = i;
-                break;
-            }
+            zx_shell_sel_files = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static char zx_shell_filter_char(uint8_t keycode)
+{
+    if (keycode >= HID_KEY_A && keycode <= HID_KEY_Z) return 'a' + (keycode - HID_KEY_A);
+    else if (keycode >= HID_KEY_1 && keycode <= HID_KEY_9) return '1' + (keycode - HID_KEY_1);
+    else if (keycode == HID_KEY_0) return '0';
+    else if (keycode == HID_KEY_PERIOD) return '.';
+    else if (keycode == HID_KEY_SPACE) return ' ';
+    return 0;
+}
+
+static void zx_shell_sel_last_name()
+{
+    if (zx_shell_sel_moved || strlen(zx_shell_file_last_name) == 0)
+    {
+        return;
+    }
+
+    for (int i = 0; i < zx_shell_total_files; i++)
+    {
+        if (strcmp(zx_dir_list_name(zx_dir_list_view_entry(i)), zx_shell_file_last_name) == 0)
+        {
+            zx_shell_sel_files = i;
+            break;
         }
     }
 }
@@ -411,24 +443,18 @@ static void zx_shell_write_str_attr(uint8_t x, uint8_t y, const char *str, uint8
     zx_shell_write_attr(x, y, attr, size);
 }
 
-uint8_t zx_shell_get_sel_attr(zx_shell_file_record_Struct* fr)
+uint8_t zx_shell_get_sel_attr(const zx_dir_list_entry_Struct* fr)
 {
     uint8_t result = 007;
 
     if ((fr->attr & AM_DIR) == 0)
     {
-        strlwr(fr->name);
+        const char *ext = zx_dir_list_name_ext(zx_dir_list_name(fr));
 
-        char *ext = fr->name + strlen(fr->name);
-        while (ext > fr->name && *ext != '.')
-        {
-            ext--;
-        }
-
-        if ( strcmp( ext, ".trd" ) == 0 || strcmp( ext, ".fdi" ) == 0 || strcmp( ext, ".scl" ) == 0 ) result = 006;
-        else if ( strcmp( ext, ".tap" ) == 0 || strcmp( ext, ".tzx" ) == 0 ) result = 004;
-        else if ( strcmp( ext, ".sna" ) == 0 ) result = 0103;
-        else if ( strcmp( ext, ".scr" ) == 0 ) result = 0102;
+        if ( strcasecmp( ext, ".trd" ) == 0 || strcasecmp( ext, ".fdi" ) == 0 || strcasecmp( ext, ".scl" ) == 0 ) result = 006;
+        else if ( strcasecmp( ext, ".tap" ) == 0 || strcasecmp( ext, ".tzx" ) == 0 || strcasecmp( ext, ".pzx" ) == 0 || strcasecmp( ext, ".csw" ) == 0 ) result = 004;
+        else if ( strcasecmp( ext, ".sna" ) == 0 || strcasecmp( ext, ".z80" ) == 0 || strcasecmp( ext, ".szx" ) == 0 ) result = 0103;
+        else if ( strcasecmp( ext, ".scr" ) == 0 ) result = 0102;
         else result = 005;
     }
 
@@ -478,9 +504,16 @@ void zx_shell_display_path(char *str, int col, int row, uint8_t max_sz)
 
 void zx_shell_show_table()
 {
-    zx_shell_display_path(zx_shell_path, 0, ZX_SHELL_FILES_PER_ROW + 3, 32);
-
-    zx_shell_file_record_Struct fr;
+    if (zx_shell_filter[0] != 0)
+    {
+        char str[ZX_SHELL_TOTAL_CHAR_COLUMNS + 1];
+        sniprintf(str, sizeof(str), "find: %s", zx_shell_filter);
+        zx_shell_write_str(0, ZX_SHELL_FILES_PER_ROW + 3, str, ZX_SHELL_TOTAL_CHAR_COLUMNS);
+    }
+    else
+    {
+        zx_shell_display_path(zx_shell_path, 0, ZX_SHELL_FILES_PER_ROW + 3, 32);
+    }
 
     for (int i = 0; i < ZX_SHELL_FILES_PER_ROW; i++)
     {
@@ -490,16 +523,16 @@ void zx_shell_show_table()
             int row = i + 2;
             int pos = i + j * ZX_SHELL_FILES_PER_ROW + zx_shell_file_table_start;
 
-            zx_shell_read(&fr, zx_shell_files, pos);
-
-            char sname[16];
-            zx_shell_make_short_name(sname, sizeof( sname ), fr.name);
-
             if (pos < zx_shell_total_files)
             {
-                zx_shell_write_attr(col, row, zx_shell_get_sel_attr(&fr), 16);
+                const zx_dir_list_entry_Struct* fr = zx_dir_list_view_entry(pos);
+
+                char sname[16];
+                zx_shell_make_short_name(sname, sizeof( sname ), zx_dir_list_name(fr));
 
-                if (fr.sel) zx_shell_write_char(col, row, 0x95, zx_shell_current_font);
+                zx_shell_write_attr(col, row, zx_shell_get_sel_attr(fr), 16);
+
+                if (fr->sel) zx_shell_write_char(col, row, 0x95, zx_shell_current_font);
                 else zx_shell_write_char(col, row, ' ', zx_shell_current_font);
 
                 zx_shell_write_str(col + 1, row, sname, 15);
@@ -514,8 +547,13 @@ void zx_shell_show_table()
 
     if (zx_shell_too_many_files)
     {
-        zx_shell_write_str(3, 5, "too many files (>9999) !", 0);
-        zx_shell_write_attr(3, 5, 0102, 24);
+        zx_shell_write_str(8, 5, "too many files !", 0);
+        zx_shell_write_attr(8, 5, 0102, 16);
+    }
+    else if (zx_shell_total_files == 0 && zx_shell_filter[0] != 0)
+    {
+        zx_shell_write_str(9, 5, "no matches !", 0);
+        zx_shell_write_attr(9, 5, 0102, 12);
     }
     else if (zx_shell_total_files == 0)
     {
@@ -553,14 +591,13 @@ bool zx_shell_calc_sel()
 
 void zx_shell_hide_sel()
 {
-    zx_shell_file_record_Struct fr;
-    zx_shell_read(&fr, zx_shell_files, zx_shell_sel_files);
-
     if (zx_shell_total_files != 0)
     {
-        zx_shell_write_attr(selx * 16, 2 + sely, zx_shell_get_sel_attr(&fr), 16);
+        const zx_dir_list_entry_Struct* fr = zx_dir_list_view_entry(zx_shell_sel_files);
+
+        zx_shell_write_attr(selx * 16, 2 + sely, zx_shell_get_sel_attr(fr), 16);
 
-        if (fr.sel) zx_shell_write_char(selx * 16, 2 + sely, 0x95, zx_shell_current_font);
+        if (fr->sel) zx_shell_write_char(selx * 16, 2 + sely, 0x95, zx_shell_current_font);
         else zx_shell_write_char(selx * 16, 2 + sely, ' ', zx_shell_current_font);
     }
 
@@ -574,17 +611,24 @@ void zx_shell_show_sel(bool redraw)
 
     if (zx_shell_total_files != 0)
     {
-        zx_shell_file_record_Struct fr;
-        zx_shell_read(&fr, zx_shell_files, zx_shell_sel_files);
+        const zx_dir_list_entry_Struct* fr = zx_dir_list_view_entry(zx_shell_sel_files);
 
         zx_shell_write_attr(selx * 16, 2 + sely, 071, 16);
 
-        if (fr.sel) zx_shell_write_char(selx * 16, 2 + sely, 0x95, zx_shell_current_font);
+        if (fr->sel) zx_shell_write_char(selx * 16, 2 + sely, 0x95, zx_shell_current_font);
         else zx_shell_write_char(selx * 16, 2 + sely, ' ', zx_shell_current_font);
 
         char sname[ZX_SHELL_PATH_SIZE];
-        zx_shell_make_short_name(sname, 33, fr.name);
-        zx_shell_write_str(0, ZX_SHELL_FILES_PER_ROW + 4, sname, 32);
+        zx_shell_make_short_name(sname, ZX_SHELL_CACHE_STATS_COLUMN + 1, zx_dir_list_name(fr));
+        zx_shell_write_str(0, ZX_SHELL_FILES_PER_ROW + 4, sname, ZX_SHELL_CACHE_STATS_COLUMN);
+
+        // Hits and misses of the content cache share the line with the name
+        uint32_t hits, misses;
+        char stats[ZX_SHELL_TOTAL_CHAR_COLUMNS];
+        zx_content_cache_stats_get(&hits, &misses);
+        sniprintf(stats, sizeof(stats), "H%lu M%lu", hits, misses);
+        sniprintf(sname, sizeof(sname), "%*s", ZX_SHELL_TOTAL_CHAR_COLUMNS - ZX_SHELL_CACHE_STATS_COLUMN, stats);
+        zx_shell_write_str(ZX_SHELL_CACHE_STATS_COLUMN, ZX_SHELL_FILES_PER_ROW + 4, sname, ZX_SHELL_TOTAL_CHAR_COLUMNS - ZX_SHELL_CACHE_STATS_COLUMN);
 
         if (zx_shell_sel_file_number > 0)
         {
@@ -593,24 +637,24 @@ void zx_shell_show_sel(bool redraw)
         }
         else
         {
-            if (fr.date == 0)
+            if (fr->date == 0)
             {
                 zx_shell_write_str(0, ZX_SHELL_FILES_PER_ROW + 5, "", 15);
             }
             else
             {
-                sniprintf(sname, sizeof(sname), "%.2u.%.2u.%.2u  %.2u:%.2u", fr.date & 0x1f,
-                                                                            ( fr.date >> 5 ) & 0x0f,
-                                                                            ( 80 + ( fr.date >> 9 ) ) % 100,
-                                                                            (fr.time >> 11 ) & 0x1f,
-                                                                            (fr.time >> 5 ) & 0x3f);
+                sniprintf(sname, sizeof(sname), "%.2u.%.2u.%.2u  %.2u:%.2u", fr->date & 0x1f,
+                                                                            ( fr->date >> 5 ) & 0x0f,
+                                                                            ( 80 + ( fr->date >> 9 ) ) % 100,
+                                                                            (fr->time >> 11 ) & 0x1f,
+                                                                            (fr->time >> 5 ) & 0x3f);
                 zx_shell_write_str(0, ZX_SHELL_FILES_PER_ROW + 5, sname, 15);
             }
 
-            if (( fr.attr & AM_DIR ) != 0) sniprintf(sname, sizeof(sname), "      Folder");
-            else if(fr.size < 9999) sniprintf(sname, sizeof(sname), "%10lu B", fr.size);
-            else if(fr.size < 0x100000) sniprintf(sname, sizeof(sname), "%6lu.%.2lu kB", fr.size >> 10, ((fr.size & 0x3ff) * 100) >> 10);
-            else sniprintf(sname, sizeof(sname), "%6lu.%.2lu MB", fr.size >> 20, ((fr.size & 0xfffff) * 100) >> 20);
+            if (( fr->attr & AM_DIR ) != 0) sniprintf(sname, sizeof(sname), "      Folder");
+            else if(fr->size < 9999) sniprintf(sname, sizeof(sname), "%10lu B", fr->size);
+            else if(fr->size < 0x100000) sniprintf(sname, sizeof(sname), "%6lu.%.2lu kB", fr->size >> 10, ((fr->size & 0x3ff) * 100) >> 10);
+            else sniprintf(sname, sizeof(sname), "%6lu.%.2lu MB", fr->size >> 20, ((fr->size & 0xfffff) * 100) >> 20);
 
             zx_shell_write_str(20, ZX_SHELL_FILES_PER_ROW + 5, sname, 12);
         }
@@ -621,6 +665,8 @@ static void zx_shell_browser()
 {
     //zx_cpu_stop();
     zx_shell_init(ZX_SHELL_DEFAULT_PAGE);
+    zx_shell_tape_view = false;
+    zx_shell_stats_view = false;
 
     zx_shell_read_dir();
     zx_shell_show_sel(true);
@@ -628,8 +674,6 @@ static void zx_shell_browser()
 
 void zx_shell_leave_dir()
 {
-    zx_shell_file_record_Struct fr;
-
     uint8_t i = strlen(zx_shell_path);
     char dir_name[FF_MAX_LFN + 1];
 
@@ -642,13 +686,10 @@ void zx_shell_leave_dir()
         strcpy(dir_name, &zx_shell_path[i]);
 
         zx_shell_path[i] = 0;
-        zx_shell_read_dir();
 
-        for (zx_shell_sel_files = 0; zx_shell_sel_files < zx_shell_total_files; zx_shell_sel_files++)
-        {
-            zx_shell_read(&fr, zx_shell_files, zx_shell_sel_files);
-            if (strcmp( fr.name, dir_name) == 0) break;
-        }
+        // The folder is selected as soon as it has been read
+        strcpy(zx_shell_file_last_name, dir_name);
+        zx_shell_read_dir();
 
         if ((zx_shell_file_table_start + ZX_SHELL_FILES_PER_ROW * 2 - 1 ) < zx_shell_sel_files)
         {
@@ -662,14 +703,326 @@ void zx_shell_leave_dir()
     }
 }
 
+static void zx_shell_show_tape()
+{
+    int total = zx_tape_blocks_count();
+    int current = zx_tape_current_block_get();
+    char str[ZX_SHELL_TOTAL_CHAR_COLUMNS + 1];
+
+    if (zx_shell_tape_sel >= total) zx_shell_tape_sel = total - 1;
+    if (zx_shell_tape_sel < 0) zx_shell_tape_sel = 0;
+
+    while (zx_shell_tape_sel < zx_shell_tape_table_start) zx_shell_tape_table_start -= ZX_SHELL_FILES_PER_ROW;
+    while (zx_shell_tape_sel >= zx_shell_tape_table_start + ZX_SHELL_FILES_PER_ROW) zx_shell_tape_table_start += ZX_SHELL_FILES_PER_ROW;
+    if (zx_shell_tape_table_start < 0) zx_shell_tape_table_start = 0;
+
+    for (int i = 0; i < ZX_SHELL_FILES_PER_ROW; i++)
+    {
+        int pos = zx_shell_tape_table_start + i;
+        int row = i + 2;
+
+        if (pos < total)
+        {
+            char descr[ZX_SHELL_TOTAL_CHAR_COLUMNS];
+            zx_tape_block_describe(pos, descr, sizeof(descr));
+            sniprintf(str, sizeof(str), "%c%3d %s", pos == current ? '>' : ' ', pos + 1, descr);
+
+            zx_shell_write_str(0, row, str, ZX_SHELL_TOTAL_CHAR_COLUMNS);
+            zx_shell_write_attr(0, row, pos == zx_shell_tape_sel ? 071 : (pos == current ? 004 : 007), ZX_SHELL_TOTAL_CHAR_COLUMNS);
+        }
+        else
+        {
+            zx_shell_write_attr(0, row, 0, ZX_SHELL_TOTAL_CHAR_COLUMNS);
+            zx_shell_write_str(0, row, "", ZX_SHELL_TOTAL_CHAR_COLUMNS);
+        }
+    }
+
+    if (total == 0)
+    {
+        zx_shell_write_str(9, 5, "no tape blocks !", 0);
+        zx_shell_write_attr(9, 5, 0102, 16);
+    }
+
+    sniprintf(str, sizeof(str), "Block %d/%d, underruns %u", current + 1, total, zx_tape_underflows_get());
+    zx_shell_write_str(0, ZX_SHELL_FILES_PER_ROW + 4, str, ZX_SHELL_TOTAL_CHAR_COLUMNS);
+
+    sniprintf(str, sizeof(str), "%s, instant load %s", zx_tape_started() ? "playing" : "stopped", zx_tape_flash_load_get() ? "on" : "off");
+    zx_shell_write_str(0, ZX_SHELL_FILES_PER_ROW + 5, str, ZX_SHELL_TOTAL_CHAR_COLUMNS);
+}
+
+static bool zx_shell_tape_keycode_handle(uint8_t keycode)
+{
+    bool res = true;
+
+    if (HID_KEY_ARROW_UP == keycode)
+    {
+        zx_shell_tape_sel--;
+    }
+    else if (HID_KEY_ARROW_DOWN == keycode)
+    {
+        zx_shell_tape_sel++;
+    }
+    else if (HID_KEY_ARROW_LEFT == keycode)
+    {
+        zx_shell_tape_sel -= ZX_SHELL_FILES_PER_ROW;
+    }
+    else if (HID_KEY_ARROW_RIGHT == keycode)
+    {
+        zx_shell_tape_sel += ZX_SHELL_FILES_PER_ROW;
+    }
+    else if (HID_KEY_RETURN == keycode || HID_KEY_ENTER == keycode)
+    {
+        zx_tape_block_seek(zx_shell_tape_sel);
+    }
+    else if (HID_KEY_TAB == keycode)
+    {
+        zx_shell_tape_view = false;
+        zx_shell_show_sel(true);
+        return true;
+    }
+    else
+    {
+        res = false;
+    }
+
+    zx_shell_show_tape();
+    return res;
+}
+
+static void zx_shell_show_stats()
+{
+    char str[ZX_SHELL_TOTAL_CHAR_COLUMNS + 1];
+
+    for (int i = 0; i < ZX_SHELL_FILES_PER_ROW; i++)
+    {
+        int row = i + 2;
+
+        if (i == 0)
+        {
+            zx_shell_write_str(0, row, "Task       Load Latency    Busy", ZX_SHELL_TOTAL_CHAR_COLUMNS);
+            zx_shell_write_attr(0, row, 071, ZX_SHELL_TOTAL_CHAR_COLUMNS);
+        }
+        else if (i <= ZYNQ_TASK_STATS_COUNT)
+        {
+            zynq_task_stats_Struct stats;
+            zynq_task_stats_get(i - 1, &stats);
+
+            sniprintf(str, sizeof(str), "%-8s %3u.%u%% %5luus %5luus", stats.name,
+                stats.load_permille / 10, stats.load_permille % 10, (unsigned long)stats.max_latency_us, (unsigned long)stats.max_busy_us);
+            zx_shell_write_str(0, row, str, ZX_SHELL_TOTAL_CHAR_COLUMNS);
+            zx_shell_write_attr(0, row, 007, ZX_SHELL_TOTAL_CHAR_COLUMNS);
+        }
+        else
+        {
+            zx_shell_write_attr(0, row, 0, ZX_SHELL_TOTAL_CHAR_COLUMNS);
+            zx_shell_write_str(0, row, "", ZX_SHELL_TOTAL_CHAR_COLUMNS);
+        }
+    }
+
+    zx_shell_write_str(0, ZX_SHELL_FILES_PER_ROW + 4, "Load since the previous refresh", ZX_SHELL_TOTAL_CHAR_COLUMNS);
+    zx_shell_write_str(0, ZX_SHELL_FILES_PER_ROW + 5, "Enter: reset worst case, F11: back", ZX_SHELL_TOTAL_CHAR_COLUMNS);
+}
+
+static bool zx_shell_stats_keycode_handle(uint8_t keycode)
+{
+    if (HID_KEY_F11 == keycode)
+    {
+        zx_shell_stats_view = false;
+        zx_shell_show_sel(true);
+        return true;
+    }
+    else if (HID_KEY_F12 == keycode)
+    {
+        return false;
+    }
+    else if (HID_KEY_RETURN == keycode || HID_KEY_ENTER == keycode)
+    {
+        zynq_task_stats_reset();
+    }
+
+    // Any other key just refreshes the figures
+    zx_shell_show_stats();
+    return true;
+}
+
+static void zx_shell_snapshot_save(const char* ext)
+{
+    char name[FF_MAX_LFN + 1];
+    char full_name[ZX_SHELL_PATH_SIZE];
+    FILINFO fi;
+
+    for (uint32_t i = 0; i < ZX_SHELL_SNAPSHOT_SLOTS; i++)
+    {
+        sniprintf(name, sizeof(name), "snap%03u%s", (unsigned int)i, ext);
+        sniprintf(full_name, sizeof(full_name), "%s%s", zx_shell_path, name);
+        if (f_stat(full_name, &fi) == FR_NO_FILE) break;
+        name[0] = 0;
+    }
+
+    if (name[0] == 0 || !zx_snapshot_save(full_name))
+    {
+        return;
+    }
+
+    // Show the new file selected
+    zx_shell_hide_sel();
+    strcpy(zx_shell_file_last_name, name);
+    zx_shell_read_dir();
+
+    if ((zx_shell_file_table_start + ZX_SHELL_FILES_PER_ROW * 2 - 1 ) < zx_shell_sel_files)
+    {
+        zx_shell_file_table_start = zx_shell_sel_files;
+    }
+
+    selx = ((zx_shell_sel_files - zx_shell_file_table_start) / ZX_SHELL_FILES_PER_ROW);
+    sely = ((zx_shell_sel_files - zx_shell_file_table_start) % ZX_SHELL_FILES_PER_ROW);
+
+    zx_shell_show_table();
+    zx_shell_show_sel(false);
+}
+
+static void zx_shell_filter_update(uint8_t keycode)
+{
+    size_t length = strlen(zx_shell_filter);
+    char c = zx_shell_filter_char(keycode);
+
+    if (zx_shell_too_many_files)
+    {
+        return;
+    }
+    else if (c != 0)
+    {
+        if (length + 1 >= sizeof(zx_shell_filter)) return;
+        zx_shell_filter[length] = c;
+        zx_shell_filter[length + 1] = 0;
+    }
+    else if (length == 0)
+    {
+        return;
+    }
+    else if (HID_KEY_BACKSPACE == keycode)
+    {
+        zx_shell_filter[length - 1] = 0;
+    }
+    else
+    {
+        zx_shell_filter[0] = 0;
+    }
+
+    zx_shell_hide_sel();
+    const zx_dir_list_entry_Struct* p_entry = zx_dir_list_view_entry(zx_shell_sel_files);
+    uint32_t selected = p_entry != NULL ? p_entry->name_offset : 0;
+
+    zx_dir_list_filter(zx_shell_filter);
+    zx_shell_total_files = zx_dir_list_view_count();
+    zx_shell_sel_moved = true;
+
+    // The selected file stays selected while it matches, otherwise the first match is
+    zx_shell_file_table_start = 0;
+    if (p_entry == NULL || !zx_shell_sel_find(selected))
+    {
+        zx_shell_sel_files = 0;
+    }
+
+    zx_shell_show_sel(true);
+}
+
+static void zx_shell_sort_next()
+{
+    if (zx_shell_too_many_files || zx_shell_total_files == 0)
+    {
+        return;
+    }
+
+    zx_shell_hide_sel();
+
+    zx_shell_sort_order = (zx_shell_sort_order + 1) % ZX_DIR_LIST_ORDER_LAST_ENTRY;
+    zx_shell_sort_keep_sel();
+
+    zx_shell_show_sel(true);
+
+    char str[ZX_SHELL_TOTAL_CHAR_COLUMNS + 1];
+    sniprintf(str, sizeof(str), "sorted by %s", zx_shell_sort_names[zx_shell_sort_order]);
+    zx_shell_write_str(0, ZX_SHELL_FILES_PER_ROW + 5, str, ZX_SHELL_TOTAL_CHAR_COLUMNS);
+}
+
 bool zx_shell_active_get()
 {
     return zx_shell_active;
 }
 
+bool zx_shell_loading_get()
+{
+    return zx_shell_loading;
+}
+
+void zx_shell_loading_step()
+{
+    if (!zx_shell_loading)
+    {
+        return;
+    }
+
+    bool done = zx_shell_read_dir_step(ZX_SHELL_LOAD_CHUNK);
+
+    if (zx_shell_active && !zx_shell_tape_view && !zx_shell_stats_view)
+    {
+        if (done)
+        {
+            // The sorted listing replaces the files shown so far
+            zx_shell_hide_sel();
+            zx_shell_show_sel(true);
+        }
+        else
+        {
+            zx_shell_cycle_mark();
+        }
+    }
+}
+
 bool zx_shell_hid_keycode_handle(uint8_t keycode)
 {
-    if (HID_KEY_F12 == keycode)
+    if (zx_shell_active == true && zx_shell_tape_view == true && zx_shell_tape_keycode_handle(keycode))
+    {
+        return zx_shell_active;
+    }
+
+    if (zx_shell_active == true && zx_shell_stats_view == true && zx_shell_stats_keycode_handle(keycode))
+    {
+        return zx_shell_active;
+    }
+
+    if (HID_KEY_F11 == keycode && zx_shell_active == true)
+    {
+        zx_shell_hide_sel();
+        zx_shell_tape_view = false;
+        zx_shell_stats_view = true;
+        zx_shell_show_stats();
+    }
+    else if (HID_KEY_F2 == keycode && zx_shell_active == true)
+    {
+        zx_shell_snapshot_save(".sna");
+    }
+    else if (HID_KEY_F3 == keycode && zx_shell_active == true)
+    {
+        zx_shell_snapshot_save(".z80");
+    }
+    else if (HID_KEY_F4 == keycode && zx_shell_active == true)
+    {
+        zx_shell_sort_next();
+    }
+    else if ((zx_shell_filter_char(keycode) != 0 || HID_KEY_BACKSPACE == keycode || HID_KEY_ESCAPE == keycode) && zx_shell_active == true && zx_shell_tape_view == false)
+    {
+        zx_shell_filter_update(keycode);
+    }
+    else if (HID_KEY_TAB == keycode && zx_shell_active == true)
+    {
+        zx_shell_hide_sel();
+        zx_shell_tape_view = true;
+        zx_shell_tape_sel = zx_tape_current_block_get();
+        zx_shell_show_tape();
+    }
+    else if (HID_KEY_F12 == keycode)
     {
         if (zx_shell_active == false)
         {
@@ -684,45 +1037,54 @@ bool zx_shell_hid_keycode_handle(uint8_t keycode)
     else if (HID_KEY_ARROW_RIGHT == keycode && zx_shell_active == true)
     {
         zx_shell_hide_sel();
+        zx_shell_sel_moved = true;
         zx_shell_sel_files += ZX_SHELL_FILES_PER_ROW;
         zx_shell_show_sel(false);
     }
     else if (HID_KEY_ARROW_LEFT == keycode && zx_shell_active == true)
     {
         zx_shell_hide_sel();
+        zx_shell_sel_moved = true;
         zx_shell_sel_files -= ZX_SHELL_FILES_PER_ROW;
         zx_shell_show_sel(false);
     }
     else if (HID_KEY_ARROW_UP == keycode && zx_shell_active == true)
     {
         zx_shell_hide_sel();
+        zx_shell_sel_moved = true;
         zx_shell_sel_files--;
         zx_shell_show_sel(false);
     }
     else if (HID_KEY_ARROW_DOWN == keycode && zx_shell_active == true)
     {
         zx_shell_hide_sel();
+        zx_shell_sel_moved = true;
         zx_shell_sel_files++;
         zx_shell_show_sel(false);
     }
     else if ((HID_KEY_RETURN == keycode || (HID_KEY_ENTER == keycode)) && zx_shell_active == true)
     {
-        zx_shell_file_record_Struct fr;
-        zx_shell_read(&fr, zx_shell_files, zx_shell_sel_files);
+        const zx_dir_list_entry_Struct* fr = zx_dir_list_view_entry(zx_shell_sel_files);
+        if (fr == NULL)
+        {
+            return zx_shell_active;
+        }
 
-        if ((fr.attr & AM_DIR) != 0)
+        const char* name = zx_dir_list_name(fr);
+
+        if ((fr->attr & AM_DIR) != 0)
         {
             zx_shell_hide_sel();
 
-            if (strcmp(fr.name, "..") == 0)
+            if (strcmp(name, "..") == 0)
             {
                 zx_shell_leave_dir();
             }
-            else if (strlen(zx_shell_path) + strlen(fr.name) + 1 < ZX_SHELL_PATH_SIZE)
+            else if (strlen(zx_shell_path) + fr->name_length + 1 < ZX_SHELL_PATH_SIZE)
             {
                 strcpy(zx_shell_file_last_name, "");
 
-                strcat(zx_shell_path, fr.name);
+                strcat(zx_shell_path, name);
                 strcat(zx_shell_path, "/");
                 zx_shell_read_dir();
 
@@ -736,25 +1098,26 @@ bool zx_shell_hid_keycode_handle(uint8_t keycode)
         else
         {
             char full_name[ZX_SHELL_PATH_SIZE];
-            sniprintf(full_name, sizeof(full_name), "%s%s", zx_shell_path, fr.name);
+            sniprintf(full_name, sizeof(full_name), "%s%s", zx_shell_path, name);
 
             // Switch the back to ZX video page
             zx_vdma_start_address_set(EMULATOR_MEMORY_AREA_START + EMULATOR_VDMA_AREA_OFFSET, 0);
             zx_shell_active = !zx_shell_active;
 
-            strlwr(fr.name);
-
-            char *ext = fr.name + strlen(fr.name);
-            while (ext > fr.name && *ext != '.') ext--;
+            const char *ext = zx_dir_list_name_ext(name);
 
-            if (strcmp(ext, ".tap") == 0 || strcmp(ext, ".tzx") == 0)
+            if (strcasecmp(ext, ".tap") == 0 || strcasecmp(ext, ".tzx") == 0 || strcasecmp(ext, ".pzx") == 0 || strcasecmp(ext, ".csw") == 0)
             {
                 zx_tape_select_file(full_name);
             }
-            else if (strcmp(ext, ".sna") == 0)
+            else if (strcasecmp(ext, ".sna") == 0 || strcasecmp(ext, ".z80") == 0 || strcasecmp(ext, ".szx") == 0)
             {
                 zx_snapshot_load(full_name);
             }
+            else if (strcasecmp(ext, ".trd") == 0 || strcasecmp(ext, ".scl") == 0)
+            {
+                zx_betadisk_mount(ZX_BETADISK_DRIVE_A, full_name);
+            }
         }
     }
     return zx_shell_active;
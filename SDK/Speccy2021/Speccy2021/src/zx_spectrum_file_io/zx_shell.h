@@ -18,6 +18,10 @@
 #include "../zynq_usb/tinyusb/class/hid/hid.h"
 #include "zx_snapshot.h"
 #include "zx_tape.h"
+#include "zx_betadisk.h"
+#include "zx_dir_list.h"
+#include "zx_dir_cache.h"
+#include "../zynq_misc/task_stats/zynq_task_stats.h"
 
 #define ZX_SHELL_DEFAULT_PAGE (0)
 
@@ -37,6 +41,14 @@ bool zx_shell_hid_keycode_handle(uint8_t keycode);
 //! @return true if the shell is active or false otherwise
 bool zx_shell_active_get(void);
 
+//! @brief Check whether the current folder is still being read
+//! @return true if there are more files to read or false otherwise
+bool zx_shell_loading_get(void);
+
+//! @brief Read the next files of the current folder, called by the file I/O thread
+//!   with zx_tape_lock taken while there are no keyboard events to handle
+void zx_shell_loading_step(void);
+
 #endif
 
 
@@ -1,8 +1,14 @@
 /*
- SNA file loader
- ===============
+ SNA, Z80 and SZX file loader
+ ============================
 
- This logic allows for loading shapshot files in SNA format
+ This logic allows for loading shapshot files in SNA, Z80 (v1, v2, v3) and SZX formats
+ and for saving the machine state in SNA and Z80 (v3) formats. The state
+ can also be kept in quick save slots in DDR.
+ Decoded RAM of every loaded snapshot goes into the content cache together
+ with the registers so that loading the same file again skips SD card.
+ Z80 and SZX registers are converted into SNA header layout so that all formats
+ share the same register loader running on the emulated CPU
 
  Originally designed by SYD as part of Speccy2010 project
 
@@ -11,15 +17,204 @@
 
 #include "zx_snapshot.h"
 #include "zx_loader.h"
+#include "zx_rewind.h"
 
 #define ZX_SNAPSHOT_INIT_DATA_LENGTH (0x1B)
 #define ZX_SNAPSHOT_48K_SIZE (0xC01B)
 #define ZX_SNAPSHOT_TOTAL_PAGES (8)
-#define ZX_SNAPSHOT_OPCODE_RET (0xC9)
 #define ZX_SNAPSHOT_HEADER_LOADER_OFFSET (0x40)
+#define ZX_SNAPSHOT_LOADER_SAVE_OFFSET (0x40)
+#define ZX_SNAPSHOT_LOADER_ADDR (0x8000 | ZX_SNAPSHOT_HEADER_LOADER_OFFSET)
+#define ZX_SNAPSHOT_STUB_AREA_ADDR (0x8000)
+#define ZX_SNAPSHOT_STUB_AREA_SIZE (0x100)
+#define ZX_SNAPSHOT_RAM_SIZE (ZX_SNAPSHOT_TOTAL_PAGES * EMULATOR_PAGE_SIZE)
+#define ZX_SNAPSHOT_DMA_ALIGN (32)
+#define ZX_SNAPSHOT_US_PER_SECOND (1000000U)
+#define ZX_SNAPSHOT_CPU_TIMEOUT_US (10000U)
+// Both halves of the loader end with JP to itself
+#define ZX_SNAPSHOT_LOADER_SPIN_ADDR (ZX_SNAPSHOT_LOADER_ADDR + 0x20)
+#define ZX_SNAPSHOT_SAVER_SPIN_ADDR (ZX_SNAPSHOT_LOADER_ADDR + ZX_SNAPSHOT_LOADER_SAVE_OFFSET + 0x20)
+#define ZX_SNAPSHOT_JP_SIZE (3)
+#define ZX_SNAPSHOT_Z80_HEADER_SIZE (30)
+#define ZX_SNAPSHOT_Z80_EXT_HEADER_MAX (54)
+#define ZX_SNAPSHOT_Z80_V2_EXT_SIZE (23)
+#define ZX_SNAPSHOT_Z80_V3_1FFD_EXT_SIZE (55)
+#define ZX_SNAPSHOT_Z80_BLOCK_HEADER_SIZE (3)
+#define ZX_SNAPSHOT_Z80_BLOCK_RAW (0xFFFF)
+#define ZX_SNAPSHOT_Z80_FLAG_COMPRESSED (0x20)
+#define ZX_SNAPSHOT_Z80_ED (0xED)
+#define ZX_SNAPSHOT_PORT_7FFD_48K ((1 << 4) | (1 << 5))
+#define ZX_SNAPSHOT_128K_TAIL_SIZE (4)
+#define ZX_SNAPSHOT_Z80_MODE_128K (4)
+#define ZX_SNAPSHOT_Z80_PAGE_OFFSET (3)
+#define ZX_SNAPSHOT_SZX_HEADER_SIZE (8)
+#define ZX_SNAPSHOT_SZX_CHUNK_HEADER_SIZE (8)
+#define ZX_SNAPSHOT_SZX_Z80R_SIZE (37)
+#define ZX_SNAPSHOT_SZX_SPCR_SIZE (8)
+#define ZX_SNAPSHOT_SZX_RAMP_HEADER_SIZE (3)
+#define ZX_SNAPSHOT_SZX_RAMP_COMPRESSED (0x01)
+#define ZX_SNAPSHOT_SZX_MID_16K (0)
+#define ZX_SNAPSHOT_SZX_MID_48K (1)
+#define ZX_SNAPSHOT_SZX_MID_PLUS2A (4)
+#define ZX_SNAPSHOT_SZX_MID_PLUS3 (5)
+#define ZX_SNAPSHOT_SZX_MID_TC2048 (8)
+#define ZX_SNAPSHOT_SZX_MID_NTSC48K (15)
+// A cached snapshot is RAM followed by zx_snapshot_state_Struct
+#define ZX_SNAPSHOT_CACHE_ENTRY_SIZE (ZX_SNAPSHOT_RAM_SIZE + sizeof(zx_snapshot_state_Struct))
 
 static reg_ZX_Spectrum_io_ports_Struct zx_io_ports;
 static reg_ZX_Spectrum_cpu_control_Struct zx_cpu_control;
+static uint8_t zx_stub_area_backup[ZX_SNAPSHOT_STUB_AREA_SIZE];
+static bool zx_stub_area_in_use = false;
+static uint8_t zx_snapshot_bounce[EMULATOR_PAGE_SIZE + ZX_SNAPSHOT_DMA_ALIGN] __attribute__((aligned(ZX_SNAPSHOT_DMA_ALIGN)));
+static zx_file_stream_Struct zx_snapshot_stream;
+
+//! @brief State of a compressed block of Z80 file kept between pages
+//!   as the single block of version 1 covers three pages
+typedef struct
+{
+    uint32_t left;
+    bool compressed;
+    uint8_t run_value;
+    uint16_t run_count;
+} zx_snapshot_z80_block_Struct;
+
+//! @brief RAM page chunk of SZX file found while walking through the chunks
+typedef struct
+{
+    uint32_t offset;
+    uint32_t length;
+    bool compressed;
+    uint8_t page;
+} zx_snapshot_szx_page_Struct;
+
+static zx_inflate_Struct zx_snapshot_inflate;
+
+//! @brief Quick save slot, RAM pages are kept in DDR at EMULATOR_SLOTS_AREA_START
+typedef struct
+{
+    bool valid;
+    zx_snapshot_state_Struct state;
+} zx_snapshot_slot_Struct;
+
+static zx_snapshot_slot_Struct zx_snapshot_slots[EMULATOR_SLOTS_COUNT];
+static zx_content_cache_key_Struct zx_snapshot_cache_key;
+static bool zx_snapshot_cache_key_valid = false;
+
+//! @brief Get the address of page 2 where the helper routines run
+//! @return the address in the emulator memory area
+static uint8_t* zx_stub_area_get(void);
+
+//! @brief Translate Z80 address into the address in the emulator memory area
+//! @param addr is the Z80 address
+//! @return the address in the emulator memory area
+static uint8_t* zx_memory_ptr(uint16_t addr);
+
+//! @brief Wait until the CPU reports the given status bits
+//! @param mask is a value of reg_ZX_Spectrum_cpu_status_Struct with the bits to wait for
+//! @return true if the bits have been set or false on timeout
+static bool zx_cpu_status_wait(uint32_t mask);
+
+//! @brief Wait until the CPU gets to the spin loop at the end of a helper routine
+//! @param addr is the address of the JP instruction which jumps to itself
+//! @return true if the CPU spins at the address or false on timeout
+static bool zx_cpu_spin_wait(uint16_t addr);
+
+//! @brief Put the CPU into HALT mode and wait until it stops at an instruction boundary
+static void zx_cpu_stop_wait(void);
+
+//! @brief Read a block of a file with as few FatFs calls as possible
+//! @param *file is a pointer to the file
+//! @param *dst is a pointer to the destination
+//! @param size is the number of bytes to be read, up to EMULATOR_PAGE_SIZE
+//! @return the number of bytes actually read
+static UINT zx_snapshot_read(FIL *file, uint8_t* dst, UINT size);
+
+//! @brief Read a 16K page of a snapshot into the emulator memory
+//! @param *file is a pointer to the file positioned at the page data
+//! @param page is the RAM page number
+static void zx_snapshot_load_page(FIL *file, uint8_t page);
+
+//! @brief Reset the machine and leave the CPU stopped in reset
+static void zx_snapshot_machine_reset(void);
+
+//! @brief Load CPU registers by running the loader in page 2. Page 2 gets
+//!   overwritten so it has to be done before the memory is loaded
+//! @param *header is a pointer to SNA header
+static void zx_snapshot_regs_load(const uint8_t* header);
+
+//! @brief Load a snapshot in SNA format
+//! @param *file is a pointer to the opened file
+//! @return true if the snapshot has been loaded or false otherwise
+static bool zx_snapshot_load_sna(FIL *file);
+
+//! @brief Load a snapshot in Z80 format
+//! @param *file is a pointer to the opened file
+//! @return true if the snapshot has been loaded or false otherwise
+static bool zx_snapshot_load_z80(FIL *file);
+
+//! @brief Load a snapshot in SZX format
+//! @param *file is a pointer to the opened file
+//! @return true if the snapshot has been loaded or false otherwise
+static bool zx_snapshot_load_szx(FIL *file);
+
+//! @brief Keep the snapshot which has just been loaded in the content cache,
+//!   called once RAM is in place and before the CPU is resumed
+//! @param *header is a pointer to SNA header
+//! @param pc is the program counter
+//! @param istate holds IFF2, IFF1 and IM in bits 3...0
+static void zx_snapshot_cache_put(const uint8_t* header, uint16_t pc, uint8_t istate);
+
+//! @brief Bring back the machine state and RAM kept in DDR and resume the CPU
+//! @param *p_state is a pointer to the state
+//! @param *ram is a pointer to the copy of all RAM pages
+static void zx_snapshot_state_restore(const zx_snapshot_state_Struct* p_state, const uint8_t* ram);
+
+//! @brief Get the address of a quick save slot in DDR
+//! @param slot is the slot number
+//! @return the address of the first RAM page copy
+static uint8_t* zx_snapshot_slot_address(uint8_t slot);
+
+//! @brief Write a block of data into a snapshot file
+//! @param *file is a pointer to the opened file
+//! @param *src is a pointer to the data
+//! @param size is the number of bytes to be written
+//! @return true if all bytes have been written or false otherwise
+static bool zx_snapshot_write(FIL *file, const void* src, UINT size);
+
+//! @brief Write a 16K page of the emulator memory into a snapshot
+//! @param *file is a pointer to the opened file
+//! @param page is the RAM page number
+//! @return true if the page has been written or false otherwise
+static bool zx_snapshot_save_page(FIL *file, uint8_t page);
+
+//! @brief Write the machine state in SNA format
+//! @param *file is a pointer to the opened file
+//! @param *header is a pointer to SNA header
+//! @param pc is the program counter
+//! @return true if the snapshot has been written or false otherwise
+static bool zx_snapshot_save_sna(FIL *file, const uint8_t* header, uint16_t pc);
+
+//! @brief Write the machine state in Z80 (version 3) format
+//! @param *file is a pointer to the opened file
+//! @param *header is a pointer to SNA header
+//! @param pc is the program counter
+//! @param istate holds IFF2, IFF1 and IM in bits 3...0
+//! @return true if the snapshot has been written or false otherwise
+static bool zx_snapshot_save_z80(FIL *file, const uint8_t* header, uint16_t pc, uint8_t istate);
+
+//! @brief Unpack data of a Z80 file block straight into the emulator memory
+//! @param *p_block is a pointer to the block state
+//! @param *dst is a pointer to the destination
+//! @param size is the number of bytes to be produced
+//! @return the number of bytes actually produced
+static uint32_t zx_snapshot_z80_unpack(zx_snapshot_z80_block_Struct* p_block, uint8_t* dst, uint32_t size);
+
+//! @brief Translate the page number of a Z80 file block into RAM page number
+//! @param block_page is the page number stored in the block header
+//! @param is_128k is true for 128K machines or false for 48K ones
+//! @return RAM page number or -1 if the block is not to be loaded
+static int8_t zx_snapshot_z80_page(uint8_t block_page, bool is_128k);
 
 bool zx_cpu_stopped()
 {
@@ -48,12 +243,62 @@ void zx_cpu_reset(bool reset)
         zx_cpu_control.bits.cpu_reset = reset;
     }
 
-    zx_cpu_control.bits.trdos_flag = 0; // hardcoded for now
+    zx_cpu_control.bits.trdos_flag = 0; // the machine always starts in BASIC ROM
     zx_cpu_control.bits.cpu_restore_pc_n = 1;
     zx_spectrum_control_reg_write(&zx_cpu_control);
 
 }
 
+static bool zx_cpu_status_wait(uint32_t mask)
+{
+    reg_ZX_Spectrum_cpu_status_Struct status;
+    XTime start, now;
+
+    XTime_GetTime(&start);
+    do
+    {
+        zx_spectrum_status_reg_read(&status);
+        if ((status.u32 & mask) == mask)
+        {
+            return true;
+        }
+        XTime_GetTime(&now);
+    } while ((now - start) * ZX_SNAPSHOT_US_PER_SECOND < (XTime)ZX_SNAPSHOT_CPU_TIMEOUT_US * COUNTS_PER_SECOND);
+
+    return false;
+}
+
+static bool zx_cpu_spin_wait(uint16_t addr)
+{
+    reg_ZX_Spectrum_cpu_status_Struct status;
+    XTime start, now;
+
+    XTime_GetTime(&start);
+    do
+    {
+        // PC runs over the operand bytes of the JP before it jumps back
+        zx_spectrum_status_reg_read(&status);
+        if ((uint16_t)(status.bits.cpu_pc - addr) <= ZX_SNAPSHOT_JP_SIZE)
+        {
+            return true;
+        }
+        XTime_GetTime(&now);
+    } while ((now - start) * ZX_SNAPSHOT_US_PER_SECOND < (XTime)ZX_SNAPSHOT_CPU_TIMEOUT_US * COUNTS_PER_SECOND);
+
+    return false;
+}
+
+static void zx_cpu_stop_wait()
+{
+    reg_ZX_Spectrum_cpu_status_Struct mask;
+
+    zx_cpu_stop();
+
+    mask.u32 = 0;
+    mask.bits.cpu_halt_ack = 1;
+    zx_cpu_status_wait(mask.u32);
+}
+
 void zx_cpu_start()
 {
     zx_cpu_control.bits.cpu_halt_req = 0;
@@ -61,10 +306,14 @@ void zx_cpu_start()
     zx_spectrum_control_reg_write(&zx_cpu_control);
 }
 
-static void zx_cpu_modify_pc(uint16_t pc, uint8_t istate)
+void zx_cpu_modify_pc(uint16_t pc, uint8_t istate)
 {
+    reg_ZX_Spectrum_cpu_status_Struct mask;
+
     zx_cpu_stop();
 
+    // Released from reset with the halt request set the CPU runs up to the
+    // first opcode fetch and stops there
     zx_cpu_control.bits.cpu_pc = pc;
     zx_cpu_control.bits.cpu_int = istate;
     zx_cpu_control.bits.cpu_reset = 0;
@@ -72,11 +321,17 @@ static void zx_cpu_modify_pc(uint16_t pc, uint8_t istate)
     zx_cpu_control.bits.cpu_one_cycle_wait_req = 0;
     zx_cpu_control.bits.cpu_restore_pc_n = 1;
     zx_spectrum_control_reg_write(&zx_cpu_control);
-    vTaskDelay(10);
+
+    mask.u32 = 0;
+    mask.bits.cpu_halt_ack = 1;
+    zx_cpu_status_wait(mask.u32);
 
     zx_cpu_control.bits.cpu_restore_pc_n = 0;
     zx_spectrum_control_reg_write(&zx_cpu_control);
-    vTaskDelay(10);
+
+    mask.u32 = 0;
+    mask.bits.cpu_restore_done = 1;
+    zx_cpu_status_wait(mask.u32);
 
     zx_cpu_control.bits.cpu_restore_pc_n = 1;
     zx_spectrum_control_reg_write(&zx_cpu_control);
@@ -84,156 +339,960 @@ static void zx_cpu_modify_pc(uint16_t pc, uint8_t istate)
     zx_cpu_start();
 }
 
+void zx_cpu_state_get(uint16_t* pc, uint8_t* istate)
+{
+    reg_ZX_Spectrum_cpu_status_Struct status;
+    zx_spectrum_status_reg_read(&status);
+
+    *pc = status.bits.cpu_pc;
+    *istate = status.bits.cpu_int & 0x0F;
+
+    // Keeps TR-DOS paged in once the PC is restored
+    zx_cpu_control.bits.trdos_flag = status.bits.trdos_active;
+}
+
+bool zx_cpu_trdos_active()
+{
+    reg_ZX_Spectrum_cpu_status_Struct status;
+    zx_spectrum_status_reg_read(&status);
+
+    return status.bits.trdos_active == 1;
+}
+
+static uint8_t* zx_stub_area_get()
+{
+    return (uint8_t*)(EMULATOR_MEMORY_AREA_START | ((EMULATOR_PAGE_2 + EMULATOR_ROM_PAGES_COUNT) << EMULATOR_PAGE_LEFT_SHIFT_BITS));
+}
+
+static uint8_t* zx_memory_ptr(uint16_t addr)
+{
+    uint8_t page;
+
+    switch (addr >> EMULATOR_PAGE_LEFT_SHIFT_BITS)
+    {
+        case 0:
+            return (uint8_t*)(EMULATOR_MEMORY_AREA_START + ((zx_io_ports.bits.zx_port_7ffd >> 4) & 0x01) * EMULATOR_PAGE_SIZE + addr);
+        case 1:
+            page = 0x05;
+            break;
+        case 2:
+            page = EMULATOR_PAGE_2;
+            break;
+        default:
+            page = zx_io_ports.bits.zx_port_7ffd & 0x07;
+            break;
+    }
+
+    return (uint8_t*)(EMULATOR_MEMORY_AREA_START | ((page + EMULATOR_ROM_PAGES_COUNT) << EMULATOR_PAGE_LEFT_SHIFT_BITS) | (addr & (EMULATOR_PAGE_SIZE - 1)));
+}
+
+uint8_t zx_memory_read(uint16_t addr)
+{
+    if (zx_stub_area_in_use && (uint16_t)(addr - ZX_SNAPSHOT_STUB_AREA_ADDR) < ZX_SNAPSHOT_STUB_AREA_SIZE)
+    {
+        return zx_stub_area_backup[addr - ZX_SNAPSHOT_STUB_AREA_ADDR];
+    }
+    return *zx_memory_ptr(addr);
+}
+
+void zx_memory_write(uint16_t addr, uint8_t value)
+{
+    if (addr < EMULATOR_PAGE_SIZE)
+    {
+        return;
+    }
+
+    if (zx_stub_area_in_use && (uint16_t)(addr - ZX_SNAPSHOT_STUB_AREA_ADDR) < ZX_SNAPSHOT_STUB_AREA_SIZE)
+    {
+        zx_stub_area_backup[addr - ZX_SNAPSHOT_STUB_AREA_ADDR] = value;
+        return;
+    }
+    uint8_t* ptr = zx_memory_ptr(addr);
+    *ptr = value;
+    zx_rewind_pages_touched(1 << ((((uint32_t)ptr - EMULATOR_MEMORY_AREA_START) >> EMULATOR_PAGE_LEFT_SHIFT_BITS) - EMULATOR_ROM_PAGES_COUNT));
+}
+
+void zx_memory_flush()
+{
+    Xil_DCacheFlushRange(EMULATOR_MEMORY_AREA_START | (EMULATOR_ROM_PAGES_COUNT << EMULATOR_PAGE_LEFT_SHIFT_BITS), ZX_SNAPSHOT_RAM_SIZE);
+}
+
+void zx_cpu_regs_save(uint8_t* regs)
+{
+    uint8_t* stub_area = zx_stub_area_get();
+    uint16_t i;
+
+    zx_spectrum_io_ports_reg_read(&zx_io_ports);
+
+    // Drop stale cache lines as the CPU has been writing into RAM behind PS
+    zx_memory_flush();
+
+    for (i = 0; i < ZX_SNAPSHOT_STUB_AREA_SIZE; i++)
+    {
+        zx_stub_area_backup[i] = stub_area[i];
+    }
+    zx_stub_area_in_use = true;
+
+    for (i = 0; i < zx_loader_size; i++)
+    {
+        stub_area[ZX_SNAPSHOT_HEADER_LOADER_OFFSET + i] = zx_loader[i];
+    }
+    Xil_DCacheFlushRange((UINTPTR)stub_area, ZX_SNAPSHOT_STUB_AREA_SIZE);
+
+    // The second half of the loader pushes all registers into the header and spins
+    zx_cpu_modify_pc(ZX_SNAPSHOT_LOADER_ADDR + ZX_SNAPSHOT_LOADER_SAVE_OFFSET, 0);
+    zx_cpu_spin_wait(ZX_SNAPSHOT_SAVER_SPIN_ADDR);
+    zx_cpu_stop_wait();
+
+    Xil_DCacheInvalidateRange((UINTPTR)stub_area, ZX_SNAPSHOT_STUB_AREA_SIZE);
+    for (i = 0; i < ZX_SNAPSHOT_REGS_SIZE; i++)
+    {
+        regs[i] = stub_area[i];
+    }
+}
+
+void zx_cpu_regs_restore(const uint8_t* regs, uint16_t pc, uint8_t istate)
+{
+    uint8_t* stub_area = zx_stub_area_get();
+    uint16_t i;
+
+    for (i = 0; i < ZX_SNAPSHOT_REGS_SIZE; i++)
+    {
+        stub_area[i] = regs[i];
+    }
+    Xil_DCacheFlushRange((UINTPTR)stub_area, ZX_SNAPSHOT_STUB_AREA_SIZE);
+
+    zx_cpu_modify_pc(ZX_SNAPSHOT_LOADER_ADDR, 0);
+    zx_cpu_spin_wait(ZX_SNAPSHOT_LOADER_SPIN_ADDR);
+    zx_cpu_stop_wait();
+
+    for (i = 0; i < ZX_SNAPSHOT_STUB_AREA_SIZE; i++)
+    {
+        stub_area[i] = zx_stub_area_backup[i];
+    }
+    zx_stub_area_in_use = false;
+    Xil_DCacheFlushRange((UINTPTR)stub_area, ZX_SNAPSHOT_STUB_AREA_SIZE);
+
+    zx_cpu_modify_pc(pc, istate);
+}
+
+static UINT zx_snapshot_read(FIL *file, uint8_t* dst, UINT size)
+{
+    UINT res = 0;
+    uint32_t skew = f_tell(file) % ZX_SNAPSHOT_DMA_ALIGN;
+
+    // FatFs passes whole sectors straight to the multi-block DMA of the SD
+    // controller which wants a word aligned buffer and cache maintenance is done
+    // by lines, so the destination has to be aligned the same way as the file
+    // position. Otherwise the sectors land in a bounce buffer which is aligned
+    // that way and then get copied.
+    if (((UINTPTR)dst % ZX_SNAPSHOT_DMA_ALIGN) == skew)
+    {
+        f_read(file, dst, size, &res);
+    }
+    else
+    {
+        uint8_t* bounce = zx_snapshot_bounce + skew;
+        f_read(file, bounce, size, &res);
+        memcpy(dst, bounce, res);
+    }
+    return res;
+}
+
 static void zx_snapshot_load_page(FIL *file, uint8_t page)
 {
     uint32_t addr = (EMULATOR_MEMORY_AREA_START | ((page + EMULATOR_ROM_PAGES_COUNT) << EMULATOR_PAGE_LEFT_SHIFT_BITS));
+    XTime start, end;
 
-    uint8_t data;
-    UINT res;
+    XTime_GetTime(&start);
+    UINT res = zx_snapshot_read(file, (uint8_t*)addr, EMULATOR_PAGE_SIZE);
+    Xil_DCacheFlushRange(addr, EMULATOR_PAGE_SIZE);
+    XTime_GetTime(&end);
 
-    uint8_t* emulator_memory_area = (uint8_t*)addr;
+    if (res != 0)
+    {
+        uint32_t us = (uint32_t)((end - start) * ZX_SNAPSHOT_US_PER_SECOND / COUNTS_PER_SECOND);
+        xil_printf("Page %d loaded in %d.%03d ms\r\n", page, us / 1000, us % 1000);
+    }
+}
 
-    for (int i = 0; i < EMULATOR_PAGE_SIZE; i++)
+static void zx_snapshot_machine_reset()
+{
+    // The reset is synchronous so it is taken on the next clock
+    zx_cpu_start();
+    zx_cpu_reset(false);
+    zx_cpu_reset(true);
+    zx_cpu_stop();
+}
+
+static void zx_snapshot_regs_load(const uint8_t* header)
+{
+    uint32_t addr;
+    uint16_t i;
+
+    // Copy SNA header into page 2
+    addr = EMULATOR_MEMORY_AREA_START | ((EMULATOR_PAGE_2 + EMULATOR_ROM_PAGES_COUNT) << EMULATOR_PAGE_LEFT_SHIFT_BITS);
+    uint8_t* emulator_memory_area = (uint8_t*)addr;
+    for (i = 0; i < ZX_SNAPSHOT_INIT_DATA_LENGTH; i++)
     {
-        if (f_read(file, &data, 1, &res) != FR_OK) break;
-        if (res == 0) break;
+        *emulator_memory_area = header[i];
+        emulator_memory_area++;
+    }
+    Xil_DCacheFlushRange(addr, ZX_SNAPSHOT_INIT_DATA_LENGTH);
 
-        *emulator_memory_area = data;
+    // Now copy the loader which will initialise CPU registers from the header and then will simply spin in infinite loop until we stop it
+    addr = EMULATOR_MEMORY_AREA_START | ((EMULATOR_PAGE_2 + EMULATOR_ROM_PAGES_COUNT) << EMULATOR_PAGE_LEFT_SHIFT_BITS) | ZX_SNAPSHOT_HEADER_LOADER_OFFSET;
+    emulator_memory_area = (uint8_t*)addr;
+    for (i = 0; i < zx_loader_size; i++)
+    {
+        *emulator_memory_area = zx_loader[i];
         emulator_memory_area++;
     }
+    Xil_DCacheFlushRange(addr, zx_loader_size);
 
-    Xil_DCacheFlushRange(addr, EMULATOR_PAGE_SIZE);
+    zx_cpu_modify_pc(ZX_SNAPSHOT_LOADER_ADDR, 0);
+    zx_cpu_spin_wait(ZX_SNAPSHOT_LOADER_SPIN_ADDR);
+    zx_cpu_stop_wait();
 }
 
-bool zx_snapshot_load(const char *file_name)
+static bool zx_snapshot_load_sna(FIL *sna_file)
 {
-    bool result = false;
+    uint16_t spec_pc = 0;
 
-    bool stopped = zx_cpu_stopped();
-    if (!stopped)
+    if (f_size(sna_file) < ZX_SNAPSHOT_48K_SIZE)
     {
-        zx_cpu_stop();
+        return false;
     }
 
-    zx_spectrum_io_ports_reg_read(&zx_io_ports);
-    uint16_t spec_pc = 0;
+    zx_snapshot_machine_reset();
+
+    uint8_t header[0x1c];
+
+    UINT res;
+    f_lseek(sna_file, 0);
+    f_read(sna_file, header, ZX_SNAPSHOT_INIT_DATA_LENGTH, &res);
+
+    zx_io_ports.bits.zx_port_fe = header[26] & 0x07;
+
+    if (f_size(sna_file) == ZX_SNAPSHOT_48K_SIZE)
+    {
+        zx_io_ports.bits.zx_port_7ffd = ZX_SNAPSHOT_PORT_7FFD_48K;// -- 48K mode
+        zx_cpu_control.bits.trdos_flag = 0;
+    }
+    else
+    {
+        uint8_t header2[4];
+        f_lseek(sna_file, ZX_SNAPSHOT_INIT_DATA_LENGTH + EMULATOR_THREE_PAGE_SIZE);
+        f_read(sna_file, header2, 0x04, &res);
+
+        spec_pc = header2[0] | ( header2[1] << 8 );
+        zx_io_ports.bits.zx_port_7ffd = header2[2];
+        zx_cpu_control.bits.trdos_flag = header2[3];
+    }
+    zx_spectrum_control_reg_write(&zx_cpu_control);
+    zx_spectrum_io_ports_reg_write(&zx_io_ports);
+
+    zx_snapshot_regs_load(header);
+
+    f_lseek(sna_file, ZX_SNAPSHOT_INIT_DATA_LENGTH);
 
-    FIL sna_file;
-    if (f_open(&sna_file, file_name, FA_READ ) == FR_OK)
+    zx_snapshot_load_page(sna_file, 0x05);
+    zx_snapshot_load_page(sna_file, 0x02);
+    zx_snapshot_load_page(sna_file, zx_io_ports.bits.zx_port_7ffd & 0x07);
+
+    f_lseek(sna_file, ZX_SNAPSHOT_INIT_DATA_LENGTH + EMULATOR_THREE_PAGE_SIZE + 0x04);
+
+    for (uint8_t page = 0; page < ZX_SNAPSHOT_TOTAL_PAGES; page++)
     {
-        if (f_size(&sna_file) >= ZX_SNAPSHOT_48K_SIZE)
+        if (page != 0x05 && page != 0x02 && page != (zx_io_ports.bits.zx_port_7ffd & 0x07))
         {
-            zx_cpu_start();
-            zx_cpu_reset(false);
-            vTaskDelay(10);
-            zx_cpu_reset(true);
-            zx_cpu_stop();
+            zx_snapshot_load_page(sna_file, page);
+        }
+    }
 
-            uint32_t addr;
-            uint16_t i;
+    zx_spectrum_io_ports_reg_write(&zx_io_ports);
 
-            uint8_t header[0x1c];
+    if (f_size(sna_file) == ZX_SNAPSHOT_48K_SIZE)
+    {
+        uint8_t rom_page = 0;
+        if ((zx_io_ports.bits.zx_port_7ffd & 0x10) != 0) rom_page |= 0x01;
 
-            UINT res;
-            f_lseek(&sna_file, 0);
-            f_read(&sna_file, header, ZX_SNAPSHOT_INIT_DATA_LENGTH, &res);
+        // 48K snapshots carry no TR-DOS flag so the RET is never looked up in TR-DOS ROM
+        // This piece of logic is extraordinary - the program counter is not
+        // saved in SNA files, instead, its value is in stack. So once
+        // the stack is initialised PC needs to be pushed out of it and
+        // this can be done by executing RET (0xC9) opcode. At this moment there
+        // is no place in RAM anymore because we have just restored the full
+        // snapshot so we jump to this opcode in ROM, its address has been
+        // found when the ROM was installed.
+        spec_pc = zx_rom_descriptor_get(rom_page)->ret_addr;
+    }
 
-            zx_io_ports.bits.zx_port_fe = header[26] & 0x07;
+    zx_snapshot_cache_put(header, spec_pc, (header[25] & 0x03) | 0x08 | (header[19] & 0x04));
+    zx_cpu_modify_pc(spec_pc, (header[25] & 0x03) | 0x08 | (header[19] & 0x04));
+    return true;
+}
 
-            if (f_size(&sna_file) == ZX_SNAPSHOT_48K_SIZE)
-            {
-                zx_io_ports.bits.zx_port_7ffd = ( 1 << 4 ) | ( 1 << 5 );// -- 48K mode
-                zx_cpu_control.bits.trdos_flag = 0;
-            }
-            else
-            {
-                uint8_t header2[4];
-                f_lseek(&sna_file, ZX_SNAPSHOT_INIT_DATA_LENGTH + EMULATOR_THREE_PAGE_SIZE);
-                f_read(&sna_file, header2, 0x04, &res);
+static uint32_t zx_snapshot_z80_unpack(zx_snapshot_z80_block_Struct* p_block, uint8_t* dst, uint32_t size)
+{
+    uint32_t produced = 0;
+    uint8_t value;
 
-                spec_pc = header2[0] | ( header2[1] << 8 );
-                zx_io_ports.bits.zx_port_7ffd = header2[2];
-                zx_cpu_control.bits.trdos_flag = header2[3];
-            }
-            zx_spectrum_control_reg_write(&zx_cpu_control);
-            zx_spectrum_io_ports_reg_write(&zx_io_ports);
+    if (!p_block->compressed)
+    {
+        uint32_t cnt = (size < p_block->left) ? size : p_block->left;
+        produced = zx_file_stream_read(&zx_snapshot_stream, dst, cnt);
+        p_block->left -= produced;
+        return produced;
+    }
 
-            // Copy SNA header into page 2
-            addr = EMULATOR_MEMORY_AREA_START | ((EMULATOR_PAGE_2 + EMULATOR_ROM_PAGES_COUNT) << EMULATOR_PAGE_LEFT_SHIFT_BITS);
-            uint8_t* emulator_memory_area = (uint8_t*)addr;
-            for (i = 0; i < ZX_SNAPSHOT_INIT_DATA_LENGTH; i++)
-            {
-                *emulator_memory_area = header[i];
-                emulator_memory_area++;
-            }
-            Xil_DCacheFlushRange(addr, ZX_SNAPSHOT_INIT_DATA_LENGTH);
+    while (produced < size)
+    {
+        // A run may go on into the next page when the whole 48K is a single block
+        if (p_block->run_count > 0)
+        {
+            dst[produced++] = p_block->run_value;
+            p_block->run_count--;
+            continue;
+        }
 
-            // Now copy the loader which will initialise CPU registers from the header and then will simply spin in infinite loop until we stop it
-            addr = EMULATOR_MEMORY_AREA_START | ((EMULATOR_PAGE_2 + EMULATOR_ROM_PAGES_COUNT) << EMULATOR_PAGE_LEFT_SHIFT_BITS) | ZX_SNAPSHOT_HEADER_LOADER_OFFSET;
-            emulator_memory_area = (uint8_t*)addr;
-            for (i = 0; i < zx_loader_size; i++)
+        if (p_block->left == 0 || !zx_file_stream_read_byte(&zx_snapshot_stream, &value))
+        {
+            break;
+        }
+        p_block->left--;
+
+        if (value == ZX_SNAPSHOT_Z80_ED && p_block->left > 0)
+        {
+            uint8_t next;
+            zx_file_stream_read_byte(&zx_snapshot_stream, &next);
+            p_block->left--;
+
+            // ED ED nn xx stands for nn bytes of xx, a single ED is never followed by a run
+            if (next == ZX_SNAPSHOT_Z80_ED && p_block->left >= 2)
             {
-                *emulator_memory_area = zx_loader[i];
-                emulator_memory_area++;
+                uint8_t count = 0;
+                zx_file_stream_read_byte(&zx_snapshot_stream, &count);
+                zx_file_stream_read_byte(&zx_snapshot_stream, &p_block->run_value);
+                p_block->left -= 2;
+                p_block->run_count = count;
+                continue;
             }
-            Xil_DCacheFlushRange(addr, zx_loader_size);
+            p_block->run_value = next;
+            p_block->run_count = 1;
+        }
+        dst[produced++] = value;
+    }
+    return produced;
+}
+
+static int8_t zx_snapshot_z80_page(uint8_t block_page, bool is_128k)
+{
+    if (is_128k)
+    {
+        return (block_page >= 3 && block_page < 3 + ZX_SNAPSHOT_TOTAL_PAGES) ? (int8_t)(block_page - 3) : -1;
+    }
+
+    switch (block_page)
+    {
+        case 4:
+            return 2;
+        case 5:
+            return 0;
+        case 8:
+            return 5;
+        default:
+            return -1;
+    }
+}
+
+static bool zx_snapshot_load_z80(FIL *file)
+{
+    uint8_t z80[ZX_SNAPSHOT_Z80_HEADER_SIZE];
+    uint8_t ext[ZX_SNAPSHOT_Z80_EXT_HEADER_MAX + 1];
+    uint8_t header[ZX_SNAPSHOT_INIT_DATA_LENGTH];
+    uint16_t ext_size = 0;
+    uint16_t pc;
+    bool is_128k = false;
+    zx_snapshot_z80_block_Struct block;
+
+    zx_file_stream_init(&zx_snapshot_stream, file);
+    if (zx_file_stream_read(&zx_snapshot_stream, z80, sizeof(z80)) != sizeof(z80))
+    {
+        return false;
+    }
+
+    // Byte 12 of 255 has to be treated as 1 for compatibility
+    if (z80[12] == 0xFF) z80[12] = 0x01;
+
+    pc = z80[6] | (z80[7] << 8);
+    if (pc == 0)
+    {
+        // Version 2 and 3 keep PC and the hardware setup in an additional header
+        uint8_t len[2];
+        zx_file_stream_read(&zx_snapshot_stream, len, sizeof(len));
+        ext_size = len[0] | (len[1] << 8);
+        if (ext_size < ZX_SNAPSHOT_Z80_V2_EXT_SIZE || ext_size > ZX_SNAPSHOT_Z80_EXT_HEADER_MAX + 1)
+        {
+            return false;
+        }
+        memset(ext, 0, sizeof(ext));
+        zx_file_stream_read(&zx_snapshot_stream, ext, ext_size);
 
-            zx_cpu_modify_pc(addr, 0);
-            //zx_cpu_start();
-            vTaskDelay(10);
-            zx_cpu_stop();
+        pc = ext[0] | (ext[1] << 8);
+        is_128k = (ext_size == ZX_SNAPSHOT_Z80_V2_EXT_SIZE) ? (ext[2] >= 3) : (ext[2] >= 4);
+    }
+
+    // Registers go into SNA header layout for the loader
+    header[0] = z80[10];
+    header[1] = z80[19]; header[2] = z80[20];
+    header[3] = z80[17]; header[4] = z80[18];
+    header[5] = z80[15]; header[6] = z80[16];
+    header[7] = z80[22]; header[8] = z80[21];
+    header[9] = z80[4]; header[10] = z80[5];
+    header[11] = z80[13]; header[12] = z80[14];
+    header[13] = z80[2]; header[14] = z80[3];
+    header[15] = z80[23]; header[16] = z80[24];
+    header[17] = z80[25]; header[18] = z80[26];
+    header[19] = z80[28] ? 0x04 : 0x00;
+    header[20] = (z80[11] & 0x7F) | ((z80[12] & 0x01) << 7);
+    header[21] = z80[1]; header[22] = z80[0];
+    header[23] = z80[8]; header[24] = z80[9];
+    header[25] = z80[29] & 0x03;
+    header[26] = (z80[12] >> 1) & 0x07;
 
-            f_lseek(&sna_file, ZX_SNAPSHOT_INIT_DATA_LENGTH);
+    zx_snapshot_machine_reset();
+
+    zx_io_ports.bits.zx_port_fe = header[26];
+    zx_io_ports.bits.zx_port_7ffd = is_128k ? ext[3] : ZX_SNAPSHOT_PORT_7FFD_48K;
+    zx_io_ports.bits.zx_port_1ffd = (ext_size == ZX_SNAPSHOT_Z80_V3_1FFD_EXT_SIZE) ? ext[ZX_SNAPSHOT_Z80_EXT_HEADER_MAX] : 0;
+    zx_cpu_control.bits.trdos_flag = 0;
+    zx_spectrum_control_reg_write(&zx_cpu_control);
+    zx_spectrum_io_ports_reg_write(&zx_io_ports);
+
+    zx_snapshot_regs_load(header);
+
+    if (ext_size == 0)
+    {
+        // Version 1 holds 48K of memory from 0x4000 as a single block
+        static const uint8_t v1_pages[] = {5, 2, 0};
 
-            zx_snapshot_load_page(&sna_file, 0x05);
-            zx_snapshot_load_page(&sna_file, 0x02);
-            zx_snapshot_load_page(&sna_file, zx_io_ports.bits.zx_port_7ffd & 0x07);
+        block.left = f_size(file) - ZX_SNAPSHOT_Z80_HEADER_SIZE;
+        block.compressed = (z80[12] & ZX_SNAPSHOT_Z80_FLAG_COMPRESSED) != 0;
+        block.run_count = 0;
 
-            f_lseek(&sna_file, ZX_SNAPSHOT_INIT_DATA_LENGTH + EMULATOR_THREE_PAGE_SIZE + 0x04);
+        for (uint8_t i = 0; i < sizeof(v1_pages); i++)
+        {
+            uint32_t addr = EMULATOR_MEMORY_AREA_START | ((v1_pages[i] + EMULATOR_ROM_PAGES_COUNT) << EMULATOR_PAGE_LEFT_SHIFT_BITS);
+            zx_snapshot_z80_unpack(&block, (uint8_t*)addr, EMULATOR_PAGE_SIZE);
+            Xil_DCacheFlushRange(addr, EMULATOR_PAGE_SIZE);
+        }
+    }
+    else
+    {
+        uint8_t block_header[ZX_SNAPSHOT_Z80_BLOCK_HEADER_SIZE];
+
+        while (zx_file_stream_read(&zx_snapshot_stream, block_header, sizeof(block_header)) == sizeof(block_header))
+        {
+            uint16_t length = block_header[0] | (block_header[1] << 8);
+            int8_t page = zx_snapshot_z80_page(block_header[2], is_128k);
+            uint32_t next = zx_file_stream_tell(&zx_snapshot_stream) + ((length == ZX_SNAPSHOT_Z80_BLOCK_RAW) ? EMULATOR_PAGE_SIZE : length);
 
-            for (uint8_t page = 0; page < ZX_SNAPSHOT_TOTAL_PAGES; page++)
+            if (page >= 0)
             {
-                if (page != 0x05 && page != 0x02 && page != (zx_io_ports.bits.zx_port_7ffd & 0x07))
-                {
-                    zx_snapshot_load_page(&sna_file, page);
-                }
+                uint32_t addr = EMULATOR_MEMORY_AREA_START | ((page + EMULATOR_ROM_PAGES_COUNT) << EMULATOR_PAGE_LEFT_SHIFT_BITS);
+
+                block.left = next - zx_file_stream_tell(&zx_snapshot_stream);
+                block.compressed = (length != ZX_SNAPSHOT_Z80_BLOCK_RAW);
+                block.run_count = 0;
+                zx_snapshot_z80_unpack(&block, (uint8_t*)addr, EMULATOR_PAGE_SIZE);
+                Xil_DCacheFlushRange(addr, EMULATOR_PAGE_SIZE);
             }
+            zx_file_stream_seek(&zx_snapshot_stream, next);
+        }
+    }
+
+    zx_spectrum_io_ports_reg_write(&zx_io_ports);
+
+    zx_snapshot_cache_put(header, pc, header[25] | (z80[27] ? 0x04 : 0x00) | (z80[28] ? 0x08 : 0x00));
+    zx_cpu_modify_pc(pc, header[25] | (z80[27] ? 0x04 : 0x00) | (z80[28] ? 0x08 : 0x00));
+    return true;
+}
+
+static bool zx_snapshot_load_szx(FIL *file)
+{
+    uint8_t szx[ZX_SNAPSHOT_SZX_HEADER_SIZE];
+    uint8_t chunk[ZX_SNAPSHOT_SZX_CHUNK_HEADER_SIZE];
+    uint8_t regs[ZX_SNAPSHOT_SZX_Z80R_SIZE];
+    uint8_t spcr[ZX_SNAPSHOT_SZX_SPCR_SIZE];
+    uint8_t header[ZX_SNAPSHOT_INIT_DATA_LENGTH];
+    zx_snapshot_szx_page_Struct pages[ZX_SNAPSHOT_TOTAL_PAGES];
+    uint8_t pages_count = 0;
+    bool regs_found = false;
+
+    zx_file_stream_init(&zx_snapshot_stream, file);
+    if (zx_file_stream_read(&zx_snapshot_stream, szx, sizeof(szx)) != sizeof(szx) || memcmp(szx, "ZXST", 4) != 0)
+    {
+        return false;
+    }
+
+    uint8_t machine = szx[6];
+    // Every machine but the 48K ones has the 128K memory paging
+    bool is_128k = !(machine == ZX_SNAPSHOT_SZX_MID_16K || machine == ZX_SNAPSHOT_SZX_MID_48K ||
+        machine == ZX_SNAPSHOT_SZX_MID_NTSC48K || machine == ZX_SNAPSHOT_SZX_MID_TC2048);
+    memset(spcr, 0, sizeof(spcr));
+
+    // Only chunk headers are read here, bodies of the chunks which are not
+    // needed are skipped by seeking and RAM pages are left for later
+    while (zx_file_stream_read(&zx_snapshot_stream, chunk, sizeof(chunk)) == sizeof(chunk))
+    {
+        uint32_t size = chunk[4] | (chunk[5] << 8) | (chunk[6] << 16) | (chunk[7] << 24);
+        uint32_t next = zx_file_stream_tell(&zx_snapshot_stream) + size;
 
-            zx_spectrum_io_ports_reg_write(&zx_io_ports);
+        if (memcmp(chunk, "Z80R", 4) == 0 && size >= ZX_SNAPSHOT_SZX_Z80R_SIZE)
+        {
+            zx_file_stream_read(&zx_snapshot_stream, regs, sizeof(regs));
+            regs_found = true;
+        }
+        else if (memcmp(chunk, "SPCR", 4) == 0 && size >= ZX_SNAPSHOT_SZX_SPCR_SIZE)
+        {
+            zx_file_stream_read(&zx_snapshot_stream, spcr, sizeof(spcr));
+        }
+        else if (memcmp(chunk, "RAMP", 4) == 0 && size > ZX_SNAPSHOT_SZX_RAMP_HEADER_SIZE && pages_count < ZX_SNAPSHOT_TOTAL_PAGES)
+        {
+            uint8_t ramp[ZX_SNAPSHOT_SZX_RAMP_HEADER_SIZE];
+            zx_file_stream_read(&zx_snapshot_stream, ramp, sizeof(ramp));
 
-            if (f_size(&sna_file) == ZX_SNAPSHOT_48K_SIZE)
+            if (ramp[2] < ZX_SNAPSHOT_TOTAL_PAGES)
             {
-                uint8_t rom_page = 0;
-                if ((zx_io_ports.bits.zx_port_7ffd & 0x10) != 0) rom_page |= 0x01;
-
-                // TODO: uncomment when full emulation of Beta Disk Interface is added
-                //if (zx_cpu_control.bits.trdos_flag == 0) rom_page |= 0x02;
-
-                // This piece of logic is extraordinary - the program counter is not
-                // saved in SNA files, instead, its value is in stack. So once
-                // the stack is initialised PC needs to be pushed out of it and
-                // this can be done by executing RET (0xC9) opcode. At this moment there
-                // is no place in RAM anymore because we have just restored the full
-                // snapshot so we simply look for this opcode in ROM and then jump
-                // to that address.
-                addr = EMULATOR_MEMORY_AREA_START + rom_page * EMULATOR_PAGE_SIZE;
-                emulator_memory_area = (uint8_t*)addr;
-                for (i = 0; i < EMULATOR_PAGE_SIZE; i++)
-                {
-                    uint8_t data = *emulator_memory_area;
-                    if (data == ZX_SNAPSHOT_OPCODE_RET)
-                    {
-                        spec_pc = i;
-                        break;
-                    }
-                    emulator_memory_area++;
-                }
+                pages[pages_count].offset = zx_file_stream_tell(&zx_snapshot_stream);
+                pages[pages_count].length = size - ZX_SNAPSHOT_SZX_RAMP_HEADER_SIZE;
+                pages[pages_count].compressed = (ramp[0] & ZX_SNAPSHOT_SZX_RAMP_COMPRESSED) != 0;
+                pages[pages_count].page = ramp[2];
+                pages_count++;
             }
+        }
+        zx_file_stream_seek(&zx_snapshot_stream, next);
+    }
+
+    if (!regs_found)
+    {
+        return false;
+    }
+
+    // Registers go into SNA header layout for the loader, SZX keeps F in the low byte of AF
+    header[0] = regs[24];
+    header[1] = regs[14]; header[2] = regs[15];
+    header[3] = regs[12]; header[4] = regs[13];
+    header[5] = regs[10]; header[6] = regs[11];
+    header[7] = regs[8]; header[8] = regs[9];
+    header[9] = regs[6]; header[10] = regs[7];
+    header[11] = regs[4]; header[12] = regs[5];
+    header[13] = regs[2]; header[14] = regs[3];
+    header[15] = regs[18]; header[16] = regs[19];
+    header[17] = regs[16]; header[18] = regs[17];
+    header[19] = regs[27] ? 0x04 : 0x00;
+    header[20] = regs[25];
+    header[21] = regs[0]; header[22] = regs[1];
+    header[23] = regs[20]; header[24] = regs[21];
+    header[25] = regs[28] & 0x03;
+    header[26] = spcr[0] & 0x07;
+
+    zx_snapshot_machine_reset();
+
+    zx_io_ports.bits.zx_port_fe = header[26];
+    zx_io_ports.bits.zx_port_7ffd = is_128k ? spcr[1] : ZX_SNAPSHOT_PORT_7FFD_48K;
+    zx_io_ports.bits.zx_port_1ffd = (machine == ZX_SNAPSHOT_SZX_MID_PLUS2A || machine == ZX_SNAPSHOT_SZX_MID_PLUS3) ? spcr[2] : 0;
+    zx_cpu_control.bits.trdos_flag = 0;
+    zx_spectrum_control_reg_write(&zx_cpu_control);
+    zx_spectrum_io_ports_reg_write(&zx_io_ports);
+
+    zx_snapshot_regs_load(header);
+
+    bool result = true;
+    for (uint8_t i = 0; i < pages_count; i++)
+    {
+        uint32_t addr = EMULATOR_MEMORY_AREA_START | ((pages[i].page + EMULATOR_ROM_PAGES_COUNT) << EMULATOR_PAGE_LEFT_SHIFT_BITS);
+        uint32_t produced;
+
+        zx_file_stream_seek(&zx_snapshot_stream, pages[i].offset);
+        if (pages[i].compressed)
+        {
+            // The page is inflated straight into the emulator memory, only the window is kept aside
+            zx_inflate_init(&zx_snapshot_inflate, &zx_snapshot_stream, pages[i].length, true);
+            produced = zx_inflate_read(&zx_snapshot_inflate, (uint8_t*)addr, EMULATOR_PAGE_SIZE);
+            if (zx_inflate_error(&zx_snapshot_inflate)) produced = 0;
+        }
+        else
+        {
+            produced = zx_file_stream_read(&zx_snapshot_stream, (uint8_t*)addr, (pages[i].length < EMULATOR_PAGE_SIZE) ? pages[i].length : EMULATOR_PAGE_SIZE);
+        }
+        Xil_DCacheFlushRange(addr, EMULATOR_PAGE_SIZE);
+
+        if (produced != EMULATOR_PAGE_SIZE)
+        {
+            xil_printf("SZX page %d is corrupted\r\n", pages[i].page);
+            result = false;
+        }
+    }
+
+    zx_spectrum_io_ports_reg_write(&zx_io_ports);
+
+    if (result)
+    {
+        zx_snapshot_cache_put(header, regs[22] | (regs[23] << 8), header[25] | (regs[26] ? 0x04 : 0x00) | (regs[27] ? 0x08 : 0x00));
+    }
+    zx_cpu_modify_pc(regs[22] | (regs[23] << 8), header[25] | (regs[26] ? 0x04 : 0x00) | (regs[27] ? 0x08 : 0x00));
+    return result;
+}
+
+void zx_snapshot_state_capture(zx_snapshot_state_Struct* p_state)
+{
+    zx_cpu_stop_wait();
+    zx_cpu_state_get(&p_state->pc, &p_state->istate);
+    zx_cpu_regs_save(p_state->header);
+
+    // The saver does not touch IFF2, IM and the border so they come from PL
+    p_state->header[19] = (p_state->istate & 0x08) ? 0x04 : 0x00;
+    p_state->header[25] = p_state->istate & 0x03;
+    p_state->header[26] = zx_io_ports.bits.zx_port_fe & 0x07;
+    p_state->io_ports = zx_io_ports;
+    p_state->trdos_flag = zx_cpu_control.bits.trdos_flag;
+}
+
+void zx_snapshot_state_prepare(const zx_snapshot_state_Struct* p_state)
+{
+    zx_cpu_stop_wait();
+
+    zx_io_ports = p_state->io_ports;
+    zx_cpu_control.bits.trdos_flag = p_state->trdos_flag;
+    zx_spectrum_control_reg_write(&zx_cpu_control);
+    zx_spectrum_io_ports_reg_write(&zx_io_ports);
+
+    zx_snapshot_regs_load(p_state->header);
+}
+
+void zx_memory_page_read(uint8_t page, uint8_t* dst)
+{
+    const uint8_t* src = (const uint8_t*)(EMULATOR_MEMORY_AREA_START | ((page + EMULATOR_ROM_PAGES_COUNT) << EMULATOR_PAGE_LEFT_SHIFT_BITS));
+
+    memcpy(dst, src, EMULATOR_PAGE_SIZE);
+    if (page == EMULATOR_PAGE_2 && zx_stub_area_in_use)
+    {
+        memcpy(dst, zx_stub_area_backup, ZX_SNAPSHOT_STUB_AREA_SIZE);
+    }
+}
+
+static void zx_snapshot_state_restore(const zx_snapshot_state_Struct* p_state, const uint8_t* ram)
+{
+    uint32_t dst = EMULATOR_MEMORY_AREA_START | (EMULATOR_ROM_PAGES_COUNT << EMULATOR_PAGE_LEFT_SHIFT_BITS);
+
+    // Same order as loading from a file: registers first as the loader
+    // occupies page 2 and then the memory goes on top of it
+    zx_snapshot_state_prepare(p_state);
+    memcpy((uint8_t*)dst, ram, ZX_SNAPSHOT_RAM_SIZE);
+    Xil_DCacheFlushRange(dst, ZX_SNAPSHOT_RAM_SIZE);
+
+    zx_cpu_modify_pc(p_state->pc, p_state->istate);
+    zx_rewind_pages_touched(0xFF);
+}
+
+static void zx_snapshot_cache_put(const uint8_t* header, uint16_t pc, uint8_t istate)
+{
+    uint8_t* ram = (uint8_t*)(EMULATOR_MEMORY_AREA_START | (EMULATOR_ROM_PAGES_COUNT << EMULATOR_PAGE_LEFT_SHIFT_BITS));
+
+    if (!zx_snapshot_cache_key_valid)
+    {
+        return;
+    }
+
+    uint8_t* dst = zx_content_cache_store(&zx_snapshot_cache_key, ZX_SNAPSHOT_CACHE_ENTRY_SIZE);
+    if (dst == NULL)
+    {
+        return;
+    }
+
+    zx_snapshot_state_Struct* p_state = (zx_snapshot_state_Struct*)(dst + ZX_SNAPSHOT_RAM_SIZE);
+    memcpy(dst, ram, ZX_SNAPSHOT_RAM_SIZE);
+    memcpy(p_state->header, header, ZX_SNAPSHOT_REGS_SIZE);
+    p_state->pc = pc;
+    p_state->istate = istate;
+    p_state->io_ports = zx_io_ports;
+    p_state->trdos_flag = zx_cpu_control.bits.trdos_flag;
+}
+
+static uint8_t* zx_snapshot_slot_address(uint8_t slot)
+{
+    return (uint8_t*)(EMULATOR_SLOTS_AREA_START + slot * EMULATOR_SLOT_SIZE);
+}
+
+bool zx_snapshot_slot_save(uint8_t slot)
+{
+    zx_snapshot_slot_Struct* p_slot = &zx_snapshot_slots[slot];
+    uint8_t* ram = (uint8_t*)(EMULATOR_MEMORY_AREA_START | (EMULATOR_ROM_PAGES_COUNT << EMULATOR_PAGE_LEFT_SHIFT_BITS));
+    uint8_t* dst = zx_snapshot_slot_address(slot);
+    XTime start, end;
+
+    if (slot >= EMULATOR_SLOTS_COUNT)
+    {
+        return false;
+    }
+
+    XTime_GetTime(&start);
+
+    bool stopped = zx_cpu_stopped();
+    zx_snapshot_state_capture(&p_slot->state);
+
+    // Page 2 gets the original bytes in place of the register saver
+    memcpy(dst, ram, ZX_SNAPSHOT_RAM_SIZE);
+    memcpy(dst + EMULATOR_PAGE_2 * EMULATOR_PAGE_SIZE, zx_stub_area_backup, ZX_SNAPSHOT_STUB_AREA_SIZE);
+    p_slot->valid = true;
+
+    zx_cpu_regs_restore(p_slot->state.header, p_slot->state.pc, p_slot->state.istate);
+    if (stopped)
+    {
+        zx_cpu_stop_wait();
+    }
+
+    XTime_GetTime(&end);
+    uint32_t us = (uint32_t)((end - start) * ZX_SNAPSHOT_US_PER_SECOND / COUNTS_PER_SECOND);
+    xil_printf("Slot %d saved in %d.%03d ms\r\n", slot + 1, us / 1000, us % 1000);
+
+    return true;
+}
+
+bool zx_snapshot_slot_load(uint8_t slot)
+{
+    zx_snapshot_slot_Struct* p_slot = &zx_snapshot_slots[slot];
+    XTime start, end;
+
+    if (slot >= EMULATOR_SLOTS_COUNT || !p_slot->valid)
+    {
+        return false;
+    }
+
+    XTime_GetTime(&start);
+
+    bool stopped = zx_cpu_stopped();
+    zx_snapshot_state_restore(&p_slot->state, zx_snapshot_slot_address(slot));
+    if (stopped)
+    {
+        zx_cpu_stop_wait();
+    }
+
+    XTime_GetTime(&end);
+    uint32_t us = (uint32_t)((end - start) * ZX_SNAPSHOT_US_PER_SECOND / COUNTS_PER_SECOND);
+    xil_printf("Slot %d restored in %d.%03d ms\r\n", slot + 1, us / 1000, us % 1000);
+
+    return true;
+}
+
+bool zx_snapshot_slot_key(uint8_t keycode)
+{
+    return (uint8_t)(keycode - ZX_SNAPSHOT_SLOT_LOAD_KEY) < EMULATOR_SLOTS_COUNT
+        || (uint8_t)(keycode - ZX_SNAPSHOT_SLOT_SAVE_KEY) < EMULATOR_SLOTS_COUNT;
+}
+
+bool zx_snapshot_hid_keycode_handle(uint8_t keycode)
+{
+    bool res = false;
+    if ((uint8_t)(keycode - ZX_SNAPSHOT_SLOT_LOAD_KEY) < EMULATOR_SLOTS_COUNT)
+    {
+        zx_snapshot_slot_load(keycode - ZX_SNAPSHOT_SLOT_LOAD_KEY);
+        res = true;
+    }
+    else if ((uint8_t)(keycode - ZX_SNAPSHOT_SLOT_SAVE_KEY) < EMULATOR_SLOTS_COUNT)
+    {
+        zx_snapshot_slot_save(keycode - ZX_SNAPSHOT_SLOT_SAVE_KEY);
+        res = true;
+    }
+    return res;
+}
+
+static bool zx_snapshot_write(FIL *file, const void* src, UINT size)
+{
+    UINT res = 0;
+    return (f_write(file, src, size, &res) == FR_OK) && (res == size);
+}
+
+static bool zx_snapshot_save_page(FIL *file, uint8_t page)
+{
+    const uint8_t* src = (const uint8_t*)(EMULATOR_MEMORY_AREA_START | ((page + EMULATOR_ROM_PAGES_COUNT) << EMULATOR_PAGE_LEFT_SHIFT_BITS));
+
+    // The beginning of page 2 holds the register saver at the moment,
+    // the original content is kept aside
+    if (page == EMULATOR_PAGE_2 && zx_stub_area_in_use)
+    {
+        return zx_snapshot_write(file, zx_stub_area_backup, ZX_SNAPSHOT_STUB_AREA_SIZE)
+            && zx_snapshot_write(file, src + ZX_SNAPSHOT_STUB_AREA_SIZE, EMULATOR_PAGE_SIZE - ZX_SNAPSHOT_STUB_AREA_SIZE);
+    }
+    return zx_snapshot_write(file, src, EMULATOR_PAGE_SIZE);
+}
+
+static bool zx_snapshot_save_sna(FIL *file, const uint8_t* header, uint16_t pc)
+{
+    uint8_t current = zx_io_ports.bits.zx_port_7ffd & 0x07;
+    uint8_t tail[ZX_SNAPSHOT_128K_TAIL_SIZE];
+    bool result;
+
+    // Always 128K layout as PC is stored explicitly and 48K machines
+    // simply have 7FFD locked
+    tail[0] = pc & 0xFF;
+    tail[1] = pc >> 8;
+    tail[2] = zx_io_ports.bits.zx_port_7ffd;
+    tail[3] = zx_cpu_control.bits.trdos_flag;
+
+    result = zx_snapshot_write(file, header, ZX_SNAPSHOT_INIT_DATA_LENGTH)
+        && zx_snapshot_save_page(file, 0x05)
+        && zx_snapshot_save_page(file, 0x02)
+        && zx_snapshot_save_page(file, current)
+        && zx_snapshot_write(file, tail, sizeof(tail));
+
+    for (uint8_t page = 0; page < ZX_SNAPSHOT_TOTAL_PAGES && result; page++)
+    {
+        if (page != 0x05 && page != 0x02 && page != current)
+        {
+            result = zx_snapshot_save_page(file, page);
+        }
+    }
+    return result;
+}
+
+static bool zx_snapshot_save_z80(FIL *file, const uint8_t* header, uint16_t pc, uint8_t istate)
+{
+    uint8_t z80[ZX_SNAPSHOT_Z80_HEADER_SIZE + 2 + ZX_SNAPSHOT_Z80_EXT_HEADER_MAX + 1];
+    uint16_t ext_size = (zx_io_ports.bits.zx_port_1ffd != 0) ? ZX_SNAPSHOT_Z80_V3_1FFD_EXT_SIZE : ZX_SNAPSHOT_Z80_EXT_HEADER_MAX;
+    uint8_t* ext = z80 + ZX_SNAPSHOT_Z80_HEADER_SIZE + 2;
+    bool result;
+
+    memset(z80, 0, sizeof(z80));
+
+    // PC of 0 in the main header marks the presence of the additional one
+    z80[0] = header[22]; z80[1] = header[21];
+    z80[2] = header[13]; z80[3] = header[14];
+    z80[4] = header[9]; z80[5] = header[10];
+    z80[8] = header[23]; z80[9] = header[24];
+    z80[10] = header[0];
+    z80[11] = header[20] & 0x7F;
+    z80[12] = (header[20] >> 7) | ((header[26] & 0x07) << 1);
+    z80[13] = header[11]; z80[14] = header[12];
+    z80[15] = header[5]; z80[16] = header[6];
+    z80[17] = header[3]; z80[18] = header[4];
+    z80[19] = header[1]; z80[20] = header[2];
+    z80[21] = header[8]; z80[22] = header[7];
+    z80[23] = header[15]; z80[24] = header[16];
+    z80[25] = header[17]; z80[26] = header[18];
+    z80[27] = (istate & 0x04) ? 1 : 0;
+    z80[28] = (istate & 0x08) ? 1 : 0;
+    z80[29] = istate & 0x03;
+
+    z80[ZX_SNAPSHOT_Z80_HEADER_SIZE] = ext_size & 0xFF;
+    z80[ZX_SNAPSHOT_Z80_HEADER_SIZE + 1] = ext_size >> 8;
+    ext[0] = pc & 0xFF;
+    ext[1] = pc >> 8;
+    ext[2] = ZX_SNAPSHOT_Z80_MODE_128K;
+    ext[3] = zx_io_ports.bits.zx_port_7ffd;
+    ext[ZX_SNAPSHOT_Z80_EXT_HEADER_MAX] = zx_io_ports.bits.zx_port_1ffd;
 
-            zx_cpu_modify_pc(spec_pc, (header[25] & 0x03) | 0x08 | (header[19] & 0x04));
-            result = true;
+    result = zx_snapshot_write(file, z80, ZX_SNAPSHOT_Z80_HEADER_SIZE + 2 + ext_size);
+
+    // Pages are stored uncompressed so that each one goes out in a single large write
+    for (uint8_t page = 0; page < ZX_SNAPSHOT_TOTAL_PAGES && result; page++)
+    {
+        uint8_t block_header[ZX_SNAPSHOT_Z80_BLOCK_HEADER_SIZE] = {ZX_SNAPSHOT_Z80_BLOCK_RAW & 0xFF, ZX_SNAPSHOT_Z80_BLOCK_RAW >> 8, page + ZX_SNAPSHOT_Z80_PAGE_OFFSET};
+        result = zx_snapshot_write(file, block_header, sizeof(block_header)) && zx_snapshot_save_page(file, page);
+    }
+    return result;
+}
+
+bool zx_snapshot_save(const char *file_name)
+{
+    bool result = false;
+    zx_snapshot_state_Struct state;
+    XTime start, end;
+
+    XTime_GetTime(&start);
+
+    bool stopped = zx_cpu_stopped();
+    zx_snapshot_state_capture(&state);
+
+    FIL file;
+    if (f_open(&file, file_name, FA_WRITE | FA_CREATE_ALWAYS) == FR_OK)
+    {
+        const char *ext = file_name + strlen(file_name);
+        while (ext > file_name && *ext != '.') ext--;
+
+        if (strcasecmp(ext, ".z80") == 0)
+        {
+            result = zx_snapshot_save_z80(&file, state.header, state.pc, state.istate);
+        }
+        else
+        {
+            result = zx_snapshot_save_sna(&file, state.header, state.pc);
+        }
+        result = (f_close(&file) == FR_OK) && result;
+    }
+
+    zx_cpu_regs_restore(state.header, state.pc, state.istate);
+    if (stopped)
+    {
+        zx_cpu_stop_wait();
+    }
+
+    XTime_GetTime(&end);
+    uint32_t us = (uint32_t)((end - start) * ZX_SNAPSHOT_US_PER_SECOND / COUNTS_PER_SECOND);
+    xil_printf("Snapshot %s %s in %d.%03d ms\r\n", file_name, result ? "saved" : "failed", us / 1000, us % 1000);
+
+    return result;
+}
+
+bool zx_snapshot_load(const char *file_name)
+{
+    bool result = false;
+
+    bool stopped = zx_cpu_stopped();
+    if (!stopped)
+    {
+        zx_cpu_stop();
+    }
+
+    zx_spectrum_io_ports_reg_read(&zx_io_ports);
+
+    const uint8_t* cached = NULL;
+    zx_snapshot_cache_key_valid = zx_content_cache_key_make(&zx_snapshot_cache_key, file_name, ZX_CONTENT_CACHE_SNAPSHOT);
+    if (zx_snapshot_cache_key_valid)
+    {
+        cached = zx_content_cache_find(&zx_snapshot_cache_key, NULL);
+    }
+
+    FIL file;
+    if (cached != NULL)
+    {
+        zx_snapshot_state_restore((const zx_snapshot_state_Struct*)(cached + ZX_SNAPSHOT_RAM_SIZE), cached);
+        xil_printf("Snapshot %s loaded from cache\r\n", file_name);
+        result = true;
+    }
+    else if (f_open(&file, file_name, FA_READ ) == FR_OK)
+    {
+        const char *ext = file_name + strlen(file_name);
+        while (ext > file_name && *ext != '.') ext--;
+
+        if (strcasecmp(ext, ".z80") == 0)
+        {
+            result = zx_snapshot_load_z80(&file);
+        }
+        else if (strcasecmp(ext, ".szx") == 0)
+        {
+            result = zx_snapshot_load_szx(&file);
         }
+        else
+        {
+            result = zx_snapshot_load_sna(&file);
+        }
+        f_close(&file);
+        zx_rewind_pages_touched(0xFF);
     }
+    zx_snapshot_cache_key_valid = false;
 
     if (!zx_cpu_stopped())
     {
@@ -241,4 +1300,3 @@ bool zx_snapshot_load(const char *file_name)
     }
     return result;
 }
-
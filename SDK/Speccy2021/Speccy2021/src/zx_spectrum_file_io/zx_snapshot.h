@@ -1,5 +1,5 @@
 //! @file zx_loader.h
-//! @brief Snapshot file (*.sna) loader
+//! @brief Snapshot file (*.sna, *.z80, *.szx) loader and saver
 //!   Originally designed by SYD as part of Speccy2010 project
 
 #ifndef ZX_SNAPSHOT_H_INCLUDED
@@ -7,17 +7,89 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include <FreeRTOS.h>
 #include <task.h>
 #include "../zynq_file_io/xilffs_v4_4/ff.h"
 #include "../zx_spectrum_io/zx_config.h"
+#include "../zx_spectrum_io/zx_rom.h"
 #include "../zx_spectrum_video/zx_spectrum_display_ctrl.h"
 #include "xil_cache.h"
+#include "xil_printf.h"
+#include "xtime_l.h"
+#include "zx_file_stream.h"
+#include "zx_inflate.h"
+#include "zx_content_cache.h"
+#include "../zynq_usb/tinyusb/class/hid/hid.h"
 
-//! @brief Initiate the process of a snapshot (*.sna) loading
+// Z80 registers are exchanged with the CPU in the layout of SNA header
+#define ZX_SNAPSHOT_REGS_SIZE (0x1B)
+#define ZX_SNAPSHOT_REG_DE (11)
+#define ZX_SNAPSHOT_REG_IX (17)
+#define ZX_SNAPSHOT_REG_F (21)
+#define ZX_SNAPSHOT_REG_A (22)
+
+//! @brief Machine state apart from RAM
+typedef struct
+{
+    uint16_t pc;
+    uint8_t istate;
+    uint8_t trdos_flag;
+    reg_ZX_Spectrum_io_ports_Struct io_ports;
+    uint8_t header[ZX_SNAPSHOT_REGS_SIZE];
+} zx_snapshot_state_Struct;
+
+// F1...F4 restore and F5...F8 save quick slots
+#define ZX_SNAPSHOT_SLOT_LOAD_KEY (HID_KEY_F1)
+#define ZX_SNAPSHOT_SLOT_SAVE_KEY (HID_KEY_F5)
+
+//! @brief Initiate the process of a snapshot (*.sna, *.z80, *.szx) loading,
+//!   the format is chosen by the file extension
 //! @param *name is a pointer to the file name
+//! @return true if the snapshot has been loaded or false otherwise
 bool zx_snapshot_load(const char *file_name);
 
+//! @brief Save the state of the machine into a snapshot (*.sna, *.z80),
+//!   the format is chosen by the file extension. The CPU is halted while
+//!   its registers are read back and resumes afterwards
+//! @param *name is a pointer to the file name
+//! @return true if the snapshot has been saved or false otherwise
+bool zx_snapshot_save(const char *file_name);
+
+//! @brief Halt the CPU and capture the machine state. The CPU stays halted with
+//!   the register saver in page 2 until zx_cpu_regs_restore is called
+//! @param *p_state is a pointer to the state to be filled
+void zx_snapshot_state_capture(zx_snapshot_state_Struct* p_state);
+
+//! @brief Halt the CPU and bring back the ports and the registers. The loader
+//!   runs in page 2 so RAM has to be written afterwards and the CPU resumed with zx_cpu_modify_pc
+//! @param *p_state is a pointer to the state to be restored
+void zx_snapshot_state_prepare(const zx_snapshot_state_Struct* p_state);
+
+//! @brief Copy a RAM page with the bytes kept aside by zx_cpu_regs_save in place
+//! @param page is the RAM page number
+//! @param *dst is a pointer to EMULATOR_PAGE_SIZE bytes of the destination
+void zx_memory_page_read(uint8_t page, uint8_t* dst);
+
+//! @brief Copy the state of the machine into a quick save slot in DDR
+//! @param slot is the slot number in the range of 0...EMULATOR_SLOTS_COUNT - 1
+//! @return true if the state has been saved or false otherwise
+bool zx_snapshot_slot_save(uint8_t slot);
+
+//! @brief Bring the state of the machine back from a quick save slot in DDR
+//! @param slot is the slot number in the range of 0...EMULATOR_SLOTS_COUNT - 1
+//! @return true if the state has been restored or false if the slot is empty
+bool zx_snapshot_slot_load(uint8_t slot);
+
+//! @brief Check whether a key is bound to quick save slots
+//! @param keycode is a HID keycode
+//! @return true if the key saves or restores a slot or false otherwise
+bool zx_snapshot_slot_key(uint8_t keycode);
+
+//! @brief Handle keyboard events
+//! @return true if the even has been consumed false otherwise
+bool zx_snapshot_hid_keycode_handle(uint8_t keycode);
+
 //! @brief Release the emulated Z80 CPU from reset
 void zx_cpu_start(void);
 
@@ -32,6 +104,47 @@ void zx_cpu_stop(void);
 //! @return true is the CPU is held in HALT mode or false otherwise
 bool zx_cpu_stopped(void);
 
+//! @brief Restart the stopped emulated Z80 CPU from a new address
+//! @param pc is the new value of the program counter
+//! @param istate holds IFF2, IFF1 and IM in bits 3...0
+void zx_cpu_modify_pc(uint16_t pc, uint8_t istate);
+
+//! @brief Get the program counter and the interrupt state of the stopped CPU
+//! @param *pc is a pointer to the program counter value
+//! @param *istate is a pointer to IFF2, IFF1 and IM value in bits 3...0
+void zx_cpu_state_get(uint16_t* pc, uint8_t* istate);
+
+//! @brief Get the TR-DOS ROM paging state of the emulated Z80 CPU
+//! @return true if the TR-DOS ROM is paged in or false otherwise
+bool zx_cpu_trdos_active(void);
+
+//! @brief Capture registers of the stopped CPU by running a helper routine in page 2.
+//!   The memory used by the routine is kept aside until zx_cpu_regs_restore
+//!   so that zx_memory_read, zx_memory_write still see the original content
+//! @param *regs is a pointer to ZX_SNAPSHOT_REGS_SIZE bytes in SNA header layout
+void zx_cpu_regs_save(uint8_t* regs);
+
+//! @brief Load registers into the stopped CPU, put back the memory used by
+//!   the helper routine and resume execution
+//! @param *regs is a pointer to ZX_SNAPSHOT_REGS_SIZE bytes in SNA header layout
+//! @param pc is the address to resume from
+//! @param istate holds IFF2, IFF1 and IM in bits 3...0
+void zx_cpu_regs_restore(const uint8_t* regs, uint16_t pc, uint8_t istate);
+
+//! @brief Read a byte of the emulated memory as seen by the CPU with current paging
+//! @param addr is the Z80 address
+//! @return the byte value
+uint8_t zx_memory_read(uint16_t addr);
+
+//! @brief Write a byte of the emulated memory as seen by the CPU with current paging.
+//!   Writes to ROM are ignored, call zx_memory_flush when done
+//! @param addr is the Z80 address
+//! @param value is the byte value
+void zx_memory_write(uint16_t addr, uint8_t value);
+
+//! @brief Make the bytes written by zx_memory_write visible to PL
+void zx_memory_flush(void);
+
 #endif
 
 
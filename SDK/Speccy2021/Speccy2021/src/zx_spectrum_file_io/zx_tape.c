@@ -16,9 +16,63 @@
 #define ZX_TAPE_BLOCK_DATA 0
 #define ZX_TAPE_SEQUENCE_DATA 1
 #define ZX_TAPE_SKIP_DATA 2
+#define ZX_TAPE_STREAM_DATA 3
+#define ZX_TAPE_LEVEL_DATA 4
 #define ZX_TAPE_PATH_SIZE 0x80
 #define ZX_TAPE_LOOPS_SIZE 0x10
 #define ZX_TAPE_FIFO_DEPTH 0x30
+#define ZX_TAPE_PAUSE_PULSE 3500
+#define ZX_TAPE_PULSE_FLAG 0x8000
+#define ZX_TAPE_PULSE_LENGTH_MASK 0x7fff
+#define ZX_TAPE_PACKET_REPEAT 0x8000
+#define ZX_TAPE_PACKET_BYTE 0x0000
+#define ZX_TAPE_TZX_HEADER_SIZE 10
+#define ZX_TAPE_FLAGS_LOADED 0x93
+#define ZX_TAPE_FLAG_CARRY 0x01
+#define ZX_TAPE_ISTATE_EI 0x0C
+#define ZX_TAPE_CACHE_DIR "zxcache"
+#define ZX_TAPE_CACHE_MAGIC 0x3343505A
+#define ZX_TAPE_CACHE_BUF_WORDS 0x400
+#define ZX_TAPE_CACHE_BURST 8
+#define ZX_TAPE_CACHE_SLICE_WORDS 0x800
+#define ZX_TAPE_CACHE_HASH_BASIS 0x811C9DC5
+#define ZX_TAPE_CACHE_HASH_PRIME 0x01000193
+#define ZX_TAPE_STD_BLOCK_ID 0x10
+#define ZX_TAPE_STD_HEADER_LENGTH 19
+#define ZX_TAPE_STD_HEADER_PEEK 12
+#define ZX_TAPE_CPU_CLOCK 3500000
+#define ZX_TAPE_EDGE_HOLD_MAX 0x7000
+#define ZX_TAPE_TICKS_MAX 0xFFFF
+#define ZX_TAPE_SYMBOLS_SIZE 0x1000
+#define ZX_TAPE_CSW_HEADER_SIZE 10
+#define ZX_TAPE_CSW_ZRLE 2
+#define ZX_TAPE_GDB_HEADER_SIZE 14
+#define ZX_TAPE_GDB_PILOT_ENTRY 3
+#define ZX_TAPE_FORMAT_TAP 0
+#define ZX_TAPE_FORMAT_TZX 1
+#define ZX_TAPE_FORMAT_PZX 2
+#define ZX_TAPE_FORMAT_CSW 3
+#define ZX_TAPE_PZX_HEADER_SIZE 8
+#define ZX_TAPE_PZX_DATA_HEADER_SIZE 8
+#define ZX_TAPE_PZX_PULS_ID 0xF0
+#define ZX_TAPE_PZX_DATA_ID 0xF1
+#define ZX_TAPE_PZX_PAUS_ID 0xF2
+#define ZX_TAPE_PZX_INFO_ID 0xF3
+#define ZX_TAPE_CSW_ID 0xF4
+#define ZX_TAPE_CSW_SIGNATURE "Compressed Square Wave\x1A"
+#define ZX_TAPE_CSW_SIGNATURE_SIZE 23
+#define ZX_TAPE_CSW_V1_HEADER_SIZE 0x20
+#define ZX_TAPE_CSW_V2_HEADER_SIZE 0x34
+#define ZX_TAPE_HW_FIFO_SIZE 1024
+#define ZX_TAPE_HW_FIFO_HEADROOM 8
+#define ZX_TAPE_HW_FIFO_LOW_WATER 512
+// IRQ_F2P[1] of the processing system
+#define ZX_TAPE_IRQ_ID 62
+#define ZX_TAPE_IRQ_PRIORITY 0xA8
+#define ZX_TAPE_IRQ_LEVEL_HIGH 0x1
+#define ZX_TAPE_TASK_STACK_SIZE 2048
+#define ZX_TAPE_TASK_PRIO (tskIDLE_PRIORITY + 3)
+#define ZX_TAPE_TASK_POLL_MS 10
 
 typedef struct
 {
@@ -41,29 +95,330 @@ typedef struct
     uint8_t data_type;
 } zx_tape_block_Struct;
 
+// Decoding state of a block which is read straight from the file instead of
+// going through the byte FIFO: direct recording (0x15), CSW (0x18) and
+// generalized data (0x19) blocks of TZX, all signal blocks of PZX and the
+// whole of a CSW file. Only one symbol table is kept at a time so memory
+// use does not depend on the size of the block.
+typedef struct
+{
+    uint8_t id;
+    uint32_t end;
+    uint32_t sample;
+    uint8_t last_bits;
+    uint8_t data;
+    uint8_t data_bits;
+    bool zrle;
+    uint8_t level;
+    uint32_t duration;
+    uint32_t ticks_left;
+    uint32_t totp;
+    uint32_t totd;
+    uint8_t np;
+    uint16_t as;
+    uint8_t nb;
+    bool data_table;
+    uint16_t symbol;
+    uint8_t pulse;
+    uint16_t repeat;
+    uint8_t p0;
+    uint8_t p1;
+    bool packed;
+    uint8_t symbols[ZX_TAPE_SYMBOLS_SIZE];
+} zx_tape_signal_Struct;
+
+// Pulse stream cache file starts with this header followed by the words
+// exactly as they are sent to the PL FIFO
+typedef struct
+{
+    uint32_t magic;
+    uint32_t source_size;
+    uint16_t source_date;
+    uint16_t source_time;
+    uint32_t words;
+    uint32_t blocks;
+} zx_tape_cache_header_Struct;
+
+// Everything the playback pipeline keeps between calls. Live playback and
+// the cache compiler each have their own so that a tape can be compiled a
+// slice at a time while it is being played
+typedef struct
+{
+    bool started;
+    bool finished;
+    zx_tape_block_Struct current_block;
+    zx_tape_fifo_Struct fifo;
+    uint8_t fifo_buf[ZX_TAPE_FIFO_DEPTH];
+    FIL file;
+    zx_file_stream_Struct stream;
+    uint32_t header_size;
+    uint32_t data_size;
+    uint8_t header[0x20];
+    uint32_t header_pos;
+    uint8_t block_header[0x20];
+    uint8_t block_header_pos;
+    uint8_t block_header_size;
+    zx_tape_loop_Struct loops[ZX_TAPE_LOOPS_SIZE];
+    int loops_size;
+    int32_t index_current;
+    int32_t pending[ZX_TAPE_FIFO_DEPTH];
+    uint32_t pending_head;
+    uint32_t pending_tail;
+    uint8_t level;
+    uint32_t edge_pending;
+    bool signal_busy;
+    zx_tape_signal_Struct signal;
+    zx_inflate_Struct inflate;
+} zx_tape_pipe_Struct;
+
 static reg_ZX_Tape_fifo_Struct zx_tape_fifo_reg;
-static bool zx_tape_tape_started = false;
+static zx_tape_pipe_Struct zx_tape_live_pipe;
+static zx_tape_pipe_Struct zx_tape_compile_pipe;
+static zx_tape_pipe_Struct* zx_tape_pipe = &zx_tape_live_pipe;
 static bool zx_tape_tape_restart = false;
-static bool zx_tape_tape_finished = false;
-static bool zx_tape_tzx = false;
-static zx_tape_block_Struct zx_tape_current_block;
+static uint8_t zx_tape_format = ZX_TAPE_FORMAT_TAP;
+static uint32_t zx_tape_csw_rate;
+static bool zx_tape_csw_zrle;
+static uint8_t zx_tape_csw_level;
+static uint32_t zx_tape_csw_offset;
+static uint32_t zx_tape_csw_data_size;
 static char zx_tape_path[ZX_TAPE_PATH_SIZE];
-static zx_tape_fifo_Struct zx_tape_fifo;
-static uint8_t zx_tape_fifo_buf[ZX_TAPE_FIFO_DEPTH];
+static uint32_t zx_tape_start_pos = 0;
+static bool zx_tape_flash_enabled = true;
+static bool zx_tape_flash_armed = false;
+static bool zx_tape_flash_finished = false;
+static uint32_t zx_tape_flash_pos = 0;
+static FIL zx_tape_flash_file;
+static zx_file_stream_Struct zx_tape_flash_stream;
+static const uint8_t* zx_tape_content = NULL;
+static uint32_t zx_tape_content_length = 0;
+static bool zx_tape_cache_playing = false;
+static bool zx_tape_cache_compiling = false;
+static bool zx_tape_cache_error = false;
+static FIL zx_tape_cache_file;
+static bool zx_tape_cache_job = false;
+static FIL zx_tape_cache_job_file;
+static char zx_tape_cache_job_path[ZX_TAPE_PATH_SIZE];
+static zx_tape_cache_header_Struct zx_tape_cache_job_header;
+static uint32_t zx_tape_cache_slice_left;
+static zx_file_stream_Struct zx_tape_cache_stream;
+static uint16_t zx_tape_cache_buf[ZX_TAPE_CACHE_BUF_WORDS];
+static uint32_t zx_tape_cache_buf_pos;
+static uint32_t zx_tape_cache_words;
+static uint32_t zx_tape_cache_play_words;
+static zx_tape_index_entry_Struct zx_tape_index[ZX_TAPE_INDEX_SIZE];
+static uint32_t zx_tape_index_count = 0;
+static uint32_t zx_tape_hw_fifo_room = 0;
+static uint16_t zx_tape_underflows = 0;
+static bool zx_tape_irq_enabled = false;
+static reg_ZX_Tape_fifo_ctrl_Struct zx_tape_fifo_ctrl_reg;
+static TaskHandle_t zx_tape_task_handle = NULL;
+static SemaphoreHandle_t zx_tape_mutex = NULL;
+
+// Interrupt controller structure defined in FreeRTOS
+extern XScuGic xInterruptController;
 
 //! @brief Get the status of the FIFO
-//! @return true if the FIFO is full or false otherwise
+//! @return true if the FIFO has no room for the longest packet or false otherwise
 static bool zx_tape_fifo_full(void);
 
+//! @brief Write the FIFO control register in PL
+//! @param irq_clear is set to true to acknowledge the low-water interrupt
+//! @param underflows_clear is set to true to reset the underflow counter
+static void zx_tape_fifo_ctrl_write(bool irq_clear, bool underflows_clear);
+
+//! @brief Low-water interrupt handler of the FIFO in PL
+//! @param *data is not used
+static void zx_tape_irq_handler(void* data);
+
+//! @brief Tape task which refills the FIFO in PL
+//! @param *param is not used
+static void zx_tape_task(void* param);
+
+//! @brief Put one word into the FIFO
+//! @param word is a pulse word or a part of a packet
+static void zx_tape_send_word(uint16_t word);
+
 //! @brief Put the audio data into the FIFO
 //! @param pulseLength is the length of the pulse in ZX Spectrum units
 //! @param pulse is set to true for a pulse or false otherwise
 static void zx_tape_send(uint16_t pulseLength, bool pulse);
 
+//! @brief Put a packet into the FIFO which is expanded by PL into a number of identical pulses
+//! @param pulseLength is the length of the pulse in ZX Spectrum units
+//! @param pulse is set to true for a pulse or false otherwise
+//! @param count is the number of pulses
+static void zx_tape_send_repeat(uint16_t pulseLength, bool pulse, uint16_t count);
+
+//! @brief Put a packet into the FIFO which is expanded by PL into two pulses per bit, MSB first
+//! @param zeroLength is the length of the pulse for bit 0 in ZX Spectrum units
+//! @param oneLength is the length of the pulse for bit 1 in ZX Spectrum units
+//! @param data is the byte to be sent
+//! @param bits is the number of bits to be sent, in range of 1...8
+static void zx_tape_send_byte(uint16_t zeroLength, uint16_t oneLength, uint8_t data, uint8_t bits);
+
+//! @brief Keep the current level for a while without an edge
+//! @param length is the time in PL units, up to ZX_TAPE_PULSE_LENGTH_MASK
+static void zx_tape_edge_hold(uint16_t length);
+
+//! @brief Change the level of the signal, the time accumulated at the previous level is sent as a pulse
+//! @param level is the new level, 0 or 1
+static void zx_tape_edge_level(uint8_t level);
+
+//! @brief Let the time pass at the current level
+//! @param ticks is the time in T-states, up to ZX_TAPE_TICKS_MAX
+static void zx_tape_edge_advance(uint32_t ticks);
+
+//! @brief Prepare decoding of a block which is read straight from the file
+//! @param *header is a pointer to the TZX block header
+//! @return true if the block can be played or false otherwise
+static bool zx_tape_signal_start(uint8_t* header);
+
+//! @brief Read the next byte of a streamed block
+//! @param *value is a pointer to the destination byte
+//! @return false at the end of the block or true otherwise
+static bool zx_tape_signal_byte(uint8_t* value);
+
+//! @brief Read the next 16-bit value of a streamed block
+//! @param *value is a pointer to the destination value
+//! @return false at the end of the block or true otherwise
+static bool zx_tape_signal_word(uint16_t* value);
+
+//! @brief Play a portion of the pulse in progress
+//! @return true if a pulse is in progress or false otherwise
+static bool zx_tape_signal_ticks(void);
+
+//! @brief Read a symbol table of a generalized data block
+//! @param as is the number of symbols
+//! @param np is the maximum number of pulses per symbol
+//! @return true if the table fits into the buffer or false otherwise
+static bool zx_tape_signal_table(uint16_t as, uint8_t np);
+
+//! @brief Produce the next edge of a streamed block, the output is kept within
+//!   the room the PL FIFO has when it is almost full
+//! @return false at the end of the block or true otherwise
+static bool zx_tape_signal_fill(void);
+
+//! @brief Play the next edge of a direct recording block (0x15)
+//! @return false at the end of the block or true otherwise
+static bool zx_tape_signal_direct(void);
+
+//! @brief Play the next pulse of a CSW block (0x18)
+//! @return false at the end of the block or true otherwise
+static bool zx_tape_signal_csw(void);
+
+//! @brief Play the next pulse of a generalized data block (0x19)
+//! @return false at the end of the block or true otherwise
+static bool zx_tape_signal_general(void);
+
+//! @brief Play the next pulse of a PZX pulse sequence block (PULS)
+//! @return false at the end of the block or true otherwise
+static bool zx_tape_signal_pzx_pulses(void);
+
+//! @brief Play the next pulse of a PZX data block (DATA)
+//! @return false at the end of the block or true otherwise
+static bool zx_tape_signal_pzx_data(void);
+
 //! @brief Fill the FIFO with a new portion of audio data
 //! @return false if the end of data stream has been reached or true otherwise
 static bool zx_tape_fill_buffer(void);
 
+//! @brief Arm or disarm the ROM loader trap
+//! @param armed set to true to stop the CPU at the entry of LD-BYTES
+static void zx_tape_flash_arm(bool armed);
+
+//! @brief Arm the ROM loader trap when it is needed and serve it once it fires
+static void zx_tape_flash_routine(void);
+
+//! @brief Serve the ROM loader trap: copy the next standard block straight into
+//!   memory, or hand the rest of the tape over to pulse playback if the next
+//!   block is not a standard one
+static void zx_tape_flash_load(void);
+
+//! @brief Find the next block which produces a signal for the ROM loader
+//! @param *data_size is a pointer to the size of the data following the header
+//! @return true if it is a standard data block or false otherwise
+static bool zx_tape_flash_next_block(uint32_t* data_size);
+
+//! @brief Find out the format of a tape file
+//! @param *stream is a pointer to the stream of the file
+//! @return the offset of the first block, the stream is positioned there
+static uint32_t zx_tape_detect(zx_file_stream_Struct* stream);
+
+//! @brief Read the header of the next block
+//! @param *stream is a pointer to the stream positioned at the block
+//! @param *header is a pointer to the destination buffer
+//! @return the size of the header or 0 at the end of the file
+static uint8_t zx_tape_read_header(zx_file_stream_Struct* stream, uint8_t* header);
+
+//! @brief Get the kind of a block, the same as the block ID for TZX
+//! @param *header is a pointer to the block header
+//! @return TZX block ID or one of ZX_TAPE_PZX_*_ID, ZX_TAPE_CSW_ID
+static uint8_t zx_tape_block_type(uint8_t* header);
+
+//! @brief Find the selected file in the content cache or read it there in one go
+static void zx_tape_content_load(void);
+
+//! @brief Attach a stream to the selected file, taken from the content cache if it is there
+//! @param *stream is a pointer to the stream
+//! @param *file is a pointer to the file object used when the file is not cached
+//! @return true if the stream is ready or false otherwise
+static bool zx_tape_stream_open(zx_file_stream_Struct* stream, FIL* file);
+
+//! @brief Open the selected file and position it at the first block to be played
+//! @param start is the offset of the block to start from or 0 for the first block
+//! @return true if the file has been opened or false otherwise
+static bool zx_tape_open(uint32_t start);
+
+//! @brief Open the selected file in a single pass and record every block into the index
+static void zx_tape_index_build(void);
+
+//! @brief Find the index entry of a block
+//! @param offset is the file offset of the block
+//! @return the entry number or -1 if there is no block at this offset
+static int32_t zx_tape_index_find(uint32_t offset);
+
+//! @brief Follow the position of the cache playback through the index
+//! @param word is the number of words already played from the cache
+static void zx_tape_index_cache_follow(uint32_t word);
+
+//! @brief Parse the blocks of the file and queue their headers and data for zx_tape_fill_buffer
+static void zx_tape_read_blocks(void);
+
+//! @brief Turn the queued blocks into FIFO words
+static void zx_tape_generate(void);
+
+//! @brief Get the name hash used as the cache file name
+//! @param *str is a pointer to the tape file name
+//! @return FNV-1a hash of the name
+static uint32_t zx_tape_cache_hash(const char* str);
+
+//! @brief Write the collected words into the cache file
+static void zx_tape_cache_flush(void);
+
+//! @brief Collect one word for the cache file
+//! @param word is the word to be written
+static void zx_tape_cache_put_word(uint16_t word);
+
+//! @brief Start compiling the selected tape into a cache file, live playback carries on meanwhile
+//! @param *path is the name of the cache file
+//! @param *header is a pointer to the cache header describing the tape
+static void zx_tape_cache_compile_start(const char* path, const zx_tape_cache_header_Struct* header);
+
+//! @brief Run the next slice of the tape through the cache compiler
+static void zx_tape_cache_compile_step(void);
+
+//! @brief Close the cache file being compiled, it is kept only if the whole tape has been compiled
+//! @param complete is true if the whole tape has been compiled
+static void zx_tape_cache_compile_end(bool complete);
+
+//! @brief Open the cache file of the selected tape or start compiling it if it is missing or out of date
+//! @return true if playback can be served from the cache or false otherwise
+static bool zx_tape_cache_prepare(void);
+
+//! @brief Copy the cached words into the FIFO while it has room
+static void zx_tape_cache_play(void);
+
 
 void zx_tape_block_clean(zx_tape_block_Struct* zx_tape_block)
 {
@@ -88,6 +443,11 @@ bool zx_tape_hid_keycode_handle(uint8_t keycode)
         }
         res = true;
     }
+    else if (HID_KEY_EQUAL == keycode)
+    {
+        zx_tape_flash_load_set(!zx_tape_flash_load_get());
+        res = true;
+    }
     return res;
 }
 
@@ -125,7 +485,19 @@ void zx_tape_block_parse_header(uint8_t* header, zx_tape_block_Struct* zx_tape_b
     zx_tape_block->tape_pause = 0;
     zx_tape_block->data_size = 0;
 
-    if (!zx_tape_tzx)
+    if (zx_tape_format == ZX_TAPE_FORMAT_PZX)
+    {
+        uint8_t type = zx_tape_block_type(header);
+
+        zx_tape_block->data_size = zx_tape_read_dword(header + 4);
+        zx_tape_block->data_type = type == ZX_TAPE_PZX_INFO_ID ? ZX_TAPE_SKIP_DATA : ZX_TAPE_STREAM_DATA;
+    }
+    else if (zx_tape_format == ZX_TAPE_FORMAT_CSW)
+    {
+        zx_tape_block->data_size = zx_tape_csw_data_size;
+        zx_tape_block->data_type = ZX_TAPE_STREAM_DATA;
+    }
+    else if (zx_tape_format == ZX_TAPE_FORMAT_TAP)
     {
         zx_tape_block->tape_pilot = 6000;
         zx_tape_block->tape_sync = 2;
@@ -184,8 +556,16 @@ void zx_tape_block_parse_header(uint8_t* header, zx_tape_block_Struct* zx_tape_b
                 break;
 
             case 0x15:
-                zx_tape_block->data_size = zx_tape_read_word3(header + 6) * 2;
-                zx_tape_block->data_type = ZX_TAPE_SKIP_DATA;
+                zx_tape_block->tape_pause = zx_tape_read_word(header + 3);
+                zx_tape_block->data_size = zx_tape_read_word3(header + 6);
+                zx_tape_block->data_type = ZX_TAPE_STREAM_DATA;
+                break;
+
+            case 0x18:
+            case 0x19:
+                // The pause is a part of the data and gets known once the block is started
+                zx_tape_block->data_size = zx_tape_read_dword(header + 1);
+                zx_tape_block->data_type = ZX_TAPE_STREAM_DATA;
                 break;
 
             case 0x20:
@@ -206,6 +586,10 @@ void zx_tape_block_parse_header(uint8_t* header, zx_tape_block_Struct* zx_tape_b
                 break;
             case 0x25:
                 break;
+            case 0x2B:
+                zx_tape_block->data_size = zx_tape_read_dword(header + 1);
+                zx_tape_block->data_type = ZX_TAPE_LEVEL_DATA;
+                break;
             case 0x31:
                 zx_tape_block->data_size = header[2];
                 zx_tape_block->data_type = ZX_TAPE_SKIP_DATA;
@@ -240,192 +624,533 @@ void zx_tape_block_parse_header(uint8_t* header, zx_tape_block_Struct* zx_tape_b
     }
 }
 
-void zx_tape_select_file(const char *name)
+uint8_t zx_tape_get_header_size(uint8_t code)
 {
-    sniprintf(zx_tape_path, sizeof(zx_tape_path), "%s", name);
+    if (zx_tape_format == ZX_TAPE_FORMAT_PZX) return ZX_TAPE_PZX_HEADER_SIZE;
+    else if (zx_tape_format == ZX_TAPE_FORMAT_CSW) return 1;
+    else if (zx_tape_format == ZX_TAPE_FORMAT_TZX)
+    {
+        const uint8_t tzx_header_size[] =
+        {
+            5, 19, 5, 2, 11, 9, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 3, 2, 1, 3, 3, 1, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 2, 3, 3, 2, 9, 0x15,
+        };
+
+        if( code == 'Z' ) return 10;
+        else return tzx_header_size[ code - 0x10 ];
+    }
+    else return 2;
 }
 
-void zx_tape_start()
+uint32_t zx_tape_get_data_size(uint8_t* header)
 {
-    zx_tape_tape_started = true;
-
-    zx_fifo_init(&zx_tape_fifo, zx_tape_fifo_buf, ZX_TAPE_FIFO_DEPTH);
-    zx_fifo_clean(&zx_tape_fifo);
+    if (zx_tape_format != ZX_TAPE_FORMAT_TAP) return 0;
+    else return zx_tape_read_word(header);
 }
 
-void zx_tape_stop()
+static uint32_t zx_tape_detect(zx_file_stream_Struct* stream)
 {
-    zx_tape_tape_started = false;
+    uint8_t buff[ZX_TAPE_CSW_V2_HEADER_SIZE];
+    uint32_t size = zx_file_stream_read(stream, buff, sizeof(buff));
+    uint32_t start = 0;
+
+    zx_tape_format = ZX_TAPE_FORMAT_TAP;
+
+    if (size >= ZX_TAPE_TZX_HEADER_SIZE && buff[0] == 'Z' && buff[1] == 'X' && buff[2] == 'T')
+    {
+        zx_tape_format = ZX_TAPE_FORMAT_TZX;
+        start = ZX_TAPE_TZX_HEADER_SIZE;
+    }
+    else if (size >= ZX_TAPE_PZX_HEADER_SIZE && memcmp(buff, "PZXT", 4) == 0)
+    {
+        // The PZX header is an ordinary block which is skipped
+        zx_tape_format = ZX_TAPE_FORMAT_PZX;
+    }
+    else if (size >= ZX_TAPE_CSW_V1_HEADER_SIZE && memcmp(buff, ZX_TAPE_CSW_SIGNATURE, ZX_TAPE_CSW_SIGNATURE_SIZE) == 0)
+    {
+        if (buff[0x17] == 1)
+        {
+            zx_tape_csw_rate = zx_tape_read_word(buff + 0x19);
+            zx_tape_csw_zrle = false;
+            zx_tape_csw_level = buff[0x1C] & 0x01;
+            start = ZX_TAPE_CSW_V1_HEADER_SIZE;
+        }
+        else if (size == ZX_TAPE_CSW_V2_HEADER_SIZE)
+        {
+            zx_tape_csw_rate = zx_tape_read_dword(buff + 0x19);
+            zx_tape_csw_zrle = buff[0x21] == ZX_TAPE_CSW_ZRLE;
+            zx_tape_csw_level = buff[0x22] & 0x01;
+            start = ZX_TAPE_CSW_V2_HEADER_SIZE + buff[0x23];
+        }
+
+        // The pulses of a CSW file make a single block, the last byte of the
+        // file header stands for its block header so that the block has an offset
+        if (start > 0 && start <= zx_file_stream_size_get(stream))
+        {
+            zx_tape_format = ZX_TAPE_FORMAT_CSW;
+            zx_tape_csw_data_size = zx_file_stream_size_get(stream) - start;
+            zx_tape_csw_offset = --start;
+        }
+        else
+        {
+            start = zx_file_stream_size_get(stream);
+        }
+    }
+
+    zx_file_stream_seek(stream, start);
+    return start;
 }
 
-void zx_tape_restart()
+static uint8_t zx_tape_read_header(zx_file_stream_Struct* stream, uint8_t* header)
 {
-    zx_tape_block_clean(&zx_tape_current_block);
+    if (zx_tape_format == ZX_TAPE_FORMAT_CSW && zx_file_stream_tell(stream) != zx_tape_csw_offset)
+    {
+        return 0;
+    }
 
-    zx_fifo_init(&zx_tape_fifo, zx_tape_fifo_buf, ZX_TAPE_FIFO_DEPTH);
-    zx_fifo_clean(&zx_tape_fifo);
+    if (!zx_file_stream_read_byte(stream, header))
+    {
+        return 0;
+    }
 
-    zx_tape_tape_restart = true;
-    zx_tape_tape_started = true;
+    uint8_t hs = zx_tape_get_header_size(header[0]);
+    if (zx_file_stream_read(stream, header + 1, hs - 1) + 1 != hs)
+    {
+        return 0;
+    }
+    return hs;
 }
 
-bool zx_tape_started()
+static uint8_t zx_tape_block_type(uint8_t* header)
 {
-    return zx_tape_tape_started;
+    if (zx_tape_format == ZX_TAPE_FORMAT_TZX) return header[0];
+    else if (zx_tape_format == ZX_TAPE_FORMAT_CSW) return ZX_TAPE_CSW_ID;
+    else if (zx_tape_format == ZX_TAPE_FORMAT_PZX)
+    {
+        if (memcmp(header, "PULS", 4) == 0) return ZX_TAPE_PZX_PULS_ID;
+        else if (memcmp(header, "DATA", 4) == 0) return ZX_TAPE_PZX_DATA_ID;
+        else if (memcmp(header, "PAUS", 4) == 0) return ZX_TAPE_PZX_PAUS_ID;
+        else return ZX_TAPE_PZX_INFO_ID;
+    }
+    else return ZX_TAPE_STD_BLOCK_ID;
 }
 
-uint8_t zx_tape_get_header_size(uint8_t code)
+void zx_tape_select_file(const char *name)
 {
-    if (zx_tape_tzx)
+    // A newly inserted tape stops the previous one and drops its unfinished cache
+    if (zx_tape_cache_job)
     {
-        const uint8_t tzx_header_size[] =
+        zx_tape_cache_compile_end(false);
+    }
+
+    sniprintf(zx_tape_path, sizeof(zx_tape_path), "%s", name);
+
+    zx_tape_pipe->started = false;
+    zx_tape_tape_restart = true;
+    zx_tape_cache_playing = false;
+    zx_tape_block_clean(&zx_tape_pipe->current_block);
+
+    zx_tape_start_pos = 0;
+    zx_tape_flash_finished = false;
+    zx_tape_content_load();
+    zx_tape_index_build();
+
+    zx_tape_underflows = 0;
+    zx_tape_fifo_ctrl_write(false, true);
+}
+
+static void zx_tape_content_load()
+{
+    zx_content_cache_key_Struct key;
+
+    if (zx_tape_content != NULL)
+    {
+        zx_content_cache_pin(zx_tape_content, false);
+        zx_tape_content = NULL;
+    }
+
+    if (!zx_content_cache_key_make(&key, zx_tape_path, ZX_CONTENT_CACHE_TAPE))
+    {
+        return;
+    }
+
+    const uint8_t* content = zx_content_cache_find(&key, &zx_tape_content_length);
+    if (content == NULL)
+    {
+        // The whole file is read with a single call, FatFs hands the sectors
+        // straight to the SD card DMA as the room is aligned
+        uint8_t* room = zx_content_cache_store(&key, key.size);
+        if (room == NULL)
         {
-            5, 19, 5, 2, 11, 9, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 3, 2, 1, 3, 3, 1, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 2, 3, 3, 2, 9, 0x15,
-        };
+            return;
+        }
 
-        if( code == 'Z' ) return 10;
-        else return tzx_header_size[ code - 0x10 ];
+        UINT res = 0;
+        if (f_open(&zx_tape_pipe->file, zx_tape_path, FA_READ) == FR_OK)
+        {
+            f_read(&zx_tape_pipe->file, room, key.size, &res);
+            f_close(&zx_tape_pipe->file);
+        }
+
+        if (res != key.size)
+        {
+            zx_content_cache_drop(room);
+            return;
+        }
+        content = room;
+        zx_tape_content_length = key.size;
     }
-    else return 2;
+
+    // The tape stays in the cache for as long as it is inserted
+    zx_content_cache_pin(content, true);
+    zx_tape_content = content;
 }
 
-uint32_t zx_tape_get_data_size(uint8_t* header)
+static bool zx_tape_stream_open(zx_file_stream_Struct* stream, FIL* file)
 {
-    if (zx_tape_tzx) return 0;
-    else return zx_tape_read_word(header);
+    if (zx_tape_content != NULL)
+    {
+        zx_file_stream_init_memory(stream, zx_tape_content, zx_tape_content_length);
+        return true;
+    }
+
+    zx_file_stream_init(stream, NULL);
+    if (f_open(file, zx_tape_path, FA_READ) != FR_OK)
+    {
+        return false;
+    }
+
+    zx_file_stream_init(stream, file);
+    return true;
 }
 
-void zx_tape_routine()
+static void zx_tape_index_build()
 {
-    static FIL tape_file;
-    static uint32_t header_size = 0;
-    static uint32_t data_size = 0;
-    static zx_tape_loop_Struct loops[ZX_TAPE_LOOPS_SIZE];
-    static int loops_size;
+    uint8_t header[0x20];
+    zx_tape_block_Struct block;
 
-    if (!zx_tape_tape_started && f_size(&tape_file) != 0 && tape_file.fptr >= f_size(&tape_file))
+    zx_tape_index_count = 0;
+    zx_tape_pipe->index_current = -1;
+    zx_tape_format = ZX_TAPE_FORMAT_TAP;
+    zx_tape_flash_pos = 0;
+
+    if (!zx_tape_stream_open(&zx_tape_flash_stream, &zx_tape_flash_file))
     {
-        zx_tape_tape_restart = true;
+        return;
     }
 
-    //if (zx_tape_tape_started && (f_size(&tape_file) == 0 || zx_tape_tape_restart))
-    if (zx_tape_tape_started && f_eof(&tape_file) == 1)
+    zx_tape_flash_pos = zx_tape_detect(&zx_tape_flash_stream);
+
+    while (zx_tape_index_count < ZX_TAPE_INDEX_SIZE)
     {
-        if (f_open(&tape_file, zx_tape_path, FA_READ ) == FR_OK)
+        uint32_t offset = zx_file_stream_tell(&zx_tape_flash_stream);
+
+        uint8_t hs = zx_tape_read_header(&zx_tape_flash_stream, header);
+        if (hs == 0)
         {
-            f_lseek(&tape_file, 0);
-            zx_tape_tzx = false;
+            break;
+        }
 
-            header_size = 0;
-            data_size = 0;
-            loops_size = 0;
+        zx_tape_block_parse_header(header, &block);
 
-            if (f_size(&tape_file) >= 10)
-            {
-                char buff[10];
-                UINT res;
-                f_read(&tape_file, buff, 10, &res);
+        zx_tape_index_entry_Struct* entry = &zx_tape_index[zx_tape_index_count++];
+        entry->offset = offset;
+        entry->length = block.data_size;
+        entry->type = zx_tape_block_type(header);
+        entry->header_type = ZX_TAPE_NO_HEADER;
+        entry->cache_word = ZX_TAPE_NO_CACHE_WORD;
+        entry->name[0] = 0;
 
-                if (res == 10 && buff[0] == 'Z' && buff[1] == 'X' && buff[2] == 'T' ) zx_tape_tzx = true;
-                else f_lseek(&tape_file, 0);
+        if (entry->type == ZX_TAPE_STD_BLOCK_ID && block.data_size == ZX_TAPE_STD_HEADER_LENGTH)
+        {
+            // Flag 0x00, file type and 10 characters of the Spectrum file name
+            uint8_t std[ZX_TAPE_STD_HEADER_PEEK];
+            if (zx_file_stream_read(&zx_tape_flash_stream, std, sizeof(std)) == sizeof(std) && std[0] == 0)
+            {
+                entry->header_type = std[1];
+                memcpy(entry->name, &std[2], ZX_TAPE_NAME_SIZE);
+                entry->name[ZX_TAPE_NAME_SIZE] = 0;
             }
         }
-        else
+
+        zx_file_stream_seek(&zx_tape_flash_stream, offset + hs + block.data_size);
+    }
+}
+
+static int32_t zx_tape_index_find(uint32_t offset)
+{
+    int32_t l = 0;
+    int32_t h = (int32_t)zx_tape_index_count - 1;
+
+    while (l <= h)
+    {
+        int32_t m = (l + h) / 2;
+        if (zx_tape_index[m].offset == offset) return m;
+        if (zx_tape_index[m].offset < offset) l = m + 1;
+        else h = m - 1;
+    }
+    return -1;
+}
+
+static void zx_tape_index_cache_follow(uint32_t word)
+{
+    int32_t next = zx_tape_pipe->index_current + 1;
+
+    while (next < (int32_t)zx_tape_index_count)
+    {
+        if (zx_tape_index[next].cache_word != ZX_TAPE_NO_CACHE_WORD)
         {
-            zx_tape_tape_started = false;
+            if (zx_tape_index[next].cache_word > word) break;
+            zx_tape_pipe->index_current = next;
         }
+        next++;
+    }
+}
 
-        zx_tape_tape_restart = false;
+uint32_t zx_tape_blocks_count()
+{
+    return zx_tape_index_count;
+}
+
+const zx_tape_index_entry_Struct* zx_tape_block_get(uint32_t idx)
+{
+    return idx < zx_tape_index_count ? &zx_tape_index[idx] : NULL;
+}
+
+int32_t zx_tape_current_block_get()
+{
+    return zx_tape_pipe->index_current;
+}
+
+void zx_tape_block_seek(uint32_t idx)
+{
+    if (idx >= zx_tape_index_count)
+    {
+        return;
+    }
+
+    zx_tape_pipe->started = false;
+    zx_tape_tape_restart = true;
+    zx_tape_cache_playing = false;
+    zx_tape_block_clean(&zx_tape_pipe->current_block);
+
+    // Both instant loading and the next start of playback carry on from the block
+    zx_tape_start_pos = zx_tape_index[idx].offset;
+    zx_tape_flash_pos = zx_tape_index[idx].offset;
+    zx_tape_flash_finished = false;
+    zx_tape_pipe->index_current = idx;
+}
+
+void zx_tape_block_describe(uint32_t idx, char* str, size_t size)
+{
+    static const char* const std_types[] = {"Program", "Num arr", "Chr arr", "Bytes"};
+
+    if (idx >= zx_tape_index_count)
+    {
+        str[0] = 0;
+        return;
+    }
+
+    zx_tape_index_entry_Struct* entry = &zx_tape_index[idx];
+
+    if (entry->header_type < sizeof(std_types) / sizeof(std_types[0]))
+    {
+        sniprintf(str, size, "%s: %s", std_types[entry->header_type], entry->name);
+    }
+    else if (entry->type == ZX_TAPE_STD_BLOCK_ID)
+    {
+        sniprintf(str, size, "Data %lu", (unsigned long)entry->length);
+    }
+    else
+    {
+        switch (entry->type)
+        {
+            case 0x11: sniprintf(str, size, "Turbo %lu", (unsigned long)entry->length); break;
+            case 0x12: sniprintf(str, size, "Pure tone"); break;
+            case 0x13: sniprintf(str, size, "Pulses"); break;
+            case 0x14: sniprintf(str, size, "Pure data %lu", (unsigned long)entry->length); break;
+            case 0x15: sniprintf(str, size, "Direct rec"); break;
+            case 0x18: sniprintf(str, size, "CSW rec"); break;
+            case 0x19: sniprintf(str, size, "Generalized"); break;
+            case 0x20: sniprintf(str, size, "Pause"); break;
+            case 0x21: sniprintf(str, size, "Group start"); break;
+            case 0x22: sniprintf(str, size, "Group end"); break;
+            case 0x24: sniprintf(str, size, "Loop start"); break;
+            case 0x25: sniprintf(str, size, "Loop end"); break;
+            case 0x2B: sniprintf(str, size, "Set level"); break;
+            case ZX_TAPE_PZX_PULS_ID: sniprintf(str, size, "Pulses %lu", (unsigned long)entry->length); break;
+            case ZX_TAPE_PZX_DATA_ID: sniprintf(str, size, "Data %lu", (unsigned long)entry->length); break;
+            case ZX_TAPE_PZX_PAUS_ID: sniprintf(str, size, "Pause"); break;
+            case ZX_TAPE_PZX_INFO_ID: sniprintf(str, size, "Info"); break;
+            case ZX_TAPE_CSW_ID: sniprintf(str, size, "CSW rec %lu", (unsigned long)entry->length); break;
+            case 0x30: sniprintf(str, size, "Text"); break;
+            case 0x32: sniprintf(str, size, "Archive info"); break;
+            default: sniprintf(str, size, "Block %.2X", entry->type); break;
+        }
+    }
+}
+
+void zx_tape_flash_load_set(bool enabled)
+{
+    zx_tape_flash_enabled = enabled;
+}
+
+bool zx_tape_flash_load_get()
+{
+    return zx_tape_flash_enabled;
+}
+
+void zx_tape_start()
+{
+    zx_tape_pipe->started = true;
+
+    zx_fifo_init(&zx_tape_pipe->fifo, zx_tape_pipe->fifo_buf, ZX_TAPE_FIFO_DEPTH);
+    zx_fifo_clean(&zx_tape_pipe->fifo);
+}
+
+void zx_tape_stop()
+{
+    zx_tape_pipe->started = false;
+}
+
+void zx_tape_restart()
+{
+    zx_tape_block_clean(&zx_tape_pipe->current_block);
+
+    zx_fifo_init(&zx_tape_pipe->fifo, zx_tape_pipe->fifo_buf, ZX_TAPE_FIFO_DEPTH);
+    zx_fifo_clean(&zx_tape_pipe->fifo);
+
+    zx_tape_tape_restart = true;
+    zx_tape_pipe->started = true;
+}
+
+bool zx_tape_started()
+{
+    return zx_tape_pipe->started;
+}
+
+static bool zx_tape_open(uint32_t start)
+{
+    if (!zx_tape_stream_open(&zx_tape_pipe->stream, &zx_tape_pipe->file))
+    {
+        return false;
+    }
+
+    zx_tape_pipe->header_size = 0;
+    zx_tape_pipe->data_size = 0;
+    zx_tape_pipe->loops_size = 0;
+
+    zx_tape_detect(&zx_tape_pipe->stream);
+
+    // Carry on from a block picked in the index or where instant loading has stopped
+    if (start > zx_file_stream_tell(&zx_tape_pipe->stream))
+    {
+        zx_file_stream_seek(&zx_tape_pipe->stream, start);
     }
 
-    static uint8_t header[0x20];
-    static uint32_t header_pos;
+    zx_tape_pipe->pending_head = 0;
+    zx_tape_pipe->pending_tail = 0;
+    zx_tape_pipe->level = 0;
+    zx_tape_pipe->edge_pending = 0;
+    zx_tape_pipe->signal_busy = false;
+    return true;
+}
 
-    while (zx_tape_tape_started && zx_fifo_get_free(&zx_tape_fifo) > 0)
+static void zx_tape_read_blocks()
+{
+    while (zx_tape_pipe->started && zx_fifo_get_free(&zx_tape_pipe->fifo) > 0)
     {
-        if (header_size > 0)
+        if (zx_tape_pipe->header_size > 0)
         {
-            zx_fifo_write_byte(&zx_tape_fifo, header[header_pos++]);
-            header_size--;
+            zx_fifo_write_byte(&zx_tape_pipe->fifo, zx_tape_pipe->header[zx_tape_pipe->header_pos++]);
+            zx_tape_pipe->header_size--;
             continue;
         }
 
-        if (data_size > 0)
+        if (zx_tape_pipe->data_size > 0)
         {
             uint8_t data;
-            UINT res;
-            f_read(&tape_file, &data, 1, &res);
-
-            if (res == 1)
+            if (zx_file_stream_read_byte(&zx_tape_pipe->stream, &data))
             {
-                zx_fifo_write_byte(&zx_tape_fifo, data);
-                data_size--;
+                zx_fifo_write_byte(&zx_tape_pipe->fifo, data);
+                zx_tape_pipe->data_size--;
                 continue;
             }
             else
             {
-                zx_tape_tape_started = false;
+                zx_tape_pipe->started = false;
                 break;
             }
         }
 
-        if (tape_file.fptr >= f_size(&tape_file))
+        // A streamed block is read by zx_tape_fill_buffer, the next block
+        // starts where it ends
+        if (zx_tape_pipe->signal_busy)
         {
-            zx_tape_tape_finished = true;
             break;
         }
 
-        UINT res;
-        f_read(&tape_file, header, 1, &res);
-        if( res != 1 )
+        if (zx_file_stream_eof(&zx_tape_pipe->stream))
         {
-            zx_tape_tape_finished = true;
+            zx_tape_pipe->finished = true;
             break;
         }
 
-        uint8_t hs = zx_tape_get_header_size(header[0]);
-        f_read(&tape_file, header + 1, hs - 1, &res);
-        if( res + 1 != hs )
+        uint8_t hs = zx_tape_read_header(&zx_tape_pipe->stream, zx_tape_pipe->header);
+        if (hs == 0)
         {
-            zx_tape_tape_finished = true;
+            zx_tape_pipe->finished = true;
             break;
         }
 
         zx_tape_block_Struct temp_block;
-        zx_tape_block_parse_header(header, &temp_block);
+        zx_tape_block_parse_header(zx_tape_pipe->header, &temp_block);
 
         if (temp_block.tape_pilot > 0 || temp_block.tape_sync > 0 || temp_block.tape_pause > 0 || (temp_block.data_size > 0 && temp_block.data_type != ZX_TAPE_SKIP_DATA))
         {
-            header_pos = 0;
-            header_size = hs;
-            data_size = temp_block.data_size;
+            zx_tape_pipe->header_pos = 0;
+            zx_tape_pipe->header_size = hs;
+            zx_tape_pipe->data_size = temp_block.data_size;
+
+            if (temp_block.data_type == ZX_TAPE_STREAM_DATA && temp_block.data_size > 0)
+            {
+                zx_tape_pipe->data_size = 0;
+                zx_tape_pipe->signal_busy = true;
+            }
+
+            // Every queued block has at least one byte in the software FIFO so
+            // the queue of index entries can never overflow
+            zx_tape_pipe->pending[zx_tape_pipe->pending_head] = zx_tape_index_find(zx_file_stream_tell(&zx_tape_pipe->stream) - hs);
+            zx_tape_pipe->pending_head = (zx_tape_pipe->pending_head + 1) % ZX_TAPE_FIFO_DEPTH;
         }
-        else if( header[ 0 ] == 0x24 )
+        else if (zx_tape_format == ZX_TAPE_FORMAT_TZX && zx_tape_pipe->header[0] == 0x24)
         {
-            if (loops_size < ZX_TAPE_LOOPS_SIZE)
+            if (zx_tape_pipe->loops_size < ZX_TAPE_LOOPS_SIZE)
             {
-                loops[loops_size].fptr = tape_file.fptr;
-                loops[loops_size].counter = zx_tape_read_word(header + 1);
-                loops_size++;
+                zx_tape_pipe->loops[zx_tape_pipe->loops_size].fptr = zx_file_stream_tell(&zx_tape_pipe->stream);
+                zx_tape_pipe->loops[zx_tape_pipe->loops_size].counter = zx_tape_read_word(zx_tape_pipe->header + 1);
+                zx_tape_pipe->loops_size++;
             }
         }
-        else if( header[ 0 ] == 0x25 )
+        else if (zx_tape_format == ZX_TAPE_FORMAT_TZX && zx_tape_pipe->header[0] == 0x25)
         {
-            if (loops_size > 0)
+            if (zx_tape_pipe->loops_size > 0)
             {
-                if (loops[loops_size - 1].counter > 0) loops[loops_size - 1].counter--;
+                if (zx_tape_pipe->loops[zx_tape_pipe->loops_size - 1].counter > 0) zx_tape_pipe->loops[zx_tape_pipe->loops_size - 1].counter--;
 
-                if (loops[loops_size - 1].counter > 0 ) f_lseek(&tape_file, loops[loops_size - 1].fptr);
-                else loops_size--;
+                if (zx_tape_pipe->loops[zx_tape_pipe->loops_size - 1].counter > 0 ) zx_file_stream_seek(&zx_tape_pipe->stream, zx_tape_pipe->loops[zx_tape_pipe->loops_size - 1].fptr);
+                else zx_tape_pipe->loops_size--;
             }
         }
         else
         {
-            f_lseek(&tape_file, tape_file.fptr + temp_block.data_size);
+            zx_file_stream_seek(&zx_tape_pipe->stream, zx_file_stream_tell(&zx_tape_pipe->stream) + temp_block.data_size);
         }
     }
+}
 
-    while (zx_tape_tape_started && zx_tape_fifo_full() == false)
+static void zx_tape_generate()
+{
+    while (zx_tape_pipe->started && zx_tape_fifo_full() == false)
     {
         if (zx_tape_fill_buffer() == false)
         {
@@ -434,133 +1159,1330 @@ void zx_tape_routine()
     }
 }
 
-static bool zx_tape_fifo_full()
+void zx_tape_init()
 {
-    zx_tape_fifo_reg_read(&zx_tape_fifo_reg);
-    return (zx_tape_fifo_reg.bits.fifo_full == 1);
-}
+    zx_tape_mutex = xSemaphoreCreateMutex();
+    zx_tape_live_pipe.index_current = -1;
 
-static void zx_tape_send(uint16_t pulseLength, bool pulse)
-{
-    pulseLength &= 0x7fff;
-    if (pulse)
+    zx_tape_fifo_ctrl_reg.u32 = 0;
+    zx_tape_fifo_ctrl_reg.bits.low_water = ZX_TAPE_HW_FIFO_LOW_WATER;
+    zx_tape_fifo_ctrl_write(true, true);
+
+    xTaskCreate(zx_tape_task, "tape_task", ZX_TAPE_TASK_STACK_SIZE, NULL, ZX_TAPE_TASK_PRIO, &zx_tape_task_handle);
+
+    XScuGic_SetPriorityTriggerType(&xInterruptController, ZX_TAPE_IRQ_ID, ZX_TAPE_IRQ_PRIORITY, ZX_TAPE_IRQ_LEVEL_HIGH);
+    if (XScuGic_Connect(&xInterruptController, ZX_TAPE_IRQ_ID, (Xil_ExceptionHandler)zx_tape_irq_handler, NULL) == XST_SUCCESS)
     {
-       pulseLength |= 0x8000;
+        XScuGic_Enable(&xInterruptController, ZX_TAPE_IRQ_ID);
     }
-    zx_tape_fifo_reg.bits.fifo_data = pulseLength;
-    zx_tape_fifo_reg_write(&zx_tape_fifo_reg);
 }
 
-static bool zx_tape_fill_buffer()
+void zx_tape_lock()
 {
-    bool result = false;
+    xSemaphoreTake(zx_tape_mutex, portMAX_DELAY);
+}
 
-    static uint8_t tape_header[0x20];
-    static uint8_t tape_header_pos = 0;
-    static uint8_t tape_header_size = 2;
+void zx_tape_unlock()
+{
+    xSemaphoreGive(zx_tape_mutex);
+}
 
-    static uint8_t tape_bit = 0;
-    static uint8_t tape_byte = 0;
+uint16_t zx_tape_underflows_get()
+{
+    return zx_tape_underflows;
+}
+
+static void zx_tape_fifo_ctrl_write(bool irq_clear, bool underflows_clear)
+{
+    reg_ZX_Tape_fifo_ctrl_Struct value = zx_tape_fifo_ctrl_reg;
+    value.bits.irq_clear = irq_clear ? 1 : 0;
+    value.bits.underflows_clear = underflows_clear ? 1 : 0;
+    zx_tape_fifo_ctrl_reg_write(&value);
+}
+
+static void zx_tape_irq_handler(void* data)
+{
+    BaseType_t woken = pdFALSE;
+
+    // The request stays asserted until acknowledged as the interrupt is level sensitive
+    zx_tape_fifo_ctrl_write(true, false);
+    zynq_task_stats_signal(ZYNQ_TASK_STATS_TAPE);
+    vTaskNotifyGiveFromISR(zx_tape_task_handle, &woken);
+    portYIELD_FROM_ISR(woken);
+}
 
-    if (!zx_tape_current_block.tape_pilot && !zx_tape_current_block.tape_sync && !zx_tape_current_block.tape_pause && !zx_tape_current_block.data_size)
+static void zx_tape_task(void* param)
+{
+    while (true)
     {
-        while (zx_fifo_get_cntr(&zx_tape_fifo) > 0 && (tape_header_pos == 0 || tape_header_pos < tape_header_size))
+        // Wakes up on the low-water interrupt, the timeout keeps the ROM trap
+        // and the start of playback serviced while the FIFO is idle. A cache
+        // being compiled takes a slice every tick with the lock released between
+        ulTaskNotifyTake(pdTRUE, zx_tape_cache_job ? 1 : pdMS_TO_TICKS(ZX_TAPE_TASK_POLL_MS));
+
+        zx_tape_lock();
+        zynq_task_stats_begin(ZYNQ_TASK_STATS_TAPE);
+        zx_tape_routine();
+
+        bool irq_en = zx_tape_pipe->started;
+        if (irq_en != zx_tape_irq_enabled)
         {
-            tape_header[tape_header_pos++] = zx_fifo_read_byte(&zx_tape_fifo);
-            if (tape_header_pos == 1) tape_header_size = zx_tape_get_header_size(tape_header[0]);
+            zx_tape_irq_enabled = irq_en;
+            zx_tape_fifo_ctrl_reg.bits.irq_en = irq_en ? 1 : 0;
+            zx_tape_fifo_ctrl_write(true, false);
         }
+        zynq_task_stats_end(ZYNQ_TASK_STATS_TAPE);
+        zx_tape_unlock();
+    }
+}
+
+void zx_tape_routine()
+{
+    if (!zx_tape_pipe->started && zx_file_stream_size_get(&zx_tape_pipe->stream) != 0 && zx_file_stream_eof(&zx_tape_pipe->stream))
+    {
+        zx_tape_tape_restart = true;
+    }
+
+    zx_tape_flash_routine();
+
+    if (zx_tape_pipe->started && ((zx_file_stream_eof(&zx_tape_pipe->stream) && !zx_tape_pipe->signal_busy) || zx_tape_tape_restart))
+    {
+        zx_tape_tape_restart = false;
+        zx_tape_cache_playing = false;
 
-        if (tape_header_size != 0 && tape_header_pos == tape_header_size)
+        if (!zx_tape_open(zx_tape_start_pos))
         {
-            zx_tape_block_parse_header(tape_header, &zx_tape_current_block);
-            tape_bit = 0;
-            tape_header_pos = 0;
-            tape_header_size = 0;
+            zx_tape_pipe->started = false;
         }
         else
         {
-            if (zx_tape_tape_finished)
+            zx_tape_cache_playing = zx_tape_cache_prepare();
+        }
+
+        if (zx_tape_cache_playing)
+        {
+            int32_t idx = zx_tape_start_pos ? zx_tape_index_find(zx_tape_start_pos) : 0;
+
+            if (zx_tape_start_pos == 0 || (idx >= 0 && zx_tape_index[idx].cache_word != ZX_TAPE_NO_CACHE_WORD))
             {
-                zx_tape_tape_finished = false;
-                zx_tape_tape_started = false;
+                uint32_t word = zx_tape_start_pos ? zx_tape_index[idx].cache_word : 0;
+                zx_file_stream_seek(&zx_tape_cache_stream, sizeof(zx_tape_cache_header_Struct) + word * sizeof(uint16_t));
+                zx_tape_pipe->index_current = idx - 1;
+                zx_tape_index_cache_follow(word);
+            }
+            else
+            {
+                zx_tape_cache_playing = false;
             }
         }
+        zx_tape_start_pos = 0;
     }
 
-    if (zx_tape_current_block.tape_pilot > 0)
+    if (zx_tape_cache_playing)
     {
-        zx_tape_send(zx_tape_current_block.pulse_pilot, true);
-        zx_tape_current_block.tape_pilot--;
-        result = true;
+        zx_tape_cache_play();
+        return;
     }
-    else if (zx_tape_current_block.tape_sync >= 2)
+
+    zx_tape_read_blocks();
+    zx_tape_generate();
+
+    // The FIFO has been topped up first so compiling never holds back live playback
+    zx_tape_cache_compile_step();
+}
+
+static uint32_t zx_tape_cache_hash(const char* str)
+{
+    uint32_t hash = ZX_TAPE_CACHE_HASH_BASIS;
+
+    while (*str)
     {
-        zx_tape_send(zx_tape_current_block.pulse_sync1, true);
-        zx_tape_current_block.tape_sync--;
-        result = true;
+        hash ^= (uint8_t)*str++;
+        hash *= ZX_TAPE_CACHE_HASH_PRIME;
     }
-    else if (zx_tape_current_block.tape_sync == 1)
+    return hash;
+}
+
+static void zx_tape_cache_flush()
+{
+    UINT res;
+    UINT size = zx_tape_cache_buf_pos * sizeof(zx_tape_cache_buf[0]);
+
+    if (size != 0 && (f_write(&zx_tape_cache_job_file, zx_tape_cache_buf, size, &res) != FR_OK || res != size))
     {
-        zx_tape_send(zx_tape_current_block.pulse_sync2, true);
-        zx_tape_current_block.tape_sync--;
-        result = true;
+        zx_tape_cache_error = true;
+    }
+    zx_tape_cache_buf_pos = 0;
+}
+
+static void zx_tape_cache_put_word(uint16_t word)
+{
+    zx_tape_cache_buf[zx_tape_cache_buf_pos++] = word;
+    if (zx_tape_cache_buf_pos == ZX_TAPE_CACHE_BUF_WORDS)
+    {
+        zx_tape_cache_flush();
+    }
+}
+
+static void zx_tape_cache_compile_start(const char* path, const zx_tape_cache_header_Struct* header)
+{
+    UINT res;
+
+    f_mkdir(ZX_TAPE_CACHE_DIR);
+    if (f_open(&zx_tape_cache_job_file, path, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+    {
+        return;
+    }
+
+    // The header is completed last so a partially written cache is never trusted
+    zx_tape_cache_job_header = *header;
+    zx_tape_cache_job_header.words = 0;
+    zx_tape_cache_job_header.blocks = 0;
+    if (f_write(&zx_tape_cache_job_file, &zx_tape_cache_job_header, sizeof(zx_tape_cache_job_header), &res) != FR_OK ||
+        res != sizeof(zx_tape_cache_job_header))
+    {
+        f_close(&zx_tape_cache_job_file);
+        f_unlink(path);
+        return;
+    }
+
+    sniprintf(zx_tape_cache_job_path, sizeof(zx_tape_cache_job_path), "%s", path);
+    zx_tape_cache_job = true;
+    zx_tape_cache_buf_pos = 0;
+    zx_tape_cache_words = 0;
+    zx_tape_cache_error = false;
+
+    for (uint32_t i = 0; i < zx_tape_index_count; i++)
+    {
+        zx_tape_index[i].cache_word = ZX_TAPE_NO_CACHE_WORD;
+    }
+
+    // The compiler runs the regular playback pipeline from the start of the tape
+    // on its own state so live playback is not disturbed
+    memset(&zx_tape_compile_pipe, 0, sizeof(zx_tape_compile_pipe));
+    zx_tape_pipe = &zx_tape_compile_pipe;
+    zx_tape_pipe->index_current = -1;
+    zx_tape_pipe->started = zx_tape_open(0);
+    zx_tape_block_clean(&zx_tape_pipe->current_block);
+    zx_fifo_init(&zx_tape_pipe->fifo, zx_tape_pipe->fifo_buf, ZX_TAPE_FIFO_DEPTH);
+    zx_fifo_clean(&zx_tape_pipe->fifo);
+    zx_tape_pipe = &zx_tape_live_pipe;
+
+    if (!zx_tape_compile_pipe.started)
+    {
+        zx_tape_cache_compile_end(false);
+    }
+}
+
+static void zx_tape_cache_compile_step()
+{
+    if (!zx_tape_cache_job)
+    {
+        return;
+    }
+
+    // A slice is limited in words so the FatFs lock is not held for the whole tape
+    zx_tape_pipe = &zx_tape_compile_pipe;
+    zx_tape_cache_compiling = true;
+    zx_tape_cache_slice_left = ZX_TAPE_CACHE_SLICE_WORDS;
+
+    while (zx_tape_pipe->started && zx_tape_cache_slice_left > 0)
+    {
+        zx_tape_read_blocks();
+        zx_tape_generate();
+    }
+
+    zx_tape_cache_compiling = false;
+    zx_tape_pipe = &zx_tape_live_pipe;
+
+    if (!zx_tape_compile_pipe.started || zx_tape_cache_error)
+    {
+        zx_tape_cache_compile_end(!zx_tape_compile_pipe.started);
+    }
+}
+
+static void zx_tape_cache_compile_end(bool complete)
+{
+    UINT res;
+
+    zx_tape_cache_job = false;
+    if (zx_tape_compile_pipe.stream.file != NULL)
+    {
+        f_close(&zx_tape_compile_pipe.file);
+    }
+
+    if (complete)
+    {
+        // The position of every block in the stream follows the words
+        for (uint32_t i = 0; i < zx_tape_index_count; i++)
+        {
+            zx_tape_cache_put_word(zx_tape_index[i].cache_word & 0xFFFF);
+            zx_tape_cache_put_word(zx_tape_index[i].cache_word >> 16);
+        }
+        zx_tape_cache_flush();
+
+        zx_tape_cache_job_header.words = zx_tape_cache_words;
+        zx_tape_cache_job_header.blocks = zx_tape_index_count;
+        if (!zx_tape_cache_error && f_lseek(&zx_tape_cache_job_file, 0) == FR_OK &&
+            f_write(&zx_tape_cache_job_file, &zx_tape_cache_job_header, sizeof(zx_tape_cache_job_header), &res) == FR_OK &&
+            res == sizeof(zx_tape_cache_job_header) && f_close(&zx_tape_cache_job_file) == FR_OK)
+        {
+            return;
+        }
+    }
+
+    f_close(&zx_tape_cache_job_file);
+    f_unlink(zx_tape_cache_job_path);
+}
+
+static bool zx_tape_cache_prepare()
+{
+    FILINFO fi;
+    char cache_path[ZX_TAPE_PATH_SIZE];
+    zx_tape_cache_header_Struct expected;
+    zx_tape_cache_header_Struct header;
+    UINT res;
+
+    // The tape is played live for as long as its cache is being compiled
+    if (zx_tape_cache_job || f_stat(zx_tape_path, &fi) != FR_OK)
+    {
+        return false;
     }
-    else if (zx_tape_current_block.data_size > 0)
+
+    expected.magic = ZX_TAPE_CACHE_MAGIC;
+    expected.source_size = fi.fsize;
+    expected.source_date = fi.fdate;
+    expected.source_time = fi.ftime;
+    expected.words = 0;
+    expected.blocks = 0;
+
+    sniprintf(cache_path, sizeof(cache_path), "%s/%08lx.zpc", ZX_TAPE_CACHE_DIR, (unsigned long)zx_tape_cache_hash(zx_tape_path));
+
+    if (f_open(&zx_tape_cache_file, cache_path, FA_READ) == FR_OK)
     {
-        if (zx_tape_current_block.data_type == ZX_TAPE_BLOCK_DATA)
+        if (f_read(&zx_tape_cache_file, &header, sizeof(header), &res) == FR_OK && res == sizeof(header) &&
+            header.magic == expected.magic && header.source_size == expected.source_size &&
+            header.source_date == expected.source_date && header.source_time == expected.source_time &&
+            header.blocks == zx_tape_index_count &&
+            f_size(&zx_tape_cache_file) == sizeof(header) + header.words * sizeof(uint16_t) + header.blocks * sizeof(uint32_t))
         {
-            if (tape_bit == 0)
+            zx_file_stream_init(&zx_tape_cache_stream, &zx_tape_cache_file);
+            zx_file_stream_seek(&zx_tape_cache_stream, sizeof(header) + header.words * sizeof(uint16_t));
+
+            for (uint32_t i = 0; i < header.blocks; i++)
             {
-                if (zx_fifo_get_cntr(&zx_tape_fifo) > 0)
-                {
-                    tape_byte = zx_fifo_read_byte(&zx_tape_fifo);
-                    tape_bit = 16;
-                }
+                uint32_t word = ZX_TAPE_NO_CACHE_WORD;
+                zx_file_stream_read(&zx_tape_cache_stream, (uint8_t*)&word, sizeof(word));
+                zx_tape_index[i].cache_word = word;
             }
 
-            if (tape_bit != 0)
+            // The block table is not played, it must never reach the FIFO
+            zx_tape_cache_play_words = header.words;
+            zx_file_stream_seek(&zx_tape_cache_stream, sizeof(header));
+            return true;
+        }
+        f_close(&zx_tape_cache_file);
+    }
+
+    // The cache is missing or the tape has been changed since it was compiled,
+    // the tape is played live until zx_tape_routine has compiled it
+    zx_tape_cache_compile_start(cache_path, &expected);
+    return false;
+}
+
+static void zx_tape_cache_play()
+{
+    uint16_t words[ZX_TAPE_CACHE_BURST];
+    uint32_t end = sizeof(zx_tape_cache_header_Struct) + zx_tape_cache_play_words * sizeof(uint16_t);
+
+    while (zx_tape_pipe->started && zx_tape_fifo_full() == false)
+    {
+        // Almost full leaves room for a burst so the status is checked once per burst
+        uint32_t pos = zx_file_stream_tell(&zx_tape_cache_stream);
+        uint32_t size = (end > pos) ? end - pos : 0;
+        if (size > sizeof(words))
+        {
+            size = sizeof(words);
+        }
+
+        uint32_t cnt = zx_file_stream_read(&zx_tape_cache_stream, (uint8_t*)words, size) / sizeof(words[0]);
+
+        for (uint32_t i = 0; i < cnt; i++)
+        {
+            zx_tape_send_word(words[i]);
+        }
+        zx_tape_index_cache_follow((zx_file_stream_tell(&zx_tape_cache_stream) - sizeof(zx_tape_cache_header_Struct)) / sizeof(uint16_t));
+
+        // Playback ends with the last pulse word, the block table behind it is not played
+        if (cnt * sizeof(words[0]) < size || zx_file_stream_tell(&zx_tape_cache_stream) >= end)
+        {
+            zx_tape_pipe->started = false;
+            zx_tape_tape_restart = true;
+            break;
+        }
+    }
+}
+
+static bool zx_tape_fifo_full()
+{
+    if (zx_tape_cache_compiling)
+    {
+        return (zx_tape_cache_slice_left == 0);
+    }
+
+    // PL only drains the FIFO so the room counted down by zx_tape_send_word
+    // never exceeds the real one and the level is read back only when it runs out
+    if (zx_tape_hw_fifo_room < ZX_TAPE_HW_FIFO_HEADROOM)
+    {
+        reg_ZX_Tape_fifo_status_Struct status;
+        zx_tape_fifo_status_reg_read(&status);
+        zx_tape_hw_fifo_room = ZX_TAPE_HW_FIFO_SIZE - status.bits.fifo_level;
+        zx_tape_underflows = status.bits.underflows;
+    }
+    return (zx_tape_hw_fifo_room < ZX_TAPE_HW_FIFO_HEADROOM);
+}
+
+static void zx_tape_send_word(uint16_t word)
+{
+    if (zx_tape_cache_compiling)
+    {
+        zx_tape_cache_put_word(word);
+        zx_tape_cache_words++;
+        if (zx_tape_cache_slice_left > 0) zx_tape_cache_slice_left--;
+        return;
+    }
+
+    zx_tape_fifo_reg.bits.fifo_data = word;
+    zx_tape_fifo_reg_write(&zx_tape_fifo_reg);
+    if (zx_tape_hw_fifo_room > 0) zx_tape_hw_fifo_room--;
+}
+
+static void zx_tape_send(uint16_t pulseLength, bool pulse)
+{
+    pulseLength &= ZX_TAPE_PULSE_LENGTH_MASK;
+
+    // A zero length marks the start of a packet in PL and would not produce a pulse anyway
+    if (pulseLength == 0)
+    {
+        return;
+    }
+
+    // The time left at the level by a streamed block is added to the pulse when it fits
+    uint32_t length = pulseLength + zx_tape_convert(zx_tape_pipe->edge_pending);
+    if (length > ZX_TAPE_PULSE_LENGTH_MASK)
+    {
+        zx_tape_edge_hold(zx_tape_convert(zx_tape_pipe->edge_pending));
+        length = pulseLength;
+    }
+    zx_tape_pipe->edge_pending = 0;
+
+    if (pulse)
+    {
+       length |= ZX_TAPE_PULSE_FLAG;
+    }
+    zx_tape_send_word(length);
+    zx_tape_pipe->level = pulse ? zx_tape_pipe->level ^ 1 : 0;
+}
+
+static void zx_tape_send_repeat(uint16_t pulseLength, bool pulse, uint16_t count)
+{
+    pulseLength &= ZX_TAPE_PULSE_LENGTH_MASK;
+    if (pulseLength == 0 || count == 0)
+    {
+        return;
+    }
+
+    if (zx_tape_pipe->edge_pending > 0)
+    {
+        zx_tape_send(pulseLength, pulse);
+        if (--count == 0)
+        {
+            return;
+        }
+    }
+
+    zx_tape_pipe->level = pulse ? zx_tape_pipe->level ^ (count & 1) : 0;
+
+    if (pulse)
+    {
+       pulseLength |= ZX_TAPE_PULSE_FLAG;
+    }
+    zx_tape_send_word(ZX_TAPE_PACKET_REPEAT);
+    zx_tape_send_word(pulseLength);
+    zx_tape_send_word(count);
+}
+
+static void zx_tape_send_byte(uint16_t zeroLength, uint16_t oneLength, uint8_t data, uint8_t bits)
+{
+    // Two pulses per bit leave the level as it is
+    zx_tape_edge_hold(zx_tape_convert(zx_tape_pipe->edge_pending));
+    zx_tape_pipe->edge_pending = 0;
+
+    zx_tape_send_word(ZX_TAPE_PACKET_BYTE);
+    zx_tape_send_word((zeroLength & ZX_TAPE_PULSE_LENGTH_MASK) | ZX_TAPE_PULSE_FLAG);
+    zx_tape_send_word((oneLength & ZX_TAPE_PULSE_LENGTH_MASK) | ZX_TAPE_PULSE_FLAG);
+    zx_tape_send_word(data | ((uint16_t)(bits & 0x07) << 8));
+}
+
+static void zx_tape_edge_hold(uint16_t length)
+{
+    if (length == 0)
+    {
+        return;
+    }
+
+    // A word without the pulse flag keeps the level low, a high level can
+    // only be kept by two edges next to each other
+    if (zx_tape_pipe->level == 0)
+    {
+        zx_tape_send_word(length);
+    }
+    else if (length > 1)
+    {
+        zx_tape_send_word((length - 1) | ZX_TAPE_PULSE_FLAG);
+        zx_tape_send_word(1 | ZX_TAPE_PULSE_FLAG);
+    }
+}
+
+static void zx_tape_edge_level(uint8_t level)
+{
+    if (level != zx_tape_pipe->level)
+    {
+        uint16_t length = zx_tape_convert(zx_tape_pipe->edge_pending);
+        zx_tape_send_word((length ? length : 1) | ZX_TAPE_PULSE_FLAG);
+        zx_tape_pipe->edge_pending = 0;
+        zx_tape_pipe->level = level;
+    }
+}
+
+static void zx_tape_edge_advance(uint32_t ticks)
+{
+    zx_tape_pipe->edge_pending += ticks;
+    while (zx_tape_pipe->edge_pending >= ZX_TAPE_EDGE_HOLD_MAX)
+    {
+        zx_tape_edge_hold(zx_tape_convert(ZX_TAPE_EDGE_HOLD_MAX));
+        zx_tape_pipe->edge_pending -= ZX_TAPE_EDGE_HOLD_MAX;
+    }
+}
+
+static bool zx_tape_signal_start(uint8_t* header)
+{
+    uint8_t buff[ZX_TAPE_GDB_HEADER_SIZE];
+
+    zx_tape_pipe->signal.id = zx_tape_block_type(header);
+    zx_tape_pipe->signal.end = zx_file_stream_tell(&zx_tape_pipe->stream) + zx_tape_pipe->current_block.data_size;
+    zx_tape_pipe->signal.data_bits = 0;
+    zx_tape_pipe->signal.zrle = false;
+    zx_tape_pipe->signal.level = zx_tape_pipe->level;
+    zx_tape_pipe->signal.ticks_left = 0;
+    zx_tape_pipe->signal.repeat = 0;
+
+    switch (zx_tape_pipe->signal.id)
+    {
+        case 0x15:
+            zx_tape_pipe->signal.sample = zx_tape_read_word(header + 1);
+            zx_tape_pipe->signal.last_bits = header[5];
+            return zx_tape_pipe->signal.sample > 0;
+
+        case 0x18:
+            if (zx_file_stream_read(&zx_tape_pipe->stream, buff, ZX_TAPE_CSW_HEADER_SIZE) != ZX_TAPE_CSW_HEADER_SIZE)
+            {
+                return false;
+            }
+            zx_tape_pipe->current_block.tape_pause = zx_tape_read_word(buff);
+            zx_tape_pipe->signal.sample = zx_tape_read_word3(buff + 2);
+            zx_tape_pipe->signal.zrle = buff[5] == ZX_TAPE_CSW_ZRLE;
+            if (zx_tape_pipe->signal.zrle)
+            {
+                zx_inflate_init(&zx_tape_pipe->inflate, &zx_tape_pipe->stream, zx_tape_pipe->signal.end - zx_file_stream_tell(&zx_tape_pipe->stream), true);
+            }
+            return zx_tape_pipe->signal.sample > 0;
+
+        case 0x19:
+            if (zx_file_stream_read(&zx_tape_pipe->stream, buff, ZX_TAPE_GDB_HEADER_SIZE) != ZX_TAPE_GDB_HEADER_SIZE)
+            {
+                return false;
+            }
+            zx_tape_pipe->current_block.tape_pause = zx_tape_read_word(buff);
+            zx_tape_pipe->signal.totp = zx_tape_read_dword(buff + 2);
+            zx_tape_pipe->signal.totd = zx_tape_read_dword(buff + 8);
+            zx_tape_pipe->signal.pulse = 0;
+            zx_tape_pipe->signal.np = 0;
+            zx_tape_pipe->signal.repeat = 0;
+            zx_tape_pipe->signal.data_table = false;
+
+            // The data table follows the pilot stream so only the header is
+            // kept for it until the pilot is over
+            zx_tape_pipe->signal.sample = ((uint32_t)buff[12] << 16) | (buff[13] ? buff[13] : 0x100);
+            if (zx_tape_pipe->signal.totp > 0)
+            {
+                return zx_tape_signal_table(buff[7] ? buff[7] : 0x100, buff[6]);
+            }
+            return true;
+
+        case ZX_TAPE_PZX_PULS_ID:
+            // Every pulse sequence starts low
+            zx_tape_pipe->signal.level = 0;
+            return true;
+
+        case ZX_TAPE_PZX_DATA_ID:
+        {
+            if (zx_file_stream_read(&zx_tape_pipe->stream, buff, ZX_TAPE_PZX_DATA_HEADER_SIZE) != ZX_TAPE_PZX_DATA_HEADER_SIZE)
+            {
+                return false;
+            }
+            uint32_t count = zx_tape_read_dword(buff);
+            zx_tape_pipe->signal.level = count >> 31;
+            zx_tape_pipe->signal.totd = count & 0x7FFFFFFF;
+            zx_tape_pipe->signal.duration = zx_tape_read_word(buff + 4);
+            zx_tape_pipe->signal.p0 = buff[6];
+            zx_tape_pipe->signal.p1 = buff[7];
+            zx_tape_pipe->signal.pulse = 0;
+            zx_tape_pipe->signal.np = 0;
+
+            // The pulse sequences of bit 0 and bit 1 go one after another
+            uint32_t size = 2 * ((uint32_t)zx_tape_pipe->signal.p0 + zx_tape_pipe->signal.p1);
+            if (zx_file_stream_read(&zx_tape_pipe->stream, zx_tape_pipe->signal.symbols, size) != size)
+            {
+                return false;
+            }
+
+            // The usual two equal pulses per bit are sent to PL a byte at a time
+            uint16_t zero = zx_tape_read_word(zx_tape_pipe->signal.symbols);
+            uint16_t one = zx_tape_read_word(zx_tape_pipe->signal.symbols + 4);
+            zx_tape_pipe->signal.packed = zx_tape_pipe->signal.p0 == 2 && zx_tape_pipe->signal.p1 == 2 &&
+                zero == zx_tape_read_word(zx_tape_pipe->signal.symbols + 2) &&
+                one == zx_tape_read_word(zx_tape_pipe->signal.symbols + 6) &&
+                zero > 0 && one > 0 &&
+                zx_tape_convert(zero) <= ZX_TAPE_PULSE_LENGTH_MASK && zx_tape_convert(one) <= ZX_TAPE_PULSE_LENGTH_MASK;
+            return true;
+        }
+
+        case ZX_TAPE_PZX_PAUS_ID:
+        {
+            if (zx_file_stream_read(&zx_tape_pipe->stream, buff, sizeof(uint32_t)) != sizeof(uint32_t))
             {
-                if ((tape_byte & 0x80) != 0) zx_tape_send(zx_tape_current_block.pulse_one, true);
-                else zx_tape_send(zx_tape_current_block.pulse_zero, true);
+                return false;
+            }
+            uint32_t duration = zx_tape_read_dword(buff);
+            zx_tape_pipe->signal.level = duration >> 31;
+            zx_tape_pipe->signal.ticks_left = duration & 0x7FFFFFFF;
+            return true;
+        }
 
-                if ( tape_bit & 1 ) tape_byte <<= 1;
-                tape_bit--;
+        case ZX_TAPE_CSW_ID:
+            zx_tape_pipe->signal.sample = zx_tape_csw_rate;
+            zx_tape_pipe->signal.zrle = zx_tape_csw_zrle;
+            zx_tape_pipe->signal.level = zx_tape_csw_level;
+            if (zx_tape_pipe->signal.zrle)
+            {
+                zx_inflate_init(&zx_tape_pipe->inflate, &zx_tape_pipe->stream, zx_tape_pipe->signal.end - zx_file_stream_tell(&zx_tape_pipe->stream), true);
+            }
+            return zx_tape_pipe->signal.sample > 0;
 
-                if (tape_bit == 0) zx_tape_current_block.data_size--;
-                else if (zx_tape_current_block.data_size == 1 && tape_bit == zx_tape_current_block.block_lastbit)
+        default:
+            return false;
+    }
+}
+
+static bool zx_tape_signal_byte(uint8_t* value)
+{
+    if (zx_tape_pipe->signal.zrle)
+    {
+        return zx_inflate_read_byte(&zx_tape_pipe->inflate, value);
+    }
+
+    if (zx_file_stream_tell(&zx_tape_pipe->stream) >= zx_tape_pipe->signal.end)
+    {
+        return false;
+    }
+    return zx_file_stream_read_byte(&zx_tape_pipe->stream, value);
+}
+
+static bool zx_tape_signal_word(uint16_t* value)
+{
+    uint8_t buff[2];
+
+    if (!zx_tape_signal_byte(&buff[0]) || !zx_tape_signal_byte(&buff[1]))
+    {
+        return false;
+    }
+    *value = zx_tape_read_word(buff);
+    return true;
+}
+
+static bool zx_tape_signal_ticks()
+{
+    // Long pulses are played in portions to keep the output of a single call short
+    if (zx_tape_pipe->signal.ticks_left > 0)
+    {
+        uint32_t ticks = zx_tape_pipe->signal.ticks_left < ZX_TAPE_TICKS_MAX ? zx_tape_pipe->signal.ticks_left : ZX_TAPE_TICKS_MAX;
+        zx_tape_edge_advance(ticks);
+        zx_tape_pipe->signal.ticks_left -= ticks;
+        return true;
+    }
+    return false;
+}
+
+static bool zx_tape_signal_table(uint16_t as, uint8_t np)
+{
+    uint32_t size = (uint32_t)as * (1 + 2 * np);
+
+    zx_tape_pipe->signal.as = as;
+    zx_tape_pipe->signal.np = np;
+
+    return size <= ZX_TAPE_SYMBOLS_SIZE &&
+           zx_file_stream_tell(&zx_tape_pipe->stream) + size <= zx_tape_pipe->signal.end &&
+           zx_file_stream_read(&zx_tape_pipe->stream, zx_tape_pipe->signal.symbols, size) == size;
+}
+
+static bool zx_tape_signal_fill()
+{
+    switch (zx_tape_pipe->signal.id)
+    {
+        case 0x15: return zx_tape_signal_direct();
+        case 0x18: return zx_tape_signal_csw();
+        case 0x19: return zx_tape_signal_general();
+        case ZX_TAPE_PZX_PULS_ID: return zx_tape_signal_pzx_pulses();
+        case ZX_TAPE_PZX_DATA_ID: return zx_tape_signal_pzx_data();
+        case ZX_TAPE_CSW_ID: return zx_tape_signal_csw();
+        case ZX_TAPE_PZX_PAUS_ID:
+            // The level is set once the pause starts and stays after it
+            zx_tape_edge_level(zx_tape_pipe->signal.level);
+            return zx_tape_signal_ticks();
+        default: return false;
+    }
+}
+
+static bool zx_tape_signal_direct()
+{
+    if (zx_tape_pipe->signal.data_bits == 0)
+    {
+        if (!zx_tape_signal_byte(&zx_tape_pipe->signal.data))
+        {
+            return false;
+        }
+
+        // Only a part of the last byte may be used
+        zx_tape_pipe->signal.data_bits = 8;
+        if (zx_file_stream_tell(&zx_tape_pipe->stream) >= zx_tape_pipe->signal.end &&
+            zx_tape_pipe->signal.last_bits > 0 && zx_tape_pipe->signal.last_bits < 8)
+        {
+            zx_tape_pipe->signal.data_bits = zx_tape_pipe->signal.last_bits;
+        }
+    }
+
+    // Samples at the same level just add up, an edge is sent once the level changes
+    zx_tape_edge_level(zx_tape_pipe->signal.data >> 7);
+    zx_tape_edge_advance(zx_tape_pipe->signal.sample);
+    zx_tape_pipe->signal.data <<= 1;
+    zx_tape_pipe->signal.data_bits--;
+    return true;
+}
+
+static bool zx_tape_signal_csw()
+{
+    uint8_t data;
+
+    if (zx_tape_signal_ticks())
+    {
+        return true;
+    }
+
+    if (!zx_tape_signal_byte(&data))
+    {
+        return false;
+    }
+
+    // A zero is followed by a 32-bit number of samples
+    uint32_t samples = data;
+    if (data == 0)
+    {
+        uint8_t buff[4];
+        for (uint8_t i = 0; i < sizeof(buff); i++)
+        {
+            if (!zx_tape_signal_byte(&buff[i])) return false;
+        }
+        samples = zx_tape_read_dword(buff);
+    }
+
+    uint64_t ticks = (uint64_t)samples * ZX_TAPE_CPU_CLOCK / zx_tape_pipe->signal.sample;
+    zx_tape_pipe->signal.ticks_left = ticks > UINT32_MAX ? UINT32_MAX : (uint32_t)ticks;
+
+    // Levels alternate, the first one is the level the block starts with
+    zx_tape_edge_level(zx_tape_pipe->signal.level);
+    zx_tape_pipe->signal.level ^= 1;
+    return true;
+}
+
+static bool zx_tape_signal_general()
+{
+    uint16_t stride = 1 + 2 * zx_tape_pipe->signal.np;
+    uint8_t* symbol = &zx_tape_pipe->signal.symbols[zx_tape_pipe->signal.symbol * stride];
+
+    if (zx_tape_pipe->signal.pulse < zx_tape_pipe->signal.np)
+    {
+        uint16_t length = zx_tape_read_word(symbol + 1 + 2 * zx_tape_pipe->signal.pulse);
+
+        if (length == 0)
+        {
+            // A symbol with less pulses than the table allows
+            zx_tape_pipe->signal.pulse = zx_tape_pipe->signal.np;
+            return true;
+        }
+
+        if (zx_tape_pipe->signal.pulse == 0)
+        {
+            // The flags of the symbol tell how it starts
+            switch (symbol[0] & 0x03)
+            {
+                case 0: zx_tape_edge_level(zx_tape_pipe->level ^ 1); break;
+                case 2: zx_tape_edge_level(0); break;
+                case 3: zx_tape_edge_level(1); break;
+                default: break;
+            }
+        }
+        else
+        {
+            zx_tape_edge_level(zx_tape_pipe->level ^ 1);
+        }
+
+        zx_tape_edge_advance(length);
+        zx_tape_pipe->signal.pulse++;
+        return true;
+    }
+
+    if (zx_tape_pipe->signal.repeat > 0)
+    {
+        zx_tape_pipe->signal.repeat--;
+        zx_tape_pipe->signal.pulse = 0;
+        return true;
+    }
+
+    if (zx_tape_pipe->signal.totp > 0)
+    {
+        uint8_t entry[ZX_TAPE_GDB_PILOT_ENTRY];
+        for (uint8_t i = 0; i < sizeof(entry); i++)
+        {
+            if (!zx_tape_signal_byte(&entry[i])) return false;
+        }
+        zx_tape_pipe->signal.totp--;
+
+        if (entry[0] >= zx_tape_pipe->signal.as)
+        {
+            return false;
+        }
+        zx_tape_pipe->signal.symbol = entry[0];
+        zx_tape_pipe->signal.pulse = 0;
+        zx_tape_pipe->signal.repeat = zx_tape_read_word(entry + 1);
+        symbol = &zx_tape_pipe->signal.symbols[zx_tape_pipe->signal.symbol * stride];
+
+        // A pilot tone of single pulse symbols goes as one repeat packet
+        uint16_t length = zx_tape_pipe->signal.np > 0 ? zx_tape_read_word(symbol + 1) : 0;
+        bool single = zx_tape_pipe->signal.np == 1 || (zx_tape_pipe->signal.np > 1 && zx_tape_read_word(symbol + 3) == 0);
+
+        if (zx_tape_pipe->signal.repeat > 1 && (symbol[0] & 0x03) == 0 && single && length > 0 &&
+            zx_tape_convert(length) <= ZX_TAPE_PULSE_LENGTH_MASK)
+        {
+            zx_tape_edge_level(zx_tape_pipe->level ^ 1);
+            zx_tape_send_repeat(zx_tape_convert(length), true, zx_tape_pipe->signal.repeat - 1);
+            zx_tape_edge_advance(length);
+            zx_tape_pipe->signal.pulse = zx_tape_pipe->signal.np;
+            zx_tape_pipe->signal.repeat = 0;
+            return true;
+        }
+
+        if (zx_tape_pipe->signal.repeat > 0)
+        {
+            zx_tape_pipe->signal.repeat--;
+        }
+        else
+        {
+            zx_tape_pipe->signal.pulse = zx_tape_pipe->signal.np;
+        }
+        return true;
+    }
+
+    if (zx_tape_pipe->signal.totd == 0)
+    {
+        return false;
+    }
+
+    if (!zx_tape_pipe->signal.data_table)
+    {
+        uint16_t asd = zx_tape_pipe->signal.sample & 0xFFFF;
+
+        if (!zx_tape_signal_table(asd, zx_tape_pipe->signal.sample >> 16))
+        {
+            return false;
+        }
+        zx_tape_pipe->signal.data_table = true;
+        zx_tape_pipe->signal.data_bits = 0;
+
+        // Every symbol takes as many bits as needed to tell all of them apart
+        zx_tape_pipe->signal.nb = 0;
+        while ((1U << zx_tape_pipe->signal.nb) < asd)
+        {
+            zx_tape_pipe->signal.nb++;
+        }
+        return true;
+    }
+
+    // Symbols are packed MSB first
+    uint16_t index = 0;
+    for (uint8_t i = 0; i < zx_tape_pipe->signal.nb; i++)
+    {
+        if (zx_tape_pipe->signal.data_bits == 0)
+        {
+            if (!zx_tape_signal_byte(&zx_tape_pipe->signal.data)) return false;
+            zx_tape_pipe->signal.data_bits = 8;
+        }
+        index = (index << 1) | (zx_tape_pipe->signal.data >> 7);
+        zx_tape_pipe->signal.data <<= 1;
+        zx_tape_pipe->signal.data_bits--;
+    }
+    zx_tape_pipe->signal.totd--;
+
+    if (index >= zx_tape_pipe->signal.as)
+    {
+        return false;
+    }
+    zx_tape_pipe->signal.symbol = index;
+    zx_tape_pipe->signal.pulse = 0;
+    return true;
+}
+
+static bool zx_tape_signal_pzx_pulses()
+{
+    uint16_t value;
+
+    if (zx_tape_signal_ticks())
+    {
+        return true;
+    }
+
+    if (zx_tape_pipe->signal.repeat == 0)
+    {
+        // An optional repeat count goes before the duration, a long duration
+        // takes two values
+        if (!zx_tape_signal_word(&value))
+        {
+            return false;
+        }
+
+        zx_tape_pipe->signal.repeat = 1;
+        if (value > 0x8000)
+        {
+            zx_tape_pipe->signal.repeat = value & 0x7FFF;
+            if (!zx_tape_signal_word(&value)) return false;
+        }
+
+        zx_tape_pipe->signal.duration = value;
+        if (value >= 0x8000)
+        {
+            uint16_t low;
+            if (!zx_tape_signal_word(&low)) return false;
+            zx_tape_pipe->signal.duration = ((uint32_t)(value & 0x7FFF) << 16) | low;
+        }
+        return true;
+    }
+
+    // Pulses of zero duration only flip the level
+    if (zx_tape_pipe->signal.duration == 0)
+    {
+        zx_tape_pipe->signal.level ^= zx_tape_pipe->signal.repeat & 1;
+        zx_tape_pipe->signal.repeat = 0;
+        return true;
+    }
+
+    zx_tape_edge_level(zx_tape_pipe->signal.level);
+
+    // A run of identical pulses but the last one goes as a single repeat packet
+    if (zx_tape_pipe->signal.repeat > 1 && zx_tape_pipe->signal.duration <= ZX_TAPE_TICKS_MAX &&
+        zx_tape_convert(zx_tape_pipe->signal.duration) <= ZX_TAPE_PULSE_LENGTH_MASK)
+    {
+        zx_tape_send_repeat(zx_tape_convert(zx_tape_pipe->signal.duration), true, zx_tape_pipe->signal.repeat - 1);
+        zx_tape_pipe->signal.repeat = 1;
+    }
+
+    zx_tape_pipe->signal.ticks_left = zx_tape_pipe->signal.duration;
+    zx_tape_pipe->signal.level = zx_tape_pipe->level ^ 1;
+    zx_tape_pipe->signal.repeat--;
+    return true;
+}
+
+static bool zx_tape_signal_pzx_data()
+{
+    if (zx_tape_signal_ticks())
+    {
+        return true;
+    }
+
+    if (zx_tape_pipe->signal.pulse < zx_tape_pipe->signal.np)
+    {
+        const uint8_t* pulses = zx_tape_pipe->signal.symbols + (zx_tape_pipe->signal.symbol ? 2 * zx_tape_pipe->signal.p0 : 0);
+        uint16_t length = zx_tape_read_word((uint8_t*)pulses + 2 * zx_tape_pipe->signal.pulse);
+
+        if (length > 0)
+        {
+            zx_tape_edge_level(zx_tape_pipe->signal.level);
+            zx_tape_pipe->signal.ticks_left = length;
+        }
+        zx_tape_pipe->signal.level ^= 1;
+        zx_tape_pipe->signal.pulse++;
+        return true;
+    }
+
+    if (zx_tape_pipe->signal.totd > 0)
+    {
+        if (zx_tape_pipe->signal.data_bits == 0 && zx_tape_pipe->signal.totd >= 8 && zx_tape_pipe->signal.packed)
+        {
+            uint8_t data;
+            if (!zx_tape_signal_byte(&data))
+            {
+                return false;
+            }
+
+            // Two pulses per bit leave the level as it is
+            zx_tape_edge_level(zx_tape_pipe->signal.level);
+            zx_tape_send_byte(zx_tape_convert(zx_tape_read_word(zx_tape_pipe->signal.symbols)),
+                zx_tape_convert(zx_tape_read_word(zx_tape_pipe->signal.symbols + 4)), data, 8);
+            zx_tape_pipe->signal.totd -= 8;
+            return true;
+        }
+
+        // Bits are sent MSB first
+        if (zx_tape_pipe->signal.data_bits == 0)
+        {
+            if (!zx_tape_signal_byte(&zx_tape_pipe->signal.data)) return false;
+            zx_tape_pipe->signal.data_bits = 8;
+        }
+        zx_tape_pipe->signal.symbol = zx_tape_pipe->signal.data >> 7;
+        zx_tape_pipe->signal.data <<= 1;
+        zx_tape_pipe->signal.data_bits--;
+        zx_tape_pipe->signal.totd--;
+
+        zx_tape_pipe->signal.pulse = 0;
+        zx_tape_pipe->signal.np = zx_tape_pipe->signal.symbol ? zx_tape_pipe->signal.p1 : zx_tape_pipe->signal.p0;
+        return true;
+    }
+
+    if (zx_tape_pipe->signal.duration > 0)
+    {
+        // The tail pulse after the last bit
+        zx_tape_edge_level(zx_tape_pipe->signal.level);
+        zx_tape_pipe->signal.ticks_left = zx_tape_pipe->signal.duration;
+        zx_tape_pipe->signal.level ^= 1;
+        zx_tape_pipe->signal.duration = 0;
+        return true;
+    }
+    return false;
+}
+
+static bool zx_tape_fill_buffer()
+{
+    bool result = false;
+
+    if (!zx_tape_pipe->current_block.tape_pilot && !zx_tape_pipe->current_block.tape_sync && !zx_tape_pipe->current_block.tape_pause && !zx_tape_pipe->current_block.data_size)
+    {
+        while (zx_fifo_get_cntr(&zx_tape_pipe->fifo) > 0 && (zx_tape_pipe->block_header_pos == 0 || zx_tape_pipe->block_header_pos < zx_tape_pipe->block_header_size))
+        {
+            zx_tape_pipe->block_header[zx_tape_pipe->block_header_pos++] = zx_fifo_read_byte(&zx_tape_pipe->fifo);
+            if (zx_tape_pipe->block_header_pos == 1) zx_tape_pipe->block_header_size = zx_tape_get_header_size(zx_tape_pipe->block_header[0]);
+        }
+
+        if (zx_tape_pipe->block_header_size != 0 && zx_tape_pipe->block_header_pos == zx_tape_pipe->block_header_size)
+        {
+            zx_tape_block_parse_header(zx_tape_pipe->block_header, &zx_tape_pipe->current_block);
+
+            if (zx_tape_pipe->current_block.data_type == ZX_TAPE_STREAM_DATA && zx_tape_pipe->current_block.data_size > 0 &&
+                !zx_tape_signal_start(zx_tape_pipe->block_header))
+            {
+                zx_file_stream_seek(&zx_tape_pipe->stream, zx_tape_pipe->signal.end);
+                zx_tape_pipe->current_block.data_size = 0;
+                zx_tape_pipe->signal_busy = false;
+            }
+
+            if (zx_tape_pipe->pending_tail != zx_tape_pipe->pending_head)
+            {
+                zx_tape_pipe->index_current = zx_tape_pipe->pending[zx_tape_pipe->pending_tail];
+                zx_tape_pipe->pending_tail = (zx_tape_pipe->pending_tail + 1) % ZX_TAPE_FIFO_DEPTH;
+
+                if (zx_tape_cache_compiling && zx_tape_pipe->index_current >= 0 &&
+                    zx_tape_index[zx_tape_pipe->index_current].cache_word == ZX_TAPE_NO_CACHE_WORD)
+                {
+                    zx_tape_index[zx_tape_pipe->index_current].cache_word = zx_tape_cache_words;
+                }
+            }
+            zx_tape_pipe->block_header_pos = 0;
+            zx_tape_pipe->block_header_size = 0;
+        }
+        else
+        {
+            if (zx_tape_pipe->finished)
+            {
+                zx_tape_pipe->finished = false;
+                zx_tape_pipe->started = false;
+            }
+        }
+    }
+
+    if (zx_tape_pipe->current_block.tape_pilot > 0)
+    {
+        zx_tape_send_repeat(zx_tape_pipe->current_block.pulse_pilot, true, zx_tape_pipe->current_block.tape_pilot);
+        zx_tape_pipe->current_block.tape_pilot = 0;
+        result = true;
+    }
+    else if (zx_tape_pipe->current_block.tape_sync >= 2)
+    {
+        zx_tape_send(zx_tape_pipe->current_block.pulse_sync1, true);
+        zx_tape_pipe->current_block.tape_sync--;
+        result = true;
+    }
+    else if (zx_tape_pipe->current_block.tape_sync == 1)
+    {
+        zx_tape_send(zx_tape_pipe->current_block.pulse_sync2, true);
+        zx_tape_pipe->current_block.tape_sync--;
+        result = true;
+    }
+    else if (zx_tape_pipe->current_block.data_size > 0)
+    {
+        if (zx_tape_pipe->current_block.data_type == ZX_TAPE_BLOCK_DATA)
+        {
+            if (zx_fifo_get_cntr(&zx_tape_pipe->fifo) > 0)
+            {
+                // The last byte of a TZX block may carry less than 8 bits,
+                // 0 is expanded by PL as a full byte
+                uint8_t bits = 8;
+                if (zx_tape_pipe->current_block.data_size == 1)
                 {
-                    zx_tape_current_block.data_size = 0;
-                    tape_bit = 0;
+                    bits = 8 - zx_tape_pipe->current_block.block_lastbit / 2;
                 }
+
+                zx_tape_send_byte(zx_tape_pipe->current_block.pulse_zero, zx_tape_pipe->current_block.pulse_one, zx_fifo_read_byte(&zx_tape_pipe->fifo), bits);
+                zx_tape_pipe->current_block.data_size--;
                 result = true;
             }
         }
-        else if (zx_tape_current_block.data_type == ZX_TAPE_SEQUENCE_DATA)
+        else if (zx_tape_pipe->current_block.data_type == ZX_TAPE_SEQUENCE_DATA)
         {
-            if (zx_fifo_get_cntr(&zx_tape_fifo) >= 2)
+            if (zx_fifo_get_cntr(&zx_tape_pipe->fifo) >= 2)
             {
                 uint16_t next;
-                zx_filo_read_file(&zx_tape_fifo, (uint8_t*)&next, 2);
+                zx_filo_read_file(&zx_tape_pipe->fifo, (uint8_t*)&next, 2);
                 zx_tape_send(zx_tape_convert(next), true);
-                zx_tape_current_block.data_size -= 2;
+                zx_tape_pipe->current_block.data_size -= 2;
+                result = true;
+            }
+        }
+        else if (zx_tape_pipe->current_block.data_type == ZX_TAPE_STREAM_DATA)
+        {
+            if (!zx_tape_signal_fill())
+            {
+                zx_file_stream_seek(&zx_tape_pipe->stream, zx_tape_pipe->signal.end);
+                zx_tape_pipe->current_block.data_size = 0;
+                zx_tape_pipe->signal_busy = false;
+            }
+            result = true;
+        }
+        else if (zx_tape_pipe->current_block.data_type == ZX_TAPE_LEVEL_DATA)
+        {
+            if (zx_fifo_get_cntr(&zx_tape_pipe->fifo) > 0)
+            {
+                zx_tape_edge_level(zx_fifo_read_byte(&zx_tape_pipe->fifo) ? 1 : 0);
+                zx_tape_pipe->current_block.data_size--;
                 result = true;
             }
         }
         else
         {
-            while (zx_fifo_get_cntr(&zx_tape_fifo) > 0  && zx_tape_current_block.data_size > 0)
+            while (zx_fifo_get_cntr(&zx_tape_pipe->fifo) > 0  && zx_tape_pipe->current_block.data_size > 0)
             {
-                zx_fifo_read_byte(&zx_tape_fifo);
-                zx_tape_current_block.data_size--;
+                zx_fifo_read_byte(&zx_tape_pipe->fifo);
+                zx_tape_pipe->current_block.data_size--;
             }
         }
     }
-    else if (zx_tape_current_block.tape_pause > 0)
+    else if (zx_tape_pipe->current_block.tape_pause > 0)
     {
-        zx_tape_send(3500, false);
-        zx_tape_current_block.tape_pause--;
+        zx_tape_send_repeat(ZX_TAPE_PAUSE_PULSE, false, zx_tape_pipe->current_block.tape_pause);
+        zx_tape_pipe->current_block.tape_pause = 0;
         result = true;
     }
     return result;
 }
 
+
+static void zx_tape_flash_arm(bool armed)
+{
+    reg_ZX_Tape_trap_Struct trap;
+
+    trap.u32 = 0;
+    trap.bits.trap_addr = zx_rom_descriptor_get(ZX_ROM_48_PAGE)->ld_bytes_addr;
+    trap.bits.trap_en = armed;
+    trap.bits.trap_clear = 1;
+    zx_tape_trap_reg_write(&trap);
+
+    zx_tape_flash_armed = armed;
+}
+
+static void zx_tape_flash_routine()
+{
+    // A ROM without the standard LD-BYTES leaves all blocks to be played as pulses
+    bool needed = zx_tape_flash_enabled && !zx_tape_pipe->started && !zx_tape_flash_finished && zx_tape_path[0] != 0 &&
+        zx_rom_descriptor_get(ZX_ROM_48_PAGE)->ld_bytes_addr != ZX_ROM_NO_ADDR;
+
+    if (needed != zx_tape_flash_armed)
+    {
+        zx_tape_flash_arm(needed);
+    }
+
+    if (zx_tape_flash_armed)
+    {
+        reg_ZX_Tape_trap_Struct trap;
+        zx_tape_trap_reg_read(&trap);
+
+        if (trap.bits.trap_hit)
+        {
+            zx_tape_flash_load();
+        }
+    }
+}
+
+static bool zx_tape_flash_next_block(uint32_t* data_size)
+{
+    uint8_t header[0x20];
+    zx_tape_block_Struct block;
+
+    uint8_t hs;
+
+    while ((hs = zx_tape_read_header(&zx_tape_flash_stream, header)) != 0)
+    {
+        zx_tape_block_parse_header(header, &block);
+
+        if (zx_tape_block_type(header) == ZX_TAPE_STD_BLOCK_ID)
+        {
+            *data_size = block.data_size;
+            return true;
+        }
+
+        if (block.tape_pilot > 0 || block.tape_sync > 0 ||
+            (block.data_size > 0 && block.data_type != ZX_TAPE_SKIP_DATA && block.data_type != ZX_TAPE_LEVEL_DATA))
+        {
+            // Turbo and custom blocks are only understood by custom loaders,
+            // rewind to the header and let them be played as pulses
+            zx_file_stream_seek(&zx_tape_flash_stream, zx_file_stream_tell(&zx_tape_flash_stream) - hs);
+            return false;
+        }
+
+        // Pauses, loops and descriptive blocks make no difference for the ROM loader
+        zx_file_stream_seek(&zx_tape_flash_stream, zx_file_stream_tell(&zx_tape_flash_stream) + block.data_size);
+    }
+
+    zx_file_stream_seek(&zx_tape_flash_stream, zx_file_stream_size_get(&zx_tape_flash_stream));
+    return false;
+}
+
+static void zx_tape_flash_load()
+{
+    uint16_t pc;
+    uint8_t istate;
+    uint32_t data_size = 0;
+
+    // Take the CPU over from the trap so that it stays halted once the trap is cleared
+    zx_cpu_stop();
+    zx_tape_flash_arm(false);
+    zx_cpu_state_get(&pc, &istate);
+
+    // TR-DOS has its own code at the trap address, the tape is left as it is
+    if (zx_cpu_trdos_active())
+    {
+        zx_cpu_modify_pc(pc, istate);
+        return;
+    }
+
+    zx_file_stream_seek(&zx_tape_flash_stream, zx_tape_flash_pos);
+
+    if (!zx_tape_flash_next_block(&data_size))
+    {
+        // Resume the ROM loader untouched: it either gets the rest of the tape
+        // as pulses or keeps waiting for a signal if the tape has ended
+        zx_tape_flash_pos = zx_file_stream_tell(&zx_tape_flash_stream);
+        zx_tape_flash_finished = true;
+
+        if (!zx_file_stream_eof(&zx_tape_flash_stream))
+        {
+            zx_tape_start_pos = zx_tape_flash_pos;
+            zx_tape_restart();
+        }
+
+        zx_cpu_modify_pc(pc, istate);
+        return;
+    }
+
+    uint32_t block_end = zx_file_stream_tell(&zx_tape_flash_stream) + data_size;
+    zx_tape_pipe->index_current = zx_tape_index_find(zx_file_stream_tell(&zx_tape_flash_stream) - zx_tape_get_header_size(ZX_TAPE_STD_BLOCK_ID));
+    uint8_t regs[ZX_SNAPSHOT_REGS_SIZE];
+    zx_cpu_regs_save(regs);
+
+    // Mimic LD-BYTES: A holds the expected flag byte, IX the destination,
+    // DE the length and the carry flag selects LOAD or VERIFY
+    uint8_t flag_expected = regs[ZX_SNAPSHOT_REG_A];
+    bool verify = (regs[ZX_SNAPSHOT_REG_F] & ZX_TAPE_FLAG_CARRY) == 0;
+    uint16_t length = zx_tape_read_word(regs + ZX_SNAPSHOT_REG_DE);
+    uint16_t dest = zx_tape_read_word(regs + ZX_SNAPSHOT_REG_IX);
+    uint16_t count = 0;
+    bool loaded = false;
+    uint8_t data;
+
+    if (data_size > 0 && zx_file_stream_read_byte(&zx_tape_flash_stream, &data) && data == flag_expected)
+    {
+        uint8_t parity = data;
+
+        while (count < length && zx_file_stream_read_byte(&zx_tape_flash_stream, &data))
+        {
+            if (verify)
+            {
+                if (zx_memory_read(dest + count) != data) break;
+            }
+            else
+            {
+                zx_memory_write(dest + count, data);
+            }
+            parity ^= data;
+            count++;
+        }
+
+        // The byte after the data is the checksum, a block which is too
+        // short or fails the check gets reported as a tape loading error
+        if (count == length && count + 1U < data_size && zx_file_stream_read_byte(&zx_tape_flash_stream, &data))
+        {
+            loaded = (parity ^ data) == 0;
+        }
+    }
+    zx_memory_flush();
+
+    zx_tape_flash_pos = block_end;
+
+    dest += count;
+    length -= count;
+    regs[ZX_SNAPSHOT_REG_IX] = dest & 0xFF;
+    regs[ZX_SNAPSHOT_REG_IX + 1] = dest >> 8;
+    regs[ZX_SNAPSHOT_REG_DE] = length & 0xFF;
+    regs[ZX_SNAPSHOT_REG_DE + 1] = length >> 8;
+
+    if (loaded)
+    {
+        // Same as the ROM leaves it after the final CP 01
+        regs[ZX_SNAPSHOT_REG_A] = 0;
+        regs[ZX_SNAPSHOT_REG_F] = ZX_TAPE_FLAGS_LOADED;
+    }
+    else
+    {
+        regs[ZX_SNAPSHOT_REG_F] = 0;
+    }
+
+    // The return address of LD-BYTES is on top of the stack so any RET in the
+    // 48K ROM brings the CPU back to the caller with interrupts enabled
+    zx_cpu_regs_restore(regs, zx_rom_descriptor_get(ZX_ROM_48_PAGE)->ret_addr, (istate & 0x03) | ZX_TAPE_ISTATE_EI);
+}
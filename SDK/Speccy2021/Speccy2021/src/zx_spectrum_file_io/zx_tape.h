@@ -9,11 +9,34 @@
 #include <string.h>
 #include <stdbool.h>
 #include "zx_fifo.h"
+#include "zx_file_stream.h"
+#include "zx_inflate.h"
+#include "zx_content_cache.h"
+#include "zx_snapshot.h"
+#include <semphr.h>
+#include "xscugic.h"
+#include "../zynq_misc/task_stats/zynq_task_stats.h"
 #include "../zynq_file_io/xilffs_v4_4/ff.h"
 #include "../zx_spectrum_video/zx_spectrum_display_ctrl.h"
 #include "../zynq_usb/tinyusb/class/hid/hid.h"
 
-//! @brief Select *.tap, *.tzx file for playback
+#define ZX_TAPE_INDEX_SIZE (0x200)
+#define ZX_TAPE_NAME_SIZE (10)
+#define ZX_TAPE_NO_HEADER (0xFF)
+#define ZX_TAPE_NO_CACHE_WORD (0xFFFFFFFFU)
+
+//! @brief Block index entry built when a file is selected
+typedef struct
+{
+    uint32_t offset;
+    uint32_t length;
+    uint32_t cache_word;
+    uint8_t type;
+    uint8_t header_type;
+    char name[ZX_TAPE_NAME_SIZE + 1];
+} zx_tape_index_entry_Struct;
+
+//! @brief Select *.tap, *.tzx, *.pzx, *.csw file for playback
 //! @param *name is a pointer to the file name
 void zx_tape_select_file(const char *name);
 
@@ -30,7 +53,52 @@ void zx_tape_restart(void);
 //! @return true is playback is active false otherwise
 bool zx_tape_started(void);
 
-//! @brief Non-blocking routine which should be periodically called from main thread
+//! @brief Get the number of blocks in the selected file
+//! @return the number of index entries
+uint32_t zx_tape_blocks_count(void);
+
+//! @brief Get an index entry
+//! @param idx is the entry number
+//! @return a pointer to the entry or NULL if out of range
+const zx_tape_index_entry_Struct* zx_tape_block_get(uint32_t idx);
+
+//! @brief Get the block being played
+//! @return the entry number or -1 if playback has not reached any block yet
+int32_t zx_tape_current_block_get(void);
+
+//! @brief Stop playback and wind the tape to the beginning of a block
+//! @param idx is the entry number
+void zx_tape_block_seek(uint32_t idx);
+
+//! @brief Make a short human readable description of a block
+//! @param idx is the entry number
+//! @param *str is a pointer to the destination string
+//! @param size is the size of the destination string
+void zx_tape_block_describe(uint32_t idx, char* str, size_t size);
+
+//! @brief Enable or disable instant loading of standard blocks through the ROM loader trap
+//! @param enabled set to true to enable or false to play all blocks as pulses
+void zx_tape_flash_load_set(bool enabled);
+
+//! @brief Get instant loading status
+//! @return true if standard blocks are loaded instantly or false otherwise
+bool zx_tape_flash_load_get(void);
+
+//! @brief Create the tape task and connect the FIFO low-water interrupt
+void zx_tape_init(void);
+
+//! @brief Take exclusive access to the tape emulator and the file system,
+//!   FatFs is built without FF_FS_REENTRANT so all file access goes through this lock
+void zx_tape_lock(void);
+
+//! @brief Release exclusive access taken by zx_tape_lock
+void zx_tape_unlock(void);
+
+//! @brief Get the number of times the FIFO in PL has run empty during playback
+//! @return the number of underflows since the file was selected
+uint16_t zx_tape_underflows_get(void);
+
+//! @brief Non-blocking routine which is called from the tape task
 void zx_tape_routine(void);
 
 //! @brief Handle keyboard events
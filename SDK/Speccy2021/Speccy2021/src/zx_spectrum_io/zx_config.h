@@ -10,9 +10,30 @@
 #define EMULATOR_PAGE_SIZE (0x4000U)
 #define EMULATOR_VDMA_AREA_OFFSET (0x24000U)
 
+// 128K BASIC, 48K BASIC, TR-DOS and a spare page
 #define EMULATOR_ROM_PAGES_COUNT (4)
 #define EMULATOR_PAGE_LEFT_SHIFT_BITS (14)
 #define EMULATOR_THREE_PAGE_SIZE (0xC000U)
 #define EMULATOR_PAGE_2 (2)
 
+// Quick save slots live in DDR well past the emulator window
+#define EMULATOR_SLOTS_AREA_START (EMULATOR_MEMORY_AREA_START + 0x100000U)
+#define EMULATOR_SLOT_SIZE (0x20000U)
+#define EMULATOR_SLOTS_COUNT (4)
+#define EMULATOR_REWIND_AREA_START (EMULATOR_SLOTS_AREA_START + EMULATOR_SLOTS_COUNT * EMULATOR_SLOT_SIZE)
+#define EMULATOR_REWIND_AREA_SIZE (0x400000U)
+// Recently loaded snapshots and tapes are kept right after the rewind buffer
+#define EMULATOR_CACHE_AREA_START (EMULATOR_REWIND_AREA_START + EMULATOR_REWIND_AREA_SIZE)
+#define EMULATOR_CACHE_AREA_SIZE (0x1000000U)
+// Disk images mounted in the Betadisk drives, up to 80 tracks of 2 sides each
+#define EMULATOR_BETADISK_AREA_START (EMULATOR_CACHE_AREA_START + EMULATOR_CACHE_AREA_SIZE)
+#define EMULATOR_BETADISK_DRIVE_SIZE (0xA0000U)
+#define EMULATOR_BETADISK_DRIVES_COUNT (4)
+// Listing of the folder shown by the shell, the entries followed by the names
+#define EMULATOR_DIR_LIST_AREA_START (EMULATOR_BETADISK_AREA_START + EMULATOR_BETADISK_DRIVES_COUNT * EMULATOR_BETADISK_DRIVE_SIZE)
+#define EMULATOR_DIR_LIST_AREA_SIZE (0x400000U)
+// Listings of the recently visited folders
+#define EMULATOR_DIR_CACHE_AREA_START (EMULATOR_DIR_LIST_AREA_START + EMULATOR_DIR_LIST_AREA_SIZE)
+#define EMULATOR_DIR_CACHE_AREA_SIZE (0x800000U)
+
 #endif
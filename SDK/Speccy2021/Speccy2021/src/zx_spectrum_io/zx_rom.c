@@ -0,0 +1,88 @@
+/*
+ ROM descriptors
+ ===============
+
+ The emulator needs a few addresses inside the ROM: any RET opcode to
+ resume 48K SNA snapshots and LD-BYTES for the tape loader trap. The ROM
+ area is not cached so scanning it on every use is slow, instead each page
+ is examined once when its image is installed. The standard routines are
+ recognised by their first bytes so a ROM which has them elsewhere or not
+ at all simply gets no address.
+
+ Designed in Magictale Electronics.
+
+ Copyright (c) 2021 Dmitry Pakhomenko.
+ dmitryp@magictale.com
+ http://magictale.com
+
+ This code is in the public domain.
+*/
+
+#include "zx_rom.h"
+
+#include <string.h>
+#include <xil_printf.h>
+
+#define ZX_ROM_OPCODE_RET 0xC9
+#define ZX_ROM_LD_BYTES_ADDR 0x0556
+#define ZX_ROM_SA_BYTES_ADDR 0x04C2
+#define ZX_ROM_FNV_OFFSET_BASIS 0x811C9DC5U
+#define ZX_ROM_FNV_PRIME 0x01000193U
+
+// INC D; EX AF,AF'; DEC D; DI; LD A,$0F; OUT ($FE),A
+static const uint8_t zx_rom_ld_bytes_signature[] = { 0x14, 0x08, 0x15, 0xF3, 0x3E, 0x0F, 0xD3, 0xFE };
+// LD HL,SA/LD-RET; PUSH HL; LD HL,$1F80
+static const uint8_t zx_rom_sa_bytes_signature[] = { 0x21, 0x3F, 0x05, 0xE5, 0x21, 0x80, 0x1F };
+
+static zx_rom_descriptor_Struct zx_rom_descriptors[EMULATOR_ROM_PAGES_COUNT];
+
+//! @brief Check whether a routine starts at the given address
+//! @param *rom is a pointer to the ROM page
+//! @param addr is the address of the routine
+//! @param *signature is a pointer to the first bytes of the routine
+//! @param size is the number of bytes to compare
+//! @return the address if the routine is there or ZX_ROM_NO_ADDR otherwise
+static uint16_t zx_rom_entry_match(const uint8_t* rom, uint16_t addr, const uint8_t* signature, uint32_t size);
+
+
+void zx_rom_init()
+{
+    for (uint8_t i = 0; i < EMULATOR_ROM_PAGES_COUNT; i++)
+    {
+        zx_rom_install(i);
+    }
+}
+
+void zx_rom_install(uint8_t rom_page)
+{
+    const uint8_t* rom = (const uint8_t*)(EMULATOR_MEMORY_AREA_START + rom_page * EMULATOR_PAGE_SIZE);
+    zx_rom_descriptor_Struct* p_desc = &zx_rom_descriptors[rom_page];
+    uint32_t hash = ZX_ROM_FNV_OFFSET_BASIS;
+
+    p_desc->ret_addr = ZX_ROM_NO_ADDR;
+    for (uint16_t i = 0; i < EMULATOR_PAGE_SIZE; i++)
+    {
+        hash = (hash ^ rom[i]) * ZX_ROM_FNV_PRIME;
+        if (p_desc->ret_addr == ZX_ROM_NO_ADDR && rom[i] == ZX_ROM_OPCODE_RET)
+        {
+            p_desc->ret_addr = i;
+        }
+    }
+    p_desc->hash = hash;
+
+    p_desc->ld_bytes_addr = zx_rom_entry_match(rom, ZX_ROM_LD_BYTES_ADDR, zx_rom_ld_bytes_signature, sizeof(zx_rom_ld_bytes_signature));
+    p_desc->sa_bytes_addr = zx_rom_entry_match(rom, ZX_ROM_SA_BYTES_ADDR, zx_rom_sa_bytes_signature, sizeof(zx_rom_sa_bytes_signature));
+
+    xil_printf("ROM %d: hash %08x, RET %04x, LD-BYTES %04x, SA-BYTES %04x\r\n", rom_page, p_desc->hash,
+        p_desc->ret_addr, p_desc->ld_bytes_addr, p_desc->sa_bytes_addr);
+}
+
+const zx_rom_descriptor_Struct* zx_rom_descriptor_get(uint8_t rom_page)
+{
+    return &zx_rom_descriptors[rom_page % EMULATOR_ROM_PAGES_COUNT];
+}
+
+static uint16_t zx_rom_entry_match(const uint8_t* rom, uint16_t addr, const uint8_t* signature, uint32_t size)
+{
+    return memcmp(rom + addr, signature, size) == 0 ? addr : ZX_ROM_NO_ADDR;
+}
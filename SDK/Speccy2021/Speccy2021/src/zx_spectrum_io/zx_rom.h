@@ -0,0 +1,36 @@
+//! @file zx_rom.h
+//! @brief Descriptors of the ROM pages, built once when a ROM image is installed
+
+#ifndef ZX_ROM_H
+#define ZX_ROM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "zx_config.h"
+
+// None of the entry points can be at the reset vector so it marks a missing one
+#define ZX_ROM_NO_ADDR (0x0000U)
+#define ZX_ROM_48_PAGE (1)
+
+//! @brief Well-known addresses of a ROM page
+typedef struct
+{
+    uint32_t hash;
+    uint16_t ret_addr;
+    uint16_t ld_bytes_addr;
+    uint16_t sa_bytes_addr;
+} zx_rom_descriptor_Struct;
+
+//! @brief Build descriptors of all ROM pages, the images are placed in DDR by the boot loader
+void zx_rom_init(void);
+
+//! @brief Build the descriptor of a ROM page, call it every time a new image is written into the page
+//! @param rom_page is the ROM page number
+void zx_rom_install(uint8_t rom_page);
+
+//! @brief Get the descriptor of a ROM page
+//! @param rom_page is the ROM page number
+//! @return a pointer to the descriptor
+const zx_rom_descriptor_Struct* zx_rom_descriptor_get(uint8_t rom_page);
+
+#endif
@@ -116,6 +116,11 @@ void zx_spectrum_control_reg_read(reg_ZX_Spectrum_cpu_control_Struct* value)
     value->u32 = reg_read(ZX_SPECTRUM_CONTROL_OFFSET);
 }
 
+void zx_spectrum_status_reg_read(reg_ZX_Spectrum_cpu_status_Struct* value)
+{
+    value->u32 = reg_read(ZX_SPECTRUM_CONTROL_OFFSET);
+}
+
 void zx_mem_write(uint32_t address, uint8_t value)
 {
     reg_ZX_mem_write_test_Struct mem_write_test_reg;
@@ -229,4 +234,54 @@ void zx_tape_fifo_reg_read(reg_ZX_Tape_fifo_Struct* value)
     value->u32 = reg_read(ZX_TAPE_FIFO_OFFSET);
 }
 
+void zx_tape_trap_reg_write(reg_ZX_Tape_trap_Struct* value)
+{
+    reg_write(ZX_TAPE_TRAP_OFFSET, value->u32);
+}
+
+void zx_tape_trap_reg_read(reg_ZX_Tape_trap_Struct* value)
+{
+    value->u32 = reg_read(ZX_TAPE_TRAP_OFFSET);
+}
+
+void zx_tape_fifo_ctrl_reg_write(reg_ZX_Tape_fifo_ctrl_Struct* value)
+{
+    reg_write(ZX_TAPE_FIFO_CTRL_OFFSET, value->u32);
+}
+
+void zx_tape_fifo_status_reg_read(reg_ZX_Tape_fifo_status_Struct* value)
+{
+    value->u32 = reg_read(ZX_TAPE_FIFO_CTRL_OFFSET);
+}
+
+void zx_ram_dirty_reg_write(reg_ZX_Ram_dirty_Struct* value)
+{
+    reg_write(ZX_RAM_DIRTY_OFFSET, value->u32);
+}
+
+void zx_ram_dirty_reg_read(reg_ZX_Ram_dirty_Struct* value)
+{
+    value->u32 = reg_read(ZX_RAM_DIRTY_OFFSET);
+}
+
+void zx_trdos_ports_reg_write(reg_ZX_Spectrum_trdos_ports_Struct* value)
+{
+    reg_write(ZX_TRDOS_PORTS_OFFSET, value->u32);
+}
+
+void zx_trdos_request_reg_read(reg_ZX_Spectrum_trdos_request_Struct* value)
+{
+    value->u32 = reg_read(ZX_TRDOS_PORTS_OFFSET);
+}
+
+void zx_trdos_fifo_ctrl_reg_write(reg_ZX_Spectrum_trdos_fifo_ctrl_Struct* value)
+{
+    reg_write(ZX_TRDOS_FIFO_CTRL_OFFSET, value->u32);
+}
+
+void zx_trdos_fifo_status_reg_read(reg_ZX_Spectrum_trdos_fifo_status_Struct* value)
+{
+    value->u32 = reg_read(ZX_TRDOS_FIFO_CTRL_OFFSET);
+}
+
 
@@ -32,6 +32,11 @@
 #define ZX_KEYBOARD_REG2_OFFSET          (0x120L)
 #define ZX_IO_PORTS_OFFSET               (0x124L)
 #define ZX_TAPE_FIFO_OFFSET              (0x128L)
+#define ZX_TAPE_TRAP_OFFSET              (0x12CL)
+#define ZX_TAPE_FIFO_CTRL_OFFSET         (0x130L)
+#define ZX_RAM_DIRTY_OFFSET              (0x134L)
+#define ZX_TRDOS_PORTS_OFFSET            (0x138L)
+#define ZX_TRDOS_FIFO_CTRL_OFFSET        (0x13CL)
 
 // Spectrum common constants
 #define ZX_SPECTRUM_H_RESOLUTION (256)
@@ -172,6 +177,29 @@ typedef union
  
 } reg_ZX_Spectrum_cpu_control_Struct;
 
+//!@brief C structure representing ZX Spectrum 2021 control register as it is read back.
+//! cpu_int holds IFF2, IFF1 and IM in bits 3...0 while the CPU is halted,
+//! cpu_halt_ack is set once the CPU has stopped at an instruction boundary and
+//! cpu_restore_done is set once the CPU has taken the PC while cpu_restore_pc_n is low,
+//! trdos_active is set while the TR-DOS ROM is paged in
+typedef union
+{
+    uint32_t u32;
+
+    struct
+    {
+        uint32_t cpu_int : 8;
+        uint32_t cpu_pc : 16;
+        uint32_t trdos_active : 1;
+        uint32_t reserved1 : 3;
+        uint32_t cpu_reset : 1;
+        uint32_t cpu_restore_done : 1;
+        uint32_t cpu_halt_ack : 1;
+        uint32_t cpu_halt_req : 1;
+    } bits;
+
+} reg_ZX_Spectrum_cpu_status_Struct;
+
 //!@brief C structure representing ZX Spectrum 2021 IO port register.
 typedef union
 {
@@ -187,33 +215,86 @@ typedef union
     
 } reg_ZX_Spectrum_io_ports_Struct;
 
-//!@brief C structure representing ZX Spectrum 2021 TR-DOS port register (currently not used).
+//!@brief C structure representing ZX Spectrum 2021 TR-DOS port register when written.
+//! fifo_push puts fifo_data into the FIFO read by the CPU from port 7F,
+//! fifo_pop takes the next byte written by the CPU into port 7F
 typedef union
 {
     uint32_t u32;
 
     struct
     {
-        uint32_t trdos_fifo_read_wr : 8;
-        uint32_t reserved : 24;
+        uint32_t fifo_data : 8;
+        uint32_t fifo_push : 1;
+        uint32_t fifo_pop : 1;
+        uint32_t reserved : 22;
     } bits;
 
 } reg_ZX_Spectrum_trdos_ports_Struct;
 
-//!@brief C structure representing ZX Spectrum 2021 TR-DOS FIFO control register (currently not used).
+//!@brief C structure representing ZX Spectrum 2021 TR-DOS port register when read.
+//! The CPU waits while req_pending is set for the access to port req_port
+//! to be emulated, fifo_data holds the byte taken by the last fifo_pop
+typedef union
+{
+    uint32_t u32;
+
+    struct
+    {
+        uint32_t req_data : 8;
+        uint32_t req_port : 8;
+        uint32_t req_wr : 1;
+        uint32_t req_pending : 1;
+        uint32_t reserved : 6;
+        uint32_t fifo_data : 8;
+    } bits;
+
+} reg_ZX_Spectrum_trdos_request_Struct;
+
+//!@brief C structure representing ZX Spectrum 2021 TR-DOS FIFO control register when written.
+//! req_release lets the waiting CPU go on with response as the byte read,
+//! while stream_rd or stream_wr are set port 7F is served from the FIFOs
 typedef union
 {
     uint32_t u32;
 
     struct
     {
-        uint32_t trdos_fifo_write_rst : 1;
-        uint32_t trdos_fifo_write_counter : 11;
-        uint32_t reserved : 20;
+        uint32_t response : 8;
+        uint32_t req_release : 1;
+        uint32_t intrq : 1;
+        uint32_t drq : 1;
+        uint32_t stream_rd : 1;
+        uint32_t stream_wr : 1;
+        uint32_t fifo_rst : 1;
+        uint32_t irq_en : 1;
+        uint32_t reserved : 17;
     } bits;
 
 } reg_ZX_Spectrum_trdos_fifo_ctrl_Struct;
 
+//!@brief C structure representing ZX Spectrum 2021 TR-DOS FIFO control register when read.
+//! wfifo_level counts the bytes written by the CPU and not taken yet
+typedef union
+{
+    uint32_t u32;
+
+    struct
+    {
+        uint32_t wfifo_level : 11;
+        uint32_t reserved : 13;
+        uint32_t rfifo_empty : 1;
+        uint32_t wfifo_empty : 1;
+        uint32_t intrq : 1;
+        uint32_t drq : 1;
+        uint32_t stream_rd : 1;
+        uint32_t stream_wr : 1;
+        uint32_t irq_en : 1;
+        uint32_t irq_pending : 1;
+    } bits;
+
+} reg_ZX_Spectrum_trdos_fifo_status_Struct;
+
 //!@brief C structure representing ZX Spectrum 2021 mouse register (currently not used).
 typedef union
 {
@@ -254,7 +335,8 @@ typedef union
     struct
     {
         uint32_t fifo_data : 16;
-        uint32_t reserved : 12;
+        uint32_t reserved : 11;
+        uint32_t fifo_almost_full : 1;
         uint32_t fifo_underflow : 1;
         uint32_t fifo_overflow : 1;
         uint32_t fifo_full : 1;
@@ -263,6 +345,73 @@ typedef union
 
 } reg_ZX_Tape_fifo_Struct;
 
+//!@brief C structure representing ZX Spectrum 2021 tape ROM trap register.
+//! Writing trap_clear releases the CPU frozen by the trap
+typedef union
+{
+    uint32_t u32;
+
+    struct
+    {
+        uint32_t trap_addr : 16;
+        uint32_t trap_en : 1;
+        uint32_t trap_clear : 1;
+        uint32_t reserved : 13;
+        uint32_t trap_hit : 1;
+    } bits;
+
+} reg_ZX_Tape_trap_Struct;
+
+//!@brief C structure representing ZX Spectrum 2021 tape FIFO control register when written.
+//! An interrupt is raised once the FIFO drops below low_water
+typedef union
+{
+    uint32_t u32;
+
+    struct
+    {
+        uint32_t low_water : 11;
+        uint32_t reserved1 : 5;
+        uint32_t irq_en : 1;
+        uint32_t irq_clear : 1;
+        uint32_t underflows_clear : 1;
+        uint32_t reserved2 : 13;
+    } bits;
+
+} reg_ZX_Tape_fifo_ctrl_Struct;
+
+//!@brief C structure representing ZX Spectrum 2021 tape FIFO control register when read.
+//! Underflows are counted while the interrupt is enabled
+typedef union
+{
+    uint32_t u32;
+
+    struct
+    {
+        uint32_t underflows : 16;
+        uint32_t fifo_level : 11;
+        uint32_t reserved : 3;
+        uint32_t irq_en : 1;
+        uint32_t irq_pending : 1;
+    } bits;
+
+} reg_ZX_Tape_fifo_status_Struct;
+
+//!@brief C structure representing ZX Spectrum 2021 RAM dirty register.
+//! A bit of pages is set once the CPU writes into the RAM page,
+//! writing 1 into the bit clears it
+typedef union
+{
+    uint32_t u32;
+
+    struct
+    {
+        uint32_t pages : 8;
+        uint32_t reserved : 24;
+    } bits;
+
+} reg_ZX_Ram_dirty_Struct;
+
 
 //! @brief Writes to the control register
 //! @param *value is a pointer to reg_ZX_Control_Struct to be written
@@ -351,6 +500,10 @@ void zx_spectrum_io_ports_reg_read(reg_ZX_Spectrum_io_ports_Struct* value);
 //! @param *value is a pointer to reg_ZX_Spectrum_cpu_control_Struct to be read
 void zx_spectrum_control_reg_read(reg_ZX_Spectrum_cpu_control_Struct* value);
 
+//! @brief Reads the CPU status from the ZX Spectrum CPU control register
+//! @param *value is a pointer to reg_ZX_Spectrum_cpu_status_Struct to be read
+void zx_spectrum_status_reg_read(reg_ZX_Spectrum_cpu_status_Struct* value);
+
 //! @brief Writes to the ZX Spectrum tape FIFO register
 //! @param *value is a pointer to reg_ZX_Spectrum_io_ports_Struct to be written
 void zx_tape_fifo_reg_write(reg_ZX_Tape_fifo_Struct* value);
@@ -359,4 +512,44 @@ void zx_tape_fifo_reg_write(reg_ZX_Tape_fifo_Struct* value);
 //! @param *value is a pointer to reg_ZX_Spectrum_io_ports_Struct to be read
 void zx_tape_fifo_reg_read(reg_ZX_Tape_fifo_Struct* value);
 
+//! @brief Writes to the ZX Spectrum tape ROM trap register
+//! @param *value is a pointer to reg_ZX_Tape_trap_Struct to be written
+void zx_tape_trap_reg_write(reg_ZX_Tape_trap_Struct* value);
+
+//! @brief Reads from the ZX Spectrum tape ROM trap register
+//! @param *value is a pointer to reg_ZX_Tape_trap_Struct to be read
+void zx_tape_trap_reg_read(reg_ZX_Tape_trap_Struct* value);
+
+//! @brief Writes to the ZX Spectrum tape FIFO control register
+//! @param *value is a pointer to reg_ZX_Tape_fifo_ctrl_Struct to be written
+void zx_tape_fifo_ctrl_reg_write(reg_ZX_Tape_fifo_ctrl_Struct* value);
+
+//! @brief Reads from the ZX Spectrum tape FIFO control register
+//! @param *value is a pointer to reg_ZX_Tape_fifo_status_Struct to be read
+void zx_tape_fifo_status_reg_read(reg_ZX_Tape_fifo_status_Struct* value);
+
+//! @brief Writes to the ZX Spectrum RAM dirty register
+//! @param *value is a pointer to reg_ZX_Ram_dirty_Struct with the bits to be cleared
+void zx_ram_dirty_reg_write(reg_ZX_Ram_dirty_Struct* value);
+
+//! @brief Reads from the ZX Spectrum RAM dirty register
+//! @param *value is a pointer to reg_ZX_Ram_dirty_Struct to be read
+void zx_ram_dirty_reg_read(reg_ZX_Ram_dirty_Struct* value);
+
+//! @brief Writes to the ZX Spectrum TR-DOS port register
+//! @param *value is a pointer to reg_ZX_Spectrum_trdos_ports_Struct to be written
+void zx_trdos_ports_reg_write(reg_ZX_Spectrum_trdos_ports_Struct* value);
+
+//! @brief Reads from the ZX Spectrum TR-DOS port register
+//! @param *value is a pointer to reg_ZX_Spectrum_trdos_request_Struct to be read
+void zx_trdos_request_reg_read(reg_ZX_Spectrum_trdos_request_Struct* value);
+
+//! @brief Writes to the ZX Spectrum TR-DOS FIFO control register
+//! @param *value is a pointer to reg_ZX_Spectrum_trdos_fifo_ctrl_Struct to be written
+void zx_trdos_fifo_ctrl_reg_write(reg_ZX_Spectrum_trdos_fifo_ctrl_Struct* value);
+
+//! @brief Reads from the ZX Spectrum TR-DOS FIFO control register
+//! @param *value is a pointer to reg_ZX_Spectrum_trdos_fifo_status_Struct to be read
+void zx_trdos_fifo_status_reg_read(reg_ZX_Spectrum_trdos_fifo_status_Struct* value);
+
 #endif
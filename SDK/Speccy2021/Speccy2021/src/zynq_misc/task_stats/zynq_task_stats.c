@@ -0,0 +1,137 @@
+/*
+ CPU load and latency statistics of the emulator tasks
+ =====================================================
+
+ Every task marks the moment it wakes up and the moment it is about to block
+ again, so the time spent in between is accounted as its CPU load. An event
+ the task is waiting for (an interrupt or a queued request) is time stamped
+ when it is raised, which gives the latency of the wake up. The time is taken
+ from the global timer of Cortex-A9 which is shared by both cores.
+
+ Designed in Magictale Electronics.
+ 
+ Copyright (c) 2021 Dmitry Pakhomenko.
+ dmitryp@magictale.com
+ http://magictale.com
+ 
+ This code is in the public domain.
+*/
+
+#include "zynq_task_stats.h"
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include "xtime_l.h"
+
+#define ZYNQ_TASK_STATS_US_PER_SECOND (1000000U)
+#define ZYNQ_TASK_STATS_PERMILLE (1000U)
+
+typedef struct
+{
+    const char* name;
+    volatile uint32_t signal_time;
+    volatile bool signalled;
+    XTime begin_time;
+    XTime busy;
+    XTime sample_time;
+    uint32_t max_latency;
+    uint32_t max_busy;
+    uint32_t events;
+} zynq_task_stats_entry_Struct;
+
+static zynq_task_stats_entry_Struct zynq_task_stats[ZYNQ_TASK_STATS_COUNT] =
+{
+    { .name = "USB host" },
+    { .name = "Tape" },
+    { .name = "File I/O" },
+    { .name = "Rewind" },
+    { .name = "Betadisk" },
+};
+
+//! @brief Convert global timer counts to microseconds
+//! @param counts is the number of global timer counts
+//! @return the time in microseconds
+static uint32_t zynq_task_stats_to_us(uint64_t counts);
+
+
+static uint32_t zynq_task_stats_to_us(uint64_t counts)
+{
+    return (uint32_t)(counts * ZYNQ_TASK_STATS_US_PER_SECOND / COUNTS_PER_SECOND);
+}
+
+void zynq_task_stats_signal(uint8_t task)
+{
+    zynq_task_stats_entry_Struct* p = &zynq_task_stats[task];
+
+    // Only the oldest event waiting for the task counts
+    if (!p->signalled)
+    {
+        XTime now;
+        XTime_GetTime(&now);
+        p->signal_time = (uint32_t)now;
+        p->signalled = true;
+    }
+}
+
+void zynq_task_stats_begin(uint8_t task)
+{
+    zynq_task_stats_entry_Struct* p = &zynq_task_stats[task];
+
+    XTime_GetTime(&p->begin_time);
+    if (p->signalled)
+    {
+        uint32_t latency = (uint32_t)p->begin_time - p->signal_time;
+        p->signalled = false;
+        if (latency > p->max_latency) p->max_latency = latency;
+    }
+}
+
+void zynq_task_stats_end(uint8_t task)
+{
+    zynq_task_stats_entry_Struct* p = &zynq_task_stats[task];
+    XTime now;
+
+    XTime_GetTime(&now);
+    uint64_t busy = now - p->begin_time;
+
+    taskENTER_CRITICAL();
+    p->busy += busy;
+    p->events++;
+    if (busy > p->max_busy) p->max_busy = (busy > UINT32_MAX) ? UINT32_MAX : (uint32_t)busy;
+    taskEXIT_CRITICAL();
+}
+
+void zynq_task_stats_get(uint8_t task, zynq_task_stats_Struct* stats)
+{
+    zynq_task_stats_entry_Struct* p = &zynq_task_stats[task];
+    XTime now;
+    XTime busy;
+
+    taskENTER_CRITICAL();
+    XTime_GetTime(&now);
+    busy = p->busy;
+    p->busy = 0;
+    stats->events = p->events;
+    p->events = 0;
+    taskEXIT_CRITICAL();
+
+    uint64_t elapsed = now - p->sample_time;
+    uint64_t load = elapsed ? busy * ZYNQ_TASK_STATS_PERMILLE / elapsed : 0;
+    p->sample_time = now;
+
+    stats->name = p->name;
+    stats->load_permille = (load > ZYNQ_TASK_STATS_PERMILLE) ? ZYNQ_TASK_STATS_PERMILLE : (uint16_t)load;
+    stats->max_latency_us = zynq_task_stats_to_us(p->max_latency);
+    stats->max_busy_us = zynq_task_stats_to_us(p->max_busy);
+}
+
+void zynq_task_stats_reset()
+{
+    taskENTER_CRITICAL();
+    for (uint8_t i = 0; i < ZYNQ_TASK_STATS_COUNT; i++)
+    {
+        zynq_task_stats[i].max_latency = 0;
+        zynq_task_stats[i].max_busy = 0;
+    }
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,47 @@
+//! @file zynq_task_stats.h
+//! @brief CPU load and latency statistics of the emulator tasks
+
+#ifndef ZYNQ_TASK_STATS_H
+#define ZYNQ_TASK_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ZYNQ_TASK_STATS_USB (0)
+#define ZYNQ_TASK_STATS_TAPE (1)
+#define ZYNQ_TASK_STATS_FILE_IO (2)
+#define ZYNQ_TASK_STATS_REWIND (3)
+#define ZYNQ_TASK_STATS_BETADISK (4)
+#define ZYNQ_TASK_STATS_COUNT (5)
+
+//! @brief Statistics of a task collected since the previous sample
+typedef struct
+{
+    const char* name;
+    uint16_t load_permille;
+    uint32_t max_latency_us;
+    uint32_t max_busy_us;
+    uint32_t events;
+} zynq_task_stats_Struct;
+
+//! @brief Note an event which the task is going to handle, may be called from an interrupt handler
+//! @param task is the task number
+void zynq_task_stats_signal(uint8_t task);
+
+//! @brief Note that the task has woken up and started its work
+//! @param task is the task number
+void zynq_task_stats_begin(uint8_t task);
+
+//! @brief Note that the task has finished its work and is going to block
+//! @param task is the task number
+void zynq_task_stats_end(uint8_t task);
+
+//! @brief Get the statistics of a task. The load is measured since the previous call
+//! @param task is the task number
+//! @param *stats is a pointer to the destination structure
+void zynq_task_stats_get(uint8_t task, zynq_task_stats_Struct* stats);
+
+//! @brief Forget the worst-case figures of all tasks
+void zynq_task_stats_reset(void);
+
+#endif /* ZYNQ_TASK_STATS_H */
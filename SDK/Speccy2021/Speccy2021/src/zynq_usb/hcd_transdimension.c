@@ -31,6 +31,7 @@
 #include "ehci/ehci_api.h"
 #include "ulpi.h"
 #include "xusbps_hw.h"
+#include "../zynq_misc/task_stats/zynq_task_stats.h"
 
 //--------------------------------------------------------------------+
 // MACRO CONSTANT TYPEDEF
@@ -182,6 +183,7 @@ bool hcd_init(uint8_t rhport)
 
 void hcd_int_zynq_handler(void *CallBackRef, u32 IrqMask)
 {
+    zynq_task_stats_signal(ZYNQ_TASK_STATS_USB);
     hcd_int_handler((uint8_t)(uint32_t)CallBackRef);
 }
 
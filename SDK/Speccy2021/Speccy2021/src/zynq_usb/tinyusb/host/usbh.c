@@ -334,6 +334,16 @@ bool tuh_init(uint8_t rhport)
     }
     @endcode
  */
+#if CFG_TUSB_OS == OPT_OS_FREERTOS
+bool tuh_task_wait(uint32_t timeout_ms)
+{
+  if ( !tusb_inited() ) return false;
+
+  hcd_event_t event;
+  return osal_queue_peek(_usbh_q, &event, timeout_ms);
+}
+#endif
+
 void tuh_task(void)
 {
   // Skip if stack is not initialized
@@ -53,6 +53,11 @@ bool tuh_inited(void);
 // Task function should be called in main/rtos loop
 void tuh_task(void);
 
+#if CFG_TUSB_OS == OPT_OS_FREERTOS
+// Block until there is an event for tuh_task or the timeout expires
+bool tuh_task_wait(uint32_t timeout_ms);
+#endif
+
 // Interrupt handler, name alias to HCD
 extern void hcd_int_handler(uint8_t rhport);
 #define tuh_int_handler   hcd_int_handler
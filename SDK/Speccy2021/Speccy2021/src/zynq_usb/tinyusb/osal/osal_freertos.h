@@ -143,7 +143,15 @@ static inline osal_queue_t osal_queue_create(osal_queue_def_t* qdef)
 
 static inline bool osal_queue_receive(osal_queue_t qhdl, void* data)
 {
-  return xQueueReceive(qhdl, data, 10); //portMAX_DELAY); -- do not block indefinetely (DmitryP)
+  // Never blocks, tuh_task_wait waits for the next event with osal_queue_peek
+  // so that tuh_task only runs when there is an event to process
+  return xQueueReceive(qhdl, data, 0);
+}
+
+static inline bool osal_queue_peek(osal_queue_t qhdl, void* data, uint32_t msec)
+{
+  uint32_t const ticks = (msec == OSAL_TIMEOUT_WAIT_FOREVER) ? portMAX_DELAY : pdMS_TO_TICKS(msec);
+  return xQueuePeek(qhdl, data, ticks) != 0;
 }
 
 static inline bool osal_queue_send(osal_queue_t qhdl, void const * data, bool in_isr)
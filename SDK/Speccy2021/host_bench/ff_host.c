@@ -0,0 +1,174 @@
+/*
+ FatFs on host files
+ ===================
+
+ Just enough of FatFs for the host benchmarks: files are opened read only
+ with stdio and every f_read, f_lseek and f_open is counted. The sector
+ window of FIL is kept the way FatFs keeps it, so a read which does not
+ cover whole sectors goes through the window and only costs a disk read
+ when it leaves the sector held there, while whole sectors are read
+ straight into the destination with one disk read per cluster.
+
+ Designed in Magictale Electronics.
+
+ Copyright (c) 2021 Dmitry Pakhomenko.
+ dmitryp@magictale.com
+ http://magictale.com
+
+ This code is in the public domain.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "ff_host.h"
+
+#define FF_HOST_FILES (4)
+
+static FILE* ff_host_files[FF_HOST_FILES];
+static ff_host_stats_Struct ff_host_stats;
+
+//! @brief Read sectors of a file, counted as a single disk read
+//! @param *fp is a pointer to the file object
+//! @param sector is the first sector
+//! @param *dst is a pointer to the destination
+//! @param count is the number of sectors
+//! @return the number of bytes read
+static UINT ff_host_disk_read(FIL* fp, DWORD sector, BYTE* dst, UINT count);
+
+
+void ff_host_stats_clear()
+{
+    memset(&ff_host_stats, 0, sizeof(ff_host_stats));
+}
+
+void ff_host_stats_get(ff_host_stats_Struct* p_stats)
+{
+    *p_stats = ff_host_stats;
+}
+
+static UINT ff_host_disk_read(FIL* fp, DWORD sector, BYTE* dst, UINT count)
+{
+    FILE* file = ff_host_files[fp->obj.id - 1];
+
+    ff_host_stats.disk_reads++;
+    fseek(file, (long)sector * FF_HOST_SECTOR_SIZE, SEEK_SET);
+    return (UINT)fread(dst, 1, count * FF_HOST_SECTOR_SIZE, file);
+}
+
+FRESULT f_open(FIL* fp, const TCHAR* path, BYTE mode)
+{
+    ff_host_stats.calls++;
+    memset(fp, 0, sizeof(*fp));
+
+    if ((mode & ~FA_OPEN_EXISTING) != FA_READ)
+    {
+        return FR_DENIED;
+    }
+
+    for (WORD i = 0; i < FF_HOST_FILES; i++)
+    {
+        if (ff_host_files[i] == NULL)
+        {
+            ff_host_files[i] = fopen(path, "rb");
+            if (ff_host_files[i] == NULL)
+            {
+                return FR_NO_FILE;
+            }
+
+            fseek(ff_host_files[i], 0, SEEK_END);
+            fp->obj.objsize = (FSIZE_t)ftell(ff_host_files[i]);
+            fp->obj.id = i + 1;
+            fp->flag = mode;
+            return FR_OK;
+        }
+    }
+    return FR_TOO_MANY_OPEN_FILES;
+}
+
+FRESULT f_close(FIL* fp)
+{
+    if (fp->obj.id == 0 || ff_host_files[fp->obj.id - 1] == NULL)
+    {
+        return FR_INVALID_OBJECT;
+    }
+
+    fclose(ff_host_files[fp->obj.id - 1]);
+    ff_host_files[fp->obj.id - 1] = NULL;
+    fp->obj.id = 0;
+    return FR_OK;
+}
+
+FRESULT f_read(FIL* fp, void* buff, UINT btr, UINT* br)
+{
+    BYTE* dst = (BYTE*)buff;
+
+    ff_host_stats.calls++;
+    *br = 0;
+
+    if (fp->obj.id == 0)
+    {
+        return FR_INVALID_OBJECT;
+    }
+
+    if (btr > fp->obj.objsize - fp->fptr)
+    {
+        btr = (UINT)(fp->obj.objsize - fp->fptr);
+    }
+
+    while (btr > 0)
+    {
+        DWORD sector = (DWORD)(fp->fptr / FF_HOST_SECTOR_SIZE);
+        UINT offset = (UINT)(fp->fptr % FF_HOST_SECTOR_SIZE);
+        UINT chunk;
+
+        if (offset == 0 && btr >= FF_HOST_SECTOR_SIZE)
+        {
+            // Whole sectors bypass the window up to the end of the cluster
+            UINT count = btr / FF_HOST_SECTOR_SIZE;
+            UINT left = FF_HOST_CLUSTER_SECTORS - sector % FF_HOST_CLUSTER_SECTORS;
+            if (count > left)
+            {
+                count = left;
+            }
+            chunk = count * FF_HOST_SECTOR_SIZE;
+            if (ff_host_disk_read(fp, sector, dst, count) != chunk)
+            {
+                return FR_DISK_ERR;
+            }
+        }
+        else
+        {
+            // The window holds sector + 1 so that 0 means it is empty
+            if (fp->sect != sector + 1)
+            {
+                ff_host_disk_read(fp, sector, fp->buf, 1);
+                fp->sect = sector + 1;
+            }
+            chunk = FF_HOST_SECTOR_SIZE - offset;
+            if (chunk > btr)
+            {
+                chunk = btr;
+            }
+            memcpy(dst, fp->buf + offset, chunk);
+        }
+
+        dst += chunk;
+        fp->fptr += chunk;
+        *br += chunk;
+        btr -= chunk;
+    }
+    return FR_OK;
+}
+
+FRESULT f_lseek(FIL* fp, FSIZE_t ofs)
+{
+    ff_host_stats.calls++;
+
+    if (fp->obj.id == 0)
+    {
+        return FR_INVALID_OBJECT;
+    }
+
+    fp->fptr = (ofs > fp->obj.objsize) ? fp->obj.objsize : ofs;
+    return FR_OK;
+}
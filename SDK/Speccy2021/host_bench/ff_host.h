@@ -0,0 +1,26 @@
+//! @file ff_host.h
+//! @brief The FatFs read calls served from host files, counting the calls and the disk reads
+
+#ifndef FF_HOST_H
+#define FF_HOST_H
+
+#include <stdint.h>
+#include "ff.h"
+
+#define FF_HOST_SECTOR_SIZE (512U)
+#define FF_HOST_CLUSTER_SECTORS (64U)
+
+typedef struct
+{
+    uint32_t calls;
+    uint32_t disk_reads;
+} ff_host_stats_Struct;
+
+//! @brief Reset the counters
+void ff_host_stats_clear(void);
+
+//! @brief Get the counters
+//! @param *p_stats is a pointer to the destination
+void ff_host_stats_get(ff_host_stats_Struct* p_stats);
+
+#endif
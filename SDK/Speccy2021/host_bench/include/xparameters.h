@@ -0,0 +1,7 @@
+//! @file xparameters.h
+//! @brief Host stand-in for the BSP parameters, ffconf.h keeps its defaults
+
+#ifndef XPARAMETERS_H
+#define XPARAMETERS_H
+
+#endif
@@ -0,0 +1,320 @@
+/*
+ Directory listing sort benchmark
+ ================================
+
+ Fills the listing with a made up folder of 60000 entries, sorts it in
+ every order the shell offers and checks the outcome: the entry in front
+ of the sorted range stays in place, no entry is lost or duplicated and
+ every pair of neighbours is in order, judged by a plain comparison of
+ the names, sizes and time stamps rather than by the keys the sort uses.
+ The time taken by each sort is printed next to qsort on the same entries.
+
+ Then the type-ahead search is timed on the same folder keystroke by
+ keystroke: the pattern is extended a character at a time, shortened
+ with backspace and cleared. After every keystroke the entries shown are
+ checked against a case folded strstr over the whole listing.
+
+ The listing lives at a fixed address in DDR on the board, so the same
+ range is mapped here before the listing is touched.
+
+     make -C SDK/Speccy2021/host_bench run
+
+ Designed in Magictale Electronics.
+
+ Copyright (c) 2021 Dmitry Pakhomenko.
+ dmitryp@magictale.com
+ http://magictale.com
+
+ This code is in the public domain.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "zx_dir_list.h"
+
+#define BENCH_ENTRIES (60000U)
+#define BENCH_FOLDERS (600U)
+#define BENCH_SEED (0x2021U)
+#define BENCH_NAME_SIZE (64)
+
+static const char* const bench_order_names[ZX_DIR_LIST_ORDER_LAST_ENTRY] = {"name", "extension", "size", "date"};
+static uint32_t bench_random_state = BENCH_SEED;
+static uint8_t bench_qsort_order;
+static zx_dir_list_entry_Struct bench_copy[BENCH_ENTRIES + 1];
+static uint8_t bench_seen[BENCH_ENTRIES];
+
+//! @brief The patterns typed into the search one keystroke after another
+static const char* const bench_keystrokes[] =
+{
+    "j", "je", "jet", "jet_", "jet_1", "jet_", "jet", "je", "j", "",
+    "t", "tz", "tzx", "tz", "",
+    "9", "99", "999", "",
+};
+
+//! @brief Get the next pseudo random number, the sequence is the same on every run
+//! @return the number
+static uint32_t bench_random(void);
+
+//! @brief Fill the listing with a parent folder entry followed by the made up folder
+static void bench_fill(void);
+
+//! @brief Compare two entries the way the shell lists them, without the keys
+//! @param *a is a pointer to the first entry
+//! @param *b is a pointer to the second entry
+//! @param order is zx_dir_list_order_Enum
+//! @return a negative value if a goes before b, a positive value if a goes after b or 0 otherwise
+static int bench_compare(const zx_dir_list_entry_Struct* a, const zx_dir_list_entry_Struct* b, uint8_t order);
+
+//! @brief bench_compare in the form qsort takes
+static int bench_qsort_compare(const void* a, const void* b);
+
+//! @brief Check the listing after it has been sorted
+//! @param order is zx_dir_list_order_Enum
+//! @return true if the listing is in order or false otherwise
+static bool bench_check(uint8_t order);
+
+//! @brief Fold a string to lower case
+//! @param *dst is a pointer to the room for the folded string
+//! @param *src is a pointer to the null terminated string
+static void bench_fold(char* dst, const char* src);
+
+//! @brief Check the entries shown through the filter against strstr on every entry
+//! @param *pattern is a pointer to the pattern
+//! @return true if exactly the matching entries are shown, in the order of the listing
+static bool bench_filter_check(const char* pattern);
+
+//! @brief Time the type-ahead search keystroke by keystroke
+//! @return true if every keystroke has shown the right entries
+static bool bench_filter(void);
+
+//! @brief Get the time since an earlier moment
+//! @param *start is a pointer to the earlier moment
+//! @return the time in milliseconds
+static double bench_ms_since(const struct timespec* start);
+
+
+int main()
+{
+    bool passed = true;
+
+    void* area = mmap((void*)EMULATOR_DIR_LIST_AREA_START, EMULATOR_DIR_LIST_AREA_SIZE, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (area != (void*)EMULATOR_DIR_LIST_AREA_START)
+    {
+        fprintf(stderr, "Can not map the listing area at 0x%08X\n", (unsigned)EMULATOR_DIR_LIST_AREA_START);
+        return 1;
+    }
+
+    printf("%-10s %8s %14s %10s %8s\n", "order", "entries", "zx_dir_list ms", "qsort ms", "check");
+    for (uint8_t order = 0; order < ZX_DIR_LIST_ORDER_LAST_ENTRY; order++)
+    {
+        struct timespec start;
+
+        bench_fill();
+        uint32_t count = zx_dir_list_count();
+        for (uint32_t i = 0; i < count; i++)
+        {
+            bench_copy[i] = *zx_dir_list_entry(i);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        zx_dir_list_sort(1, order);
+        double sort_ms = bench_ms_since(&start);
+
+        bench_qsort_order = order;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        qsort(bench_copy + 1, count - 1, sizeof(bench_copy[0]), bench_qsort_compare);
+        double qsort_ms = bench_ms_since(&start);
+
+        bool ok = bench_check(order);
+        passed = passed && ok;
+        printf("%-10s %8u %14.2f %10.2f %8s\n", bench_order_names[order], count, sort_ms, qsort_ms, ok ? "ok" : "FAILED");
+    }
+
+    passed = bench_filter() && passed;
+
+    munmap(area, EMULATOR_DIR_LIST_AREA_SIZE);
+    return passed ? 0 : 1;
+}
+
+static uint32_t bench_random()
+{
+    bench_random_state ^= bench_random_state << 13;
+    bench_random_state ^= bench_random_state >> 17;
+    bench_random_state ^= bench_random_state << 5;
+    return bench_random_state;
+}
+
+static void bench_fill()
+{
+    static const char* const exts[] = {".tap", ".TZX", ".z80", ".sna", ".trd", ".SCR", ".szx", ".pzx", ".csw", ""};
+    static const char* const prefixes[] = {"", "the ", "Jet", "jet", "Manic", "0", "_"};
+    char name[BENCH_NAME_SIZE];
+
+    bench_random_state = BENCH_SEED;
+    zx_dir_list_clear();
+    zx_dir_list_add("..", AM_DIR, 0, 0, 0);
+
+    for (uint32_t i = 0; i < BENCH_ENTRIES; i++)
+    {
+        bool folder = (i % (BENCH_ENTRIES / BENCH_FOLDERS)) == 0;
+        uint32_t length = 1 + bench_random() % 20;
+        uint32_t pos = snprintf(name, sizeof(name), "%s", prefixes[bench_random() % (sizeof(prefixes) / sizeof(prefixes[0]))]);
+
+        // Shared prefixes make plenty of equal keys which are settled by the names
+        for (uint32_t j = 0; j < length; j++)
+        {
+            uint32_t r = bench_random() % 40;
+            name[pos++] = r < 13 ? 'a' + r : r < 26 ? 'A' + r - 13 : r < 36 ? '0' + r - 26 : (uint32_t)" -_."[r - 36];
+        }
+        snprintf(name + pos, sizeof(name) - pos, "_%u%s", i, folder ? "" : exts[bench_random() % (sizeof(exts) / sizeof(exts[0]))]);
+
+        uint32_t size = folder ? 0 : (bench_random() % 4 == 0 ? 6912 : bench_random() % 0x100000);
+        uint16_t date = folder ? 0 : (uint16_t)(((1990 - 1980 + bench_random() % 40) << 9) | ((1 + bench_random() % 12) << 5) | (1 + bench_random() % 28));
+        uint16_t time = folder ? 0 : (uint16_t)(bench_random() % 0xBF7D);
+
+        zx_dir_list_add(name, folder ? AM_DIR : AM_ARC, size, date, time);
+    }
+}
+
+static int bench_compare(const zx_dir_list_entry_Struct* a, const zx_dir_list_entry_Struct* b, uint8_t order)
+{
+    const char* name_a = zx_dir_list_name(a);
+    const char* name_b = zx_dir_list_name(b);
+    int result = 0;
+
+    if ((a->attr ^ b->attr) & AM_DIR)
+    {
+        return (a->attr & AM_DIR) ? -1 : 1;
+    }
+
+    switch (order)
+    {
+        case ZX_DIR_LIST_ORDER_EXT:
+            result = strcasecmp(zx_dir_list_name_ext(name_a), zx_dir_list_name_ext(name_b));
+            break;
+
+        case ZX_DIR_LIST_ORDER_SIZE:
+            result = (a->size > b->size) - (a->size < b->size);
+            break;
+
+        case ZX_DIR_LIST_ORDER_DATE:
+        {
+            // Newest first
+            uint32_t stamp_a = ((uint32_t)a->date << 16) | a->time;
+            uint32_t stamp_b = ((uint32_t)b->date << 16) | b->time;
+            result = (stamp_a < stamp_b) - (stamp_a > stamp_b);
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    return result != 0 ? result : strcasecmp(name_a, name_b);
+}
+
+static int bench_qsort_compare(const void* a, const void* b)
+{
+    return bench_compare((const zx_dir_list_entry_Struct*)a, (const zx_dir_list_entry_Struct*)b, bench_qsort_order);
+}
+
+static bool bench_check(uint8_t order)
+{
+    uint32_t count = zx_dir_list_count();
+
+    if (count != BENCH_ENTRIES + 1 || strcmp(zx_dir_list_name(zx_dir_list_entry(0)), "..") != 0)
+    {
+        return false;
+    }
+
+    // Every made up name ends with its number, each one has to be seen exactly once
+    memset(bench_seen, 0, sizeof(bench_seen));
+    for (uint32_t i = 1; i < count; i++)
+    {
+        const zx_dir_list_entry_Struct* p_entry = zx_dir_list_entry(i);
+        const char* number = strrchr(zx_dir_list_name(p_entry), '_');
+        uint32_t idx = (number != NULL) ? strtoul(number + 1, NULL, 10) : BENCH_ENTRIES;
+
+        if (idx >= BENCH_ENTRIES || bench_seen[idx]++ != 0)
+        {
+            return false;
+        }
+        if (i > 1 && bench_compare(zx_dir_list_entry(i - 1), p_entry, order) > 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static double bench_ms_since(const struct timespec* start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static void bench_fold(char* dst, const char* src)
+{
+    while (*src != 0)
+    {
+        char c = *src++;
+        *dst++ = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    }
+    *dst = 0;
+}
+
+static bool bench_filter_check(const char* pattern)
+{
+    char folded_pattern[BENCH_NAME_SIZE];
+    char folded_name[BENCH_NAME_SIZE];
+    uint32_t shown = 0;
+
+    bench_fold(folded_pattern, pattern);
+    for (uint32_t i = 0; i < zx_dir_list_count(); i++)
+    {
+        zx_dir_list_entry_Struct* p_entry = zx_dir_list_entry(i);
+
+        bench_fold(folded_name, zx_dir_list_name(p_entry));
+        if (strstr(folded_name, folded_pattern) != NULL)
+        {
+            if (zx_dir_list_view_entry(shown++) != p_entry)
+            {
+                return false;
+            }
+        }
+    }
+    return shown == zx_dir_list_view_count();
+}
+
+static bool bench_filter()
+{
+    bool passed = true;
+    const char* previous = "";
+
+    bench_fill();
+    zx_dir_list_sort(1, ZX_DIR_LIST_ORDER_NAME);
+    zx_dir_list_filter("");
+
+    printf("\n%-10s %-10s %8s %10s %8s\n", "pattern", "keystroke", "shown", "filter ms", "check");
+    for (size_t i = 0; i < sizeof(bench_keystrokes) / sizeof(bench_keystrokes[0]); i++)
+    {
+        const char* pattern = bench_keystrokes[i];
+        const char* keystroke = pattern[0] == 0 ? "clear" : strlen(pattern) > strlen(previous) ? "extend" : "backspace";
+        struct timespec start;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        zx_dir_list_filter(pattern);
+        double filter_ms = bench_ms_since(&start);
+
+        bool ok = bench_filter_check(pattern);
+        passed = passed && ok;
+        printf("%-10s %-10s %8u %10.3f %8s\n", pattern[0] == 0 ? "\"\"" : pattern, keystroke, zx_dir_list_view_count(), filter_ms, ok ? "ok" : "FAILED");
+        previous = pattern;
+    }
+    return passed;
+}
@@ -0,0 +1,461 @@
+/*
+ Tape reader benchmark
+ =====================
+
+ Walks tape files the way the tape task reads them and compares the two
+ readers it has had: the original one, which issued an f_read for every
+ data byte, and zx_file_stream, which reads whole halves of its buffer.
+ The FatFs calls are served from host files by ff_host.c, so the speed
+ shown is the host one. On the board every call goes through FatFs and
+ the SD card driver, which is why the calls and the disk reads per tape
+ block are the figures to compare.
+
+ With no arguments a TAP and a TZX file are made up in the current folder
+ and measured, otherwise the files given are measured:
+
+     make -C SDK/Speccy2021/host_bench run
+     SDK/Speccy2021/host_bench/zx_file_stream_bench game.tap game.tzx
+
+ Designed in Magictale Electronics.
+
+ Copyright (c) 2021 Dmitry Pakhomenko.
+ dmitryp@magictale.com
+ http://magictale.com
+
+ This code is in the public domain.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ff_host.h"
+#include "zx_file_stream.h"
+
+#define BENCH_SAMPLE_TAP "bench_sample.tap"
+#define BENCH_SAMPLE_TZX "bench_sample.tzx"
+#define BENCH_MIN_SECONDS (0.5)
+#define BENCH_LOOPS_SIZE (8)
+
+//! @brief One of the readers being compared
+typedef struct
+{
+    const char* name;
+    bool (*open)(const char* path);
+    uint32_t (*read)(uint8_t* dst, uint32_t cnt);
+    void (*seek)(uint32_t pos);
+    uint32_t (*tell)(void);
+    uint32_t (*size)(void);
+    void (*close)(void);
+} bench_reader_Struct;
+
+//! @brief The outcome of a walk through a tape
+typedef struct
+{
+    uint32_t blocks;
+    uint32_t bytes;
+} bench_walk_Struct;
+
+static FIL bench_file;
+static zx_file_stream_Struct bench_stream;
+
+//! @brief Write a sample file
+//! @param *path is the name of the file
+//! @param *data is a pointer to the content
+//! @param size is the size of the content
+//! @return true if the file has been written
+static bool bench_sample_write(const char* path, const uint8_t* data, uint32_t size);
+
+//! @brief Append a standard speed data block to a sample image
+//! @param *dst is a pointer to the end of the image
+//! @param tzx is true if the block is a TZX one
+//! @param length is the length of the block data
+//! @return the number of bytes appended
+static uint32_t bench_sample_block(uint8_t* dst, bool tzx, uint32_t length);
+
+//! @brief Make up the sample TAP and TZX files
+//! @return true if both files have been written
+static bool bench_samples_make(void);
+
+//! @brief Get the size of the fixed part of a block
+//! @param tzx is true for a TZX file or false for a TAP one
+//! @param id is the id byte of the block
+//! @return the size including the id byte or 0 if the block is not known
+static uint8_t bench_header_size(bool tzx, uint8_t id);
+
+//! @brief Get the size of the data which follows the fixed part of a block
+//! @param tzx is true for a TZX file or false for a TAP one
+//! @param *header is a pointer to the fixed part
+//! @return the size of the data
+static uint32_t bench_data_size(bool tzx, const uint8_t* header);
+
+//! @brief Play a tape through a reader the way the tape task does
+//! @param *reader is a pointer to the reader
+//! @param *path is the name of the tape
+//! @param *walk is a pointer to the outcome
+//! @return true if the tape has been opened
+static bool bench_walk(const bench_reader_Struct* reader, const char* path, bench_walk_Struct* walk);
+
+//! @brief Measure a reader on a tape and print the figures
+//! @param *reader is a pointer to the reader
+//! @param *path is the name of the tape
+static void bench_run(const bench_reader_Struct* reader, const char* path);
+
+
+static bool bench_fatfs_open(const char* path)
+{
+    return f_open(&bench_file, path, FA_READ) == FR_OK;
+}
+
+static uint32_t bench_fatfs_read(uint8_t* dst, uint32_t cnt)
+{
+    UINT res = 0;
+    f_read(&bench_file, dst, cnt, &res);
+    return res;
+}
+
+static void bench_fatfs_seek(uint32_t pos)
+{
+    f_lseek(&bench_file, pos);
+}
+
+static uint32_t bench_fatfs_tell()
+{
+    return (uint32_t)bench_file.fptr;
+}
+
+static uint32_t bench_fatfs_size()
+{
+    return (uint32_t)f_size(&bench_file);
+}
+
+static void bench_fatfs_close()
+{
+    f_close(&bench_file);
+}
+
+static bool bench_stream_open(const char* path)
+{
+    if (f_open(&bench_file, path, FA_READ) != FR_OK)
+    {
+        return false;
+    }
+    zx_file_stream_init(&bench_stream, &bench_file);
+    return true;
+}
+
+static uint32_t bench_stream_read(uint8_t* dst, uint32_t cnt)
+{
+    // Data bytes are taken one at a time as zx_tape_fill_buffer does
+    if (cnt == 1)
+    {
+        return zx_file_stream_read_byte(&bench_stream, dst) ? 1 : 0;
+    }
+    return zx_file_stream_read(&bench_stream, dst, cnt);
+}
+
+static void bench_stream_seek(uint32_t pos)
+{
+    zx_file_stream_seek(&bench_stream, pos);
+}
+
+static uint32_t bench_stream_tell()
+{
+    return zx_file_stream_tell(&bench_stream);
+}
+
+static uint32_t bench_stream_size()
+{
+    return zx_file_stream_size_get(&bench_stream);
+}
+
+static void bench_stream_close()
+{
+    f_close(&bench_file);
+}
+
+static const bench_reader_Struct bench_readers[] =
+{
+    {"f_read per byte", bench_fatfs_open, bench_fatfs_read, bench_fatfs_seek, bench_fatfs_tell, bench_fatfs_size, bench_fatfs_close},
+    {"zx_file_stream", bench_stream_open, bench_stream_read, bench_stream_seek, bench_stream_tell, bench_stream_size, bench_stream_close},
+};
+
+int main(int argc, char** argv)
+{
+    static const char* const samples[] = {BENCH_SAMPLE_TAP, BENCH_SAMPLE_TZX};
+    const char* const* paths = (const char* const*)(argv + 1);
+    int count = argc - 1;
+
+    if (count == 0)
+    {
+        if (!bench_samples_make())
+        {
+            fprintf(stderr, "Can not write the sample files\n");
+            return 1;
+        }
+        paths = samples;
+        count = 2;
+    }
+
+    printf("%-24s %-16s %8s %12s %12s %12s\n", "tape", "reader", "blocks", "bytes/s", "calls/block", "disk/block");
+    for (int i = 0; i < count; i++)
+    {
+        for (size_t r = 0; r < sizeof(bench_readers) / sizeof(bench_readers[0]); r++)
+        {
+            bench_run(&bench_readers[r], paths[i]);
+        }
+    }
+    return 0;
+}
+
+static bool bench_sample_write(const char* path, const uint8_t* data, uint32_t size)
+{
+    FILE* file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    bool res = fwrite(data, 1, size, file) == size;
+    return (fclose(file) == 0) && res;
+}
+
+static uint32_t bench_sample_block(uint8_t* dst, bool tzx, uint32_t length)
+{
+    uint32_t pos = 0;
+
+    if (tzx)
+    {
+        dst[pos++] = 0x10;
+        dst[pos++] = 0xE8;
+        dst[pos++] = 0x03;
+    }
+    dst[pos++] = length & 0xFF;
+    dst[pos++] = length >> 8;
+
+    for (uint32_t i = 0; i < length; i++)
+    {
+        dst[pos++] = (uint8_t)(i * 7 + (i >> 8));
+    }
+    return pos;
+}
+
+static bool bench_samples_make()
+{
+    // A loader, a screen and a 48K program, as most tapes are
+    static const uint32_t lengths[] = {19, 0x200, 19, 6914, 19, 40002};
+    static uint8_t image[0x20000];
+    uint32_t size = 0;
+
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+    {
+        size += bench_sample_block(image + size, false, lengths[i]);
+    }
+    if (!bench_sample_write(BENCH_SAMPLE_TAP, image, size))
+    {
+        return false;
+    }
+
+    // The same blocks with a description, a pause and a looped pure tone
+    // which makes the reader jump back three times
+    static const uint8_t head[] = {'Z', 'X', 'T', 'a', 'p', 'e', '!', 0x1A, 1, 20};
+    static const uint8_t text[] = {0x30, 6, 'S', 'a', 'm', 'p', 'l', 'e'};
+    static const uint8_t loop[] = {0x24, 3, 0, 0x12, 0x78, 0x08, 0x00, 0x01, 0x25};
+    static const uint8_t pause[] = {0x20, 0xE8, 0x03};
+
+    size = 0;
+    memcpy(image + size, head, sizeof(head));
+    size += sizeof(head);
+    memcpy(image + size, text, sizeof(text));
+    size += sizeof(text);
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+    {
+        size += bench_sample_block(image + size, true, lengths[i]);
+        if (i == 1)
+        {
+            memcpy(image + size, loop, sizeof(loop));
+            size += sizeof(loop);
+        }
+    }
+    memcpy(image + size, pause, sizeof(pause));
+    size += sizeof(pause);
+    return bench_sample_write(BENCH_SAMPLE_TZX, image, size);
+}
+
+static uint8_t bench_header_size(bool tzx, uint8_t id)
+{
+    if (!tzx) return 2;
+
+    switch (id)
+    {
+        case 0x10: return 0x05;
+        case 0x11: return 0x13;
+        case 0x12: return 0x05;
+        case 0x13: return 0x02;
+        case 0x14: return 0x0B;
+        case 0x15: return 0x09;
+        case 0x18: return 0x05;
+        case 0x19: return 0x05;
+        case 0x20: return 0x03;
+        case 0x21: return 0x02;
+        case 0x22: return 0x01;
+        case 0x23: return 0x03;
+        case 0x24: return 0x03;
+        case 0x25: return 0x01;
+        case 0x26: return 0x03;
+        case 0x27: return 0x01;
+        case 0x28: return 0x03;
+        case 0x2A: return 0x05;
+        case 0x2B: return 0x06;
+        case 0x30: return 0x02;
+        case 0x31: return 0x03;
+        case 0x32: return 0x03;
+        case 0x33: return 0x02;
+        case 0x35: return 0x15;
+        case 0x5A: return 0x0A;
+        default: return 0;
+    }
+}
+
+static uint32_t bench_data_size(bool tzx, const uint8_t* header)
+{
+    if (!tzx) return header[0] | (header[1] << 8);
+
+    switch (header[0])
+    {
+        case 0x10: return header[3] | (header[4] << 8);
+        case 0x11: return header[0x10] | (header[0x11] << 8) | (header[0x12] << 16);
+        case 0x13: return header[1] * 2;
+        case 0x14: return header[8] | (header[9] << 8) | (header[10] << 16);
+        case 0x15: return header[6] | (header[7] << 8) | (header[8] << 16);
+        case 0x18:
+        case 0x19:
+        case 0x2A:
+        case 0x2B: return (header[1] | (header[2] << 8) | (header[3] << 16) | ((uint32_t)header[4] << 24)) - (header[0] == 0x2B ? 1 : 0);
+        case 0x21:
+        case 0x30: return header[1];
+        case 0x26: return (header[1] | (header[2] << 8)) * 2;
+        case 0x28:
+        case 0x32: return header[1] | (header[2] << 8);
+        case 0x31: return header[2];
+        case 0x33: return header[1] * 3;
+        case 0x35: return header[0x11] | (header[0x12] << 8) | (header[0x13] << 16) | ((uint32_t)header[0x14] << 24);
+        default: return 0;
+    }
+}
+
+static bool bench_walk(const bench_reader_Struct* reader, const char* path, bench_walk_Struct* walk)
+{
+    uint8_t header[0x20];
+    uint32_t loops_pos[BENCH_LOOPS_SIZE];
+    uint16_t loops_counter[BENCH_LOOPS_SIZE];
+    int loops_size = 0;
+    bool tzx = false;
+
+    walk->blocks = 0;
+    walk->bytes = 0;
+
+    if (!reader->open(path))
+    {
+        return false;
+    }
+
+    if (reader->size() >= 10)
+    {
+        if (reader->read(header, 10) == 10 && memcmp(header, "ZXTape!", 7) == 0) tzx = true;
+        else reader->seek(0);
+    }
+
+    while (reader->tell() < reader->size())
+    {
+        // The id byte first and then the rest of the fixed part, as the tape task does
+        if (reader->read(header, 1) != 1)
+        {
+            break;
+        }
+
+        uint8_t hs = bench_header_size(tzx, header[0]);
+        if (hs == 0 || (hs > 1 && reader->read(header + 1, hs - 1) != hs - 1u))
+        {
+            break;
+        }
+        walk->blocks++;
+        walk->bytes += hs;
+
+        uint32_t data_size = bench_data_size(tzx, header);
+        bool played = !tzx || header[0] <= 0x15 || header[0] == 0x20;
+
+        if (played)
+        {
+            for (uint32_t i = 0; i < data_size; i++)
+            {
+                uint8_t data;
+                if (reader->read(&data, 1) != 1)
+                {
+                    break;
+                }
+                walk->bytes++;
+            }
+        }
+        else if (header[0] == 0x24)
+        {
+            if (loops_size < BENCH_LOOPS_SIZE)
+            {
+                loops_pos[loops_size] = reader->tell();
+                loops_counter[loops_size] = header[1] | (header[2] << 8);
+                loops_size++;
+            }
+        }
+        else if (header[0] == 0x25)
+        {
+            if (loops_size > 0)
+            {
+                if (loops_counter[loops_size - 1] > 0) loops_counter[loops_size - 1]--;
+
+                if (loops_counter[loops_size - 1] > 0) reader->seek(loops_pos[loops_size - 1]);
+                else loops_size--;
+            }
+        }
+        else
+        {
+            reader->seek(reader->tell() + data_size);
+        }
+    }
+
+    reader->close();
+    return true;
+}
+
+static void bench_run(const bench_reader_Struct* reader, const char* path)
+{
+    struct timespec start;
+    struct timespec now;
+    bench_walk_Struct walk;
+    ff_host_stats_Struct stats;
+    uint64_t bytes = 0;
+    uint32_t passes = 0;
+    double elapsed;
+
+    // The counters of a single pass, the timing of as many as fit in BENCH_MIN_SECONDS
+    ff_host_stats_clear();
+    if (!bench_walk(reader, path, &walk))
+    {
+        printf("%-24s %-16s can not be opened\n", path, reader->name);
+        return;
+    }
+    ff_host_stats_get(&stats);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do
+    {
+        bench_walk(reader, path, &walk);
+        bytes += walk.bytes;
+        passes++;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+    } while (elapsed < BENCH_MIN_SECONDS);
+
+    uint32_t blocks = walk.blocks ? walk.blocks : 1;
+    printf("%-24s %-16s %8u %12.0f %12.1f %12.1f\n", path, reader->name, walk.blocks,
+        bytes / elapsed, (double)stats.calls / blocks, (double)stats.disk_reads / blocks);
+}
@@ -81,6 +81,7 @@ add_files -norecurse $origin_dir/sources/speccy2021_top.vhd
 add_files -norecurse $origin_dir/sources/zx_addr_data_bus/zx_addr_data_bus_top.vhd
 add_files -norecurse $origin_dir/sources/zx_addr_data_bus/zx_addr_data_bus.vhd
 add_files -norecurse $origin_dir/sources/zx_main/zx_main_top.vhd
+add_files -norecurse $origin_dir/sources/zx_main/zx_tape_in.vhd
 add_files -norecurse $origin_dir/sources/z80/T80.vhd
 add_files -norecurse $origin_dir/sources/z80/T80_ALU.vhd
 add_files -norecurse $origin_dir/sources/z80/T80_MCode.vhd
@@ -100,6 +101,7 @@ set_property file_type {VHDL 2008} [get_files $origin_dir/sources/zx_video/zx_ct
 set_property file_type {VHDL 2008} [get_files $origin_dir/sources/zx_addr_data_bus/zx_addr_data_bus_top.vhd]
 set_property file_type {VHDL 2008} [get_files $origin_dir/sources/zx_addr_data_bus/zx_addr_data_bus.vhd]
 set_property file_type {VHDL 2008} [get_files $origin_dir/sources/zx_main/zx_main_top.vhd]
+set_property file_type {VHDL 2008} [get_files $origin_dir/sources/zx_main/zx_tape_in.vhd]
 set_property file_type {VHDL 2008} [get_files $origin_dir/sources/z80/T80.vhd]
 set_property file_type {VHDL 2008} [get_files $origin_dir/sources/z80/T80_ALU.vhd]
 set_property file_type {VHDL 2008} [get_files $origin_dir/sources/z80/T80_MCode.vhd]
@@ -142,11 +144,12 @@ if {[string equal [get_filesets -quiet sim_1] ""]} {
 
 # Set 'sim_1' fileset object
 set obj [get_filesets sim_1]
-# Empty (no sources present)
+add_files -fileset sim_1 -norecurse $origin_dir/sim/tb_zx_tape_fifo.vhd
+set_property file_type {VHDL 2008} [get_files $origin_dir/sim/tb_zx_tape_fifo.vhd]
 
 # Set 'sim_1' fileset properties
 set obj [get_filesets sim_1]
-set_property "top" "test_pattern_top" $obj
+set_property "top" "tb_zx_tape_fifo" $obj
 
 # Create 'synth_1' run (if not found)
 if {[string equal [get_runs -quiet synth_1] ""]} {
@@ -0,0 +1,78 @@
+----------------------------------------------------------------------------------
+-- Design Name: ZX Spectrum Board
+-- Module Name: fifo_1024_16 - behavioral
+-- Project Name: ZX Spectrum retro computer emulator on Arty Z7 board
+-- Description: Behavioural model of the fifo_1024_16 IP core for simulators
+--   which can not compile Xilinx IP. Common clock, standard (non FWFT) read
+--   mode: dout is valid one clock after rd_en, overflow and underflow flag a
+--   rejected write or read one clock later. Vivado simulations use the IP.
+----------------------------------------------------------------------------------
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+entity fifo_1024_16 is
+    port (
+      clk : in std_logic;
+      rst : in std_logic;
+      din : in std_logic_vector(15 downto 0);
+      wr_en : in std_logic;
+      rd_en : in std_logic;
+      dout : out std_logic_vector(15 downto 0);
+      full : out std_logic;
+      overflow : out std_logic;
+      empty : out std_logic;
+      underflow : out std_logic
+    );
+end fifo_1024_16;
+
+architecture behavioral of fifo_1024_16 is
+
+  constant c_depth : integer := 1024;
+
+  type t_mem is array (0 to c_depth - 1) of std_logic_vector(15 downto 0);
+  signal s_mem : t_mem;
+  signal s_wr_ptr : unsigned(9 downto 0) := (others => '0');
+  signal s_rd_ptr : unsigned(9 downto 0) := (others => '0');
+  signal s_count : integer range 0 to c_depth := 0;
+  signal s_empty : std_logic;
+  signal s_full : std_logic;
+
+begin
+
+  s_empty <= '1' when s_count = 0 else '0';
+  s_full <= '1' when s_count = c_depth else '0';
+
+  p_fifo : process(clk, rst)
+    variable v_count : integer range 0 to c_depth;
+  begin
+    if rst = '1' then
+      s_wr_ptr <= (others => '0');
+      s_rd_ptr <= (others => '0');
+      s_count <= 0;
+      dout <= (others => '0');
+      overflow <= '0';
+      underflow <= '0';
+    elsif rising_edge(clk) then
+      v_count := s_count;
+      overflow <= wr_en and s_full;
+      underflow <= rd_en and s_empty;
+      if wr_en = '1' and s_full = '0' then
+        s_mem(to_integer(s_wr_ptr)) <= din;
+        s_wr_ptr <= s_wr_ptr + 1;
+        v_count := v_count + 1;
+      end if;
+      if rd_en = '1' and s_empty = '0' then
+        dout <= s_mem(to_integer(s_rd_ptr));
+        s_rd_ptr <= s_rd_ptr + 1;
+        v_count := v_count - 1;
+      end if;
+      s_count <= v_count;
+    end if;
+  end process;
+
+  empty <= s_empty;
+  full <= s_full;
+
+end behavioral;
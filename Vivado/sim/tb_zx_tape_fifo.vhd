@@ -0,0 +1,566 @@
+----------------------------------------------------------------------------------
+-- Design Name: ZX Spectrum Board
+-- Module Name: tb_zx_tape_fifo - sim
+-- Project Name: ZX Spectrum retro computer emulator on Arty Z7 board
+-- Description: Testbench of the tape signal generator (zx_tape_in).
+--
+--   The same tape is fed to two generators, once as one FIFO word per pulse
+--   and once as repeat and byte packets, and the tape signals of both have to
+--   match on every clock. The tape has repeat packets longer than the FIFO,
+--   byte packets with 1...8 bits (0 and values above 8 mean 8), back-to-back
+--   packets and an underrun in the middle. A third generator checks the FIFO
+--   level against almost-full, full, overflow, the low-water interrupt and
+--   the underflow counter.
+--
+--   Runs with GHDL and the behavioural model of fifo_1024_16:
+--     ghdl -a --std=08 ../sources/zx_main/zx_tape_in.vhd fifo_1024_16_model.vhd tb_zx_tape_fifo.vhd
+--     ghdl -e --std=08 tb_zx_tape_fifo
+--     ghdl -r --std=08 tb_zx_tape_fifo --assert-level=error
+----------------------------------------------------------------------------------
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+entity tb_zx_tape_fifo is
+end tb_zx_tape_fifo;
+
+architecture sim of tb_zx_tape_fifo is
+
+  constant c_clk_period : time := 7 ns;         -- 142.857 MHz as i_aclk
+  constant c_strobe_div : integer := 40;        -- 3.5 MHz strobe as in zx_main_top
+  constant c_starving_ticks : integer := 32767; -- pause taken once the FIFO runs dry
+  constant c_timeout : time := 50 ms;
+
+  constant c_irq_en : std_logic_vector(31 downto 0) := x"00010000";
+  constant c_irq_clear : std_logic_vector(31 downto 0) := x"00020000";
+  constant c_underflows_clear : std_logic_vector(31 downto 0) := x"00040000";
+  constant c_low_water : std_logic_vector(31 downto 0) := x"00000200";
+
+  subtype t_word is std_logic_vector(15 downto 0);
+  type t_words is array (natural range <>) of t_word;
+
+  type t_item_kind is (k_pulse, k_rep, k_byte);
+  -- pulse is the single, repeated or zero pulse, count is the number of
+  -- repeats or the bit count field of a byte packet
+  type t_item is record
+    kind : t_item_kind;
+    pulse : t_word;
+    one : t_word;
+    count : natural;
+    data : std_logic_vector(7 downto 0);
+  end record;
+  type t_items is array (natural range <>) of t_item;
+
+  function p(flag : std_logic; len : natural) return t_word is
+  begin
+    return flag & std_logic_vector(to_unsigned(len, 15));
+  end function;
+
+  function pulse(flag : std_logic; len : natural) return t_item is
+  begin
+    return (k_pulse, p(flag, len), x"0000", 0, x"00");
+  end function;
+
+  function rep(flag : std_logic; len : natural; count : natural) return t_item is
+  begin
+    return (k_rep, p(flag, len), x"0000", count, x"00");
+  end function;
+
+  function byte(zero : t_word; one : t_word; data : std_logic_vector(7 downto 0); bits : natural) return t_item is
+  begin
+    return (k_byte, zero, one, bits, data);
+  end function;
+
+  function byte(zero_len : natural; one_len : natural; data : std_logic_vector(7 downto 0); bits : natural) return t_item is
+  begin
+    return byte(p('1', zero_len), p('1', one_len), data, bits);
+  end function;
+
+  function byte_bits(bits : natural) return natural is
+  begin
+    if bits = 0 or bits > 8 then
+      return 8;
+    end if;
+    return bits;
+  end function;
+
+  function pulse_words_count(items : t_items) return natural is
+    variable v_count : natural := 0;
+  begin
+    for i in items'range loop
+      case items(i).kind is
+        when k_pulse => v_count := v_count + 1;
+        when k_rep => v_count := v_count + items(i).count;
+        when k_byte => v_count := v_count + 2 * byte_bits(items(i).count);
+      end case;
+    end loop;
+    return v_count;
+  end function;
+
+  -- The tape as the generator has to play it, one word per pulse
+  function to_pulse_words(items : t_items) return t_words is
+    variable v_words : t_words(0 to pulse_words_count(items) - 1);
+    variable v_pos : natural := 0;
+    variable v_word : t_word;
+  begin
+    for i in items'range loop
+      case items(i).kind is
+        when k_pulse =>
+          v_words(v_pos) := items(i).pulse;
+          v_pos := v_pos + 1;
+        when k_rep =>
+          for j in 1 to items(i).count loop
+            v_words(v_pos) := items(i).pulse;
+            v_pos := v_pos + 1;
+          end loop;
+        when k_byte =>
+          for j in 7 downto 8 - byte_bits(items(i).count) loop
+            if items(i).data(j) = '1' then
+              v_word := items(i).one;
+            else
+              v_word := items(i).pulse;
+            end if;
+            v_words(v_pos) := v_word;
+            v_words(v_pos + 1) := v_word;
+            v_pos := v_pos + 2;
+          end loop;
+      end case;
+    end loop;
+    return v_words;
+  end function;
+
+  function packet_words_count(items : t_items) return natural is
+    variable v_count : natural := 0;
+  begin
+    for i in items'range loop
+      case items(i).kind is
+        when k_pulse => v_count := v_count + 1;
+        when k_rep => v_count := v_count + 3;
+        when k_byte => v_count := v_count + 4;
+      end case;
+    end loop;
+    return v_count;
+  end function;
+
+  -- The same tape packed the way the PS sends it
+  function to_packet_words(items : t_items) return t_words is
+    variable v_words : t_words(0 to packet_words_count(items) - 1);
+    variable v_pos : natural := 0;
+  begin
+    for i in items'range loop
+      case items(i).kind is
+        when k_pulse =>
+          v_words(v_pos) := items(i).pulse;
+          v_pos := v_pos + 1;
+        when k_rep =>
+          v_words(v_pos to v_pos + 2) := (x"8000", items(i).pulse, std_logic_vector(to_unsigned(items(i).count, 16)));
+          v_pos := v_pos + 3;
+        when k_byte =>
+          v_words(v_pos to v_pos + 3) := (x"0000", items(i).pulse, items(i).one,
+                                          "0000" & std_logic_vector(to_unsigned(items(i).count, 4)) & items(i).data);
+          v_pos := v_pos + 4;
+      end case;
+    end loop;
+    return v_words;
+  end function;
+
+  function ticks(words : t_words) return natural is
+    variable v_ticks : natural := 0;
+  begin
+    for i in words'range loop
+      v_ticks := v_ticks + to_integer(unsigned(words(i)(14 downto 0)));
+    end loop;
+    return v_ticks;
+  end function;
+
+  -- Number of tape signal changes made by the pulses and the level left after them
+  procedure edges(words : in t_words; level : inout std_logic; count : inout natural) is
+  begin
+    for i in words'range loop
+      if words(i)(15) = '1' then
+        level := not level;
+        count := count + 1;
+      elsif level = '1' then
+        level := '0';
+        count := count + 1;
+      end if;
+    end loop;
+  end procedure;
+
+  constant c_tape_1 : t_items := (
+    rep('1', 5, 1500),                     -- pilot tone, more pulses than the FIFO holds
+    pulse('1', 2), pulse('1', 3),          -- sync pulses
+    byte(2, 4, x"A5", 0),                  -- every bit count of a byte packet
+    byte(2, 4, x"3C", 1), byte(2, 4, x"C3", 2), byte(2, 4, x"5A", 3),
+    byte(2, 4, x"F0", 4), byte(2, 4, x"0F", 5), byte(2, 4, x"81", 6),
+    byte(2, 4, x"7E", 7), byte(2, 4, x"FF", 8), byte(2, 4, x"00", 9),
+    byte(3, 6, x"96", 15),
+    byte(1, 7, x"E1", 8),                  -- back-to-back byte packets with other pulses
+    byte(p('0', 3), p('1', 5), x"A5", 8),
+    rep('1', 7, 3), rep('0', 9, 2), rep('1', 1, 1),  -- back-to-back repeat packets
+    pulse('0', 30),
+    byte(2, 4, x"55", 8), rep('1', 4, 2), byte(2, 4, x"AA", 3),
+    pulse('1', 1000),
+    rep('1', 3, 1)
+  );
+
+  constant c_tape_2 : t_items := (
+    rep('1', 3, 10),
+    byte(2, 4, x"C3", 8),
+    pulse('1', 6),
+    pulse('0', 5)
+  );
+
+  constant c_pulse_words_1 : t_words := to_pulse_words(c_tape_1);
+  constant c_pulse_words_2 : t_words := to_pulse_words(c_tape_2);
+  constant c_packet_words_1 : t_words := to_packet_words(c_tape_1);
+  constant c_packet_words_2 : t_words := to_packet_words(c_tape_2);
+
+  -- One word per clock while the FIFO is not almost full
+  procedure feed(words : in t_words;
+                 signal clk : in std_logic;
+                 signal almost_full : in std_logic;
+                 signal din : out t_word;
+                 signal wr_en : out std_logic) is
+    variable v_pos : natural := words'low;
+  begin
+    while v_pos <= words'high loop
+      wait until rising_edge(clk);
+      if almost_full = '0' then
+        din <= words(v_pos);
+        wr_en <= '1';
+        v_pos := v_pos + 1;
+      else
+        wr_en <= '0';
+      end if;
+    end loop;
+    wait until rising_edge(clk);
+    wr_en <= '0';
+  end procedure;
+
+  procedure strobe(signal clk : in std_logic;
+                   signal en : out std_logic) is
+  begin
+    wait until rising_edge(clk);
+    en <= '1';
+    wait until rising_edge(clk);
+    en <= '0';
+  end procedure;
+
+  -- Outputs of a generator
+  type t_dut is record
+    tape_in : std_logic;
+    empty : std_logic;
+    full : std_logic;
+    overflow : std_logic;
+    underflow : std_logic;
+    almost_full : std_logic;
+    level : std_logic_vector(10 downto 0);
+    irq_en : std_logic;
+    irq : std_logic;
+    underflows : std_logic_vector(15 downto 0);
+  end record;
+
+  signal s_clk : std_logic := '0';
+  signal s_resetn : std_logic := '0';
+  signal s_strobe : std_logic := '0';
+  signal s_strobes : natural := 0;
+  signal s_cmp_run : std_logic := '0';
+  signal s_cmp_clk35m : std_logic;
+  signal s_level_run : std_logic := '0';
+
+  -- Same tape as single pulses, as packets and the FIFO level checks
+  signal s_pulse_din, s_packet_din, s_level_din : t_word := (others => '0');
+  signal s_pulse_wr_en, s_packet_wr_en, s_level_wr_en : std_logic := '0';
+  signal s_pulse_ctrl_wr_en, s_packet_ctrl_wr_en, s_level_ctrl_wr_en : std_logic := '0';
+  signal s_ctrl_data : std_logic_vector(31 downto 0) := (others => '0');
+  signal s_pulse, s_packet, s_level : t_dut;
+
+  signal s_feed_phase : natural := 0;
+  signal s_pulse_fed, s_packet_fed : natural := 0;
+  signal s_edges : natural := 0;
+  signal s_mismatches : natural := 0;
+  signal s_done : boolean := false;
+
+begin
+
+  s_clk <= not s_clk after c_clk_period / 2 when not s_done;
+
+  p_strobe : process(s_clk)
+    variable v_div : natural := 0;
+  begin
+    if rising_edge(s_clk) then
+      s_strobe <= '0';
+      v_div := v_div + 1;
+      if v_div = c_strobe_div then
+        v_div := 0;
+        s_strobe <= '1';
+      end if;
+      if s_strobe = '1' and s_cmp_run = '1' then
+        s_strobes <= s_strobes + 1;
+      end if;
+    end if;
+  end process;
+
+  s_cmp_clk35m <= s_strobe and s_cmp_run;
+
+  u_pulse : entity work.zx_tape_in
+    port map (
+      i_resetn => s_resetn, i_aclk => s_clk, i_clk35m => s_cmp_clk35m, i_cpu_stopped => '0',
+      i_fifo_din => s_pulse_din, i_fifo_wr_en => s_pulse_wr_en,
+      i_ctrl_wr_en => s_pulse_ctrl_wr_en, i_ctrl_data => s_ctrl_data,
+      o_tape_in => s_pulse.tape_in, o_fifo_empty => s_pulse.empty, o_fifo_full => s_pulse.full,
+      o_fifo_overflow => s_pulse.overflow, o_fifo_underflow => s_pulse.underflow,
+      o_fifo_almost_full => s_pulse.almost_full, o_fifo_level => s_pulse.level,
+      o_irq_en => s_pulse.irq_en, o_irq => s_pulse.irq, o_underflows => s_pulse.underflows
+    );
+
+  u_packet : entity work.zx_tape_in
+    port map (
+      i_resetn => s_resetn, i_aclk => s_clk, i_clk35m => s_cmp_clk35m, i_cpu_stopped => '0',
+      i_fifo_din => s_packet_din, i_fifo_wr_en => s_packet_wr_en,
+      i_ctrl_wr_en => s_packet_ctrl_wr_en, i_ctrl_data => s_ctrl_data,
+      o_tape_in => s_packet.tape_in, o_fifo_empty => s_packet.empty, o_fifo_full => s_packet.full,
+      o_fifo_overflow => s_packet.overflow, o_fifo_underflow => s_packet.underflow,
+      o_fifo_almost_full => s_packet.almost_full, o_fifo_level => s_packet.level,
+      o_irq_en => s_packet.irq_en, o_irq => s_packet.irq, o_underflows => s_packet.underflows
+    );
+
+  -- Every clock is a strobe here so that the FIFO drains as fast as the
+  -- read pipeline allows
+  u_level : entity work.zx_tape_in
+    port map (
+      i_resetn => s_resetn, i_aclk => s_clk, i_clk35m => s_level_run, i_cpu_stopped => '0',
+      i_fifo_din => s_level_din, i_fifo_wr_en => s_level_wr_en,
+      i_ctrl_wr_en => s_level_ctrl_wr_en, i_ctrl_data => s_ctrl_data,
+      o_tape_in => s_level.tape_in, o_fifo_empty => s_level.empty, o_fifo_full => s_level.full,
+      o_fifo_overflow => s_level.overflow, o_fifo_underflow => s_level.underflow,
+      o_fifo_almost_full => s_level.almost_full, o_fifo_level => s_level.level,
+      o_irq_en => s_level.irq_en, o_irq => s_level.irq, o_underflows => s_level.underflows
+    );
+
+
+  p_feed_pulse : process
+  begin
+    wait until s_feed_phase = 1;
+    feed(c_pulse_words_1, s_clk, s_pulse.almost_full, s_pulse_din, s_pulse_wr_en);
+    s_pulse_fed <= 1;
+    wait until s_feed_phase = 2;
+    feed(c_pulse_words_2, s_clk, s_pulse.almost_full, s_pulse_din, s_pulse_wr_en);
+    s_pulse_fed <= 2;
+    wait;
+  end process;
+
+  p_feed_packet : process
+  begin
+    wait until s_feed_phase = 1;
+    feed(c_packet_words_1, s_clk, s_packet.almost_full, s_packet_din, s_packet_wr_en);
+    s_packet_fed <= 1;
+    wait until s_feed_phase = 2;
+    feed(c_packet_words_2, s_clk, s_packet.almost_full, s_packet_din, s_packet_wr_en);
+    s_packet_fed <= 2;
+    wait;
+  end process;
+
+
+  -- The packet train has to give exactly the same tape signal as the single
+  -- pulses and the FIFO level has to agree with the FIFO flags on every clock
+  p_check : process(s_clk)
+    variable v_prev : std_logic := '0';
+  begin
+    if rising_edge(s_clk) and s_resetn = '1' then
+      if s_pulse.tape_in /= s_packet.tape_in or s_pulse.underflows /= s_packet.underflows then
+        if s_mismatches < 10 then
+          report "Packet train differs from single pulses after " & integer'image(s_strobes) & " ticks" severity error;
+        end if;
+        s_mismatches <= s_mismatches + 1;
+      end if;
+
+      if s_pulse.tape_in /= v_prev then
+        s_edges <= s_edges + 1;
+      end if;
+      v_prev := s_pulse.tape_in;
+
+      assert (unsigned(s_pulse.level) = 0) = (s_pulse.empty = '1') and
+             (unsigned(s_pulse.level) = 1024) = (s_pulse.full = '1')
+        report "Single pulse FIFO level " & integer'image(to_integer(unsigned(s_pulse.level))) & " disagrees with the flags" severity error;
+      assert s_pulse.overflow = '0' and s_pulse.underflow = '0'
+        report "Single pulse FIFO overflow or underflow" severity error;
+
+      assert (unsigned(s_packet.level) = 0) = (s_packet.empty = '1') and
+             (unsigned(s_packet.level) = 1024) = (s_packet.full = '1')
+        report "Packet FIFO level " & integer'image(to_integer(unsigned(s_packet.level))) & " disagrees with the flags" severity error;
+      assert s_packet.overflow = '0' and s_packet.underflow = '0'
+        report "Packet FIFO overflow or underflow" severity error;
+
+      -- The level generator overflows on purpose but never reads an empty FIFO
+      assert (unsigned(s_level.level) = 0) = (s_level.empty = '1') and
+             (unsigned(s_level.level) = 1024) = (s_level.full = '1')
+        report "FIFO level " & integer'image(to_integer(unsigned(s_level.level))) & " disagrees with the flags" severity error;
+      assert s_level.underflow = '0'
+        report "Tape generator has read an empty FIFO" severity error;
+    end if;
+  end process;
+
+
+  p_main : process
+    variable v_level : natural;
+    variable v_written : natural;
+    variable v_tape_level : std_logic;
+    variable v_edges : natural;
+  begin
+    s_resetn <= '0';
+    for i in 1 to 10 loop
+      wait until rising_edge(s_clk);
+    end loop;
+    s_resetn <= '1';
+    for i in 1 to 10 loop
+      wait until rising_edge(s_clk);
+    end loop;
+
+    ---------------------------------------------------------------------------
+    -- FIFO level, almost-full, full and overflow. The generator starts in the
+    -- pause taken on an empty FIFO and no strobes come, so it keeps one word
+    -- in the decoder and the rest stays in the FIFO.
+    ---------------------------------------------------------------------------
+    s_ctrl_data <= c_irq_en or c_low_water;
+    strobe(s_clk, s_level_ctrl_wr_en);
+    v_written := 0;
+    while v_written < 1025 loop
+      wait until rising_edge(s_clk);
+      s_level_din <= p('1', 1);
+      s_level_wr_en <= '1';
+      wait until rising_edge(s_clk);
+      s_level_wr_en <= '0';
+      v_written := v_written + 1;
+      for i in 1 to 4 loop
+        wait until rising_edge(s_clk);
+      end loop;
+      v_level := to_integer(unsigned(s_level.level));
+      assert v_level = v_written - 1
+        report "FIFO level " & integer'image(v_level) & " after " & integer'image(v_written) & " words" severity error;
+      assert (s_level.almost_full = '1') = (v_level >= 1016)
+        report "Almost-full is wrong at level " & integer'image(v_level) severity error;
+      assert s_level.irq = '0'
+        report "Low-water interrupt while filling the FIFO" severity error;
+    end loop;
+    assert s_level.full = '1' and unsigned(s_level.level) = 1024
+      report "FIFO is not full" severity error;
+
+    wait until rising_edge(s_clk);
+    s_level_wr_en <= '1';
+    wait until rising_edge(s_clk);
+    s_level_wr_en <= '0';
+    wait until rising_edge(s_clk);
+    assert s_level.overflow = '1'
+      report "Write into a full FIFO is not flagged" severity error;
+    wait until rising_edge(s_clk);
+    assert unsigned(s_level.level) = 1024
+      report "Write into a full FIFO has changed the level" severity error;
+
+    ---------------------------------------------------------------------------
+    -- Low-water interrupt: raised once the level drops below the mark and
+    -- raised again only after the FIFO has been refilled above it
+    ---------------------------------------------------------------------------
+    s_level_run <= '1';
+    wait until s_level.irq = '1' for c_timeout;
+    v_level := to_integer(unsigned(s_level.level));
+    assert s_level.irq = '1' and v_level < 512 and v_level >= 509
+      report "Low-water interrupt at level " & integer'image(v_level) severity error;
+
+    s_ctrl_data <= c_irq_en or c_irq_clear or c_low_water;
+    strobe(s_clk, s_level_ctrl_wr_en);
+    for i in 1 to 200 loop
+      wait until rising_edge(s_clk);
+      assert s_level.irq = '0'
+        report "Low-water interrupt raised twice without a refill" severity error;
+    end loop;
+
+    s_level_run <= '0';
+    wait until rising_edge(s_clk);
+    v_level := to_integer(unsigned(s_level.level));
+    for i in v_level to 600 loop
+      wait until rising_edge(s_clk);
+      s_level_din <= p('1', 1);
+      s_level_wr_en <= '1';
+    end loop;
+    wait until rising_edge(s_clk);
+    s_level_wr_en <= '0';
+    for i in 1 to 4 loop
+      wait until rising_edge(s_clk);
+    end loop;
+    assert s_level.irq = '0' and unsigned(s_level.level) >= 512
+      report "Low-water interrupt while refilling the FIFO" severity error;
+
+    s_level_run <= '1';
+    wait until s_level.irq = '1' for c_timeout;
+    assert s_level.irq = '1' and unsigned(s_level.level) < 512
+      report "No low-water interrupt after the refill" severity error;
+    s_ctrl_data <= c_irq_en or c_irq_clear or c_low_water;
+    strobe(s_clk, s_level_ctrl_wr_en);
+
+    -- Running dry is counted once as an underflow
+    wait until unsigned(s_level.underflows) = 1 for c_timeout;
+    for i in 1 to 4 loop
+      wait until rising_edge(s_clk);
+    end loop;
+    assert unsigned(s_level.underflows) = 1 and unsigned(s_level.level) = 0 and s_level.empty = '1'
+      report "FIFO has not run dry once" severity error;
+    s_ctrl_data <= c_irq_en or c_underflows_clear or c_low_water;
+    strobe(s_clk, s_level_ctrl_wr_en);
+    wait until rising_edge(s_clk);
+    assert unsigned(s_level.underflows) = 0
+      report "Underflow counter is not cleared" severity error;
+    s_level_run <= '0';
+
+    ---------------------------------------------------------------------------
+    -- Packet train against single pulses, the FIFO runs dry between the two
+    -- parts of the tape
+    ---------------------------------------------------------------------------
+    s_ctrl_data <= c_irq_en or c_low_water;
+    wait until rising_edge(s_clk);
+    s_pulse_ctrl_wr_en <= '1';
+    s_packet_ctrl_wr_en <= '1';
+    wait until rising_edge(s_clk);
+    s_pulse_ctrl_wr_en <= '0';
+    s_packet_ctrl_wr_en <= '0';
+
+    s_cmp_run <= '1';
+    s_feed_phase <= 1;
+    wait until unsigned(s_pulse.underflows) = 1 for c_timeout;
+    assert unsigned(s_pulse.underflows) = 1 and s_pulse_fed = 1 and s_packet_fed = 1
+      report "First part of the tape has not been played" severity error;
+    assert s_strobes = c_starving_ticks + ticks(c_pulse_words_1)
+      report "First part of the tape took " & integer'image(s_strobes) & " ticks instead of " &
+             integer'image(c_starving_ticks + ticks(c_pulse_words_1)) severity error;
+
+    s_feed_phase <= 2;
+    wait until unsigned(s_pulse.underflows) = 2 for c_timeout;
+    assert unsigned(s_pulse.underflows) = 2 and s_pulse_fed = 2 and s_packet_fed = 2
+      report "Second part of the tape has not been played" severity error;
+    assert s_strobes = 2 * c_starving_ticks + ticks(c_pulse_words_1) + ticks(c_pulse_words_2)
+      report "Tape took " & integer'image(s_strobes) & " ticks" severity error;
+    wait until rising_edge(s_clk);
+
+    -- Both pauses on an empty FIFO end with a low tape signal
+    v_tape_level := '0';
+    v_edges := 0;
+    edges(c_pulse_words_1, v_tape_level, v_edges);
+    edges((0 => p('0', c_starving_ticks)), v_tape_level, v_edges);
+    edges(c_pulse_words_2, v_tape_level, v_edges);
+    assert s_edges = v_edges
+      report "Tape signal changed " & integer'image(s_edges) & " times instead of " & integer'image(v_edges) severity error;
+    assert unsigned(s_pulse.level) = 0 and unsigned(s_packet.level) = 0
+      report "FIFO level is not zero at the end of the tape" severity error;
+    assert s_mismatches = 0
+      report "Packet train differs from single pulses on " & integer'image(s_mismatches) & " clocks" severity error;
+
+    report "tb_zx_tape_fifo: " & integer'image(c_pulse_words_1'length + c_pulse_words_2'length) & " pulses from " &
+           integer'image(c_packet_words_1'length + c_packet_words_2'length) & " packet words, " &
+           integer'image(s_edges) & " edges, " & integer'image(s_mismatches) & " mismatches" severity note;
+    s_done <= true;
+    wait;
+  end process;
+
+end sim;
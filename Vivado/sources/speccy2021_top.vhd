@@ -83,6 +83,8 @@ architecture STRUCTURE of speccy2021_top is
     TMDS_clk_n : out std_logic;
     TMDS_data_p : out std_logic_vector ( 2 downto 0 );
     TMDS_data_n : out std_logic_vector ( 2 downto 0 );
+    TAPE_IRQ : in std_logic;
+    TRDOS_IRQ : in std_logic;
 
     S_VDMA_AXIS_MM2S_aclk : out std_logic;
     S_VDMA_AXI_LITE_aclk : out std_logic;
@@ -221,6 +223,16 @@ architecture STRUCTURE of speccy2021_top is
     i_zx_io_ports : in std_logic_vector(31 downto 0);
     o_zx_tape_fifo_en : out std_logic;
     i_zx_tape_fifo : in std_logic_vector(31 downto 0);
+    o_zx_tape_trap_en : out std_logic;
+    i_zx_tape_trap : in std_logic_vector(31 downto 0);
+    o_zx_tape_fifo_ctrl_en : out std_logic;
+    i_zx_tape_fifo_ctrl : in std_logic_vector(31 downto 0);
+    o_zx_ram_dirty_en : out std_logic;
+    i_zx_ram_dirty : in std_logic_vector(31 downto 0);
+    o_zx_trdos_ports_en : out std_logic;
+    i_zx_trdos_ports : in std_logic_vector(31 downto 0);
+    o_zx_trdos_fifo_ctrl_en : out std_logic;
+    i_zx_trdos_fifo_ctrl : in std_logic_vector(31 downto 0);
 
     i_border_color : in std_logic_vector(2 downto 0);
     i_border_stb : in std_logic;
@@ -302,6 +314,18 @@ architecture STRUCTURE of speccy2021_top is
     o_zx_io_ports : out std_logic_vector(31 downto 0);
     i_zx_tape_fifo_en : in std_logic;
     o_zx_tape_fifo : out std_logic_vector(31 downto 0);
+    i_zx_tape_trap_en : in std_logic;
+    o_zx_tape_trap : out std_logic_vector(31 downto 0);
+    i_zx_tape_fifo_ctrl_en : in std_logic;
+    o_zx_tape_fifo_ctrl : out std_logic_vector(31 downto 0);
+    i_zx_ram_dirty_en : in std_logic;
+    o_zx_ram_dirty : out std_logic_vector(31 downto 0);
+    i_zx_trdos_ports_en : in std_logic;
+    o_zx_trdos_ports : out std_logic_vector(31 downto 0);
+    i_zx_trdos_fifo_ctrl_en : in std_logic;
+    o_zx_trdos_fifo_ctrl : out std_logic_vector(31 downto 0);
+    o_tape_irq : out std_logic;
+    o_trdos_irq : out std_logic;
 
     o_border_color : out std_logic_vector(2 downto 0);
     o_border_stb : out std_logic;
@@ -424,6 +448,18 @@ architecture STRUCTURE of speccy2021_top is
   signal s_zx_io_ports : std_logic_vector(31 downto 0);
   signal s_zx_tape_fifo_en : std_logic;
   signal s_zx_tape_fifo : std_logic_vector(31 downto 0);
+  signal s_zx_tape_trap_en : std_logic;
+  signal s_zx_tape_trap : std_logic_vector(31 downto 0);
+  signal s_zx_tape_fifo_ctrl_en : std_logic;
+  signal s_zx_tape_fifo_ctrl : std_logic_vector(31 downto 0);
+  signal s_zx_ram_dirty_en : std_logic;
+  signal s_zx_ram_dirty : std_logic_vector(31 downto 0);
+  signal s_zx_trdos_ports_en : std_logic;
+  signal s_zx_trdos_ports : std_logic_vector(31 downto 0);
+  signal s_zx_trdos_fifo_ctrl_en : std_logic;
+  signal s_zx_trdos_fifo_ctrl : std_logic_vector(31 downto 0);
+  signal s_tape_irq : std_logic;
+  signal s_trdos_irq : std_logic;
   signal s_border_color : std_logic_vector(2 downto 0);
   signal s_border_stb : std_logic;
   signal s_new_frame_int : std_logic;
@@ -555,7 +591,9 @@ speccy2021_i: component speccy2021
       TMDS_clk_n => TMDS_clk_n,
       TMDS_clk_p => TMDS_clk_p,
       TMDS_data_n(2 downto 0) => TMDS_data_n(2 downto 0),
-      TMDS_data_p(2 downto 0) => TMDS_data_p(2 downto 0)
+      TMDS_data_p(2 downto 0) => TMDS_data_p(2 downto 0),
+      TAPE_IRQ => s_tape_irq,
+      TRDOS_IRQ => s_trdos_irq
     );
 
 zx_video_top_i : component zx_video_top
@@ -615,6 +653,16 @@ zx_video_top_i : component zx_video_top
       i_zx_io_ports => s_zx_io_ports,
       o_zx_tape_fifo_en => s_zx_tape_fifo_en,
       i_zx_tape_fifo => s_zx_tape_fifo,
+      o_zx_tape_trap_en => s_zx_tape_trap_en,
+      i_zx_tape_trap => s_zx_tape_trap,
+      o_zx_tape_fifo_ctrl_en => s_zx_tape_fifo_ctrl_en,
+      i_zx_tape_fifo_ctrl => s_zx_tape_fifo_ctrl,
+      o_zx_ram_dirty_en => s_zx_ram_dirty_en,
+      i_zx_ram_dirty => s_zx_ram_dirty,
+      o_zx_trdos_ports_en => s_zx_trdos_ports_en,
+      i_zx_trdos_ports => s_zx_trdos_ports,
+      o_zx_trdos_fifo_ctrl_en => s_zx_trdos_fifo_ctrl_en,
+      i_zx_trdos_fifo_ctrl => s_zx_trdos_fifo_ctrl,
 
       i_border_color => s_border_color,
       i_border_stb => s_border_stb,
@@ -694,6 +742,18 @@ zx_main_top_i : component zx_main_top
       o_zx_io_ports => s_zx_io_ports,
       i_zx_tape_fifo_en => s_zx_tape_fifo_en,
       o_zx_tape_fifo => s_zx_tape_fifo,
+      i_zx_tape_trap_en => s_zx_tape_trap_en,
+      o_zx_tape_trap => s_zx_tape_trap,
+      i_zx_tape_fifo_ctrl_en => s_zx_tape_fifo_ctrl_en,
+      o_zx_tape_fifo_ctrl => s_zx_tape_fifo_ctrl,
+      i_zx_ram_dirty_en => s_zx_ram_dirty_en,
+      o_zx_ram_dirty => s_zx_ram_dirty,
+      i_zx_trdos_ports_en => s_zx_trdos_ports_en,
+      o_zx_trdos_ports => s_zx_trdos_ports,
+      i_zx_trdos_fifo_ctrl_en => s_zx_trdos_fifo_ctrl_en,
+      o_zx_trdos_fifo_ctrl => s_zx_trdos_fifo_ctrl,
+      o_tape_irq => s_tape_irq,
+      o_trdos_irq => s_trdos_irq,
       
       o_border_color => s_border_color,
       o_border_stb => s_border_stb,
@@ -16,6 +16,14 @@
 -- 
 -- Revision:
 -- 
+-- Revision 0.09 - Tape signal generator moved into zx_tape_in
+-- Revision 0.08 - Betadisk interface: TR-DOS ROM paging, WD1793 ports trapped
+--   to PS with wait states and sector data streamed through FIFOs
+-- Revision 0.07 - Dirty flags of RAM pages written by the CPU
+-- Revision 0.06 - CPU halt acknowledge and PC restore done status bits
+-- Revision 0.05 - Tape FIFO low-water interrupt and underflow counter
+-- Revision 0.04 - ROM tape loader trap for instant loading
+-- Revision 0.03 - Run-length and byte packets in the tape FIFO
 -- Revision 0.02 - Fully functional 48/128K configuration without Betadisk and
 --   without original ULA timings so proper border effects are not there yet
 -- Revision 0.01 - File Created
@@ -55,6 +63,18 @@ entity zx_main_top is
       o_zx_io_ports : out std_logic_vector(g_axi_lite_data_width - 1 downto 0);
       i_zx_tape_fifo_en : in std_logic;
       o_zx_tape_fifo : out std_logic_vector(g_axi_lite_data_width - 1 downto 0);
+      i_zx_tape_trap_en : in std_logic;
+      o_zx_tape_trap : out std_logic_vector(g_axi_lite_data_width - 1 downto 0);
+      i_zx_tape_fifo_ctrl_en : in std_logic;
+      o_zx_tape_fifo_ctrl : out std_logic_vector(g_axi_lite_data_width - 1 downto 0);
+      i_zx_ram_dirty_en : in std_logic;
+      o_zx_ram_dirty : out std_logic_vector(g_axi_lite_data_width - 1 downto 0);
+      i_zx_trdos_ports_en : in std_logic;
+      o_zx_trdos_ports : out std_logic_vector(g_axi_lite_data_width - 1 downto 0);
+      i_zx_trdos_fifo_ctrl_en : in std_logic;
+      o_zx_trdos_fifo_ctrl : out std_logic_vector(g_axi_lite_data_width - 1 downto 0);
+      o_tape_irq : out std_logic;
+      o_trdos_irq : out std_logic;
 
       o_border_color : out std_logic_vector(2 downto 0);
       o_border_stb : out std_logic;
@@ -104,6 +124,7 @@ architecture rtl of zx_main_top is
   signal s_cpu_wait : std_logic;
   signal s_cpu_halt_req : std_logic := '1';
   signal s_cpu_halt_ack : std_logic := '1';
+  signal s_cpu_restore_done : std_logic := '0';
 
   -- AY signals
   signal s_ay_rd : std_logic;
@@ -139,6 +160,27 @@ architecture rtl of zx_main_top is
   constant c_tape_fifo_lsb_bit     : integer range 0 to 31 := 0;
   constant c_tape_fifo_empty_bit   : integer range 0 to 31 := 31;
   constant c_tape_fifo_full_bit    : integer range 0 to 31 := 30;
+  constant c_tape_trap_addr_msb_bit : integer range 0 to 31 := 15;
+  constant c_tape_trap_addr_lsb_bit : integer range 0 to 31 := 0;
+  constant c_tape_trap_en_bit       : integer range 0 to 31 := 16;
+  constant c_tape_trap_clear_bit    : integer range 0 to 31 := 17;
+  constant c_ram_dirty_msb_bit      : integer range 0 to 31 := 7;
+  constant c_ram_dirty_lsb_bit      : integer range 0 to 31 := 0;
+  constant c_ram_first_page         : integer := 4;
+  constant c_ram_pages              : integer := 8;
+  constant c_trdos_data_msb_bit     : integer range 0 to 31 := 7;
+  constant c_trdos_data_lsb_bit     : integer range 0 to 31 := 0;
+  constant c_trdos_fifo_push_bit    : integer range 0 to 31 := 8;
+  constant c_trdos_fifo_pop_bit     : integer range 0 to 31 := 9;
+  constant c_trdos_release_bit      : integer range 0 to 31 := 8;
+  constant c_trdos_intrq_bit        : integer range 0 to 31 := 9;
+  constant c_trdos_drq_bit          : integer range 0 to 31 := 10;
+  constant c_trdos_stream_rd_bit    : integer range 0 to 31 := 11;
+  constant c_trdos_stream_wr_bit    : integer range 0 to 31 := 12;
+  constant c_trdos_fifo_rst_bit     : integer range 0 to 31 := 13;
+  constant c_trdos_irq_en_bit       : integer range 0 to 31 := 14;
+  constant c_trdos_sector_size      : integer := 256;
+  constant c_trdos_rom_page         : std_logic_vector(7 downto 0) := x"02";
   
   -- ZX I/O ports
   signal s_spec_port_fe : std_logic_vector(7 downto 0);
@@ -155,13 +197,66 @@ architecture rtl of zx_main_top is
 
   -- TAPE FIFO
   signal s_tape_fifo_din : std_logic_vector(15 downto 0);
-  signal s_tape_fifo_dout : std_logic_vector(15 downto 0);
   signal s_tape_fifo_wr_en : std_logic := '0';
-  signal s_tape_fifo_empty : std_logic := '0';
-  signal s_tape_fifo_full : std_logic := '0';
-  signal s_tape_fifo_rd_en : std_logic := '0';
-  signal s_tape_fifo_underflow : std_logic := '0';
-  signal s_tape_fifo_overflow : std_logic := '0';
+  signal s_tape_fifo_empty : std_logic;
+  signal s_tape_fifo_full : std_logic;
+  signal s_tape_fifo_underflow : std_logic;
+  signal s_tape_fifo_overflow : std_logic;
+  signal s_tape_fifo_level : std_logic_vector(10 downto 0);
+  signal s_tape_fifo_almost_full : std_logic;
+  signal s_tape_fifo_ctrl_wr_en : std_logic;
+  signal s_tape_cpu_stopped : std_logic;
+
+  -- TAPE ROM trap
+  signal s_tape_trap_addr : std_logic_vector(15 downto 0) := (others => '0');
+  signal s_tape_trap_en : std_logic := '0';
+  signal s_tape_trap_hit : std_logic := '0';
+
+  -- TAPE FIFO low-water interrupt
+  signal s_tape_irq_en : std_logic;
+  signal s_tape_irq_pending : std_logic;
+  signal s_tape_underflows : std_logic_vector(15 downto 0);
+  -- RAM pages written since the flags were cleared
+  signal s_ram_dirty : std_logic_vector(c_ram_pages - 1 downto 0) := (others => '0');
+
+  -- Betadisk interface
+  signal s_trdos_active : std_logic := '0';
+  signal s_trdos_rom : std_logic;
+  signal s_trdos_port_sel : std_logic;
+  signal s_spec_port_trdos_ff : std_logic_vector(7 downto 0) := (others => '0');
+  signal s_trdos_wait : std_logic;
+  signal s_trdos_req_pending : std_logic := '0';
+  signal s_trdos_req_wr : std_logic := '0';
+  signal s_trdos_req_port : std_logic_vector(7 downto 0) := (others => '0');
+  signal s_trdos_req_data : std_logic_vector(7 downto 0) := (others => '0');
+  signal s_trdos_intrq : std_logic := '0';
+  signal s_trdos_drq_ps : std_logic := '0';
+  signal s_trdos_drq : std_logic;
+  signal s_trdos_stream_rd : std_logic := '0';
+  signal s_trdos_stream_wr : std_logic := '0';
+  signal s_trdos_irq_en : std_logic := '0';
+  signal s_trdos_irq : std_logic;
+  signal s_trdos_fifo_rst : std_logic := '0';
+  signal s_trdos_fifo_reset : std_logic;
+  -- Sector data going to the CPU
+  signal s_trdos_rfifo_din : std_logic_vector(15 downto 0) := (others => '0');
+  signal s_trdos_rfifo_dout : std_logic_vector(15 downto 0);
+  signal s_trdos_rfifo_wr_en : std_logic := '0';
+  signal s_trdos_rfifo_rd_en : std_logic := '0';
+  signal s_trdos_rfifo_rd_en_d : std_logic := '0';
+  signal s_trdos_rfifo_empty : std_logic;
+  signal s_trdos_rfifo_full : std_logic;
+  signal s_trdos_rfifo_pop : std_logic := '0';
+  -- Sector data coming from the CPU
+  signal s_trdos_wfifo_din : std_logic_vector(15 downto 0) := (others => '0');
+  signal s_trdos_wfifo_dout : std_logic_vector(15 downto 0);
+  signal s_trdos_wfifo_wr_en : std_logic := '0';
+  signal s_trdos_wfifo_rd_en : std_logic := '0';
+  signal s_trdos_wfifo_rd_en_d : std_logic := '0';
+  signal s_trdos_wfifo_empty : std_logic;
+  signal s_trdos_wfifo_full : std_logic;
+  signal s_trdos_wfifo_data : std_logic_vector(7 downto 0) := (others => '0');
+  signal s_trdos_wfifo_level : unsigned(10 downto 0) := (others => '0');
 
 
   component fifo_1024_16
@@ -182,18 +277,59 @@ architecture rtl of zx_main_top is
   
 begin
 
-  i_tape_fifo : fifo_1024_16
+  i_tape_in : entity work.zx_tape_in
+    port map (
+      i_resetn => i_resetn,
+      i_aclk => i_aclk,
+      i_clk35m => s_clk35m,
+      i_cpu_stopped => s_tape_cpu_stopped,
+      i_fifo_din => s_tape_fifo_din,
+      i_fifo_wr_en => s_tape_fifo_wr_en,
+      i_ctrl_wr_en => s_tape_fifo_ctrl_wr_en,
+      i_ctrl_data => i_register_data_out,
+      o_tape_in => s_tape_in,
+      o_fifo_empty => s_tape_fifo_empty,
+      o_fifo_full => s_tape_fifo_full,
+      o_fifo_overflow => s_tape_fifo_overflow,
+      o_fifo_underflow => s_tape_fifo_underflow,
+      o_fifo_almost_full => s_tape_fifo_almost_full,
+      o_fifo_level => s_tape_fifo_level,
+      o_irq_en => s_tape_irq_en,
+      o_irq => s_tape_irq_pending,
+      o_underflows => s_tape_underflows
+    );
+
+  s_tape_cpu_stopped <= s_cpu_halt_ack or s_cpu_mem_wait;
+  s_tape_fifo_ctrl_wr_en <= i_wr_en and i_zx_tape_fifo_ctrl_en;
+  o_tape_irq <= s_tape_irq_pending;
+
+  -- Only the lower byte of the Betadisk FIFOs is used
+  i_trdos_rfifo : fifo_1024_16
+    port map (
+      clk => i_aclk,
+      rst => s_trdos_fifo_reset,
+      din => s_trdos_rfifo_din,
+      wr_en => s_trdos_rfifo_wr_en,
+      rd_en => s_trdos_rfifo_rd_en,
+      dout => s_trdos_rfifo_dout,
+      full => s_trdos_rfifo_full,
+      overflow => open,
+      empty => s_trdos_rfifo_empty,
+      underflow => open
+    );
+
+  i_trdos_wfifo : fifo_1024_16
     port map (
       clk => i_aclk,
-      rst => not i_resetn,
-      din => s_tape_fifo_din,
-      wr_en => s_tape_fifo_wr_en,
-      rd_en => s_tape_fifo_rd_en,
-      dout => s_tape_fifo_dout,
-      full => s_tape_fifo_full,
-      overflow => s_tape_fifo_overflow,
-      empty => s_tape_fifo_empty,
-      underflow => s_tape_fifo_underflow
+      rst => s_trdos_fifo_reset,
+      din => s_trdos_wfifo_din,
+      wr_en => s_trdos_wfifo_wr_en,
+      rd_en => s_trdos_wfifo_rd_en,
+      dout => s_trdos_wfifo_dout,
+      full => s_trdos_wfifo_full,
+      overflow => open,
+      empty => s_trdos_wfifo_empty,
+      underflow => open
     );
 
 
@@ -277,44 +413,39 @@ begin
   end process;
 
 
-  -- Tape loader emulation
-  p_tape_in : process(i_aclk)
-    variable v_tape_counter : unsigned(14 downto 0) := (others => '0');
-    variable v_tape_pulse : std_logic := '1';
+  -- Tracks the number of bytes written by the CPU into the Betadisk FIFO
+  -- so that the PS is called once a whole sector is there
+  p_trdos_wfifo_level : process(i_aclk)
   begin
     if rising_edge(i_aclk) then
-      if v_tape_counter > 0 then 
-        if v_tape_pulse = '1' then
-          if s_clk35m = '1' and s_cpu_halt_ack = '0' and s_cpu_mem_wait = '0' then
-            v_tape_counter := v_tape_counter - 1;
-            if v_tape_counter = 0 then
-              s_tape_in <= not s_tape_in;
-            end if;
-          end if;
-        else
-          if s_clk35m = '1' then
-            v_tape_counter := v_tape_counter - 1;
-            if v_tape_counter = 0 then
-              s_tape_in <= '0';
-            end if;
-          end if;				
-        end if;
-      end if;
-
-      s_tape_fifo_rd_en <= '0';
-      if v_tape_counter = 0 then
-        if s_tape_fifo_empty = '0' then
-          v_tape_counter := unsigned(s_tape_fifo_dout(14 downto 0));
-          v_tape_pulse := s_tape_fifo_dout(15);
-          s_tape_fifo_rd_en <= '1';
-        else
-          v_tape_counter := (others => '1');
-          v_tape_pulse := '0';
+      if (i_resetn = '0') or (s_trdos_fifo_rst = '1') then
+        s_trdos_wfifo_level <= (others => '0');
+      else
+        if (s_trdos_wfifo_wr_en = '1' and s_trdos_wfifo_full = '0') and not (s_trdos_wfifo_rd_en = '1' and s_trdos_wfifo_empty = '0') then
+          s_trdos_wfifo_level <= s_trdos_wfifo_level + 1;
+        elsif (s_trdos_wfifo_rd_en = '1' and s_trdos_wfifo_empty = '0') and not (s_trdos_wfifo_wr_en = '1' and s_trdos_wfifo_full = '0') then
+          s_trdos_wfifo_level <= s_trdos_wfifo_level - 1;
         end if;
       end if;
     end if;
   end process;
 
+  -- The data request seen by TR-DOS in port FF follows the FIFOs while
+  -- a sector is streamed, otherwise it is set by the PS
+  s_trdos_drq <= '1' when (s_trdos_stream_rd = '1' and s_trdos_rfifo_empty = '0') or
+                          (s_trdos_stream_wr = '1' and s_trdos_wfifo_level < c_trdos_sector_size) or
+                          (s_trdos_drq_ps = '1') else '0';
+
+  -- The PS is called for a port access to be emulated, once the sector
+  -- to be read has been consumed and once a sector has been written
+  s_trdos_irq <= s_trdos_irq_en and (s_trdos_req_pending or
+                                     (s_trdos_stream_rd and s_trdos_rfifo_empty) or
+                                     (s_trdos_stream_wr and not s_trdos_drq));
+  o_trdos_irq <= s_trdos_irq;
+
+  s_trdos_wait <= s_trdos_req_pending or s_trdos_rfifo_pop;
+  s_trdos_fifo_reset <= (not i_resetn) or s_trdos_fifo_rst;
+
 
   -- manipulate clock enable in such a way that it makes Z80
   -- work as if it is clocked at much lower rate
@@ -358,10 +489,32 @@ begin
          (v_cpu_save_int7_prev  = '1') then
         s_cpu_halt_ack <= '1';
       end if;
+
+      -- Freeze the CPU right before the opcode fetch at the trap address
+      -- while the 48K BASIC ROM is paged in, not TR-DOS in its place.
+      -- The CPU stays halted until PS takes over with its own halt
+      -- request and clears the trap
+      if (s_cpu_mem_wait = '0') and (s_tape_trap_en = '1') and
+         (s_cpu_halt_ack = '0') and (s_cpu_save_int(7) = '0') and
+         (v_cpu_save_int7_prev  = '1') and (s_spec_port_7ffd(4) = '1') and
+         (s_trdos_active = '0') and (s_cpu_save_pc = s_tape_trap_addr) then
+        s_cpu_halt_ack <= '1';
+        s_tape_trap_hit <= '1';
+      end if;
       v_cpu_save_int7_prev := s_cpu_save_int(7);
-      if (s_cpu_halt_ack = '1') and (s_cpu_halt_req = '0') then
+
+      if (i_wr_en = '1') and (i_zx_tape_trap_en = '1') and
+         (i_register_data_out(c_tape_trap_clear_bit) = '1') then
+        s_tape_trap_hit <= '0';
+      end if;
+
+      if (s_cpu_halt_ack = '1') and (s_cpu_halt_req = '0') and (s_tape_trap_hit = '0') then
         s_cpu_halt_ack <= '0';
       end if;
+
+      -- The CPU takes the restored PC on every clock while RestorePC_n is
+      -- low, so one clock later the restore is done
+      s_cpu_restore_done <= not s_cpu_restore_pc_n;
     end if;
   end process;    
 
@@ -386,9 +539,27 @@ begin
         s_keyboard_1 <= (others => '1');
         s_keyboard_2 <= (others => '1');
         s_tape_fifo_wr_en <= '0';
+        s_tape_trap_en <= '0';
         s_selected_ay2 <= '0';
+        s_ram_dirty <= (others => '0');
+        s_trdos_active <= '0';
+        s_spec_port_trdos_ff <= x"00";
+        s_trdos_req_pending <= '0';
+        s_trdos_rfifo_pop <= '0';
+        s_trdos_intrq <= '0';
+        s_trdos_drq_ps <= '0';
+        s_trdos_stream_rd <= '0';
+        s_trdos_stream_wr <= '0';
+        s_trdos_irq_en <= '0';
       else
         s_tape_fifo_wr_en <= '0';
+        s_trdos_rfifo_wr_en <= '0';
+        s_trdos_rfifo_rd_en <= '0';
+        s_trdos_wfifo_wr_en <= '0';
+        s_trdos_wfifo_rd_en <= '0';
+        s_trdos_fifo_rst <= '0';
+        s_trdos_rfifo_rd_en_d <= s_trdos_rfifo_rd_en;
+        s_trdos_wfifo_rd_en_d <= s_trdos_wfifo_rd_en;
         if i_wr_en = '1' then
           if i_zx_control_en = '1' then
             s_cpu_halt_req <= i_register_data_out(c_control_reg_cpu_halt_bit);
@@ -396,6 +567,10 @@ begin
             s_cpu_restore_pc <= i_register_data_out(c_control_reg_cpu_pc_msb_bit downto c_control_reg_cpu_pc_lsb_bit);
             s_cpu_restore_int <= i_register_data_out(c_control_reg_cpu_int_msb_bit downto c_control_reg_cpu_int_lsb_bit);
             s_cpu_restore_pc_n <= i_register_data_out(c_control_reg_cpu_restore_pc_n_bit);
+            -- TR-DOS ROM paging is taken along with a restored PC
+            if i_register_data_out(c_control_reg_cpu_restore_pc_n_bit) = '0' then
+              s_trdos_active <= i_register_data_out(c_control_reg_trdos_flag_bit);
+            end if;
           elsif i_zx_keyboard_1_en = '1' then
             s_keyboard_1 <= i_register_data_out(19 downto 0);
           elsif i_zx_keyboard_2_en = '1' then
@@ -407,13 +582,55 @@ begin
           elsif i_zx_tape_fifo_en = '1' then
             s_tape_fifo_din <= i_register_data_out(c_tape_fifo_msb_bit downto c_tape_fifo_lsb_bit);
             s_tape_fifo_wr_en <= '1';
+          elsif i_zx_tape_trap_en = '1' then
+            s_tape_trap_addr <= i_register_data_out(c_tape_trap_addr_msb_bit downto c_tape_trap_addr_lsb_bit);
+            s_tape_trap_en <= i_register_data_out(c_tape_trap_en_bit);
+          elsif i_zx_ram_dirty_en = '1' then
+            -- Writing 1 clears the flag of a page
+            s_ram_dirty <= s_ram_dirty and not i_register_data_out(c_ram_dirty_msb_bit downto c_ram_dirty_lsb_bit);
+          elsif i_zx_trdos_ports_en = '1' then
+            if i_register_data_out(c_trdos_fifo_push_bit) = '1' then
+              s_trdos_rfifo_din <= x"00" & i_register_data_out(c_trdos_data_msb_bit downto c_trdos_data_lsb_bit);
+              s_trdos_rfifo_wr_en <= '1';
+            end if;
+            if i_register_data_out(c_trdos_fifo_pop_bit) = '1' then
+              s_trdos_wfifo_rd_en <= '1';
+            end if;
+          elsif i_zx_trdos_fifo_ctrl_en = '1' then
+            s_trdos_intrq <= i_register_data_out(c_trdos_intrq_bit);
+            s_trdos_drq_ps <= i_register_data_out(c_trdos_drq_bit);
+            s_trdos_stream_rd <= i_register_data_out(c_trdos_stream_rd_bit);
+            s_trdos_stream_wr <= i_register_data_out(c_trdos_stream_wr_bit);
+            s_trdos_fifo_rst <= i_register_data_out(c_trdos_fifo_rst_bit);
+            s_trdos_irq_en <= i_register_data_out(c_trdos_irq_en_bit);
+            if (i_register_data_out(c_trdos_release_bit) = '1') and (s_trdos_req_pending = '1') then
+              -- The CPU gets the byte the emulated controller has returned
+              if s_trdos_req_wr = '0' then
+                s_cpu_din <= i_register_data_out(c_trdos_data_msb_bit downto c_trdos_data_lsb_bit);
+              end if;
+              s_trdos_req_pending <= '0';
+            end if;
           end if;
         end if;
 
+        if s_cpu_reset = '1' then
+          s_trdos_active <= '0';
+        end if;
+
+        if s_trdos_wfifo_rd_en_d = '1' then
+          s_trdos_wfifo_data <= s_trdos_wfifo_dout(7 downto 0);
+        end if;
+
         if i_rd_en = '1' then
-           o_zx_io_ports <= x"00" & s_spec_port_1ffd & s_spec_port_7ffd & s_spec_port_fe;
-           o_zx_control <= s_cpu_halt_req & "00" & s_cpu_reset & "0000" & s_cpu_save_pc & s_cpu_save_int;
-           o_zx_tape_fifo <= s_tape_fifo_empty & s_tape_fifo_full & s_tape_fifo_overflow & s_tape_fifo_underflow & x"0000000";
+           o_zx_io_ports <= s_spec_port_trdos_ff & s_spec_port_1ffd & s_spec_port_7ffd & s_spec_port_fe;
+           o_zx_control <= s_cpu_halt_req & s_cpu_halt_ack & s_cpu_restore_done & s_cpu_reset & "000" & s_trdos_active & s_cpu_save_pc & s_cpu_save_int;
+           o_zx_tape_fifo <= s_tape_fifo_empty & s_tape_fifo_full & s_tape_fifo_overflow & s_tape_fifo_underflow & s_tape_fifo_almost_full & "000" & x"000000";
+           o_zx_tape_trap <= s_tape_trap_hit & "00000000000000" & s_tape_trap_en & s_tape_trap_addr;
+           o_zx_tape_fifo_ctrl <= s_tape_irq_pending & s_tape_irq_en & "000" & s_tape_fifo_level & s_tape_underflows;
+           o_zx_ram_dirty <= x"000000" & s_ram_dirty;
+           o_zx_trdos_ports <= s_trdos_wfifo_data & "000000" & s_trdos_req_pending & s_trdos_req_wr & s_trdos_req_port & s_trdos_req_data;
+           o_zx_trdos_fifo_ctrl <= s_trdos_irq & s_trdos_irq_en & s_trdos_stream_wr & s_trdos_stream_rd & s_trdos_drq & s_trdos_intrq &
+                                   s_trdos_wfifo_empty & s_trdos_rfifo_empty & "0000000000000" & std_logic_vector(s_trdos_wfifo_level);
         end if;
       end if;
 
@@ -440,12 +657,31 @@ begin
           -- Writing to memory
           o_zx_bus_address <= "00" & s_ram_page & s_cpu_a(13 downto 0);
           o_zx_bus_data <= s_cpu_dout;
+          if (unsigned(s_ram_page) >= c_ram_first_page) and (unsigned(s_ram_page) < c_ram_first_page + c_ram_pages) then
+            s_ram_dirty(to_integer(unsigned(s_ram_page) - c_ram_first_page)) <= '1';
+          end if;
           s_zx_bus_mem_wr <= '1';
           s_zx_bus_mem_req <= '1';
           s_cpu_mem_wait <= '1';
         elsif s_cpu_iorq = '0' and s_cpu_m1 = '1' then
           -- Writing to IO ports
-          if s_cpu_a(7 downto 0) = x"FE" then
+          if s_trdos_port_sel = '1' then
+            -- Betadisk: the system register is kept here for the PS to read,
+            -- sector data go into the FIFO while a sector is written and
+            -- everything else waits for the emulated WD1793
+            if s_cpu_a(7) = '1' then
+              s_spec_port_trdos_ff <= s_cpu_dout;
+            end if;
+            if s_cpu_a(7) = '0' and s_cpu_a(6 downto 5) = "11" and s_trdos_stream_wr = '1' then
+              s_trdos_wfifo_din <= x"00" & s_cpu_dout;
+              s_trdos_wfifo_wr_en <= '1';
+            else
+              s_trdos_req_port <= s_cpu_a(7 downto 0);
+              s_trdos_req_data <= s_cpu_dout;
+              s_trdos_req_wr <= '1';
+              s_trdos_req_pending <= '1';
+            end if;
+          elsif s_cpu_a(7 downto 0) = x"FE" then
             s_spec_port_fe <= s_cpu_dout;
             s_border_color <= s_cpu_dout(2 downto 0);
             s_border_stb <= '1';
@@ -473,12 +709,33 @@ begin
         if s_cpu_mreq = '0' then
           -- Reading from memory
           o_zx_bus_address <= "00" & s_ram_page & s_cpu_a(13 downto 0);
+          if s_cpu_m1 = '0' then
+            -- Betadisk pages its ROM in on an opcode fetch from 3Dxx of the
+            -- 48K BASIC ROM and out on any opcode fetch from RAM
+            if s_trdos_rom = '1' then
+              s_trdos_active <= '1';
+            elsif s_cpu_a(15 downto 14) /= "00" then
+              s_trdos_active <= '0';
+            end if;
+          end if;
           s_zx_bus_mem_wr <= '0';
           s_zx_bus_mem_req <= '1';
           s_cpu_mem_wait <= '1';
         elsif s_cpu_iorq = '0' and s_cpu_m1 = '1' then
           -- Reading from IO ports
-          if s_cpu_a(7 downto 0) = x"FE" then
+          if s_trdos_port_sel = '1' then
+            if s_cpu_a(7) = '1' then
+              s_cpu_din <= s_trdos_intrq & s_trdos_drq & "111111";
+            elsif s_cpu_a(6 downto 5) = "11" and s_trdos_stream_rd = '1' and s_trdos_rfifo_empty = '0' then
+              -- The byte is there one clock after the read strobe
+              s_trdos_rfifo_rd_en <= '1';
+              s_trdos_rfifo_pop <= '1';
+            else
+              s_trdos_req_port <= s_cpu_a(7 downto 0);
+              s_trdos_req_wr <= '0';
+              s_trdos_req_pending <= '1';
+            end if;
+          elsif s_cpu_a(7 downto 0) = x"FE" then
             if s_cpu_a(8) = '0' then
               s_cpu_din <= '1' & s_tape_in & '1' & s_keyboard_1(19 downto 15);
             elsif s_cpu_a(9) = '0' then
@@ -515,6 +772,11 @@ begin
         end if;
       end if;
 
+      if s_trdos_rfifo_rd_en_d = '1' then
+        s_cpu_din <= s_trdos_rfifo_dout(7 downto 0);
+        s_trdos_rfifo_pop <= '0';
+      end if;
+
       if (s_zx_bus_mem_req = '1') and (i_zx_bus_mem_ack = '1') then
         -- Handle memory read response
         if (s_zx_bus_mem_wr = '0') then
@@ -528,17 +790,27 @@ begin
     end if;
   end process;  
   
-  s_cpu_wait <= s_cpu_mem_wait or s_cpu_halt_ack;
+  s_cpu_wait <= s_cpu_mem_wait or s_cpu_halt_ack or s_trdos_wait;
   s_cpu_clk_en <= s_clk35m and not s_cpu_wait;
 
   -- Border color and strobe signals for the videocontroller
   o_border_color <= s_border_color;
   o_border_stb <= s_border_stb;
 
+  -- TR-DOS ROM is there while Betadisk is active and already for the
+  -- opcode fetch which activates it
+  s_trdos_rom <= '1' when (s_trdos_active = '1') or
+                          (s_cpu_m1 = '0' and s_cpu_a(15 downto 8) = x"3D" and s_spec_port_7ffd(4) = '1') else '0';
+
+  -- WD1793 registers are at 1F, 3F, 5F, 7F and the system register at FF
+  s_trdos_port_sel <= '1' when s_trdos_active = '1' and s_cpu_a(4 downto 0) = "11111" and
+                               (s_cpu_a(7) = '0' or s_cpu_a(6 downto 5) = "11") else '0';
+
   -- Reserve first 4 x 16K pages (64K) for ROM emulation 
   -- so real Spectrum RAM would start from the 5-th page.
-  -- As of now, only 2 x 16K pages are emulated as ROM
-  s_ram_page <= "0000000" & s_spec_port_7ffd(4) when s_cpu_a(15 downto 14) = "00" else
+  -- Pages 0 and 1 hold 128K and 48K BASIC, page 2 holds TR-DOS
+  s_ram_page <= c_trdos_rom_page when s_cpu_a(15 downto 14) = "00" and s_trdos_rom = '1' else
+    "0000000" & s_spec_port_7ffd(4) when s_cpu_a(15 downto 14) = "00" else
     "00001001" when s_cpu_a(15 downto 14) = "01" else
     "00000110" when s_cpu_a(15 downto 14) = "10" else
     std_logic_vector(unsigned("00000" & s_spec_port_7ffd(2 downto 0)) + 4);
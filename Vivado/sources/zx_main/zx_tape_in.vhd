@@ -0,0 +1,308 @@
+----------------------------------------------------------------------------------
+-- Company: Magictale Electronics http://magictale.com
+-- Engineer: Dmitry Pakhomenko
+--
+-- Design Name: ZX Spectrum Board
+-- Module Name: zx_tape_in - RTL
+-- Project Name: ZX Spectrum retro computer emulator on Arty Z7 board
+-- Target Devices: Zynq 7020
+-- Tool Versions: Vivado 2017.3
+-- Description: Tape signal generator fed by the PS through the tape FIFO
+--
+-- Dependencies: fifo_1024_16
+--
+-- Revision:
+--
+-- Revision 0.01 - Moved out of zx_main_top so that it can be simulated alone
+-- Additional Comments:
+--
+----------------------------------------------------------------------------------
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+entity zx_tape_in is
+    port (
+      i_resetn : in std_logic;
+      i_aclk : in std_logic;
+
+      -- 3.5 MHz strobe, pulses with the flag set are held while the CPU is stopped
+      i_clk35m : in std_logic;
+      i_cpu_stopped : in std_logic;
+
+      i_fifo_din : in std_logic_vector(15 downto 0);
+      i_fifo_wr_en : in std_logic;
+      i_ctrl_wr_en : in std_logic;
+      i_ctrl_data : in std_logic_vector(31 downto 0);
+
+      o_tape_in : out std_logic;
+      o_fifo_empty : out std_logic;
+      o_fifo_full : out std_logic;
+      o_fifo_overflow : out std_logic;
+      o_fifo_underflow : out std_logic;
+      o_fifo_almost_full : out std_logic;
+      o_fifo_level : out std_logic_vector(10 downto 0);
+      o_irq_en : out std_logic;
+      o_irq : out std_logic;
+      o_underflows : out std_logic_vector(15 downto 0)
+    );
+
+end zx_tape_in;
+
+architecture rtl of zx_tape_in is
+
+  constant c_tape_fifo_almost_full_level : integer := 1016; -- leaves room for the longest packet
+  constant c_tape_low_water_msb_bit : integer range 0 to 31 := 10;
+  constant c_tape_low_water_lsb_bit : integer range 0 to 31 := 0;
+  constant c_tape_irq_en_bit        : integer range 0 to 31 := 16;
+  constant c_tape_irq_clear_bit     : integer range 0 to 31 := 17;
+  constant c_tape_underflows_clear_bit : integer range 0 to 31 := 18;
+  constant c_tape_low_water_default : integer := 512;
+
+  signal s_tape_in : std_logic := '0';
+
+  -- TAPE FIFO
+  signal s_tape_fifo_dout : std_logic_vector(15 downto 0);
+  signal s_tape_fifo_empty : std_logic := '0';
+  signal s_tape_fifo_full : std_logic := '0';
+  signal s_tape_fifo_rd_en : std_logic := '0';
+  signal s_tape_fifo_rd_en_d : std_logic := '0';
+  signal s_tape_fifo_level : unsigned(10 downto 0) := (others => '0');
+
+  -- TAPE packet decoder
+  type t_sm_tape_pkt is (s_tp_word, s_tp_rep_pulse, s_tp_rep_count, s_tp_byte_zero, s_tp_byte_one, s_tp_byte_data);
+  signal s_tape_pkt_state : t_sm_tape_pkt := s_tp_word;
+  signal s_tape_word : std_logic_vector(15 downto 0) := (others => '0');
+  signal s_tape_word_valid : std_logic := '0';
+  signal s_tape_rep_word : std_logic_vector(15 downto 0) := (others => '0');
+  signal s_tape_rep_count : unsigned(15 downto 0) := (others => '0');
+  signal s_tape_zero_word : std_logic_vector(15 downto 0) := (others => '0');
+  signal s_tape_one_word : std_logic_vector(15 downto 0) := (others => '0');
+  signal s_tape_byte : std_logic_vector(7 downto 0) := (others => '0');
+  signal s_tape_half_bits : unsigned(4 downto 0) := (others => '0');
+
+  -- TAPE FIFO low-water interrupt
+  signal s_tape_low_water : unsigned(10 downto 0) := to_unsigned(c_tape_low_water_default, 11);
+  signal s_tape_irq_en : std_logic := '0';
+  signal s_tape_irq_armed : std_logic := '0';
+  signal s_tape_irq_pending : std_logic := '0';
+  signal s_tape_starving : std_logic := '0';
+  signal s_tape_starving_d : std_logic := '0';
+  signal s_tape_underflows : unsigned(15 downto 0) := (others => '0');
+
+
+  component fifo_1024_16
+    port (
+      clk : in std_logic;
+      rst : in std_logic;
+      din : in std_logic_vector(15 downto 0);
+      wr_en : in std_logic;
+      rd_en : in std_logic;
+      dout : out std_logic_vector(15 downto 0);
+      full : out std_logic;
+      overflow : out std_logic;
+      empty : out std_logic;
+      underflow : out std_logic
+    );
+  end component;
+
+
+begin
+
+  i_tape_fifo : fifo_1024_16
+    port map (
+      clk => i_aclk,
+      rst => not i_resetn,
+      din => i_fifo_din,
+      wr_en => i_fifo_wr_en,
+      rd_en => s_tape_fifo_rd_en,
+      dout => s_tape_fifo_dout,
+      full => s_tape_fifo_full,
+      overflow => o_fifo_overflow,
+      empty => s_tape_fifo_empty,
+      underflow => o_fifo_underflow
+    );
+
+
+  -- Tape loader emulation
+  --
+  -- Every 16-bit word in the tape FIFO is either a single pulse (bit 15 is
+  -- the pulse flag, bits 14..0 hold a non-zero length in 3.5 MHz ticks) or
+  -- an escape word with a zero length field which opens a packet:
+  --   x"8000", <pulse word>, <count>  - the pulse word is repeated count times
+  --                                     (pilot tones, pauses)
+  --   x"0000", <zero pulse word>, <one pulse word>, <data>
+  --                                   - data(7 downto 0) is sent MSB first as two
+  --                                     pulses per bit, data(11 downto 8) holds
+  --                                     the number of bits to send (0 means 8)
+  -- The FIFO runs in standard (non FWFT) mode so a word is sampled one clock
+  -- after the read strobe and only one read is kept in flight.
+  p_tape_in : process(i_aclk)
+    variable v_tape_counter : unsigned(14 downto 0) := (others => '0');
+    variable v_tape_pulse : std_logic := '1';
+  begin
+    if rising_edge(i_aclk) then
+      if v_tape_counter > 0 then
+        if v_tape_pulse = '1' then
+          if i_clk35m = '1' and i_cpu_stopped = '0' then
+            v_tape_counter := v_tape_counter - 1;
+            if v_tape_counter = 0 then
+              s_tape_in <= not s_tape_in;
+            end if;
+          end if;
+        else
+          if i_clk35m = '1' then
+            v_tape_counter := v_tape_counter - 1;
+            if v_tape_counter = 0 then
+              s_tape_in <= '0';
+            end if;
+          end if;
+        end if;
+      end if;
+
+      s_tape_fifo_rd_en <= '0';
+      s_tape_fifo_rd_en_d <= s_tape_fifo_rd_en;
+      if s_tape_fifo_rd_en_d = '1' then
+        s_tape_word <= s_tape_fifo_dout;
+        s_tape_word_valid <= '1';
+      elsif s_tape_word_valid = '0' and s_tape_fifo_rd_en = '0' and s_tape_fifo_empty = '0' then
+        s_tape_fifo_rd_en <= '1';
+        s_tape_starving <= '0';
+      end if;
+
+      if v_tape_counter = 0 then
+        if s_tape_rep_count > 0 then
+          v_tape_counter := unsigned(s_tape_rep_word(14 downto 0));
+          v_tape_pulse := s_tape_rep_word(15);
+          s_tape_rep_count <= s_tape_rep_count - 1;
+        elsif s_tape_half_bits > 0 then
+          if s_tape_byte(7) = '1' then
+            v_tape_counter := unsigned(s_tape_one_word(14 downto 0));
+            v_tape_pulse := s_tape_one_word(15);
+          else
+            v_tape_counter := unsigned(s_tape_zero_word(14 downto 0));
+            v_tape_pulse := s_tape_zero_word(15);
+          end if;
+          if s_tape_half_bits(0) = '1' then
+            s_tape_byte <= s_tape_byte(6 downto 0) & '0';
+          end if;
+          s_tape_half_bits <= s_tape_half_bits - 1;
+        elsif s_tape_word_valid = '1' and s_tape_fifo_rd_en_d = '0' then
+          s_tape_word_valid <= '0';
+          case s_tape_pkt_state is
+            when s_tp_word =>
+              if unsigned(s_tape_word(14 downto 0)) = 0 then
+                if s_tape_word(15) = '1' then
+                  s_tape_pkt_state <= s_tp_rep_pulse;
+                else
+                  s_tape_pkt_state <= s_tp_byte_zero;
+                end if;
+              else
+                v_tape_counter := unsigned(s_tape_word(14 downto 0));
+                v_tape_pulse := s_tape_word(15);
+              end if;
+            when s_tp_rep_pulse =>
+              s_tape_rep_word <= s_tape_word;
+              s_tape_pkt_state <= s_tp_rep_count;
+            when s_tp_rep_count =>
+              s_tape_rep_count <= unsigned(s_tape_word);
+              s_tape_pkt_state <= s_tp_word;
+            when s_tp_byte_zero =>
+              s_tape_zero_word <= s_tape_word;
+              s_tape_pkt_state <= s_tp_byte_one;
+            when s_tp_byte_one =>
+              s_tape_one_word <= s_tape_word;
+              s_tape_pkt_state <= s_tp_byte_data;
+            when s_tp_byte_data =>
+              s_tape_byte <= s_tape_word(7 downto 0);
+              if unsigned(s_tape_word(11 downto 8)) = 0 or unsigned(s_tape_word(11 downto 8)) > 8 then
+                s_tape_half_bits <= to_unsigned(16, 5);
+              else
+                s_tape_half_bits <= unsigned(s_tape_word(11 downto 8)) & '0';
+              end if;
+              s_tape_pkt_state <= s_tp_word;
+          end case;
+        elsif s_tape_pkt_state = s_tp_word and s_tape_word_valid = '0' and
+              s_tape_fifo_rd_en = '0' and s_tape_fifo_rd_en_d = '0' and s_tape_fifo_empty = '1' then
+          v_tape_counter := (others => '1');
+          v_tape_pulse := '0';
+          s_tape_starving <= '1';
+        end if;
+      end if;
+    end if;
+  end process;
+
+  o_tape_in <= s_tape_in;
+
+
+  -- Tracks the number of words in the tape FIFO so the PS can tell
+  -- whether a whole packet still fits
+  p_tape_fifo_level : process(i_aclk)
+  begin
+    if rising_edge(i_aclk) then
+      if (i_resetn = '0') then
+        s_tape_fifo_level <= (others => '0');
+      else
+        if (i_fifo_wr_en = '1' and s_tape_fifo_full = '0') and not (s_tape_fifo_rd_en = '1' and s_tape_fifo_empty = '0') then
+          s_tape_fifo_level <= s_tape_fifo_level + 1;
+        elsif (s_tape_fifo_rd_en = '1' and s_tape_fifo_empty = '0') and not (i_fifo_wr_en = '1' and s_tape_fifo_full = '0') then
+          s_tape_fifo_level <= s_tape_fifo_level - 1;
+        end if;
+      end if;
+    end if;
+  end process;
+
+  o_fifo_empty <= s_tape_fifo_empty;
+  o_fifo_full <= s_tape_fifo_full;
+  o_fifo_almost_full <= '1' when s_tape_fifo_level >= c_tape_fifo_almost_full_level else '0';
+  o_fifo_level <= std_logic_vector(s_tape_fifo_level);
+
+
+  -- Requests a refill once the FIFO drops below the low-water mark. The
+  -- request is raised again only after the FIFO has been refilled above the
+  -- mark. While the interrupt is enabled (PS is playing a tape) every time
+  -- the pulse generator runs out of words is counted as an underflow.
+  p_tape_fifo_irq : process(i_aclk)
+  begin
+    if rising_edge(i_aclk) then
+      if (i_resetn = '0') then
+        s_tape_low_water <= to_unsigned(c_tape_low_water_default, 11);
+        s_tape_irq_en <= '0';
+        s_tape_irq_armed <= '0';
+        s_tape_irq_pending <= '0';
+        s_tape_starving_d <= '0';
+        s_tape_underflows <= (others => '0');
+      else
+        if s_tape_fifo_level >= s_tape_low_water then
+          s_tape_irq_armed <= '1';
+        elsif (s_tape_irq_armed = '1') and (s_tape_irq_en = '1') then
+          s_tape_irq_armed <= '0';
+          s_tape_irq_pending <= '1';
+        end if;
+
+        s_tape_starving_d <= s_tape_starving;
+        if (s_tape_starving = '1') and (s_tape_starving_d = '0') and (s_tape_irq_en = '1') and
+           (s_tape_underflows /= x"FFFF") then
+          s_tape_underflows <= s_tape_underflows + 1;
+        end if;
+
+        if i_ctrl_wr_en = '1' then
+          s_tape_low_water <= unsigned(i_ctrl_data(c_tape_low_water_msb_bit downto c_tape_low_water_lsb_bit));
+          s_tape_irq_en <= i_ctrl_data(c_tape_irq_en_bit);
+          if i_ctrl_data(c_tape_irq_clear_bit) = '1' then
+            s_tape_irq_pending <= '0';
+          end if;
+          if i_ctrl_data(c_tape_underflows_clear_bit) = '1' then
+            s_tape_underflows <= (others => '0');
+          end if;
+        end if;
+      end if;
+    end if;
+  end process;
+
+  o_irq_en <= s_tape_irq_en;
+  o_irq <= s_tape_irq_pending;
+  o_underflows <= std_logic_vector(s_tape_underflows);
+
+end rtl;
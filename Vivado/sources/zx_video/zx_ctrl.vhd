@@ -89,7 +89,17 @@ entity zx_ctrl is
       o_zx_io_ports_en : out std_logic;
       i_zx_io_ports : in std_logic_vector(g_axi_lite_data_width - 1 downto 0);
       o_zx_tape_fifo_en : out std_logic;
-      i_zx_tape_fifo : in std_logic_vector(g_axi_lite_data_width - 1 downto 0)
+      i_zx_tape_fifo : in std_logic_vector(g_axi_lite_data_width - 1 downto 0);
+      o_zx_tape_trap_en : out std_logic;
+      i_zx_tape_trap : in std_logic_vector(g_axi_lite_data_width - 1 downto 0);
+      o_zx_tape_fifo_ctrl_en : out std_logic;
+      i_zx_tape_fifo_ctrl : in std_logic_vector(g_axi_lite_data_width - 1 downto 0);
+      o_zx_ram_dirty_en : out std_logic;
+      i_zx_ram_dirty : in std_logic_vector(g_axi_lite_data_width - 1 downto 0);
+      o_zx_trdos_ports_en : out std_logic;
+      i_zx_trdos_ports : in std_logic_vector(g_axi_lite_data_width - 1 downto 0);
+      o_zx_trdos_fifo_ctrl_en : out std_logic;
+      i_zx_trdos_fifo_ctrl : in std_logic_vector(g_axi_lite_data_width - 1 downto 0)
       
     );
 
@@ -135,6 +145,11 @@ architecture rtl of zx_ctrl is
   signal s_zx_keyboard_2_en : std_logic;
   signal s_zx_io_ports_en : std_logic;
   signal s_zx_tape_fifo_en : std_logic;
+  signal s_zx_tape_trap_en : std_logic;
+  signal s_zx_tape_fifo_ctrl_en : std_logic;
+  signal s_zx_ram_dirty_en : std_logic;
+  signal s_zx_trdos_ports_en : std_logic;
+  signal s_zx_trdos_fifo_ctrl_en : std_logic;
 
   signal s_slv_reg_rden : std_logic;
   signal s_slv_reg_wren : std_logic;
@@ -182,6 +197,12 @@ architecture rtl of zx_ctrl is
   constant c_zx_io_ports_reg         : std_logic_vector (c_opt_mem_addr_bits downto 0) := b"1001001"; -- ZX IO ports
   -- ZX TAPE FIFO
   constant c_zx_tape_fifo_reg        : std_logic_vector (c_opt_mem_addr_bits downto 0) := b"1001010"; -- ZX TAPE fifo
+  constant c_zx_tape_trap_reg        : std_logic_vector (c_opt_mem_addr_bits downto 0) := b"1001011"; -- ZX TAPE ROM trap
+  constant c_zx_tape_fifo_ctrl_reg   : std_logic_vector (c_opt_mem_addr_bits downto 0) := b"1001100"; -- ZX TAPE FIFO control
+  constant c_zx_ram_dirty_reg        : std_logic_vector (c_opt_mem_addr_bits downto 0) := b"1001101"; -- RAM pages written by CPU
+  -- ZX Betadisk
+  constant c_zx_trdos_ports_reg      : std_logic_vector (c_opt_mem_addr_bits downto 0) := b"1001110"; -- ZX Betadisk ports
+  constant c_zx_trdos_fifo_ctrl_reg  : std_logic_vector (c_opt_mem_addr_bits downto 0) := b"1001111"; -- ZX Betadisk FIFO control
   
   constant c_version : std_logic_vector(g_axi_lite_data_width - 1 downto 0) := x"00000001";
 
@@ -218,6 +239,11 @@ begin
   o_zx_keyboard_2_en <= s_zx_keyboard_2_en;
   o_zx_io_ports_en <= s_zx_io_ports_en;
   o_zx_tape_fifo_en <= s_zx_tape_fifo_en;
+  o_zx_tape_trap_en <= s_zx_tape_trap_en;
+  o_zx_tape_fifo_ctrl_en <= s_zx_tape_fifo_ctrl_en;
+  o_zx_ram_dirty_en <= s_zx_ram_dirty_en;
+  o_zx_trdos_ports_en <= s_zx_trdos_ports_en;
+  o_zx_trdos_fifo_ctrl_en <= s_zx_trdos_fifo_ctrl_en;
   
   -- Implement s_axi_awready generation
   -- s_axi_awready is asserted for one i_axi_lite_aclk clock cycle when both
@@ -419,6 +445,11 @@ begin
         s_zx_keyboard_2_en <= '0';
         s_zx_io_ports_en <= '0';
         s_zx_tape_fifo_en <= '0';
+        s_zx_tape_trap_en <= '0';
+        s_zx_tape_fifo_ctrl_en <= '0';
+        s_zx_ram_dirty_en <= '0';
+        s_zx_trdos_ports_en <= '0';
+        s_zx_trdos_fifo_ctrl_en <= '0';
       else
         if s_slv_reg_wren_cdc(2 downto 1) = "01" then
           v_loc_addr := s_axi_awaddr_r2(c_addr_lsb + c_opt_mem_addr_bits downto c_addr_lsb);
@@ -460,6 +491,16 @@ begin
               s_zx_io_ports_en <= '1';
             when c_zx_tape_fifo_reg =>
               s_zx_tape_fifo_en <= '1';
+            when c_zx_tape_trap_reg =>
+              s_zx_tape_trap_en <= '1';
+            when c_zx_tape_fifo_ctrl_reg =>
+              s_zx_tape_fifo_ctrl_en <= '1';
+            when c_zx_ram_dirty_reg =>
+              s_zx_ram_dirty_en <= '1';
+            when c_zx_trdos_ports_reg =>
+              s_zx_trdos_ports_en <= '1';
+            when c_zx_trdos_fifo_ctrl_reg =>
+              s_zx_trdos_fifo_ctrl_en <= '1';
             when others =>
               s_active_size_en <= '0';
               s_border_size_en <= '0';
@@ -477,6 +518,11 @@ begin
               s_zx_keyboard_2_en <= '0';
               s_zx_io_ports_en <= '0';
               s_zx_tape_fifo_en <= '0';
+              s_zx_tape_trap_en <= '0';
+              s_zx_tape_fifo_ctrl_en <= '0';
+              s_zx_ram_dirty_en <= '0';
+              s_zx_trdos_ports_en <= '0';
+              s_zx_trdos_fifo_ctrl_en <= '0';
           end case;
         else
           s_active_size_en <= '0';
@@ -495,6 +541,11 @@ begin
           s_zx_keyboard_2_en <= '0';
           s_zx_io_ports_en <= '0';
           s_zx_tape_fifo_en <= '0';
+          s_zx_tape_trap_en <= '0';
+          s_zx_tape_fifo_ctrl_en <= '0';
+          s_zx_ram_dirty_en <= '0';
+          s_zx_trdos_ports_en <= '0';
+          s_zx_trdos_fifo_ctrl_en <= '0';
         end if;
       end if;
     end if;                   
@@ -566,6 +617,16 @@ begin
                 s_axi_rdata <= i_zx_io_ports;
               when c_zx_tape_fifo_reg =>
                 s_axi_rdata <= i_zx_tape_fifo;
+              when c_zx_tape_trap_reg =>
+                s_axi_rdata <= i_zx_tape_trap;
+              when c_zx_tape_fifo_ctrl_reg =>
+                s_axi_rdata <= i_zx_tape_fifo_ctrl;
+              when c_zx_ram_dirty_reg =>
+                s_axi_rdata <= i_zx_ram_dirty;
+              when c_zx_trdos_ports_reg =>
+                s_axi_rdata <= i_zx_trdos_ports;
+              when c_zx_trdos_fifo_ctrl_reg =>
+                s_axi_rdata <= i_zx_trdos_fifo_ctrl;
               when others => 
                 s_axi_rdata <= (others => '0');
           end case;
@@ -90,6 +90,16 @@ entity zx_video_top is
       i_zx_io_ports : in std_logic_vector(g_axi_lite_data_width - 1 downto 0);
       o_zx_tape_fifo_en : out std_logic;
       i_zx_tape_fifo : in std_logic_vector(g_axi_lite_data_width - 1 downto 0);
+      o_zx_tape_trap_en : out std_logic;
+      i_zx_tape_trap : in std_logic_vector(g_axi_lite_data_width - 1 downto 0);
+      o_zx_tape_fifo_ctrl_en : out std_logic;
+      i_zx_tape_fifo_ctrl : in std_logic_vector(g_axi_lite_data_width - 1 downto 0);
+      o_zx_ram_dirty_en : out std_logic;
+      i_zx_ram_dirty : in std_logic_vector(g_axi_lite_data_width - 1 downto 0);
+      o_zx_trdos_ports_en : out std_logic;
+      i_zx_trdos_ports : in std_logic_vector(g_axi_lite_data_width - 1 downto 0);
+      o_zx_trdos_fifo_ctrl_en : out std_logic;
+      i_zx_trdos_fifo_ctrl : in std_logic_vector(g_axi_lite_data_width - 1 downto 0);
       
       i_border_color : in std_logic_vector(2 downto 0);
       i_border_stb : in std_logic;
@@ -254,7 +264,17 @@ architecture rtl of zx_video_top is
       o_zx_io_ports_en  : out std_logic;
       i_zx_io_ports : in std_logic_vector(g_axi_lite_data_width - 1 downto 0);
       o_zx_tape_fifo_en : out std_logic;
-      i_zx_tape_fifo : in std_logic_vector(g_axi_lite_data_width - 1 downto 0)
+      i_zx_tape_fifo : in std_logic_vector(g_axi_lite_data_width - 1 downto 0);
+      o_zx_tape_trap_en : out std_logic;
+      i_zx_tape_trap : in std_logic_vector(g_axi_lite_data_width - 1 downto 0);
+      o_zx_tape_fifo_ctrl_en : out std_logic;
+      i_zx_tape_fifo_ctrl : in std_logic_vector(g_axi_lite_data_width - 1 downto 0);
+      o_zx_ram_dirty_en : out std_logic;
+      i_zx_ram_dirty : in std_logic_vector(g_axi_lite_data_width - 1 downto 0);
+      o_zx_trdos_ports_en : out std_logic;
+      i_zx_trdos_ports : in std_logic_vector(g_axi_lite_data_width - 1 downto 0);
+      o_zx_trdos_fifo_ctrl_en : out std_logic;
+      i_zx_trdos_fifo_ctrl : in std_logic_vector(g_axi_lite_data_width - 1 downto 0)
 
     );
   end component;
@@ -373,7 +393,17 @@ begin
       o_zx_io_ports_en => o_zx_io_ports_en,
       i_zx_io_ports => i_zx_io_ports,
       o_zx_tape_fifo_en => o_zx_tape_fifo_en,
-      i_zx_tape_fifo  => i_zx_tape_fifo
+      i_zx_tape_fifo  => i_zx_tape_fifo,
+      o_zx_tape_trap_en => o_zx_tape_trap_en,
+      i_zx_tape_trap => i_zx_tape_trap,
+      o_zx_tape_fifo_ctrl_en => o_zx_tape_fifo_ctrl_en,
+      i_zx_tape_fifo_ctrl => i_zx_tape_fifo_ctrl,
+      o_zx_ram_dirty_en => o_zx_ram_dirty_en,
+      i_zx_ram_dirty => i_zx_ram_dirty,
+      o_zx_trdos_ports_en => o_zx_trdos_ports_en,
+      i_zx_trdos_ports => i_zx_trdos_ports,
+      o_zx_trdos_fifo_ctrl_en => o_zx_trdos_fifo_ctrl_en,
+      i_zx_trdos_fifo_ctrl => i_zx_trdos_fifo_ctrl
     );
   
     o_register_data_out <= s_register_data_out;